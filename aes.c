@@ -14,32 +14,65 @@
 #include <errno.h>
 #include <stdint.h>
 #include "aes.h"
+#include "aes_arena.h"
 #include "aes_log.h"
+#include "aes_stats.h"
 
+/**
+ * @brief number of rounds for a given key length
+ * @param[in] length key length in bytes
+ * @return number of rounds, 0 if the key length is not supported
+ */
+uint32_t aes_nr(uint32_t length)
+{
+    switch (length) {
+        case AES128_KEY_SIZE/8:
+            return AES128_NR;
+        case AES192_KEY_SIZE/8:
+            return AES192_NR;
+        case AES256_KEY_SIZE/8:
+            return AES256_NR;
+        default:
+            return 0;
+    }
+}
 
 /**
  * @brief cipher one AES block
  * @param[in,out] ciphered_block pointer to the ciphered data
  * @param[in] clear_block pointer to the block of clear data
  * @param[in] key pointer to the cipher/decipher key
+ * @return 0 on success, -1 on bad parameter or key length
+ * @note parameters are checked here once; the step functions below do not
+ * check anything
  */
-void aes_cipher(aes_block_t *ciphered_block, aes_block_t *clear_block,aes_key_t *cipher_key)
+int32_t aes_cipher(aes_block_t *ciphered_block, aes_block_t *clear_block,aes_key_t *cipher_key)
 {
     /* write your code here */
     /* parameter verification */
     if (clear_block == NULL || ciphered_block==NULL || cipher_key==NULL) {
-        fprintf(stderr, "[ERROR] aes_cipher: bad input parameter\n");
-        exit(EXIT_FAILURE);
+        return -1;
     }
+    uint32_t nr = aes_nr(cipher_key->length);
+    if (nr == 0) {
+        return -1;
+    }
+    aes_stats_add_blocks(AES_STATS_BACKEND_REF, AES_STATS_MODE_BLOCK,
+                         cipher_key->length, AES_STATS_DIR_ENC, 1);
+    AES_STATS_TIME_BEGIN(t_start);
     
             /* cipher_key expansion */ 
-	    aes_key_t *round_keys[11];
+	    aes_key_t round_key_buf[AES256_NR+1];
+	    aes_key_t *round_keys[AES256_NR+1];
 	    aes_key_t *(*expanded_keys)[]= &round_keys;
-	    for (uint32_t i=0;i<11;i++) {
-		round_keys[i] = calloc(1, sizeof(aes_key_t));
+	    for (uint32_t i=0;i<=nr;i++) {
+		round_keys[i] = &round_key_buf[i];
 	    }
 	    memcpy(round_keys[0], cipher_key, sizeof(aes_key_t));
-	    aes_keyexpansion(expanded_keys,cipher_key);
+	    if (aes_keyexpansion(expanded_keys,cipher_key) != 0) {
+		aes_memzero(round_key_buf, sizeof(round_key_buf));
+		return -1;
+	    }
 	    
 	    
 	    /* prepare AES ciphered_block */
@@ -63,8 +96,8 @@ void aes_cipher(aes_block_t *ciphered_block, aes_block_t *clear_block,aes_key_t
 	    /*Initial Round*/
 	    aes_addroundkey(ciphered_block,round_keys[0]);
 	    
-	    /*9 Rounds*/
-	    for (uint32_t i=0;i<9;i++){
+	    /*Nr-1 Rounds*/
+	    for (uint32_t i=0;i<nr-1;i++){
 	    	    #ifdef DBG_LOG
 		    {
 			char *msg = "start";
@@ -130,7 +163,7 @@ void aes_cipher(aes_block_t *ciphered_block, aes_block_t *clear_block,aes_key_t
 		    }
 		    #endif /*  DBG_LOG */
 	    
-    	    aes_addroundkey(ciphered_block,round_keys[10]);
+    	    aes_addroundkey(ciphered_block,round_keys[nr]);
     	     
     	     	    #ifdef DBG_LOG
 		    {
@@ -139,44 +172,57 @@ void aes_cipher(aes_block_t *ciphered_block, aes_block_t *clear_block,aes_key_t
 			    log_write_block(ciphered_block, msg, strlen(msg));
 		    }
 		    #endif /*  DBG_LOG */
-    	
+    aes_memzero(round_key_buf, sizeof(round_key_buf));
+    AES_STATS_TIME_END(t_start, AES_STATS_BACKEND_REF, AES_STATS_MODE_BLOCK);
+    return 0;
 }
 
 /**
  * @brief decipher one AES block
- * @param[in,out] clear_block pointer to the block of clear data
+ * @param[out] clear_block pointer to the block of clear data
  * @param[in] ciphered_block pointer to the ciphered data
  * @param[in] decipher_key pointer to the cipher/decipher decipher_key
+ * @return 0 on success, -1 on bad parameter or key length
  */
-void aes_decipher(aes_block_t *clear_block, aes_block_t *ciphered_block,
-                  aes_key_t *decipher_key)
+int32_t aes_decipher(aes_block_t *clear_block, aes_block_t *ciphered_block,
+                     aes_key_t *decipher_key)
 {
     /* write your code here */
     /* parameter verification */
     if (clear_block == NULL || ciphered_block==NULL || decipher_key==NULL) {
-        fprintf(stderr, "[ERROR] aes_cipher: bad input parameter\n");
-        exit(EXIT_FAILURE);
+        return -1;
+    }
+    uint32_t nr = aes_nr(decipher_key->length);
+    if (nr == 0) {
+        return -1;
     }
+    aes_stats_add_blocks(AES_STATS_BACKEND_REF, AES_STATS_MODE_BLOCK,
+                         decipher_key->length, AES_STATS_DIR_DEC, 1);
+    AES_STATS_TIME_BEGIN(t_start);
     
             /* cipher_key expansion */ 
-	    aes_key_t *round_keys[11];
+	    aes_key_t round_key_buf[AES256_NR+1];
+	    aes_key_t *round_keys[AES256_NR+1];
 	    aes_key_t *(*expanded_keys)[]= &round_keys;
-	    for (uint32_t i=0;i<11;i++) {
-		round_keys[i] = calloc(1, sizeof(aes_key_t));
+	    for (uint32_t i=0;i<=nr;i++) {
+		round_keys[i] = &round_key_buf[i];
+	    }
+	    memcpy(round_keys[0], decipher_key, sizeof(aes_key_t));
+	    if (aes_keyexpansion(expanded_keys,decipher_key) != 0) {
+		aes_memzero(round_key_buf, sizeof(round_key_buf));
+		return -1;
 	    }
-	    memcpy(round_keys[10], decipher_key, sizeof(aes_key_t));
-	    aes_keyexpansion(expanded_keys,decipher_key);
 	    
 	    
-	    /* prepare AES ciphered_block */
-	    memcpy(ciphered_block->byte,clear_block->byte,sizeof(clear_block->byte));
-	    aes_block2mat(ciphered_block);
+	    /* prepare AES clear_block: deciphering is done in place in the output */
+	    memcpy(clear_block->byte,ciphered_block->byte,sizeof(ciphered_block->byte));
+	    aes_block2mat(clear_block);
 	    
 	    #ifdef DBG_LOG
 	    {
 		char *msg = "iinput";
-		log_print_block(ciphered_block, msg, strlen(msg), LOG_MODE_BYTE_SEQ);
-		log_write_block(ciphered_block, msg, strlen(msg));
+		log_print_block(clear_block, msg, strlen(msg), LOG_MODE_BYTE_SEQ);
+		log_write_block(clear_block, msg, strlen(msg));
 	    }
 	    {
 		char *msg = "ik_sch";
@@ -186,77 +232,79 @@ void aes_decipher(aes_block_t *clear_block, aes_block_t *ciphered_block,
 	    #endif /*  DBG_LOG */
 	    
 	    /*Initial Round*/
-	    aes_addroundkey(ciphered_block,round_keys[10]);
+	    aes_addroundkey(clear_block,round_keys[nr]);
 	    
 	    	    #ifdef DBG_LOG
 		    {
 			char *msg = "istart";
-			log_print_block(ciphered_block, msg, strlen(msg), LOG_MODE_BYTE_SEQ);
-			log_write_block(ciphered_block, msg, strlen(msg));
+			log_print_block(clear_block, msg, strlen(msg), LOG_MODE_BYTE_SEQ);
+			log_write_block(clear_block, msg, strlen(msg));
 		    }
 		    #endif /*  DBG_LOG */
-	    aes_invshiftrows(ciphered_block);
+	    aes_invshiftrows(clear_block);
 	    	    #ifdef DBG_LOG
 		    {
 			    char *msg = "is_row";
-			    log_print_block(ciphered_block, msg, strlen(msg), LOG_MODE_BYTE_SEQ);
-			    log_write_block(ciphered_block, msg, strlen(msg));
+			    log_print_block(clear_block, msg, strlen(msg), LOG_MODE_BYTE_SEQ);
+			    log_write_block(clear_block, msg, strlen(msg));
 		    }
 		    #endif /*  DBG_LOG */
-	    aes_invsubbytes(ciphered_block);
+	    aes_invsubbytes(clear_block);
 		    #ifdef DBG_LOG
 		    {
 			char *msg = "is_box";
-			log_print_block(ciphered_block, msg, strlen(msg), LOG_MODE_BYTE_SEQ);
-			log_write_block(ciphered_block, msg, strlen(msg));
+			log_print_block(clear_block, msg, strlen(msg), LOG_MODE_BYTE_SEQ);
+			log_write_block(clear_block, msg, strlen(msg));
 		    }
 		    #endif /*  DBG_LOG */
-    	   for (uint32_t i=9;i>0;i--){
+    	   for (uint32_t i=nr-1;i>0;i--){
     	   	   
-    	   	    aes_addroundkey(ciphered_block,round_keys[i]);
+    	   	    aes_addroundkey(clear_block,round_keys[i]);
 	    	    #ifdef DBG_LOG
 		    {
 			char *msg = "istart";
-			log_print_block(ciphered_block, msg, strlen(msg), LOG_MODE_BYTE_SEQ);
-			log_write_block(ciphered_block, msg, strlen(msg));
+			log_print_block(clear_block, msg, strlen(msg), LOG_MODE_BYTE_SEQ);
+			log_write_block(clear_block, msg, strlen(msg));
 		    }
 		    #endif /*  DBG_LOG */
-		    aes_invmixcolumns(ciphered_block);
+		    aes_invmixcolumns(clear_block);
 	    	    #ifdef DBG_LOG
 		    {
 			    char *msg = "im_col";
-			    log_print_block(ciphered_block, msg, strlen(msg), LOG_MODE_BYTE_SEQ);
-			    log_write_block(ciphered_block, msg, strlen(msg));
+			    log_print_block(clear_block, msg, strlen(msg), LOG_MODE_BYTE_SEQ);
+			    log_write_block(clear_block, msg, strlen(msg));
 		    }
 		    #endif /*  DBG_LOG */
-		    aes_invshiftrows(ciphered_block);
+		    aes_invshiftrows(clear_block);
 	    	    #ifdef DBG_LOG
 		    {
 			    char *msg = "is_row";
-			    log_print_block(ciphered_block, msg, strlen(msg), LOG_MODE_BYTE_SEQ);
-			    log_write_block(ciphered_block, msg, strlen(msg));
+			    log_print_block(clear_block, msg, strlen(msg), LOG_MODE_BYTE_SEQ);
+			    log_write_block(clear_block, msg, strlen(msg));
 		    }
 		    #endif /*  DBG_LOG */
-	    	    aes_invsubbytes(ciphered_block);
+	    	    aes_invsubbytes(clear_block);
 		    #ifdef DBG_LOG
 		    {
 			char *msg = "is_box";
-			log_print_block(ciphered_block, msg, strlen(msg), LOG_MODE_BYTE_SEQ);
-			log_write_block(ciphered_block, msg, strlen(msg));
+			log_print_block(clear_block, msg, strlen(msg), LOG_MODE_BYTE_SEQ);
+			log_write_block(clear_block, msg, strlen(msg));
 		    }
 		    #endif /*  DBG_LOG */
 		   
 	   }
 	   
-	   aes_addroundkey(ciphered_block,round_keys[0]);
+	   aes_addroundkey(clear_block,round_keys[0]);
 	    	    #ifdef DBG_LOG
 		    {
 			char *msg = "ioutput";
-			log_print_block(ciphered_block, msg, strlen(msg), LOG_MODE_BYTE_SEQ);
-			log_write_block(ciphered_block, msg, strlen(msg));
+			log_print_block(clear_block, msg, strlen(msg), LOG_MODE_BYTE_SEQ);
+			log_write_block(clear_block, msg, strlen(msg));
 		    }
 		    #endif /*  DBG_LOG */
-    
+    aes_memzero(round_key_buf, sizeof(round_key_buf));
+    AES_STATS_TIME_END(t_start, AES_STATS_BACKEND_REF, AES_STATS_MODE_BLOCK);
+    return 0;
 }
 
 /**
@@ -265,12 +313,6 @@ void aes_decipher(aes_block_t *clear_block, aes_block_t *ciphered_block,
  */
 void aes_block2mat(aes_block_t *block)
 {
-    /* parameter verification */
-    if (block == NULL) {
-        fprintf(stderr, "[ERROR] aes_block2mat: bad input parameter\n");
-        exit(EXIT_FAILURE);
-    }
-
     for (uint32_t r=0;r<4;r++) {
         for (uint32_t c=0;c<AES_NB;c++) {
             block->mat[r][c] = block->byte[r+4*c];
@@ -284,12 +326,6 @@ void aes_block2mat(aes_block_t *block)
  */
 void aes_mat2block(aes_block_t *block)
 {
-    /* parameter verification */
-    if (block == NULL) {
-        fprintf(stderr, "[ERROR] aes_mat2block: bad input parameter\n");
-        exit(EXIT_FAILURE);
-    }
-
     for (uint32_t r=0;r<4;r++) {
         for (uint32_t c=0;c<AES_NB;c++) {
             block->byte[r+4*c] = block->mat[r][c];
@@ -300,15 +336,10 @@ void aes_mat2block(aes_block_t *block)
 /**
  * @brief update matrix to reflect the byte sequence of a key
  * @param[in,out] key pointer to the AES key structure
+ * @note key->length is trusted, an unsupported length leaves the key untouched
  */
 void aes_key2mat(aes_key_t *key)
 {
-    /* parameter verification */
-    if (key == NULL) {
-        fprintf(stderr, "[ERROR] aes_key2mat: bad input parameter\n");
-        exit(EXIT_FAILURE);
-    }
-
     uint32_t nk=0;
     switch (key->length) {
         case AES128_KEY_SIZE/8:
@@ -321,7 +352,7 @@ void aes_key2mat(aes_key_t *key)
             nk = AES256_NK;
             break;
         default:
-            fprintf(stderr, "[ERROR] aes_key2mat: bad input parameter\n");
+            break;
     }
     for (uint32_t r=0;r<4;r++) {
         for (uint32_t c=0;c<nk;c++) {
@@ -333,15 +364,10 @@ void aes_key2mat(aes_key_t *key)
 /**
  * @brief update byte sequence to reflect the matrix of a key
  * @param[in,out] key pointer to the AES key structure
+ * @note key->length is trusted, an unsupported length leaves the key untouched
  */
 void aes_mat2key(aes_key_t *key)
 {
-    /* parameter verification */
-    if (key == NULL) {
-        fprintf(stderr, "[ERROR] aes_mat2key: bad input parameter\n");
-        exit(EXIT_FAILURE);
-    }
-
     uint32_t nk=0;
     switch (key->length) {
         case AES128_KEY_SIZE/8:
@@ -354,7 +380,7 @@ void aes_mat2key(aes_key_t *key)
             nk = AES256_NK;
             break;
         default:
-            fprintf(stderr, "[ERROR] aes_key2mat: bad input parameter\n");
+            break;
     }
     for (uint32_t r=0;r<4;r++) {
         for (uint32_t c=0;c<nk;c++) {
@@ -372,14 +398,6 @@ void aes_mat2key(aes_key_t *key)
 void aes_addroundkey(aes_block_t *state, aes_key_t *key)
 {
     /* write your code here */
-     if(state==NULL || key==NULL){
-
-	 fprintf(stderr, "[ERROR] aes_addroundkey: bad input parameter\n");
-
-	 exit(EXIT_FAILURE);
-
-      }else{
-
 	 for( uint32_t i=0; i<AES_BLOCK_SIZE; i++){
 
 		 state->byte[i] =state->byte[i]^key->byte[i];
@@ -387,7 +405,6 @@ void aes_addroundkey(aes_block_t *state, aes_key_t *key)
      	 } 
 
  	aes_block2mat(state);
-      }
 }
 
 /**
@@ -400,14 +417,6 @@ void aes_subbytes(aes_block_t *state)
     
 	 uint8_t chiffre_dizaine, chiffre_unite;
 
-	 if(state==NULL){
-
-	 fprintf(stderr, "[ERROR] aes_subbytes: bad input parameter\n");
-
-	 exit(EXIT_FAILURE);
-
-	 }else{
-
 		 for( uint32_t i=0; i<AES_BLOCK_SIZE; i++){
 
 		 //extraction des unites et des dizaines
@@ -427,8 +436,6 @@ void aes_subbytes(aes_block_t *state)
 		 //printf("d:%d u:%d",chiffre_dizaine,chiffre_unite);
 
 		 aes_block2mat(state);
-
-	 }
 }
 
 /**
@@ -440,14 +447,6 @@ void aes_invsubbytes(aes_block_t *state)
     /* write your code here */
     uint8_t chiffre_dizaine, chiffre_unite;
 
-	 if(state==NULL){
-
-	 fprintf(stderr, "[ERROR] aes_subbytes: bad input parameter\n");
-
-	 exit(EXIT_FAILURE);
-
-	 }else{
-
 		 for( uint32_t i=0; i<AES_BLOCK_SIZE; i++){
 
 		 //extraction des unites et des dizaines
@@ -467,11 +466,9 @@ void aes_invsubbytes(aes_block_t *state)
 		 //printf("d:%d u:%d",chiffre_dizaine,chiffre_unite);
 
 		 aes_block2mat(state);
-
-	 }
 }
 
-inline void aes_one_rotation(uint8_t *row){
+static inline void aes_one_rotation(uint8_t *row){
 	
 	uint8_t temp;
 	
@@ -487,7 +484,7 @@ inline void aes_one_rotation(uint8_t *row){
 	
 }
 
-inline void aes_one_rotation_right(uint8_t *row){
+static inline void aes_one_rotation_right(uint8_t *row){
 	
 	uint8_t temp;
 	
@@ -510,14 +507,6 @@ inline void aes_one_rotation_right(uint8_t *row){
 void aes_shiftrows(aes_block_t *state)
 {
     /* write your code here */
-    if(state==NULL){
-
-	 fprintf(stderr, "[ERROR] aes_subbytes: bad input parameter\n");
-
-	 exit(EXIT_FAILURE);
-
-    }else{
-
 	 //shiftRows ligne 2 de la matrice
 
 	 aes_one_rotation(state->mat[1]);
@@ -541,7 +530,6 @@ void aes_shiftrows(aes_block_t *state)
 	 //aes_block2mat(state);
 
 	 aes_mat2block(state);
-	 }
 }
 
 /**
@@ -551,14 +539,6 @@ void aes_shiftrows(aes_block_t *state)
 void aes_invshiftrows(aes_block_t *state)
 {
     /* write your code here */
-    if(state==NULL){
-
-	 fprintf(stderr, "[ERROR] aes_subbytes: bad input parameter\n");
-
-	 exit(EXIT_FAILURE);
-
-    }else{
-
 	 //shiftRows ligne 2 de la matrice
 
 	 aes_one_rotation_right(state->mat[1]);
@@ -582,7 +562,6 @@ void aes_invshiftrows(aes_block_t *state)
 	 //aes_block2mat(state);
 
 	 aes_mat2block(state);
-	 }
 }
 
 /**
@@ -743,28 +722,12 @@ void aes_invmixcolumns(aes_block_t *state)
  */
 void aes_subword(uint32_t *word)
 {
-    uint32_t out_word=0;
-    uint32_t row;
-    uint32_t col;
-    uint8_t byte;
-
-    byte = (*word & 0xff000000) >> 24;
-    row = (byte & 0xf0) >> 4;
-    col = byte & 0x0f;
-    out_word = aes_sbox[row][col] << 24;
-    byte = (*word & 0x00ff0000) >> 16;
-    row = (byte & 0xf0) >> 4;
-    col = byte & 0x0f;
-    out_word |= aes_sbox[row][col] << 16;
-    byte = (*word & 0x0000ff00) >> 8;
-    row = (byte & 0xf0) >> 4;
-    col = byte & 0x0f;
-    out_word |= aes_sbox[row][col] << 8;
-    byte = *word & 0x000000ff;
-    row = (byte & 0xf0) >> 4;
-    col = byte & 0x0f;
-    out_word |= aes_sbox[row][col];
-    *word = out_word;
+    /* the 16x16 S-box is contiguous, index it with the whole byte */
+    const uint8_t *sbox = (const uint8_t *)aes_sbox;
+    uint32_t w = *word;
+
+    *word = ((uint32_t)sbox[w >> 24] << 24) | ((uint32_t)sbox[(w >> 16) & 0xff] << 16) |
+            ((uint32_t)sbox[(w >> 8) & 0xff] << 8) | sbox[w & 0xff];
 }
 
 /**
@@ -780,82 +743,97 @@ void aes_rotword(uint32_t *word)
     *word = tmp;
 }
 
+/**
+ * @brief calculate the key schedule as a contiguous array of words
+ * @param[out] w AES_NB*(Nr+1) words, w[i] holds bytes 4i..4i+3 of the
+ * schedule in big-endian order
+ * @param[in] key pointer to the key bytes
+ * @param[in] length key length in bytes (16, 24 or 32)
+ * @return 0 on success, -1 on bad parameter or key length
+ */
+int32_t aes_keyexpansion_words(uint32_t *w, const uint8_t *key, uint32_t length)
+{
+    uint32_t nk = length/4;
+    uint32_t nr = aes_nr(length);
+    uint32_t total;
+
+    /* parameter verification */
+    if ((w == NULL) || (key == NULL) || (nr == 0)) {
+        return -1;
+    }
+    aes_stats_add_keyexpansion(length);
+    for (uint32_t i=0;i<nk;i++) {
+        w[i] = ((uint32_t)key[4*i] << 24) | ((uint32_t)key[4*i+1] << 16) |
+               ((uint32_t)key[4*i+2] << 8) | key[4*i+3];
+    }
+    total = AES_NB*(nr+1);
+    /* one pass per nk words: the first one gets RotWord/SubWord/Rcon */
+    for (uint32_t i=nk, round=0;i<total;round++) {
+        uint32_t tmp = w[i-1];
+
+        aes_rotword(&tmp);
+        aes_subword(&tmp);
+        w[i] = w[i-nk] ^ tmp ^ aes_rcon[round];
+        i++;
+        for (uint32_t j=1;(j<nk) && (i<total);j++, i++) {
+            tmp = w[i-1];
+            if ((nk > 6) && (j == 4)) {
+                aes_subword(&tmp);
+            }
+            w[i] = w[i-nk] ^ tmp;
+        }
+    }
+    return 0;
+}
+
 /**
  * @brief calculate round keys from initial key
  * @param[in,out] expanded_key pointer to an array of keys
  * @param[in] key pointer to the initial key
+ * @return 0 on success, -1 on bad parameter or key length
+ * @note wrapper over aes_keyexpansion_words filling both the byte sequence
+ * and the matrix of every round key
  */
-void aes_keyexpansion(aes_key_t *(*expanded_keys)[], aes_key_t* key)
+int32_t aes_keyexpansion(aes_key_t *(*expanded_keys)[], aes_key_t* key)
 {
+    uint32_t w[AES_NB*(AES256_NR+1)];
+    uint8_t key_bytes[AES256_KEY_SIZE/8];
+    uint32_t nr;
+
     /* parameter verification */
     if ((expanded_keys == NULL) || (key == NULL)) {
-        fprintf(stderr, "[ERROR] aes_keyexpansion: bad input parameter\n");
-        exit(EXIT_FAILURE);
+        return -1;
     }
-
-    uint32_t i=0;
-    uint32_t nk=0, nr=0;
-    uint8_t w[4][AES256_NR*AES256_NK];
-    memset(w, 0, 4*AES256_NK*sizeof(uint8_t));
-    switch (key->length) {
-        case AES128_KEY_SIZE/8:
-            nk = AES128_NK;
-            nr = AES128_NR;
-            break;
-        case AES192_KEY_SIZE/8:
-            nk = AES192_NK;
-            nr = AES192_NR;
-            break;
-        case AES256_KEY_SIZE/8:
-            nk = AES256_NK;
-            nr = AES256_NR;
-            break;
-        default:
-            fprintf(stderr, "[ERROR] aes_keyexpansion: bad input parameter\n");
+    nr = aes_nr(key->length);
+    if (nr == 0) {
+        return -1;
     }
-    while (i < nk) {
+    /* the matrix is the reference form of the key */
+    for (uint32_t c=0;c<key->length/4;c++) {
         for (uint32_t r=0;r<4;r++) {
-            w[r][i] = key->mat[r][i];
+            key_bytes[r+4*c] = key->mat[r][c];
         }
-        i++;
     }
-    uint32_t tmp;
-    i = nk;
-    while (i< AES_NB*(nr+1)) {
-        tmp = w[0][i-1] << 24;
-        tmp |= w[1][i-1] << 16;
-        tmp |= w[2][i-1] <<8;
-        tmp |= w[3][i-1];
-        if ((i%nk) == 0) {
-            aes_rotword(&tmp),
-            aes_subword(&tmp);
-            tmp ^= aes_rcon[i/nk-1];
-        } else {
-            if ((nk<6) && (i%nk == 4)) {
-                aes_subword(&tmp);
+    if (aes_keyexpansion_words(w, key_bytes, key->length) != 0) {
+        aes_memzero(key_bytes, sizeof(key_bytes));
+        return -1;
+    }
+    for (uint32_t i=0;i<=nr;i++) {
+        aes_key_t *round_key = (*expanded_keys)[i];
+
+        for (uint32_t c=0;c<AES_NB;c++) {
+            uint32_t word = w[AES_NB*i + c];
+            for (uint32_t r=0;r<4;r++) {
+                uint8_t byte = (uint8_t)(word >> (24 - 8*r));
+                round_key->byte[r+4*c] = byte;
+                round_key->mat[r][c] = byte;
             }
         }
-        w[0][i] = w[0][i-nk] ^ ((tmp & 0xff000000) >> 24);
-        w[1][i] = w[1][i-nk] ^ ((tmp & 0x00ff0000) >> 16);
-        w[2][i] = w[2][i-nk] ^ ((tmp & 0x0000ff00) >> 8);
-        w[3][i] = w[3][i-nk] ^ (tmp & 0x000000ff);
-        tmp = w[0][i] << 24;
-        tmp |= w[1][i] << 16;
-        tmp |= w[2][i] <<8;
-        tmp |= w[3][i];
-        for (uint32_t r=0;r<4;r++) {
-            aes_key_t *round_key;
-            round_key = (*expanded_keys)[i/4];
-            round_key->mat[r][i%4] = w[r][i];
-        }
-        i++;
-    }
-    for (i=0;i<(nr+1);i++) {
-        aes_key_t *round_key;
-        round_key = (*expanded_keys)[i];
         round_key->length = key->length;
-        aes_mat2key(round_key);
     }
+    aes_memzero(w, sizeof(w));
+    aes_memzero(key_bytes, sizeof(key_bytes));
+    return 0;
 }
 
 #undef AES_C
@@ -0,0 +1,204 @@
+/**
+ * @file aes_arena.c
+ * @brief fixed-size slot arena for contexts, mode states and staging buffers
+ *
+ * Chunks are mapped on demand and never returned before aes_arena_destroy.
+ * Each chunk starts with a one-line header followed by back-to-back slots;
+ * a free slot stores the free-list link in its first word, everything else
+ * in it is zero.
+*/
+
+#define AES_ARENA_C
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "aes_arena.h"
+
+/**
+ * @brief map one chunk and push its slots on the free list
+ * @param[in,out] arena pointer to the arena, lock held
+ * @return 0 on success, -1 if the memory could not be mapped
+ * @note locking and huge pages are best effort, their failure leaves errno
+ * untouched
+ */
+static int32_t arena_grow(aes_arena_t *arena)
+{
+    uint8_t *map = MAP_FAILED;
+    aes_arena_chunk_t *chunk;
+    size_t size = arena->chunk_size;
+    size_t guard = (arena->flags & AES_ARENA_GUARD) ? (size_t)sysconf(_SC_PAGESIZE) : 0;
+    size_t map_size = size + 2*guard;
+    uint32_t huge = 0;
+    int saved_errno = errno;
+    uint8_t *slot;
+    size_t nslots;
+
+#ifdef MAP_HUGETLB
+    if (arena->flags & AES_ARENA_HUGEPAGE) {
+        map = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        huge = (map != MAP_FAILED);
+    }
+#endif
+    if (map == MAP_FAILED) {
+        /* no reserved huge pages: ordinary pages, transparent huge pages if allowed */
+        map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map == MAP_FAILED) {
+            return -1;
+        }
+#ifdef MADV_HUGEPAGE
+        if (arena->flags & AES_ARENA_HUGEPAGE) {
+            madvise(map, map_size, MADV_HUGEPAGE);
+        }
+#endif
+    }
+    if (guard != 0) {
+        mprotect(map, guard, PROT_NONE);
+        mprotect(map + guard + size, guard, PROT_NONE);
+    }
+    chunk = (aes_arena_chunk_t *)(map + guard);
+    if (arena->flags & AES_ARENA_LOCKED) {
+        /* RLIMIT_MEMLOCK may refuse, the chunk is still usable */
+        chunk->locked = (mlock(chunk, size) == 0);
+#ifdef MADV_DONTDUMP
+        madvise(chunk, size, MADV_DONTDUMP);
+#endif
+    }
+    errno = saved_errno;
+    chunk->size = size;
+    chunk->map = map;
+    chunk->map_size = map_size;
+    chunk->huge = huge;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    /* anonymous mappings are zero-filled, only the links need writing */
+    nslots = (size - sizeof(aes_arena_chunk_t))/arena->slot_size;
+    slot = (uint8_t *)(chunk + 1) + (nslots - 1)*arena->slot_size;
+    for (size_t i=0;i<nslots;i++) {
+        *(void **)slot = arena->free_list;
+        arena->free_list = slot;
+        slot -= arena->slot_size;
+    }
+    return 0;
+}
+
+/**
+ * @brief initialize an arena, no memory is mapped until the first allocation
+ * @param[out] arena pointer to the arena
+ * @param[in] slot_size size of every slot in bytes
+ * @param[in] chunk_slots minimum number of slots mapped at a time
+ * @param[in] flags AES_ARENA_DEFAULT or a combination of AES_ARENA_xxx flags
+ * @return 0 on success, -1 on bad parameter
+ * @note with AES_ARENA_HUGEPAGE a chunk is rounded up to a whole huge page
+ * and filled with as many slots as fit. AES_ARENA_GUARD needs page
+ * granularity and takes precedence over AES_ARENA_HUGEPAGE.
+ */
+int32_t aes_arena_init(aes_arena_t *arena, size_t slot_size, size_t chunk_slots,
+                       uint32_t flags)
+{
+    size_t page;
+
+    if ((arena == NULL) || (slot_size == 0) || (chunk_slots == 0)) {
+        return -1;
+    }
+    memset(arena, 0, sizeof(aes_arena_t));
+    pthread_mutex_init(&arena->lock, NULL);
+    if (flags & AES_ARENA_GUARD) {
+        flags &= ~(uint32_t)AES_ARENA_HUGEPAGE;
+    }
+    arena->flags = flags;
+    arena->slot_size = (slot_size + AES_ARENA_ALIGN - 1) & ~(size_t)(AES_ARENA_ALIGN - 1);
+    page = (flags & AES_ARENA_HUGEPAGE) ? AES_ARENA_HUGEPAGE_SIZE : (size_t)sysconf(_SC_PAGESIZE);
+    arena->chunk_size = sizeof(aes_arena_chunk_t) + arena->slot_size*chunk_slots;
+    arena->chunk_size = (arena->chunk_size + page - 1)/page*page;
+    return 0;
+}
+
+/**
+ * @brief clear and unmap every chunk of an arena
+ * @param[in,out] arena pointer to the arena
+ * @note slots still allocated become invalid
+ */
+void aes_arena_destroy(aes_arena_t *arena)
+{
+    aes_arena_chunk_t *chunk;
+
+    if (arena == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&arena->lock);
+    while ((chunk = arena->chunks) != NULL) {
+        void *map = chunk->map;
+        size_t map_size = chunk->map_size;
+
+        arena->chunks = chunk->next;
+        aes_memzero(chunk, chunk->size);
+        munmap(map, map_size);
+    }
+    arena->free_list = NULL;
+    arena->in_use = 0;
+    pthread_mutex_unlock(&arena->lock);
+    pthread_mutex_destroy(&arena->lock);
+}
+
+/**
+ * @brief take one slot from the arena
+ * @param[in,out] arena pointer to the arena
+ * @return pointer to a zeroed, AES_ARENA_ALIGN aligned slot, NULL on failure
+ */
+void *aes_arena_alloc(aes_arena_t *arena)
+{
+    void *slot;
+
+    pthread_mutex_lock(&arena->lock);
+    if ((arena->free_list == NULL) && (arena_grow(arena) != 0)) {
+        pthread_mutex_unlock(&arena->lock);
+        return NULL;
+    }
+    slot = arena->free_list;
+    arena->free_list = *(void **)slot;
+    arena->in_use++;
+    pthread_mutex_unlock(&arena->lock);
+    *(void **)slot = NULL;
+    return slot;
+}
+
+/**
+ * @brief clear a slot and give it back to the arena
+ * @param[in,out] arena pointer to the arena
+ * @param[in] ptr slot returned by aes_arena_alloc, may be NULL
+ */
+void aes_arena_free(aes_arena_t *arena, void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    aes_memzero(ptr, arena->slot_size);
+    pthread_mutex_lock(&arena->lock);
+    *(void **)ptr = arena->free_list;
+    arena->free_list = ptr;
+    arena->in_use--;
+    pthread_mutex_unlock(&arena->lock);
+}
+
+/**
+ * @brief clear a buffer holding secrets
+ * @param[out] ptr pointer to the buffer
+ * @param[in] len number of bytes
+ * @note unlike a plain memset before the end of a lifetime, the stores can
+ * not be removed as dead by the compiler
+ */
+void aes_memzero(void *ptr, size_t len)
+{
+    memset(ptr, 0, len);
+    /* ptr escapes to an opaque statement that may read memory */
+    __asm__ __volatile__("" : : "r"(ptr) : "memory");
+}
+
+#undef AES_ARENA_C
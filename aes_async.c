@@ -0,0 +1,537 @@
+/**
+ * @file aes_async.c
+ * @brief libaes asynchronous jobs: lock-free queues, workers, completions
+ *
+ * Submission and completion queues are bounded MPMC rings in which every
+ * cell carries a sequence number (D. Vyukov's design): producers and
+ * consumers each claim a position with one compare-and-swap and never
+ * block one another. The number of jobs in flight is capped by the queue
+ * depth, so a completion always finds room.
+ *
+ * Idle workers spin briefly then sleep on a condition variable. A
+ * submitter only takes the lock when a worker is asleep, so a busy
+ * engine costs no system call per job. A worker gathers the small CTR and
+ * ECB jobs it dequeues back to back and ciphers all of their blocks in one
+ * engine call.
+*/
+
+#define AES_ASYNC_C
+#define AES_LIB_PRIVATE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_engine.h"
+#include "aes_stats.h"
+#include "aes_lib.h"
+#include "aes_pool.h"
+#include "aes_async.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ASYNC_RELAX()   __builtin_ia32_pause()
+#else
+#define ASYNC_RELAX()   __asm__ __volatile__("" ::: "memory")
+#endif
+
+typedef struct async_cell_s {
+    uint64_t seq;
+    aes_job_t *job;
+} async_cell_t;
+
+/* producer and consumer positions on their own cache lines */
+typedef struct async_queue_s {
+    uint64_t enq __attribute__((aligned(64)));
+    uint64_t deq __attribute__((aligned(64)));
+    async_cell_t *cells __attribute__((aligned(64)));
+    uint64_t mask;
+} async_queue_t;
+
+typedef struct async_worker_s {
+    aes_async_t *async;
+    pthread_t thread;
+    int32_t cpu;
+    uint8_t *ks;                        /* coalesced blocks, allocated by the worker */
+    aes_job_t *batch[AES_ASYNC_BATCH];
+    uint32_t nbatch;
+    uint32_t posted;                    /* completions not signalled on the eventfd yet */
+} async_worker_t;
+
+struct aes_async_s {
+    async_queue_t sq;
+    async_queue_t cq;
+    uint32_t flags;
+    uint32_t depth;
+    uint32_t inflight;                  /* submitted, completion not delivered, atomic */
+    int efd;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    uint32_t sleepers;                  /* atomic */
+    uint32_t stop;
+    uint32_t nworkers;
+    async_worker_t *workers;
+};
+
+static int32_t async_queue_init(async_queue_t *q, uint32_t depth)
+{
+    uint64_t size = 1;
+
+    while (size < depth) {
+        size <<= 1;
+    }
+    q->cells = calloc(size, sizeof(async_cell_t));
+    if (q->cells == NULL) {
+        return -1;
+    }
+    for (uint64_t i=0;i<size;i++) {
+        q->cells[i].seq = i;
+    }
+    q->mask = size - 1;
+    q->enq = 0;
+    q->deq = 0;
+    return 0;
+}
+
+/**
+ * @brief enqueue a job
+ * @return 0, or -1 if the queue is full
+ */
+static int32_t async_push(async_queue_t *q, aes_job_t *job)
+{
+    uint64_t pos = __atomic_load_n(&q->enq, __ATOMIC_RELAXED);
+    async_cell_t *cell;
+
+    for (;;) {
+        int64_t dif;
+
+        cell = &q->cells[pos & q->mask];
+        dif = (int64_t)__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (int64_t)pos;
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&q->enq, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return -1;
+        } else {
+            pos = __atomic_load_n(&q->enq, __ATOMIC_RELAXED);
+        }
+    }
+    cell->job = job;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * @brief dequeue a job
+ * @return the job, NULL if the queue is empty
+ */
+static aes_job_t *async_pop(async_queue_t *q)
+{
+    uint64_t pos = __atomic_load_n(&q->deq, __ATOMIC_RELAXED);
+    async_cell_t *cell;
+    aes_job_t *job;
+
+    for (;;) {
+        int64_t dif;
+
+        cell = &q->cells[pos & q->mask];
+        dif = (int64_t)__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (int64_t)(pos + 1);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&q->deq, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return NULL;
+        } else {
+            pos = __atomic_load_n(&q->deq, __ATOMIC_RELAXED);
+        }
+    }
+    job = cell->job;
+    __atomic_store_n(&cell->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+    return job;
+}
+
+static int32_t async_queue_empty(async_queue_t *q)
+{
+    uint64_t pos = __atomic_load_n(&q->deq, __ATOMIC_SEQ_CST);
+
+    return __atomic_load_n(&q->cells[pos & q->mask].seq, __ATOMIC_SEQ_CST) != pos + 1;
+}
+
+/**
+ * @brief deliver a finished job
+ * @param[in,out] w worker that ran it
+ * @param[in,out] job finished job, status set
+ */
+static void async_complete(async_worker_t *w, aes_job_t *job)
+{
+    aes_async_t *async = w->async;
+
+    if (async->flags == AES_ASYNC_CB_POLL) {
+        /* room is guaranteed: at most depth jobs are in flight */
+        async_push(&async->cq, job);
+        w->posted++;
+        return;
+    }
+    __atomic_sub_fetch(&async->inflight, 1, __ATOMIC_RELEASE);
+    if (job->cb != NULL) {
+        job->cb(job, job->user);
+    }
+}
+
+/* wake the reactor once for all completions posted since the last signal */
+static void async_signal(async_worker_t *w)
+{
+    uint64_t n = w->posted;
+
+    if (n != 0) {
+        w->posted = 0;
+        if (write(w->async->efd, &n, sizeof(n)) != sizeof(n)) {
+            /* counter saturated: the reactor has not read it, it will poll anyway */
+        }
+    }
+}
+
+/**
+ * @brief run a job through the library call of its mode
+ * @param[in,out] job job to run, status set
+ */
+static void async_run(aes_job_t *job)
+{
+    switch (job->op) {
+        case AES_JOB_ECB_ENCRYPT:
+            job->status = aes_ecb_encrypt(job->ctx, job->out, job->in, job->len);
+            break;
+        case AES_JOB_ECB_DECRYPT:
+            job->status = aes_ecb_decrypt(job->ctx, job->out, job->in, job->len);
+            break;
+        case AES_JOB_CBC_ENCRYPT:
+            job->status = aes_cbc_encrypt(job->ctx, job->iv, job->out, job->in, job->len);
+            break;
+        case AES_JOB_CBC_DECRYPT:
+            job->status = aes_cbc_decrypt(job->ctx, job->iv, job->out, job->in, job->len);
+            break;
+        case AES_JOB_CTR:
+            job->status = aes_ctr_crypt(job->ctx, job->iv, job->out, job->in, job->len);
+            break;
+        case AES_JOB_GCM_ENCRYPT:
+            job->status = aes_gcm_encrypt(job->ctx, job->iv, job->iv_len, job->out, job->tag,
+                                          job->in, job->len, job->aad, job->aad_len);
+            break;
+        case AES_JOB_GCM_DECRYPT:
+            job->status = aes_gcm_decrypt(job->ctx, job->iv, job->iv_len, job->out, job->in,
+                                          job->len, job->tag, job->aad, job->aad_len);
+            break;
+        default:
+            job->status = AES_ERR_PARAM;
+            break;
+    }
+}
+
+/* small keystream-like job whose blocks can join a coalesced engine call */
+static int32_t async_coalescable(const aes_job_t *job)
+{
+    return (job->len <= AES_ASYNC_SMALL) && ((job->len == 0) || ((job->in != NULL) && (job->out != NULL))) &&
+           ((job->op == AES_JOB_CTR) ||
+            ((job->op == AES_JOB_ECB_ENCRYPT) && (job->len % AES_BLOCK_SIZE == 0)));
+}
+
+/**
+ * @brief cipher the gathered small jobs, one engine call per key
+ * @param[in,out] w worker, batch emptied on return
+ */
+static void async_flush(async_worker_t *w)
+{
+    uint32_t i = 0;
+
+    while (i < w->nbatch) {
+        const aes_ctx_t *ctx = w->batch[i]->ctx;
+        size_t ctr_blocks = 0;
+        size_t ecb_blocks = 0;
+        uint32_t end = i;
+
+        for (;(end < w->nbatch) && (w->batch[end]->ctx == ctx);end++) {
+            aes_job_t *job = w->batch[end];
+            uint8_t *slot = w->ks + (ctr_blocks + ecb_blocks)*AES_BLOCK_SIZE;
+            size_t nblocks = (job->len + AES_BLOCK_SIZE - 1)/AES_BLOCK_SIZE;
+
+            if (job->op == AES_JOB_CTR) {
+                aes_ctr_blocks(slot, job->iv, nblocks);
+                ctr_blocks += nblocks;
+            } else {
+                memcpy(slot, job->in, job->len);
+                ecb_blocks += nblocks;
+            }
+        }
+        ctx->engine->encrypt(&ctx->sched, w->ks, w->ks, ctr_blocks + ecb_blocks);
+        if (ctr_blocks != 0) {
+            aes_stats_add_blocks(ctx->engine->id, AES_STATS_MODE_CTR, ctx->sched.length,
+                                 AES_STATS_DIR_ENC, ctr_blocks);
+        }
+        if (ecb_blocks != 0) {
+            aes_stats_add_blocks(ctx->engine->id, AES_STATS_MODE_ECB, ctx->sched.length,
+                                 AES_STATS_DIR_ENC, ecb_blocks);
+        }
+        for (size_t off=0;i<end;i++) {
+            aes_job_t *job = w->batch[i];
+
+            if (job->op == AES_JOB_CTR) {
+                aes_xor_blocks(job->out, job->in, w->ks + off, job->len);
+            } else {
+                memcpy(job->out, w->ks + off, job->len);
+            }
+            off += (job->len + AES_BLOCK_SIZE - 1)/AES_BLOCK_SIZE*AES_BLOCK_SIZE;
+            job->status = AES_OK;
+            async_complete(w, job);
+        }
+        aes_memzero(w->ks, (ctr_blocks + ecb_blocks)*AES_BLOCK_SIZE);
+    }
+    w->nbatch = 0;
+}
+
+/**
+ * @brief worker thread: dequeue, coalesce, run, complete
+ * @param[in] arg pointer to the async_worker_t of the thread
+ * @return NULL
+ */
+static void *async_thread(void *arg)
+{
+    async_worker_t *w = arg;
+    aes_async_t *async = w->async;
+    uint32_t spin = 0;
+
+    if (w->cpu >= 0) {
+        aes_pool_pin((uint32_t)w->cpu);
+    }
+    /* first touch of the coalescing buffer on this worker's node */
+    w->ks = malloc(AES_ASYNC_BATCH*AES_ASYNC_SMALL);
+    if (w->ks != NULL) {
+        memset(w->ks, 0, AES_ASYNC_BATCH*AES_ASYNC_SMALL);
+    }
+    for (;;) {
+        aes_job_t *job = async_pop(&async->sq);
+
+        if (job != NULL) {
+            spin = 0;
+            if ((w->ks != NULL) && async_coalescable(job)) {
+                w->batch[w->nbatch++] = job;
+                if (w->nbatch == AES_ASYNC_BATCH) {
+                    async_flush(w);
+                }
+                continue;
+            }
+            async_flush(w);
+            async_run(job);
+            async_complete(w, job);
+            continue;
+        }
+        /* queue drained: finish the gathered jobs and tell the reactor */
+        if (w->nbatch != 0) {
+            async_flush(w);
+        }
+        async_signal(w);
+        if (++spin < AES_ASYNC_SPIN) {
+            ASYNC_RELAX();
+            continue;
+        }
+        spin = 0;
+        pthread_mutex_lock(&async->lock);
+        __atomic_add_fetch(&async->sleepers, 1, __ATOMIC_SEQ_CST);
+        if (async_queue_empty(&async->sq)) {
+            if (async->stop) {
+                __atomic_sub_fetch(&async->sleepers, 1, __ATOMIC_SEQ_CST);
+                pthread_mutex_unlock(&async->lock);
+                break;
+            }
+            pthread_cond_wait(&async->wake, &async->lock);
+        }
+        __atomic_sub_fetch(&async->sleepers, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&async->lock);
+    }
+    free(w->ks);
+    return NULL;
+}
+
+/**
+ * @brief create an asynchronous engine
+ * @param[out] async receives the engine, set to NULL on failure
+ * @param[in] threads number of workers, 0 for one per online CPU
+ * @param[in] depth most jobs in flight, submitted but not delivered
+ * @param[in] flags AES_ASYNC_CB_WORKER or AES_ASYNC_CB_POLL
+ * @return AES_OK or an AES_ERR_* code
+ * @note workers are pinned in the order of aes_pool_topology
+ */
+aes_status_t aes_async_new(aes_async_t **async, uint32_t threads, uint32_t depth, uint32_t flags)
+{
+    aes_topology_t *topo;
+    aes_async_t *a;
+
+    if (async == NULL) {
+        return AES_ERR_PARAM;
+    }
+    *async = NULL;
+    if ((depth == 0) || (flags > AES_ASYNC_CB_POLL)) {
+        return AES_ERR_PARAM;
+    }
+    a = calloc(1, sizeof(aes_async_t));
+    topo = malloc(sizeof(aes_topology_t));
+    if ((a == NULL) || (topo == NULL)) {
+        free(a);
+        free(topo);
+        return AES_ERR_NOMEM;
+    }
+    aes_pool_topology(topo);
+    threads = (threads != 0) ? threads : ((topo->ncpus != 0) ? topo->ncpus : 1);
+    a->flags = flags;
+    a->depth = depth;
+    a->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    a->workers = calloc(threads, sizeof(async_worker_t));
+    if ((a->efd < 0) || (a->workers == NULL) || (async_queue_init(&a->sq, depth) != 0) ||
+        (async_queue_init(&a->cq, depth) != 0)) {
+        if (a->efd >= 0) {
+            close(a->efd);
+        }
+        free(a->sq.cells);
+        free(a->cq.cells);
+        free(a->workers);
+        free(a);
+        free(topo);
+        return AES_ERR_NOMEM;
+    }
+    pthread_mutex_init(&a->lock, NULL);
+    pthread_cond_init(&a->wake, NULL);
+    for (uint32_t i=0;i<threads;i++) {
+        async_worker_t *w = &a->workers[a->nworkers];
+
+        w->async = a;
+        w->cpu = (i < topo->ncpus) ? topo->cpu[i] : -1;
+        if (pthread_create(&w->thread, NULL, async_thread, w) == 0) {
+            a->nworkers++;
+        }
+    }
+    free(topo);
+    if (a->nworkers == 0) {
+        aes_async_free(a);
+        return AES_ERR_NOMEM;
+    }
+    *async = a;
+    return AES_OK;
+}
+
+/**
+ * @brief finish the submitted jobs, stop the workers and release the engine
+ * @param[in] async pointer to the engine, may be NULL
+ * @note with AES_ASYNC_CB_POLL, completions not polled yet are dropped
+ * without their callbacks
+ */
+void aes_async_free(aes_async_t *async)
+{
+    if (async == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&async->lock);
+    async->stop = 1;
+    pthread_cond_broadcast(&async->wake);
+    pthread_mutex_unlock(&async->lock);
+    for (uint32_t i=0;i<async->nworkers;i++) {
+        pthread_join(async->workers[i].thread, NULL);
+    }
+    pthread_mutex_destroy(&async->lock);
+    pthread_cond_destroy(&async->wake);
+    close(async->efd);
+    free(async->sq.cells);
+    free(async->cq.cells);
+    free(async->workers);
+    free(async);
+}
+
+/**
+ * @brief queue a job
+ * @param[in] async pointer to the engine
+ * @param[in,out] job job owned by the caller until its completion is
+ * delivered
+ * @return AES_OK, AES_ERR_AGAIN if depth jobs are already in flight, or
+ * AES_ERR_PARAM; the job status is only set by the worker
+ * @note never blocks and, unless a worker sleeps, makes no system call
+ */
+aes_status_t aes_async_submit(aes_async_t *async, aes_job_t *job)
+{
+    if ((async == NULL) || (job == NULL) || (job->ctx == NULL) || (job->op > AES_JOB_GCM_DECRYPT) ||
+        (job->iv_len > AES_LIB_BLOCK_SIZE)) {
+        return AES_ERR_PARAM;
+    }
+    if (__atomic_fetch_add(&async->inflight, 1, __ATOMIC_ACQUIRE) >= async->depth) {
+        __atomic_sub_fetch(&async->inflight, 1, __ATOMIC_RELAXED);
+        return AES_ERR_AGAIN;
+    }
+    async_push(&async->sq, job);
+    /* pairs with the sleeper count taken before a worker re-checks the queue */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&async->sleepers, __ATOMIC_SEQ_CST) != 0) {
+        pthread_mutex_lock(&async->lock);
+        pthread_cond_signal(&async->wake);
+        pthread_mutex_unlock(&async->lock);
+    }
+    return AES_OK;
+}
+
+/**
+ * @brief eventfd readable when completions wait for aes_async_poll
+ * @param[in] async pointer to the engine
+ * @return file descriptor for epoll/poll, -1 if async is NULL
+ */
+int aes_async_fd(const aes_async_t *async)
+{
+    return (async != NULL) ? async->efd : -1;
+}
+
+/**
+ * @brief deliver completed jobs on the calling thread
+ * @param[in] async pointer to the engine created with AES_ASYNC_CB_POLL
+ * @param[in] max most callbacks to run, 0 for all pending
+ * @return number of jobs delivered
+ * @note callbacks may submit new jobs; when max leaves completions pending
+ * the eventfd stays readable
+ */
+uint32_t aes_async_poll(aes_async_t *async, uint32_t max)
+{
+    uint64_t count;
+    uint32_t done = 0;
+
+    if (async == NULL) {
+        return 0;
+    }
+    if (read(async->efd, &count, sizeof(count)) != sizeof(count)) {
+        /* nothing signalled since the last read, completions may still wait */
+    }
+    while ((max == 0) || (done < max)) {
+        aes_job_t *job = async_pop(&async->cq);
+
+        if (job == NULL) {
+            break;
+        }
+        __atomic_sub_fetch(&async->inflight, 1, __ATOMIC_RELEASE);
+        done++;
+        if (job->cb != NULL) {
+            job->cb(job, job->user);
+        }
+    }
+    /* the read above cleared the eventfd: keep it readable for what is left */
+    if ((max != 0) && (done == max) && !async_queue_empty(&async->cq)) {
+        uint64_t one = 1;
+
+        if (write(async->efd, &one, sizeof(one)) != sizeof(one)) {
+            /* counter saturated: already readable */
+        }
+    }
+    return done;
+}
+
+#undef AES_ASYNC_C
@@ -0,0 +1,274 @@
+/**
+ * @file aes_ccm.c
+ * @brief libaes CCM mode (NIST SP 800-38C, RFC 3610)
+ *
+ * CCM authenticates with a CBC-MAC, a serial chain of block encryptions,
+ * and encrypts with CTR, whose blocks are independent. When the engine has
+ * a fused CCM kernel the two run in one round loop and the keystream
+ * rounds fill the latency gaps of the chain. Otherwise the keystream of
+ * AES_LIB_BATCH blocks is made in one wide engine call and the chain
+ * follows over the same L1-resident chunk.
+*/
+
+#define AES_CCM_C
+#define AES_LIB_PRIVATE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_engine.h"
+#include "aes_stats.h"
+#include "aes_lib.h"
+
+typedef struct ccm_state_s {
+    uint8_t mac[AES_BLOCK_SIZE];    /* CBC-MAC chaining value */
+    uint8_t ctr[AES_BLOCK_SIZE];    /* next counter block */
+    uint8_t s0[AES_BLOCK_SIZE];     /* E(K, Ctr_0), masks the tag */
+} ccm_state_t;
+
+/**
+ * @brief check the parameters shared by encrypt and decrypt
+ * @return AES_OK or an AES_ERR_* code
+ */
+static aes_status_t ccm_check(const aes_ctx_t *ctx, const uint8_t *nonce, size_t nonce_len,
+                              const uint8_t *out, const uint8_t *tag, size_t tag_len,
+                              const uint8_t *in, size_t len, const uint8_t *aad, size_t aad_len)
+{
+    size_t q = AES_BLOCK_SIZE - 1 - nonce_len;
+
+    if ((ctx == NULL) || (nonce == NULL) || (tag == NULL) || ((len != 0) && ((out == NULL) || (in == NULL))) ||
+        ((aad_len != 0) && (aad == NULL))) {
+        return AES_ERR_PARAM;
+    }
+    if ((nonce_len < AES_CCM_NONCE_MIN) || (nonce_len > AES_CCM_NONCE_MAX) ||
+        (tag_len < AES_CCM_TAG_MIN) || (tag_len > AES_CCM_TAG_MAX) || (tag_len % 2 != 0)) {
+        return AES_ERR_LENGTH;
+    }
+    /* the payload length must fit the q-byte length field */
+    if ((q < sizeof(uint64_t)) && ((uint64_t)len >> (8*q) != 0)) {
+        return AES_ERR_LENGTH;
+    }
+    return AES_OK;
+}
+
+/**
+ * @brief absorb one block into the CBC-MAC
+ * @param[in] ctx pointer to the key context
+ * @param[in,out] mac chaining value
+ * @param[in] block 16 bytes
+ */
+static void ccm_mac_block(const aes_ctx_t *ctx, uint8_t mac[AES_BLOCK_SIZE], const uint8_t *block)
+{
+    aes_xor_blocks(mac, mac, block, AES_BLOCK_SIZE);
+    ctx->engine->encrypt(&ctx->sched, mac, mac, 1);
+}
+
+/**
+ * @brief format B0 and the counter blocks, absorb B0 and the encoded AAD
+ * @param[out] st CCM state
+ * @param[in] ctx pointer to the key context
+ * @return number of blocks ciphered
+ */
+static size_t ccm_start(ccm_state_t *st, const aes_ctx_t *ctx, const uint8_t *nonce, size_t nonce_len,
+                        size_t tag_len, size_t len, const uint8_t *aad, size_t aad_len)
+{
+    uint8_t block[AES_BLOCK_SIZE];
+    size_t q = AES_BLOCK_SIZE - 1 - nonce_len;
+    size_t nblocks = 2;
+    size_t fill;
+
+    /* B0: flags | nonce | payload length on q bytes */
+    memset(block, 0, sizeof(block));
+    block[0] = (uint8_t)(((aad_len != 0) ? 0x40 : 0) | (((tag_len - 2)/2) << 3) | (q - 1));
+    memcpy(block + 1, nonce, nonce_len);
+    for (size_t i=0;(i<q)&&(i<sizeof(uint64_t));i++) {
+        block[AES_BLOCK_SIZE - 1 - i] = (uint8_t)((uint64_t)len >> (8*i));
+    }
+    memset(st->mac, 0, AES_BLOCK_SIZE);
+    ccm_mac_block(ctx, st->mac, block);
+    /* Ctr_0: flags q-1 | nonce | 0, Ctr_1 starts the payload */
+    memset(st->ctr, 0, AES_BLOCK_SIZE);
+    st->ctr[0] = (uint8_t)(q - 1);
+    memcpy(st->ctr + 1, nonce, nonce_len);
+    ctx->engine->encrypt(&ctx->sched, st->s0, st->ctr, 1);
+    st->ctr[AES_BLOCK_SIZE - 1] = 1;
+    if (aad_len == 0) {
+        return nblocks;
+    }
+    /* AAD length prefix of 2, 6 or 10 bytes, then the AAD, zero padded */
+    memset(block, 0, sizeof(block));
+    if ((uint64_t)aad_len < 0xff00) {
+        block[0] = (uint8_t)(aad_len >> 8);
+        block[1] = (uint8_t)aad_len;
+        fill = 2;
+    } else if ((uint64_t)aad_len <= 0xffffffff) {
+        block[0] = 0xff;
+        block[1] = 0xfe;
+        for (uint32_t i=0;i<4;i++) {
+            block[2+i] = (uint8_t)((uint64_t)aad_len >> (24 - 8*i));
+        }
+        fill = 6;
+    } else {
+        block[0] = 0xff;
+        block[1] = 0xff;
+        for (uint32_t i=0;i<8;i++) {
+            block[2+i] = (uint8_t)((uint64_t)aad_len >> (56 - 8*i));
+        }
+        fill = 10;
+    }
+    for (size_t off=0;off<aad_len;) {
+        size_t n = AES_BLOCK_SIZE - fill;
+
+        n = (aad_len - off < n) ? (aad_len - off) : n;
+        memcpy(block + fill, aad + off, n);
+        off += n;
+        fill += n;
+        if ((fill == AES_BLOCK_SIZE) || (off == aad_len)) {
+            memset(block + fill, 0, AES_BLOCK_SIZE - fill);
+            ccm_mac_block(ctx, st->mac, block);
+            nblocks++;
+            fill = 0;
+        }
+    }
+    aes_memzero(block, sizeof(block));
+    return nblocks;
+}
+
+/**
+ * @brief cipher the payload and absorb the plaintext
+ * @param[in,out] st CCM state
+ * @param[in] ctx pointer to the key context
+ * @param[out] out output, may alias in
+ * @param[in] in input
+ * @param[in] len length in bytes
+ * @param[in] decrypt 0 to encrypt, 1 to decrypt
+ */
+static void ccm_crypt(ccm_state_t *st, const aes_ctx_t *ctx, uint8_t *out, const uint8_t *in,
+                      size_t len, uint32_t decrypt)
+{
+    uint8_t ks[AES_LIB_BATCH*AES_BLOCK_SIZE];
+
+    for (size_t off=0;off<len;off+=sizeof(ks)) {
+        size_t n = (len - off < sizeof(ks)) ? (len - off) : sizeof(ks);
+        size_t nblocks = (n + AES_BLOCK_SIZE - 1)/AES_BLOCK_SIZE;
+        size_t full = n/AES_BLOCK_SIZE;
+        size_t done = 0;
+
+        aes_ctr_blocks(ks, st->ctr, nblocks);
+        if (ctx->engine->ccm != NULL) {
+            /* whole blocks in the fused kernel, a partial last block below */
+            ctx->engine->ccm(&ctx->sched, st->mac, out + off, in + off, ks, full, decrypt);
+            done = full;
+            if (done != nblocks) {
+                ctx->engine->encrypt(&ctx->sched, ks + done*AES_BLOCK_SIZE,
+                                     ks + done*AES_BLOCK_SIZE, 1);
+            }
+        } else {
+            ctx->engine->encrypt(&ctx->sched, ks, ks, nblocks);
+        }
+        for (size_t b=done;b<nblocks;b++) {
+            size_t pos = b*AES_BLOCK_SIZE;
+            size_t m = (n - pos < AES_BLOCK_SIZE) ? (n - pos) : AES_BLOCK_SIZE;
+            uint8_t block[AES_BLOCK_SIZE];
+
+            /* the MAC covers the plaintext, zero padded */
+            memset(block, 0, sizeof(block));
+            if (decrypt) {
+                aes_xor_blocks(out + off + pos, in + off + pos, ks + pos, m);
+                memcpy(block, out + off + pos, m);
+            } else {
+                memcpy(block, in + off + pos, m);
+                aes_xor_blocks(out + off + pos, in + off + pos, ks + pos, m);
+            }
+            ccm_mac_block(ctx, st->mac, block);
+        }
+    }
+    aes_memzero(ks, sizeof(ks));
+}
+
+/**
+ * @brief encrypt and authenticate a message with AES-CCM
+ * @param[in] ctx pointer to the key context
+ * @param[in] nonce nonce, unique per message under a key
+ * @param[in] nonce_len nonce length, AES_CCM_NONCE_MIN to AES_CCM_NONCE_MAX;
+ * a nonce of n bytes limits the message to 2^(8*(15-n)) - 1 bytes
+ * @param[out] out ciphertext, len bytes, may be equal to in
+ * @param[out] tag tag, tag_len bytes
+ * @param[in] tag_len even tag length, AES_CCM_TAG_MIN to AES_CCM_TAG_MAX
+ * @param[in] in plaintext, may be NULL if len is 0
+ * @param[in] len plaintext length in bytes
+ * @param[in] aad additional authenticated data, may be NULL if aad_len is 0
+ * @param[in] aad_len AAD length in bytes
+ * @return AES_OK or an AES_ERR_* code
+ */
+aes_status_t aes_ccm_encrypt(const aes_ctx_t *ctx, const uint8_t *nonce, size_t nonce_len,
+                             uint8_t *out, uint8_t *tag, size_t tag_len,
+                             const uint8_t *in, size_t len, const uint8_t *aad, size_t aad_len)
+{
+    ccm_state_t st;
+    size_t nblocks;
+    aes_status_t status = ccm_check(ctx, nonce, nonce_len, out, tag, tag_len, in, len, aad, aad_len);
+
+    if (status != AES_OK) {
+        return status;
+    }
+    nblocks = ccm_start(&st, ctx, nonce, nonce_len, tag_len, len, aad, aad_len);
+    ccm_crypt(&st, ctx, out, in, len, 0);
+    aes_xor_blocks(tag, st.mac, st.s0, tag_len);
+    aes_stats_add_blocks(ctx->engine->id, AES_STATS_MODE_CCM, ctx->sched.length, AES_STATS_DIR_ENC,
+                         nblocks + 2*((len + AES_BLOCK_SIZE - 1)/AES_BLOCK_SIZE));
+    aes_memzero(&st, sizeof(st));
+    return AES_OK;
+}
+
+/**
+ * @brief decrypt and verify a message with AES-CCM
+ * @param[in] ctx pointer to the key context
+ * @param[in] nonce nonce
+ * @param[in] nonce_len nonce length, AES_CCM_NONCE_MIN to AES_CCM_NONCE_MAX
+ * @param[out] out plaintext, len bytes, may be equal to in
+ * @param[in] in ciphertext, may be NULL if len is 0
+ * @param[in] len ciphertext length in bytes, without the tag
+ * @param[in] tag tag, tag_len bytes
+ * @param[in] tag_len even tag length, AES_CCM_TAG_MIN to AES_CCM_TAG_MAX
+ * @param[in] aad additional authenticated data, may be NULL if aad_len is 0
+ * @param[in] aad_len AAD length in bytes
+ * @return AES_OK, AES_ERR_AUTH if the tag does not match, or another
+ * AES_ERR_* code
+ * @note on AES_ERR_AUTH out is cleared
+ */
+aes_status_t aes_ccm_decrypt(const aes_ctx_t *ctx, const uint8_t *nonce, size_t nonce_len,
+                             uint8_t *out, const uint8_t *in, size_t len,
+                             const uint8_t *tag, size_t tag_len,
+                             const uint8_t *aad, size_t aad_len)
+{
+    ccm_state_t st;
+    size_t nblocks;
+    uint8_t diff = 0;
+    aes_status_t status = ccm_check(ctx, nonce, nonce_len, out, tag, tag_len, in, len, aad, aad_len);
+
+    if (status != AES_OK) {
+        return status;
+    }
+    nblocks = ccm_start(&st, ctx, nonce, nonce_len, tag_len, len, aad, aad_len);
+    ccm_crypt(&st, ctx, out, in, len, 1);
+    /* constant time: the position of the first differing byte is not leaked */
+    for (size_t i=0;i<tag_len;i++) {
+        diff |= (uint8_t)(st.mac[i] ^ st.s0[i] ^ tag[i]);
+    }
+    aes_stats_add_blocks(ctx->engine->id, AES_STATS_MODE_CCM, ctx->sched.length, AES_STATS_DIR_DEC,
+                         nblocks + 2*((len + AES_BLOCK_SIZE - 1)/AES_BLOCK_SIZE));
+    aes_memzero(&st, sizeof(st));
+    if (diff != 0) {
+        if (len != 0) {
+            aes_memzero(out, len);
+        }
+        return AES_ERR_AUTH;
+    }
+    return AES_OK;
+}
+
+#undef AES_CCM_C
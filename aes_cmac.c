@@ -0,0 +1,180 @@
+/**
+ * @file aes_cmac.c
+ * @brief libaes CMAC (RFC 4493, NIST SP 800-38B)
+ *
+ * CMAC is a CBC chain, so one message is strictly serial. aes_cmac_multi
+ * keeps up to AES_CMAC_LANES messages in flight and advances all their
+ * chains with a single engine call per step; a lane whose message is done
+ * is refilled with the next one, so short and long messages mix freely.
+*/
+
+#define AES_CMAC_C
+#define AES_LIB_PRIVATE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_engine.h"
+#include "aes_stats.h"
+#include "aes_lib.h"
+
+/* one message being authenticated */
+typedef struct cmac_lane_s {
+    const uint8_t *msg;     /* next block to absorb */
+    size_t left;            /* bytes not absorbed yet */
+    size_t index;           /* position in the caller's arrays */
+    uint32_t done;          /* final block absorbed by the current step */
+} cmac_lane_t;
+
+/**
+ * @brief multiply by x in GF(2^128), RFC 4493 subkey generation
+ * @param[out] out result, may be equal to in
+ * @param[in] in 128-bit big-endian value
+ */
+static void cmac_double(uint8_t *out, const uint8_t *in)
+{
+    uint8_t carry = in[0] >> 7;
+
+    for (uint32_t i=0;i<AES_BLOCK_SIZE-1;i++) {
+        out[i] = (uint8_t)((in[i] << 1) | (in[i+1] >> 7));
+    }
+    out[AES_BLOCK_SIZE-1] = (uint8_t)((in[AES_BLOCK_SIZE-1] << 1) ^ (carry * 0x87));
+}
+
+/**
+ * @brief derive the CMAC subkeys K1 and K2 of a context
+ * @param[in,out] ctx pointer to a context whose schedule is set
+ */
+void aes_cmac_subkeys(aes_ctx_t *ctx)
+{
+    uint8_t l[AES_BLOCK_SIZE];
+
+    memset(l, 0, sizeof(l));
+    ctx->engine->encrypt(&ctx->sched, l, l, 1);
+    cmac_double(ctx->cmac_k1, l);
+    cmac_double(ctx->cmac_k2, ctx->cmac_k1);
+    aes_memzero(l, sizeof(l));
+}
+
+/**
+ * @brief absorb the final block of a message into its chain
+ * @param[in] ctx pointer to the key context
+ * @param[in,out] x chaining value
+ * @param[in] msg last bytes of the message
+ * @param[in] left number of bytes, 0 to 16
+ */
+void aes_cmac_last(const aes_ctx_t *ctx, uint8_t *x, const uint8_t *msg, size_t left)
+{
+    uint8_t last[AES_BLOCK_SIZE];
+
+    if (left == AES_BLOCK_SIZE) {
+        aes_xor_blocks(last, msg, ctx->cmac_k1, AES_BLOCK_SIZE);
+    } else {
+        memset(last, 0, sizeof(last));
+        if (left != 0) {
+            memcpy(last, msg, left);
+        }
+        last[left] = 0x80;
+        aes_xor_blocks(last, last, ctx->cmac_k2, AES_BLOCK_SIZE);
+    }
+    aes_xor_blocks(x, x, last, AES_BLOCK_SIZE);
+}
+
+/**
+ * @brief compute the CMAC of one message
+ * @param[in] ctx pointer to the key context
+ * @param[out] mac 16-byte tag
+ * @param[in] msg message, may be NULL if len is 0
+ * @param[in] len message length in bytes
+ * @return AES_OK or an AES_ERR_* code
+ */
+aes_status_t aes_cmac(const aes_ctx_t *ctx, uint8_t mac[AES_CMAC_SIZE],
+                      const uint8_t *msg, size_t len)
+{
+    if (mac == NULL) {
+        return AES_ERR_PARAM;
+    }
+    return aes_cmac_multi(ctx, (uint8_t (*)[AES_CMAC_SIZE])mac, &msg, &len, 1);
+}
+
+/**
+ * @brief compute the CMAC of many independent messages under one key
+ * @param[in] ctx pointer to the key context
+ * @param[out] macs count 16-byte tags, macs[i] authenticates msgs[i]
+ * @param[in] msgs count message pointers, an entry may be NULL if its length is 0
+ * @param[in] lens count message lengths in bytes
+ * @param[in] count number of messages
+ * @return AES_OK or an AES_ERR_* code
+ * @note each step XORs the next block of every lane into its chain, then
+ * ciphers all chains in one engine call, which the engines interleave
+ */
+aes_status_t aes_cmac_multi(const aes_ctx_t *ctx, uint8_t (*macs)[AES_CMAC_SIZE],
+                            const uint8_t *const *msgs, const size_t *lens, size_t count)
+{
+    uint8_t x[AES_CMAC_LANES*AES_BLOCK_SIZE];
+    cmac_lane_t lane[AES_CMAC_LANES];
+    uint32_t active = 0;
+    uint64_t nblocks = 0;
+    size_t next = 0;
+
+    if ((ctx == NULL) || ((count != 0) && ((macs == NULL) || (msgs == NULL) || (lens == NULL)))) {
+        return AES_ERR_PARAM;
+    }
+    for (size_t i=0;i<count;i++) {
+        if ((msgs[i] == NULL) && (lens[i] != 0)) {
+            return AES_ERR_PARAM;
+        }
+    }
+    for (;;) {
+        /* refill free lanes with fresh chains */
+        while ((active < AES_CMAC_LANES) && (next < count)) {
+            lane[active].msg = msgs[next];
+            lane[active].left = lens[next];
+            lane[active].index = next;
+            memset(x + active*AES_BLOCK_SIZE, 0, AES_BLOCK_SIZE);
+            active++;
+            next++;
+        }
+        if (active == 0) {
+            break;
+        }
+        for (uint32_t l=0;l<active;l++) {
+            cmac_lane_t *p = &lane[l];
+            uint8_t *xl = x + l*AES_BLOCK_SIZE;
+
+            if (p->left > AES_BLOCK_SIZE) {
+                aes_xor_blocks(xl, xl, p->msg, AES_BLOCK_SIZE);
+                p->msg += AES_BLOCK_SIZE;
+                p->left -= AES_BLOCK_SIZE;
+                p->done = 0;
+            } else {
+                aes_cmac_last(ctx, xl, p->msg, p->left);
+                p->left = 0;
+                p->done = 1;
+            }
+        }
+        ctx->engine->encrypt(&ctx->sched, x, x, active);
+        nblocks += active;
+        /* retire finished lanes, the last active lane moves into the hole */
+        for (uint32_t l=0;l<active;) {
+            if (!lane[l].done) {
+                l++;
+                continue;
+            }
+            memcpy(macs[lane[l].index], x + l*AES_BLOCK_SIZE, AES_CMAC_SIZE);
+            active--;
+            if (l != active) {
+                lane[l] = lane[active];
+                memcpy(x + l*AES_BLOCK_SIZE, x + active*AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+            }
+        }
+    }
+    aes_stats_add_blocks(ctx->engine->id, AES_STATS_MODE_CMAC, ctx->sched.length,
+                         AES_STATS_DIR_ENC, nblocks);
+    return AES_OK;
+}
+
+#undef AES_CMAC_C
@@ -0,0 +1,470 @@
+/**
+ * @file aes_container.c
+ * @brief libaes seekable encrypted container, chunked AES-GCM
+ *
+ * Chunks are sealed and opened as tasks of the worker pool, each worker
+ * using its node-local key replica and scratch buffer with pread/pwrite at
+ * offsets computed from the chunk number, so no thread waits for another's
+ * I/O. A chunk wholly inside the requested range is read and deciphered in
+ * place in the caller's buffer; only the two edge chunks of a range go
+ * through a bounce buffer.
+*/
+
+#define AES_CONTAINER_C
+#define AES_LIB_PRIVATE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_engine.h"
+#include "aes_stats.h"
+#include "aes_lib.h"
+#include "aes_pool.h"
+#include "aes_container.h"
+
+static const uint8_t container_magic[4] = {'A', 'E', 'S', 'C'};
+
+/* offsets in the header */
+#define HDR_VERSION     4
+#define HDR_CHUNK_SIZE  8
+#define HDR_LENGTH      16
+#define HDR_NCHUNKS     24
+#define HDR_NONCE       32
+#define HDR_END         (HDR_NONCE + AES_GCM_IV_SIZE)
+
+/* work shared by the tasks of one seal or read */
+typedef struct container_job_s {
+    const aes_ctx_t *ctx;
+    int in_fd;
+    int out_fd;
+    uint8_t header[AES_CONTAINER_HEADER_SIZE];
+    aes_container_info_t info;
+    uint64_t first;                 /* chunks [first, end) */
+    uint64_t end;
+    uint8_t *tags;                  /* index entries of [first, end) */
+    /* read only: requested range */
+    uint8_t *out;
+    uint64_t offset;
+    size_t len;
+    aes_status_t status;            /* first failure, atomic */
+} container_job_t;
+
+static void container_put_be(uint8_t *p, uint64_t v, uint32_t n)
+{
+    for (uint32_t i=0;i<n;i++) {
+        p[i] = (uint8_t)(v >> (8*(n-1-i)));
+    }
+}
+
+static uint64_t container_get_be(const uint8_t *p, uint32_t n)
+{
+    uint64_t v = 0;
+
+    for (uint32_t i=0;i<n;i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+/**
+ * @brief read exactly len bytes at an offset
+ * @return AES_OK or AES_ERR_IO, also on a short file
+ */
+static aes_status_t container_pread(int fd, uint8_t *buf, size_t len, uint64_t offset)
+{
+    while (len != 0) {
+        ssize_t n = pread(fd, buf, len, (off_t)offset);
+
+        if ((n < 0) && (errno == EINTR)) {
+            continue;
+        }
+        if (n <= 0) {
+            return AES_ERR_IO;
+        }
+        buf += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return AES_OK;
+}
+
+/**
+ * @brief write exactly len bytes at an offset
+ * @return AES_OK or AES_ERR_IO
+ */
+static aes_status_t container_pwrite(int fd, const uint8_t *buf, size_t len, uint64_t offset)
+{
+    while (len != 0) {
+        ssize_t n = pwrite(fd, buf, len, (off_t)offset);
+
+        if ((n < 0) && (errno == EINTR)) {
+            continue;
+        }
+        if (n <= 0) {
+            return AES_ERR_IO;
+        }
+        buf += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return AES_OK;
+}
+
+/**
+ * @brief IV and AAD of a chunk
+ * @param[in] job seal or read job
+ * @param[in] chunk chunk number
+ * @param[out] iv file nonce with the chunk number XORed into its last 8 bytes
+ * @param[out] aad header followed by the big-endian chunk number
+ */
+static void container_chunk_params(const container_job_t *job, uint64_t chunk,
+                                   uint8_t iv[AES_GCM_IV_SIZE], uint8_t aad[AES_CONTAINER_HEADER_SIZE + 8])
+{
+    uint8_t number[8];
+
+    container_put_be(number, chunk, 8);
+    memcpy(iv, job->header + HDR_NONCE, AES_GCM_IV_SIZE);
+    aes_xor_blocks(iv + 4, iv + 4, number, 8);
+    memcpy(aad, job->header, AES_CONTAINER_HEADER_SIZE);
+    memcpy(aad + AES_CONTAINER_HEADER_SIZE, number, 8);
+}
+
+static size_t container_chunk_len(const container_job_t *job, uint64_t chunk)
+{
+    uint64_t start = chunk*job->info.chunk_size;
+    uint64_t left = job->info.length - start;
+
+    return (left < job->info.chunk_size) ? (size_t)left : job->info.chunk_size;
+}
+
+/* record the first failure, the remaining tasks return at once */
+static void container_fail(container_job_t *job, aes_status_t status)
+{
+    aes_status_t ok = AES_OK;
+
+    __atomic_compare_exchange_n(&job->status, &ok, status, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief bounce buffer of a task, the worker scratch when it is large enough
+ * @return buffer of chunk_size bytes, NULL on allocation failure
+ */
+static uint8_t *container_buf(const container_job_t *job, aes_pool_worker_t *w)
+{
+    if ((w->scratch != NULL) && (w->scratch_size >= job->info.chunk_size)) {
+        return w->scratch;
+    }
+    return malloc(job->info.chunk_size);
+}
+
+static void container_buf_release(const container_job_t *job, aes_pool_worker_t *w, uint8_t *buf)
+{
+    aes_memzero(buf, job->info.chunk_size);
+    if (buf != w->scratch) {
+        free(buf);
+    }
+}
+
+/**
+ * @brief seal one chunk
+ * @param[in,out] arg pointer to the container_job_t
+ * @param[in] task chunk number
+ * @param[in,out] w pool worker, its key replica and scratch are used
+ */
+static void container_seal_task(void *arg, uint64_t task, aes_pool_worker_t *w)
+{
+    container_job_t *job = arg;
+    uint64_t chunk = job->first + task;
+    uint8_t iv[AES_GCM_IV_SIZE];
+    uint8_t aad[AES_CONTAINER_HEADER_SIZE + 8];
+    uint8_t *buf;
+    size_t n;
+    aes_status_t status;
+
+    if (__atomic_load_n(&job->status, __ATOMIC_RELAXED) != AES_OK) {
+        return;
+    }
+    buf = container_buf(job, w);
+    if (buf == NULL) {
+        container_fail(job, AES_ERR_NOMEM);
+        return;
+    }
+    n = container_chunk_len(job, chunk);
+    container_chunk_params(job, chunk, iv, aad);
+    status = container_pread(job->in_fd, buf, n, chunk*job->info.chunk_size);
+    if (status == AES_OK) {
+        status = aes_gcm_encrypt(w->ctx, iv, sizeof(iv), buf, job->tags + chunk*AES_GCM_TAG_SIZE,
+                                 buf, n, aad, sizeof(aad));
+    }
+    if (status == AES_OK) {
+        status = container_pwrite(job->out_fd, buf, n,
+                                  job->info.data_offset + chunk*job->info.chunk_size);
+    }
+    if (status != AES_OK) {
+        container_fail(job, status);
+    }
+    container_buf_release(job, w, buf);
+}
+
+/**
+ * @brief open one chunk of the requested range
+ * @param[in,out] arg pointer to the container_job_t
+ * @param[in] task chunk number relative to the first chunk of the range
+ * @param[in,out] w pool worker, its key replica and scratch are used
+ */
+static void container_read_task(void *arg, uint64_t task, aes_pool_worker_t *w)
+{
+    container_job_t *job = arg;
+    uint64_t chunk = job->first + task;
+    uint64_t start = chunk*job->info.chunk_size;
+    uint8_t iv[AES_GCM_IV_SIZE];
+    uint8_t aad[AES_CONTAINER_HEADER_SIZE + 8];
+    uint64_t lo, hi;
+    uint8_t *buf = NULL;
+    uint8_t *dst;
+    size_t n;
+    aes_status_t status;
+
+    if (__atomic_load_n(&job->status, __ATOMIC_RELAXED) != AES_OK) {
+        return;
+    }
+    n = container_chunk_len(job, chunk);
+    lo = (job->offset > start) ? job->offset : start;
+    hi = (job->offset + job->len < start + n) ? job->offset + job->len : start + n;
+    /* whole chunks are deciphered in place in the output */
+    if ((lo == start) && (hi == start + n)) {
+        dst = job->out + (start - job->offset);
+    } else {
+        buf = container_buf(job, w);
+        if (buf == NULL) {
+            container_fail(job, AES_ERR_NOMEM);
+            return;
+        }
+        dst = buf;
+    }
+    container_chunk_params(job, chunk, iv, aad);
+    status = container_pread(job->in_fd, dst, n, job->info.data_offset + start);
+    if (status == AES_OK) {
+        status = aes_gcm_decrypt(w->ctx, iv, sizeof(iv), dst, dst, n,
+                                 job->tags + task*AES_GCM_TAG_SIZE, aad, sizeof(aad));
+    }
+    if (status != AES_OK) {
+        container_fail(job, status);
+    } else if (buf != NULL) {
+        memcpy(job->out + (lo - job->offset), buf + (lo - start), hi - lo);
+    }
+    if (buf != NULL) {
+        container_buf_release(job, w, buf);
+    }
+}
+
+/**
+ * @brief run the chunks of a job on the process-wide pool
+ * @param[in,out] job seal or read job, status set on failure
+ * @param[in] fn container_seal_task or container_read_task
+ * @param[in] threads most workers to use
+ */
+static void container_run(container_job_t *job, aes_pool_fn_t fn, uint32_t threads)
+{
+    aes_pool_t *pool = aes_pool_default();
+
+    if ((pool == NULL) ||
+        (aes_pool_run(pool, fn, job, job->ctx, job->end - job->first, threads) != AES_OK)) {
+        container_fail(job, AES_ERR_NOMEM);
+    }
+}
+
+/**
+ * @brief parse and check a header
+ * @param[in] header AES_CONTAINER_HEADER_SIZE bytes
+ * @param[out] info receives the geometry
+ * @return AES_OK or AES_ERR_PARAM if this is not a valid container header
+ */
+static aes_status_t container_parse(const uint8_t *header, aes_container_info_t *info)
+{
+    uint8_t zero = 0;
+
+    if ((memcmp(header, container_magic, sizeof(container_magic)) != 0) ||
+        (header[HDR_VERSION] != AES_CONTAINER_VERSION)) {
+        return AES_ERR_PARAM;
+    }
+    /* reserved bytes, zero in version 1 */
+    for (uint32_t i=HDR_VERSION+1;i<HDR_CHUNK_SIZE;i++) {
+        zero |= header[i];
+    }
+    for (uint32_t i=HDR_CHUNK_SIZE+4;i<HDR_LENGTH;i++) {
+        zero |= header[i];
+    }
+    for (uint32_t i=HDR_END;i<AES_CONTAINER_HEADER_SIZE;i++) {
+        zero |= header[i];
+    }
+    info->chunk_size = (uint32_t)container_get_be(header + HDR_CHUNK_SIZE, 4);
+    info->length = container_get_be(header + HDR_LENGTH, 8);
+    info->nchunks = container_get_be(header + HDR_NCHUNKS, 8);
+    if ((zero != 0) || (info->chunk_size < AES_CONTAINER_MIN_CHUNK) ||
+        (info->chunk_size > AES_CONTAINER_MAX_CHUNK) || (info->chunk_size % AES_BLOCK_SIZE != 0) ||
+        (info->nchunks != (info->length + info->chunk_size - 1)/info->chunk_size)) {
+        return AES_ERR_PARAM;
+    }
+    info->data_offset = AES_CONTAINER_HEADER_SIZE + info->nchunks*AES_GCM_TAG_SIZE;
+    return AES_OK;
+}
+
+/**
+ * @brief encrypt a file into a container
+ * @param[in] ctx pointer to the key context
+ * @param[in] out_fd container file, written with pwrite from offset 0
+ * @param[in] in_fd plaintext file, read with pread, its size is taken by fstat;
+ * it must be a regular file, a pipe or a device is refused
+ * @param[in] chunk_size plaintext bytes per chunk, multiple of 16 from
+ * AES_CONTAINER_MIN_CHUNK to AES_CONTAINER_MAX_CHUNK
+ * @param[in] threads number of threads sealing chunks
+ * @return AES_OK, AES_ERR_PARAM on a bad parameter or a non-regular input,
+ * or another AES_ERR_* code
+ * @note every container gets a fresh random nonce, so one key may seal many
+ * files
+ */
+aes_status_t aes_container_seal(const aes_ctx_t *ctx, int out_fd, int in_fd,
+                                uint32_t chunk_size, uint32_t threads)
+{
+    container_job_t job;
+    struct stat st;
+    aes_status_t status;
+
+    if ((ctx == NULL) || (out_fd < 0) || (in_fd < 0) || (chunk_size < AES_CONTAINER_MIN_CHUNK) ||
+        (chunk_size > AES_CONTAINER_MAX_CHUNK) || (chunk_size % AES_BLOCK_SIZE != 0)) {
+        return AES_ERR_PARAM;
+    }
+    if (fstat(in_fd, &st) != 0) {
+        return AES_ERR_IO;
+    }
+    /* st_size is only the plaintext length of a regular file */
+    if (!S_ISREG(st.st_mode)) {
+        return AES_ERR_PARAM;
+    }
+    memset(&job, 0, sizeof(job));
+    job.ctx = ctx;
+    job.in_fd = in_fd;
+    job.out_fd = out_fd;
+    job.info.chunk_size = chunk_size;
+    job.info.length = (uint64_t)st.st_size;
+    job.info.nchunks = (job.info.length + chunk_size - 1)/chunk_size;
+    job.info.data_offset = AES_CONTAINER_HEADER_SIZE + job.info.nchunks*AES_GCM_TAG_SIZE;
+    memcpy(job.header, container_magic, sizeof(container_magic));
+    job.header[HDR_VERSION] = AES_CONTAINER_VERSION;
+    container_put_be(job.header + HDR_CHUNK_SIZE, chunk_size, 4);
+    container_put_be(job.header + HDR_LENGTH, job.info.length, 8);
+    container_put_be(job.header + HDR_NCHUNKS, job.info.nchunks, 8);
+    status = aes_rand_bytes(job.header + HDR_NONCE, AES_GCM_IV_SIZE);
+    if (status != AES_OK) {
+        return status;
+    }
+    job.tags = malloc((size_t)job.info.nchunks*AES_GCM_TAG_SIZE + 1);
+    if (job.tags == NULL) {
+        return AES_ERR_NOMEM;
+    }
+    job.end = job.info.nchunks;
+    container_run(&job, container_seal_task, threads);
+    status = job.status;
+    if (status == AES_OK) {
+        status = container_pwrite(out_fd, job.header, AES_CONTAINER_HEADER_SIZE, 0);
+    }
+    if (status == AES_OK) {
+        status = container_pwrite(out_fd, job.tags, (size_t)job.info.nchunks*AES_GCM_TAG_SIZE,
+                                  AES_CONTAINER_HEADER_SIZE);
+    }
+    free(job.tags);
+    return status;
+}
+
+/**
+ * @brief read the geometry of a container
+ * @param[in] fd container file
+ * @param[out] info receives the geometry
+ * @return AES_OK, AES_ERR_IO, or AES_ERR_PARAM if fd is not a container
+ * @note the header is only authenticated when a chunk is opened
+ */
+aes_status_t aes_container_info(int fd, aes_container_info_t *info)
+{
+    uint8_t header[AES_CONTAINER_HEADER_SIZE];
+    aes_status_t status;
+
+    if ((fd < 0) || (info == NULL)) {
+        return AES_ERR_PARAM;
+    }
+    status = container_pread(fd, header, sizeof(header), 0);
+    if (status != AES_OK) {
+        return status;
+    }
+    return container_parse(header, info);
+}
+
+/**
+ * @brief decrypt a byte range of a container
+ * @param[in] ctx pointer to the key context
+ * @param[in] fd container file
+ * @param[out] out len bytes
+ * @param[in] offset first plaintext byte
+ * @param[in] len number of bytes, offset+len at most the plaintext length
+ * @param[in] threads number of threads opening chunks
+ * @return AES_OK, AES_ERR_AUTH if a covered chunk or the header was
+ * altered, or another AES_ERR_* code
+ * @note only the chunks covering the range are read and authenticated; on
+ * failure out is cleared
+ */
+aes_status_t aes_container_read(const aes_ctx_t *ctx, int fd, uint8_t *out,
+                                uint64_t offset, size_t len, uint32_t threads)
+{
+    container_job_t job;
+    size_t tags_len;
+    aes_status_t status;
+
+    if ((ctx == NULL) || (fd < 0) || ((len != 0) && (out == NULL))) {
+        return AES_ERR_PARAM;
+    }
+    memset(&job, 0, sizeof(job));
+    status = container_pread(fd, job.header, AES_CONTAINER_HEADER_SIZE, 0);
+    if (status == AES_OK) {
+        status = container_parse(job.header, &job.info);
+    }
+    if (status != AES_OK) {
+        return status;
+    }
+    if ((offset > job.info.length) || (len > job.info.length - offset)) {
+        return AES_ERR_LENGTH;
+    }
+    if (len == 0) {
+        return AES_OK;
+    }
+    job.ctx = ctx;
+    job.in_fd = fd;
+    job.out = out;
+    job.offset = offset;
+    job.len = len;
+    job.first = offset/job.info.chunk_size;
+    job.end = (offset + len - 1)/job.info.chunk_size + 1;
+    tags_len = (size_t)(job.end - job.first)*AES_GCM_TAG_SIZE;
+    job.tags = malloc(tags_len);
+    if (job.tags == NULL) {
+        return AES_ERR_NOMEM;
+    }
+    status = container_pread(fd, job.tags, tags_len,
+                             AES_CONTAINER_HEADER_SIZE + job.first*AES_GCM_TAG_SIZE);
+    if (status == AES_OK) {
+        container_run(&job, container_read_task, threads);
+        status = job.status;
+    }
+    if (status != AES_OK) {
+        aes_memzero(out, len);
+    }
+    free(job.tags);
+    return status;
+}
+
+#undef AES_CONTAINER_C
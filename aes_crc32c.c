@@ -0,0 +1,316 @@
+/**
+ * @file aes_crc32c.c
+ * @brief CRC32C, alone and fused with the CTR keystream XOR
+ *
+ * The fused call reads each input word once: it is XORed with the keystream,
+ * stored, and the input or the output word is folded into the checksum
+ * while still in a register. The keystream is produced AES_LIB_BATCH blocks
+ * at a time in an L1-resident buffer, so the data buffer is streamed
+ * through the memory hierarchy a single time instead of once for the cipher
+ * and once for the checksum.
+*/
+
+#define AES_CRC32C_C
+#define AES_LIB_PRIVATE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_engine.h"
+#include "aes_stats.h"
+#include "aes_lib.h"
+#include "aes_crc32c.h"
+
+/* crc_table[k][b]: CRC of byte b followed by k zero bytes */
+static uint32_t crc_table[8][256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+static uint32_t crc_hw;
+
+static uint64_t crc_load64(const uint8_t *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void crc_store64(uint8_t *p, uint64_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <nmmintrin.h>
+
+#define CRC_TARGET  __attribute__((target("sse4.2")))
+
+static uint32_t crc_hw_check(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2") ? 1 : 0;
+}
+
+/**
+ * @brief fold a little-endian 64-bit word with the CRC32 instruction
+ * @param[in] crc running register
+ * @param[in] v word
+ * @return updated register
+ */
+CRC_TARGET
+static inline uint32_t crc_hw_word(uint32_t crc, uint64_t v)
+{
+#if defined(__x86_64__)
+    return (uint32_t)_mm_crc32_u64(crc, v);
+#else
+    crc = _mm_crc32_u32(crc, (uint32_t)v);
+    return _mm_crc32_u32(crc, (uint32_t)(v >> 32));
+#endif
+}
+
+CRC_TARGET
+static uint32_t crc_hw_raw(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    size_t i = 0;
+
+    for (;i+8<=len;i+=8) {
+        crc = crc_hw_word(crc, crc_load64(buf + i));
+    }
+    for (;i<len;i++) {
+        crc = _mm_crc32_u8(crc, buf[i]);
+    }
+    return crc;
+}
+
+CRC_TARGET
+static uint32_t crc_hw_xor(uint32_t crc, uint8_t *out, const uint8_t *in, const uint8_t *ks,
+                           size_t len, uint32_t sum_out)
+{
+    size_t i = 0;
+
+    for (;i+8<=len;i+=8) {
+        uint64_t a = crc_load64(in + i);
+        uint64_t x = a ^ crc_load64(ks + i);
+
+        crc_store64(out + i, x);
+        crc = crc_hw_word(crc, sum_out ? x : a);
+    }
+    for (;i<len;i++) {
+        uint8_t a = in[i];
+        uint8_t x = (uint8_t)(a ^ ks[i]);
+
+        out[i] = x;
+        crc = _mm_crc32_u8(crc, sum_out ? x : a);
+    }
+    return crc;
+}
+
+#else /* not x86 */
+
+static uint32_t crc_hw_check(void)
+{
+    return 0;
+}
+
+static uint32_t crc_hw_raw(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    (void)buf;
+    (void)len;
+    return crc;
+}
+
+static uint32_t crc_hw_xor(uint32_t crc, uint8_t *out, const uint8_t *in, const uint8_t *ks,
+                           size_t len, uint32_t sum_out)
+{
+    (void)out;
+    (void)in;
+    (void)ks;
+    (void)len;
+    (void)sum_out;
+    return crc;
+}
+
+#endif
+
+/**
+ * @brief build the slicing-by-8 tables and probe the CPU
+ */
+static void crc_init(void)
+{
+    for (uint32_t b=0;b<256;b++) {
+        uint32_t c = b;
+
+        for (uint32_t k=0;k<8;k++) {
+            c = (c >> 1) ^ ((c & 1) ? AES_CRC32C_POLY : 0);
+        }
+        crc_table[0][b] = c;
+    }
+    for (uint32_t b=0;b<256;b++) {
+        for (uint32_t k=1;k<8;k++) {
+            uint32_t c = crc_table[k-1][b];
+
+            crc_table[k][b] = (c >> 8) ^ crc_table[0][c & 0xff];
+        }
+    }
+    crc_hw = crc_hw_check();
+}
+
+/**
+ * @brief fold a 64-bit word read little-endian through the tables
+ * @param[in] crc running register
+ * @param[in] p 8 bytes
+ * @return updated register
+ */
+static inline uint32_t crc_sw_word(uint32_t crc, const uint8_t *p)
+{
+    uint32_t lo = crc ^ ((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+                         ((uint32_t)p[3] << 24));
+
+    return crc_table[7][lo & 0xff] ^ crc_table[6][(lo >> 8) & 0xff] ^
+           crc_table[5][(lo >> 16) & 0xff] ^ crc_table[4][lo >> 24] ^
+           crc_table[3][p[4]] ^ crc_table[2][p[5]] ^ crc_table[1][p[6]] ^ crc_table[0][p[7]];
+}
+
+static uint32_t crc_sw_raw(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    size_t i = 0;
+
+    for (;i+8<=len;i+=8) {
+        crc = crc_sw_word(crc, buf + i);
+    }
+    for (;i<len;i++) {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ buf[i]) & 0xff];
+    }
+    return crc;
+}
+
+static uint32_t crc_sw_xor(uint32_t crc, uint8_t *out, const uint8_t *in, const uint8_t *ks,
+                           size_t len, uint32_t sum_out)
+{
+    size_t i = 0;
+
+    for (;i+8<=len;i+=8) {
+        uint8_t a[8];
+        uint64_t x;
+
+        memcpy(a, in + i, sizeof(a));
+        x = crc_load64(a) ^ crc_load64(ks + i);
+        crc_store64(out + i, x);
+        crc = crc_sw_word(crc, sum_out ? (out + i) : a);
+    }
+    for (;i<len;i++) {
+        uint8_t a = in[i];
+        uint8_t x = (uint8_t)(a ^ ks[i]);
+
+        out[i] = x;
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ (sum_out ? x : a)) & 0xff];
+    }
+    return crc;
+}
+
+/**
+ * @brief check the CPU for the SSE4.2 CRC32 instruction
+ * @return 1 if aes_crc32c uses the instruction, 0 for the tables
+ */
+int32_t aes_crc32c_hw_supported(void)
+{
+    pthread_once(&crc_once, crc_init);
+    return (int32_t)crc_hw;
+}
+
+/**
+ * @brief update a CRC32C register without the pre and post inversions
+ * @param[in] crc running register
+ * @param[in] buf data
+ * @param[in] len data length in bytes
+ * @param[in] hw 1 for the CRC32 instruction, 0 for the tables
+ * @return updated register
+ */
+uint32_t aes_crc32c_raw(uint32_t crc, const uint8_t *buf, size_t len, uint32_t hw)
+{
+    pthread_once(&crc_once, crc_init);
+    return (hw && crc_hw) ? crc_hw_raw(crc, buf, len) : crc_sw_raw(crc, buf, len);
+}
+
+/**
+ * @brief out = in ^ ks and update a CRC32C register with in or out
+ * @param[in] crc running register, without inversions
+ * @param[out] out output, may alias in
+ * @param[in] in input
+ * @param[in] ks keystream
+ * @param[in] len length in bytes
+ * @param[in] sum_out 1 to checksum out, 0 to checksum in
+ * @param[in] hw 1 for the CRC32 instruction, 0 for the tables
+ * @return updated register
+ */
+uint32_t aes_crc32c_xor(uint32_t crc, uint8_t *out, const uint8_t *in, const uint8_t *ks,
+                        size_t len, uint32_t sum_out, uint32_t hw)
+{
+    pthread_once(&crc_once, crc_init);
+    return (hw && crc_hw) ? crc_hw_xor(crc, out, in, ks, len, sum_out) :
+                            crc_sw_xor(crc, out, in, ks, len, sum_out);
+}
+
+/**
+ * @brief CRC32C of a buffer
+ * @param[in] crc previous checksum to continue, 0 for a new one
+ * @param[in] buf data, may be NULL if len is 0
+ * @param[in] len data length in bytes
+ * @return checksum, aes_crc32c(0, "123456789", 9) is 0xe3069283
+ */
+uint32_t aes_crc32c(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    if (len == 0) {
+        return crc;
+    }
+    return ~aes_crc32c_raw(~crc, buf, len, 1);
+}
+
+/**
+ * @brief CTR encryption/decryption with the CRC32C of the input or output
+ * computed in the same pass
+ * @param[in] ctx pointer to the key context
+ * @param[in,out] counter 16-byte initial counter block, advanced as by
+ * aes_ctr_crypt
+ * @param[out] out output, may alias in
+ * @param[in] in input
+ * @param[in] len length in bytes, any value
+ * @param[in] flags AES_CRC32C_INPUT or AES_CRC32C_OUTPUT
+ * @param[in,out] crc checksum to continue (0 for a new one), receives the
+ * checksum including this call
+ * @return AES_OK or AES_ERR_PARAM
+ * @note on the encrypt side AES_CRC32C_INPUT sums the plaintext and
+ * AES_CRC32C_OUTPUT the ciphertext, the other way round when deciphering
+ */
+aes_status_t aes_ctr_crypt_crc32c(const aes_ctx_t *ctx, uint8_t counter[AES_LIB_BLOCK_SIZE],
+                                  uint8_t *out, const uint8_t *in, size_t len,
+                                  uint32_t flags, uint32_t *crc)
+{
+    uint8_t ks[AES_LIB_BATCH*AES_BLOCK_SIZE];
+    uint32_t reg;
+
+    if ((ctx == NULL) || (counter == NULL) || (crc == NULL) || (flags > AES_CRC32C_OUTPUT) ||
+        ((len != 0) && ((out == NULL) || (in == NULL)))) {
+        return AES_ERR_PARAM;
+    }
+    aes_stats_add_blocks(ctx->engine->id, AES_STATS_MODE_CTR, ctx->sched.length,
+                         AES_STATS_DIR_ENC, (len + AES_BLOCK_SIZE - 1)/AES_BLOCK_SIZE);
+    reg = ~*crc;
+    for (size_t off=0;off<len;off+=sizeof(ks)) {
+        size_t n = (len - off < sizeof(ks)) ? (len - off) : sizeof(ks);
+        size_t nblocks = (n + AES_BLOCK_SIZE - 1)/AES_BLOCK_SIZE;
+
+        aes_ctr_blocks(ks, counter, nblocks);
+        ctx->engine->encrypt(&ctx->sched, ks, ks, nblocks);
+        reg = aes_crc32c_xor(reg, out + off, in + off, ks, n, flags == AES_CRC32C_OUTPUT, 1);
+    }
+    *crc = ~reg;
+    aes_memzero(ks, sizeof(ks));
+    return AES_OK;
+}
+
+#undef AES_CRC32C_C
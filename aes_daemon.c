@@ -0,0 +1,981 @@
+/**
+ * @file aes_daemon.c
+ * @brief libaes local encryption daemon, its client calls and load generator
+ *
+ * Clients send one request per SOCK_SEQPACKET message, so the kernel keeps
+ * message boundaries and a payload is received straight into the batch
+ * buffer. The first request of a batch arms a timerfd with the latency
+ * budget; the batch is ciphered when the timer fires or when it reaches
+ * the block threshold. All CTR counter blocks and ECB blocks of a batch,
+ * whatever client they came from, go through the engine in one call per
+ * direction run, then each reply is sent with its own header.
+ *
+ * A reply that does not fit in the socket of its client is queued on the
+ * client, which is then watched for EPOLLOUT instead of EPOLLIN: its
+ * requests are not read again until the queued replies are sent, so a
+ * pipelining client is slowed down to the pace it reads at, not dropped.
+*/
+
+#define AES_DAEMON_C
+#define AES_LIB_PRIVATE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_engine.h"
+#include "aes_stats.h"
+#include "aes_lib.h"
+#include "aes_daemon.h"
+
+/* "AESD", first word of every request and reply */
+#define DAEMON_MAGIC        0x41455344
+/* events handled per epoll_wait */
+#define DAEMON_EVENTS       64
+/* requests read from one client before serving the next, for fairness */
+#define DAEMON_CLIENT_BURST 64
+/* epoll_wait timeout, bounds the reaction time to the stop flag */
+#define DAEMON_POLL_MSEC    200
+/* latency samples kept per load generator connection */
+#define LOADGEN_SAMPLES     (1 << 16)
+
+/* header of a request and of its reply, the payload follows */
+typedef struct daemon_msg_s {
+    uint32_t magic;
+    uint16_t op;
+    int16_t status;                 /* reply only, aes_status_t */
+    uint32_t id;                    /* echoed in the reply */
+    uint32_t len;                   /* payload bytes */
+    uint8_t iv[AES_BLOCK_SIZE];     /* CTR counter, advanced in the reply */
+} daemon_msg_t;
+
+/* reply waiting for room in the socket of its client */
+typedef struct daemon_out_s {
+    struct daemon_out_s *next;
+    daemon_msg_t hdr;
+    uint8_t payload[];
+} daemon_out_t;
+
+/* connected client */
+typedef struct daemon_client_s {
+    int fd;
+    uint32_t failed;                /* a send failed, closed on its hang-up */
+    daemon_out_t *head;             /* replies not sent yet, in order */
+    daemon_out_t *tail;
+} daemon_client_t;
+
+/* request waiting in the batch */
+typedef struct daemon_req_s {
+    daemon_client_t *client;
+    daemon_msg_t hdr;
+    size_t block;                   /* first block of its slot in data/ks */
+    size_t nblocks;
+} daemon_req_t;
+
+typedef struct daemon_s {
+    aes_ctx_t *ctx;
+    int lfd;
+    int epfd;
+    int tfd;
+    uint32_t latency_usec;
+    uint32_t batch_blocks;
+    /* batch: payloads in data, keystream or ECB output in ks, same slots */
+    uint8_t *data;
+    uint8_t *ks;
+    size_t cap_blocks;
+    size_t used_blocks;
+    daemon_req_t *reqs;
+    size_t nreq;
+    size_t max_req;
+    uint32_t armed;
+    /* connected clients, closed on exit */
+    daemon_client_t **clients;
+    size_t nclients;
+    size_t max_clients;
+    aes_daemon_stats_t stats;
+} daemon_t;
+
+/**
+ * @brief send a header and its payload as one message
+ * @param[in] fd connected socket
+ * @param[in] hdr message header
+ * @param[in] payload hdr->len bytes, may be NULL if hdr->len is 0
+ * @param[in] flags sendmsg flags added to MSG_NOSIGNAL
+ * @return 0 on success, -2 on EAGAIN, -1 on error
+ */
+static int32_t daemon_send(int fd, const daemon_msg_t *hdr, const uint8_t *payload, int flags)
+{
+    struct iovec iov[2];
+    struct msghdr msg;
+    ssize_t n;
+
+    iov[0].iov_base = (void *)(uintptr_t)hdr;
+    iov[0].iov_len = sizeof(daemon_msg_t);
+    iov[1].iov_base = (void *)(uintptr_t)payload;
+    iov[1].iov_len = hdr->len;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (hdr->len != 0) ? 2 : 1;
+    do {
+        n = sendmsg(fd, &msg, MSG_NOSIGNAL | flags);
+    } while ((n < 0) && (errno == EINTR));
+    if (n < 0) {
+        return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? -2 : -1;
+    }
+    return (n == (ssize_t)(sizeof(daemon_msg_t) + hdr->len)) ? 0 : -1;
+}
+
+/**
+ * @brief receive one message into a header and a payload buffer
+ * @param[in] fd connected socket
+ * @param[out] hdr message header
+ * @param[out] payload receives the payload
+ * @param[in] size payload buffer size
+ * @param[in] flags recvmsg flags
+ * @return payload bytes, -1 on a malformed or truncated message, -2 on
+ * EAGAIN, -3 on error or end of connection
+ */
+static ssize_t daemon_recv(int fd, daemon_msg_t *hdr, uint8_t *payload, size_t size, int flags)
+{
+    struct iovec iov[2];
+    struct msghdr msg;
+    ssize_t n;
+
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = sizeof(daemon_msg_t);
+    iov[1].iov_base = payload;
+    iov[1].iov_len = size;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    do {
+        n = recvmsg(fd, &msg, flags);
+    } while ((n < 0) && (errno == EINTR));
+    if (n < 0) {
+        return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? -2 : -3;
+    }
+    if (n == 0) {
+        return -3;
+    }
+    if (((msg.msg_flags & MSG_TRUNC) != 0) || ((size_t)n < sizeof(daemon_msg_t)) ||
+        (hdr->magic != DAEMON_MAGIC) || ((size_t)n - sizeof(daemon_msg_t) != hdr->len)) {
+        return -1;
+    }
+    return n - (ssize_t)sizeof(daemon_msg_t);
+}
+
+/**
+ * @brief select the events a client is watched for
+ * @param[in] d daemon state
+ * @param[in] c client
+ * @param[in] events EPOLLIN to read requests, EPOLLOUT to send queued replies
+ */
+static void daemon_watch(const daemon_t *d, daemon_client_t *c, uint32_t events)
+{
+    struct epoll_event ev;
+
+    ev.events = events;
+    ev.data.ptr = c;
+    epoll_ctl(d->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+/**
+ * @brief give up on a client after a send error
+ * @param[in,out] c client
+ * @note the hang-up event that follows closes the client
+ */
+static void daemon_fail(daemon_client_t *c)
+{
+    c->failed = 1;
+    shutdown(c->fd, SHUT_RDWR);
+}
+
+/**
+ * @brief send a reply to a client, or queue it if its socket is full
+ * @param[in,out] d daemon state
+ * @param[in,out] c client
+ * @param[in] hdr reply header
+ * @param[in] payload hdr->len bytes, may be NULL if hdr->len is 0
+ */
+static void daemon_reply(daemon_t *d, daemon_client_t *c, const daemon_msg_t *hdr,
+                         const uint8_t *payload)
+{
+    daemon_out_t *o;
+
+    if (c->failed) {
+        return;
+    }
+    /* replies already queued go first */
+    if (c->head == NULL) {
+        int32_t ret = daemon_send(c->fd, hdr, payload, 0);
+
+        if (ret == 0) {
+            return;
+        }
+        if (ret == -1) {
+            daemon_fail(c);
+            return;
+        }
+    }
+    o = malloc(sizeof(daemon_out_t) + hdr->len);
+    if (o == NULL) {
+        daemon_fail(c);
+        return;
+    }
+    o->next = NULL;
+    memcpy(&o->hdr, hdr, sizeof(daemon_msg_t));
+    if (hdr->len != 0) {
+        memcpy(o->payload, payload, hdr->len);
+    }
+    if (c->head == NULL) {
+        c->head = o;
+        d->stats.deferred++;
+        daemon_watch(d, c, EPOLLOUT);
+    } else {
+        c->tail->next = o;
+    }
+    c->tail = o;
+}
+
+/**
+ * @brief send the queued replies of a client while its socket has room
+ * @param[in,out] d daemon state
+ * @param[in,out] c client
+ * @return 0 while the client is usable, -1 once it must be closed
+ * @note once the queue is empty the requests of the client are read again
+ */
+static int32_t daemon_drain(daemon_t *d, daemon_client_t *c)
+{
+    while (c->head != NULL) {
+        daemon_out_t *o = c->head;
+        int32_t ret = daemon_send(c->fd, &o->hdr, o->payload, 0);
+
+        if (ret == -2) {
+            return 0;
+        }
+        if (ret != 0) {
+            return -1;
+        }
+        c->head = o->next;
+        aes_memzero(o->payload, o->hdr.len);
+        free(o);
+    }
+    c->tail = NULL;
+    daemon_watch(d, c, EPOLLIN);
+    return 0;
+}
+
+/**
+ * @brief cipher the batch and send every reply
+ * @param[in,out] d daemon state, batch emptied on return
+ */
+static void daemon_flush(daemon_t *d)
+{
+    const aes_ctx_t *ctx = d->ctx;
+    size_t i = 0;
+
+    if (d->nreq == 0) {
+        return;
+    }
+    if (d->armed) {
+        struct itimerspec off;
+
+        memset(&off, 0, sizeof(off));
+        timerfd_settime(d->tfd, 0, &off, NULL);
+        d->armed = 0;
+    }
+    /* one engine call per run of requests ciphering in the same direction */
+    while (i < d->nreq) {
+        uint32_t dec = (d->reqs[i].hdr.op == AES_DAEMON_OP_ECB_DECRYPT);
+        size_t first = d->reqs[i].block;
+        size_t ctr_blocks = 0;
+        size_t ecb_blocks = 0;
+
+        for (;(i < d->nreq) && ((d->reqs[i].hdr.op == AES_DAEMON_OP_ECB_DECRYPT) == dec);i++) {
+            daemon_req_t *r = &d->reqs[i];
+            uint8_t *slot = d->ks + r->block*AES_BLOCK_SIZE;
+
+            /* keystream and ECB input share the ks slots of the run */
+            if (r->hdr.op == AES_DAEMON_OP_CTR) {
+                aes_ctr_blocks(slot, r->hdr.iv, r->nblocks);
+                ctr_blocks += r->nblocks;
+            } else {
+                if (!dec) {
+                    memcpy(slot, d->data + r->block*AES_BLOCK_SIZE, r->nblocks*AES_BLOCK_SIZE);
+                }
+                ecb_blocks += r->nblocks;
+            }
+        }
+        if (dec) {
+            ctx->engine->decrypt(&ctx->sched, d->ks + first*AES_BLOCK_SIZE,
+                                 d->data + first*AES_BLOCK_SIZE, ecb_blocks);
+        } else {
+            ctx->engine->encrypt(&ctx->sched, d->ks + first*AES_BLOCK_SIZE,
+                                 d->ks + first*AES_BLOCK_SIZE, ctr_blocks + ecb_blocks);
+        }
+        if (ctr_blocks != 0) {
+            aes_stats_add_blocks(ctx->engine->id, AES_STATS_MODE_CTR, ctx->sched.length,
+                                 AES_STATS_DIR_ENC, ctr_blocks);
+        }
+        if (ecb_blocks != 0) {
+            aes_stats_add_blocks(ctx->engine->id, AES_STATS_MODE_ECB, ctx->sched.length,
+                                 dec ? AES_STATS_DIR_DEC : AES_STATS_DIR_ENC, ecb_blocks);
+        }
+    }
+    for (i=0;i<d->nreq;i++) {
+        daemon_req_t *r = &d->reqs[i];
+        uint8_t *data = d->data + r->block*AES_BLOCK_SIZE;
+        uint8_t *ks = d->ks + r->block*AES_BLOCK_SIZE;
+        const uint8_t *reply = ks;
+
+        if (r->hdr.op == AES_DAEMON_OP_CTR) {
+            aes_xor_blocks(data, data, ks, r->hdr.len);
+            reply = data;
+        }
+        r->hdr.status = AES_OK;
+        daemon_reply(d, r->client, &r->hdr, reply);
+    }
+    d->stats.batches++;
+    d->stats.requests += d->nreq;
+    d->stats.blocks += d->used_blocks;
+    aes_memzero(d->data, d->used_blocks*AES_BLOCK_SIZE);
+    aes_memzero(d->ks, d->used_blocks*AES_BLOCK_SIZE);
+    d->nreq = 0;
+    d->used_blocks = 0;
+}
+
+/**
+ * @brief read the pending requests of a client into the batch
+ * @param[in,out] d daemon state
+ * @param[in,out] c client
+ * @return 0 while the client is connected, -1 once it must be closed
+ * @note stops early once a reply of the client had to be queued
+ */
+static int32_t daemon_read(daemon_t *d, daemon_client_t *c)
+{
+    for (uint32_t burst=0;(burst<DAEMON_CLIENT_BURST) && (c->head == NULL);burst++) {
+        daemon_req_t *r = &d->reqs[d->nreq];
+        /* the block threshold is below cap_blocks by a full payload */
+        ssize_t n = daemon_recv(c->fd, &r->hdr, d->data + d->used_blocks*AES_BLOCK_SIZE,
+                                AES_DAEMON_MAX_PAYLOAD, MSG_DONTWAIT);
+
+        if (n == -2) {
+            return 0;
+        }
+        if (n == -3) {
+            return -1;
+        }
+        if ((n == -1) || (r->hdr.op > AES_DAEMON_OP_STATS) ||
+            ((r->hdr.op != AES_DAEMON_OP_CTR) && (r->hdr.len % AES_BLOCK_SIZE != 0))) {
+            r->hdr.magic = DAEMON_MAGIC;
+            r->hdr.status = (n == -1) ? AES_ERR_PARAM : AES_ERR_LENGTH;
+            r->hdr.len = 0;
+            daemon_reply(d, c, &r->hdr, NULL);
+            continue;
+        }
+        if (r->hdr.op == AES_DAEMON_OP_STATS) {
+            r->hdr.status = AES_OK;
+            r->hdr.len = sizeof(aes_daemon_stats_t);
+            daemon_reply(d, c, &r->hdr, (const uint8_t *)&d->stats);
+            continue;
+        }
+        r->client = c;
+        r->block = d->used_blocks;
+        r->nblocks = (r->hdr.len + AES_BLOCK_SIZE - 1)/AES_BLOCK_SIZE;
+        d->used_blocks += r->nblocks;
+        d->nreq++;
+        if ((d->used_blocks >= d->batch_blocks) || (d->nreq == d->max_req)) {
+            daemon_flush(d);
+        } else if ((d->nreq == 1) && (d->latency_usec != 0)) {
+            struct itimerspec when;
+
+            memset(&when, 0, sizeof(when));
+            when.it_value.tv_sec = d->latency_usec/1000000;
+            when.it_value.tv_nsec = (long)(d->latency_usec % 1000000)*1000;
+            timerfd_settime(d->tfd, 0, &when, NULL);
+            d->armed = 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief accept the pending connections
+ * @param[in,out] d daemon state
+ */
+static void daemon_accept(daemon_t *d)
+{
+    int fd;
+
+    while ((fd = accept(d->lfd, NULL, NULL)) >= 0) {
+        struct epoll_event ev;
+        daemon_client_t *c;
+
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        if (d->nclients == d->max_clients) {
+            size_t cap = (d->max_clients != 0) ? 2*d->max_clients : 16;
+            daemon_client_t **clients = realloc(d->clients, cap*sizeof(daemon_client_t *));
+
+            if (clients == NULL) {
+                close(fd);
+                continue;
+            }
+            d->clients = clients;
+            d->max_clients = cap;
+        }
+        c = calloc(1, sizeof(daemon_client_t));
+        if (c == NULL) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        if (epoll_ctl(d->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            free(c);
+            close(fd);
+            continue;
+        }
+        d->clients[d->nclients++] = c;
+    }
+}
+
+/**
+ * @brief close a client socket and release its queued replies
+ * @param[in,out] c client, freed on return
+ */
+static void daemon_client_free(daemon_client_t *c)
+{
+    close(c->fd);
+    while (c->head != NULL) {
+        daemon_out_t *o = c->head;
+
+        c->head = o->next;
+        aes_memzero(o->payload, o->hdr.len);
+        free(o);
+    }
+    free(c);
+}
+
+/**
+ * @brief close a client, its pending requests are served first
+ * @param[in,out] d daemon state
+ * @param[in,out] c client, freed on return
+ */
+static void daemon_drop(daemon_t *d, daemon_client_t *c)
+{
+    daemon_flush(d);
+    epoll_ctl(d->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    for (size_t i=0;i<d->nclients;i++) {
+        if (d->clients[i] == c) {
+            d->clients[i] = d->clients[--d->nclients];
+            break;
+        }
+    }
+    daemon_client_free(c);
+}
+
+/**
+ * @brief handle the events of a client
+ * @param[in,out] d daemon state
+ * @param[in,out] c client
+ * @param[in] events events reported by epoll
+ * @return 0 while the client is connected, -1 once it must be closed
+ */
+static int32_t daemon_client_event(daemon_t *d, daemon_client_t *c, uint32_t events)
+{
+    if (events & EPOLLOUT) {
+        return daemon_drain(d, c);
+    }
+    /* EPOLLIN may be stale if a reply was queued earlier in this round */
+    if ((events & EPOLLIN) && (c->head == NULL)) {
+        return daemon_read(d, c);
+    }
+    return (events & (EPOLLHUP | EPOLLERR)) ? -1 : 0;
+}
+
+/**
+ * @brief release everything owned by the daemon
+ * @param[in,out] d daemon state
+ * @param[in] path socket path to remove, may be NULL
+ */
+static void daemon_release(daemon_t *d, const char *path)
+{
+    for (size_t i=0;i<d->nclients;i++) {
+        daemon_client_free(d->clients[i]);
+    }
+    if (d->lfd >= 0) {
+        close(d->lfd);
+        if (path != NULL) {
+            unlink(path);
+        }
+    }
+    if (d->epfd >= 0) {
+        close(d->epfd);
+    }
+    if (d->tfd >= 0) {
+        close(d->tfd);
+    }
+    if (d->data != NULL) {
+        aes_memzero(d->data, d->cap_blocks*AES_BLOCK_SIZE);
+        aes_memzero(d->ks, d->cap_blocks*AES_BLOCK_SIZE);
+    }
+    free(d->data);
+    free(d->ks);
+    free(d->reqs);
+    free(d->clients);
+    aes_ctx_free(d->ctx);
+}
+
+/**
+ * @brief serve requests on a Unix socket until the stop flag is set
+ * @param[in] cfg daemon configuration
+ * @return AES_OK once stopped, AES_ERR_PARAM on a bad configuration or a
+ * socket failure, or another AES_ERR_* code
+ * @note a single thread serves all clients; the engine call of a batch is
+ * what amortizes the per-request cost
+ */
+aes_status_t aes_daemon_run(const aes_daemon_cfg_t *cfg)
+{
+    struct epoll_event ev, events[DAEMON_EVENTS];
+    struct sockaddr_un addr;
+    daemon_t d;
+    aes_status_t status;
+
+    if ((cfg == NULL) || (cfg->path == NULL) || (cfg->key == NULL) ||
+        (strlen(cfg->path) >= sizeof(addr.sun_path))) {
+        return AES_ERR_PARAM;
+    }
+    memset(&d, 0, sizeof(d));
+    d.lfd = d.epfd = d.tfd = -1;
+    status = aes_ctx_new(&d.ctx, cfg->key, cfg->key_len);
+    if (status != AES_OK) {
+        return status;
+    }
+    d.latency_usec = cfg->latency_usec;
+    d.batch_blocks = (cfg->batch_blocks != 0) ? cfg->batch_blocks : 1;
+    d.cap_blocks = d.batch_blocks + AES_DAEMON_MAX_PAYLOAD/AES_BLOCK_SIZE;
+    d.max_req = d.cap_blocks;
+    d.data = malloc(d.cap_blocks*AES_BLOCK_SIZE);
+    d.ks = malloc(d.cap_blocks*AES_BLOCK_SIZE);
+    d.reqs = malloc(d.max_req*sizeof(daemon_req_t));
+    if ((d.data == NULL) || (d.ks == NULL) || (d.reqs == NULL)) {
+        daemon_release(&d, NULL);
+        return AES_ERR_NOMEM;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, cfg->path);
+    unlink(cfg->path);
+    d.lfd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    d.epfd = epoll_create1(EPOLL_CLOEXEC);
+    d.tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if ((d.lfd < 0) || (d.epfd < 0) || (d.tfd < 0) ||
+        (bind(d.lfd, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(d.lfd, SOMAXCONN) != 0)) {
+        daemon_release(&d, NULL);
+        return AES_ERR_PARAM;
+    }
+    /* clients are told apart from the listener and the timer by pointer */
+    ev.events = EPOLLIN;
+    ev.data.ptr = &d.lfd;
+    epoll_ctl(d.epfd, EPOLL_CTL_ADD, d.lfd, &ev);
+    ev.data.ptr = &d.tfd;
+    epoll_ctl(d.epfd, EPOLL_CTL_ADD, d.tfd, &ev);
+    while ((cfg->stop == NULL) || (*cfg->stop == 0)) {
+        int n = epoll_wait(d.epfd, events, DAEMON_EVENTS, DAEMON_POLL_MSEC);
+
+        for (int i=0;i<n;i++) {
+            void *ptr = events[i].data.ptr;
+
+            if (ptr == &d.lfd) {
+                daemon_accept(&d);
+            } else if (ptr == &d.tfd) {
+                uint64_t expirations;
+
+                if (read(d.tfd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                    daemon_flush(&d);
+                }
+            } else if (daemon_client_event(&d, ptr, events[i].events) != 0) {
+                daemon_drop(&d, ptr);
+            }
+        }
+        /* without a budget, everything read in this round is one batch */
+        if (d.latency_usec == 0) {
+            daemon_flush(&d);
+        }
+    }
+    daemon_flush(&d);
+    daemon_release(&d, cfg->path);
+    return AES_OK;
+}
+
+/**
+ * @brief connect to a daemon
+ * @param[in] path socket path
+ * @param[out] fd receives the connected socket
+ * @return AES_OK or AES_ERR_PARAM if the daemon cannot be reached
+ */
+aes_status_t aes_daemon_connect(const char *path, int *fd)
+{
+    struct sockaddr_un addr;
+    int s;
+
+    if ((path == NULL) || (fd == NULL) || (strlen(path) >= sizeof(addr.sun_path))) {
+        return AES_ERR_PARAM;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    s = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (s < 0) {
+        return AES_ERR_PARAM;
+    }
+    if (connect(s, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(s);
+        return AES_ERR_PARAM;
+    }
+    *fd = s;
+    return AES_OK;
+}
+
+/**
+ * @brief close a connection to a daemon
+ * @param[in] fd socket from aes_daemon_connect
+ */
+void aes_daemon_close(int fd)
+{
+    close(fd);
+}
+
+/**
+ * @brief send a request and wait for its reply
+ * @param[in] fd connected socket
+ * @param[in,out] hdr request header, receives the reply header
+ * @param[out] out reply payload, hdr->len bytes expected
+ * @param[in] in request payload
+ * @return status of the reply, AES_ERR_PARAM if the connection failed
+ */
+static aes_status_t daemon_call(int fd, daemon_msg_t *hdr, uint8_t *out, const uint8_t *in)
+{
+    uint32_t len = hdr->len;
+
+    hdr->magic = DAEMON_MAGIC;
+    hdr->status = AES_OK;
+    if (daemon_send(fd, hdr, in, 0) != 0) {
+        return AES_ERR_PARAM;
+    }
+    if (daemon_recv(fd, hdr, out, len, 0) < 0) {
+        return AES_ERR_PARAM;
+    }
+    if ((hdr->status == AES_OK) && (hdr->len != len)) {
+        return AES_ERR_PARAM;
+    }
+    return hdr->status;
+}
+
+/**
+ * @brief cipher or decipher in CTR mode through a daemon
+ * @param[in] fd socket from aes_daemon_connect
+ * @param[in,out] counter 128-bit big-endian counter block, advanced as by
+ * aes_ctr_crypt
+ * @param[out] out output buffer, may be equal to in
+ * @param[in] in input buffer
+ * @param[in] len number of bytes, at most AES_DAEMON_MAX_PAYLOAD
+ * @return AES_OK or an AES_ERR_* code
+ */
+aes_status_t aes_daemon_ctr(int fd, uint8_t counter[AES_LIB_BLOCK_SIZE],
+                            uint8_t *out, const uint8_t *in, size_t len)
+{
+    daemon_msg_t hdr;
+    aes_status_t status;
+
+    if ((counter == NULL) || ((len != 0) && ((out == NULL) || (in == NULL)))) {
+        return AES_ERR_PARAM;
+    }
+    if (len > AES_DAEMON_MAX_PAYLOAD) {
+        return AES_ERR_LENGTH;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.op = AES_DAEMON_OP_CTR;
+    hdr.len = (uint32_t)len;
+    memcpy(hdr.iv, counter, AES_BLOCK_SIZE);
+    status = daemon_call(fd, &hdr, out, in);
+    if (status == AES_OK) {
+        memcpy(counter, hdr.iv, AES_BLOCK_SIZE);
+    }
+    return status;
+}
+
+/**
+ * @brief cipher or decipher in ECB mode through a daemon
+ * @param[in] fd socket from aes_daemon_connect
+ * @param[in] op AES_DAEMON_OP_ECB_ENCRYPT or AES_DAEMON_OP_ECB_DECRYPT
+ * @param[out] out output buffer, may be equal to in
+ * @param[in] in input buffer
+ * @param[in] len number of bytes, multiple of 16, at most AES_DAEMON_MAX_PAYLOAD
+ * @return AES_OK or an AES_ERR_* code
+ */
+aes_status_t aes_daemon_ecb(int fd, uint32_t op, uint8_t *out, const uint8_t *in, size_t len)
+{
+    daemon_msg_t hdr;
+
+    if (((op != AES_DAEMON_OP_ECB_ENCRYPT) && (op != AES_DAEMON_OP_ECB_DECRYPT)) ||
+        ((len != 0) && ((out == NULL) || (in == NULL)))) {
+        return AES_ERR_PARAM;
+    }
+    if ((len > AES_DAEMON_MAX_PAYLOAD) || (len % AES_BLOCK_SIZE != 0)) {
+        return AES_ERR_LENGTH;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.op = (uint16_t)op;
+    hdr.len = (uint32_t)len;
+    return daemon_call(fd, &hdr, out, in);
+}
+
+/**
+ * @brief read the batching counters of a daemon
+ * @param[in] fd socket from aes_daemon_connect
+ * @param[out] stats receives the counters
+ * @return AES_OK or an AES_ERR_* code
+ */
+aes_status_t aes_daemon_stats(int fd, aes_daemon_stats_t *stats)
+{
+    daemon_msg_t hdr;
+
+    if (stats == NULL) {
+        return AES_ERR_PARAM;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    /* the request carries no payload, only the reply does */
+    hdr.magic = DAEMON_MAGIC;
+    hdr.op = AES_DAEMON_OP_STATS;
+    if (daemon_send(fd, &hdr, NULL, 0) != 0) {
+        return AES_ERR_PARAM;
+    }
+    if ((daemon_recv(fd, &hdr, (uint8_t *)stats, sizeof(aes_daemon_stats_t), 0) !=
+         (ssize_t)sizeof(aes_daemon_stats_t)) || (hdr.status != AES_OK)) {
+        return AES_ERR_PARAM;
+    }
+    return AES_OK;
+}
+
+/* one load generator connection */
+typedef struct loadgen_conn_s {
+    pthread_t thread;
+    const aes_loadgen_cfg_t *cfg;
+    uint64_t requests;
+    uint64_t errors;
+    uint64_t nsamples;
+    uint64_t *samples;              /* request latencies in ns */
+} loadgen_conn_t;
+
+/**
+ * @brief keep cfg->depth CTR requests in flight on one connection
+ * @param[in,out] arg pointer to the loadgen_conn_t of the thread
+ * @return NULL
+ */
+static void *loadgen_thread(void *arg)
+{
+    loadgen_conn_t *c = arg;
+    const aes_loadgen_cfg_t *cfg = c->cfg;
+    uint8_t *in = malloc(cfg->payload);
+    uint8_t *out = malloc(cfg->payload);
+    uint64_t *sent = calloc(cfg->depth, sizeof(uint64_t));
+    uint32_t *ready = calloc(cfg->depth, sizeof(uint32_t));
+    uint8_t counter[AES_BLOCK_SIZE], check[AES_BLOCK_SIZE];
+    daemon_msg_t req, hdr;
+    uint64_t end;
+    uint32_t inflight = 0;
+    uint32_t nready = 0;            /* slots whose next request is not sent yet */
+    int fd = -1;
+
+    if ((in == NULL) || (out == NULL) || (sent == NULL) || (ready == NULL) ||
+        (aes_daemon_connect(cfg->path, &fd) != AES_OK)) {
+        c->errors++;
+        goto done;
+    }
+    aes_rand_bytes(in, cfg->payload);
+    aes_rand_bytes(counter, sizeof(counter));
+    /* one round trip checks the replies before timing them */
+    memcpy(check, counter, sizeof(check));
+    if ((aes_daemon_ctr(fd, check, out, in, cfg->payload) != AES_OK) ||
+        (aes_daemon_ctr(fd, counter, out, out, cfg->payload) != AES_OK) ||
+        (memcmp(out, in, cfg->payload) != 0)) {
+        c->errors++;
+        goto done;
+    }
+    end = aes_stats_timestamp() + (uint64_t)cfg->seconds*1000000000;
+    memset(&req, 0, sizeof(req));
+    req.magic = DAEMON_MAGIC;
+    req.op = AES_DAEMON_OP_CTR;
+    req.len = (uint32_t)cfg->payload;
+    memcpy(req.iv, counter, sizeof(counter));
+    for (uint32_t slot=0;slot<cfg->depth;slot++) {
+        ready[nready++] = slot;
+    }
+    /*
+     * the daemon stops reading a connection whose replies are not read, so
+     * sends never block: a request that does not fit waits for a reply
+     */
+    while ((inflight != 0) || (nready != 0)) {
+        uint64_t now;
+
+        while (nready != 0) {
+            int32_t ret;
+
+            req.id = ready[nready-1];
+            sent[req.id] = aes_stats_timestamp();
+            ret = daemon_send(fd, &req, in, MSG_DONTWAIT);
+            if (ret == -2) {
+                break;
+            }
+            if (ret != 0) {
+                c->errors++;
+                goto done;
+            }
+            nready--;
+            inflight++;
+        }
+        if (inflight == 0) {
+            struct pollfd pfd = {.fd = fd, .events = POLLOUT, .revents = 0};
+
+            poll(&pfd, 1, -1);
+            continue;
+        }
+        if ((daemon_recv(fd, &hdr, out, cfg->payload, 0) < 0) || (hdr.status != AES_OK) ||
+            (hdr.id >= cfg->depth)) {
+            c->errors++;
+            break;
+        }
+        now = aes_stats_timestamp();
+        inflight--;
+        c->requests++;
+        if (c->nsamples < LOADGEN_SAMPLES) {
+            c->samples[c->nsamples++] = now - sent[hdr.id];
+        }
+        if (now < end) {
+            ready[nready++] = hdr.id;
+        }
+    }
+done:
+    if (fd >= 0) {
+        aes_daemon_close(fd);
+    }
+    free(in);
+    free(out);
+    free(sent);
+    free(ready);
+    return NULL;
+}
+
+static int loadgen_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief drive a running daemon and report throughput and latency
+ * @param[in] cfg load generator configuration
+ * @param[in] report output stream, may be NULL
+ * @return 0 on success, the number of failed connections or requests
+ * otherwise
+ */
+int32_t aes_loadgen_run(const aes_loadgen_cfg_t *cfg, FILE *report)
+{
+    loadgen_conn_t *conns;
+    uint64_t *all;
+    aes_daemon_stats_t before, after;
+    uint64_t requests = 0, errors = 0, nsamples = 0;
+    uint64_t start, elapsed;
+    int fd;
+
+    if ((cfg == NULL) || (cfg->clients == 0) || (cfg->depth == 0) ||
+        (cfg->payload == 0) || (cfg->payload > AES_DAEMON_MAX_PAYLOAD)) {
+        return 1;
+    }
+    if ((aes_daemon_connect(cfg->path, &fd) != AES_OK) || (aes_daemon_stats(fd, &before) != AES_OK)) {
+        if (report != NULL) {
+            fprintf(report, "cannot reach the daemon at %s\n", cfg->path);
+        }
+        return 1;
+    }
+    conns = calloc(cfg->clients, sizeof(loadgen_conn_t));
+    all = malloc((size_t)cfg->clients*LOADGEN_SAMPLES*sizeof(uint64_t));
+    if ((conns == NULL) || (all == NULL)) {
+        free(conns);
+        free(all);
+        aes_daemon_close(fd);
+        return 1;
+    }
+    start = aes_stats_timestamp();
+    for (uint32_t i=0;i<cfg->clients;i++) {
+        conns[i].cfg = cfg;
+        conns[i].samples = all + (size_t)i*LOADGEN_SAMPLES;
+        if (pthread_create(&conns[i].thread, NULL, loadgen_thread, &conns[i]) != 0) {
+            conns[i].errors++;
+            conns[i].cfg = NULL;
+        }
+    }
+    for (uint32_t i=0;i<cfg->clients;i++) {
+        if (conns[i].cfg != NULL) {
+            pthread_join(conns[i].thread, NULL);
+        }
+        requests += conns[i].requests;
+        errors += conns[i].errors;
+        /* pack the samples of every connection at the front */
+        memmove(all + nsamples, conns[i].samples, conns[i].nsamples*sizeof(uint64_t));
+        nsamples += conns[i].nsamples;
+    }
+    elapsed = aes_stats_timestamp() - start;
+    if (aes_daemon_stats(fd, &after) != AES_OK) {
+        memcpy(&after, &before, sizeof(after));
+        errors++;
+    }
+    aes_daemon_close(fd);
+    if (report == NULL) {
+        free(conns);
+        free(all);
+        return (int32_t)((errors < INT32_MAX) ? errors : INT32_MAX);
+    }
+    qsort(all, nsamples, sizeof(uint64_t), loadgen_cmp);
+    fprintf(report, "clients %u, depth %u, payload %lu bytes, %.2f s\n", cfg->clients, cfg->depth,
+            (unsigned long)cfg->payload, (double)elapsed/1e9);
+    fprintf(report, "requests %lu, errors %lu, %.0f req/s, %.1f MB/s\n", (unsigned long)requests,
+            (unsigned long)errors, (double)requests*1e9/(double)elapsed,
+            (double)requests*(double)cfg->payload*1e3/(double)elapsed);
+    if (nsamples != 0) {
+        fprintf(report, "latency us: p50 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+                (double)all[nsamples/2]/1e3, (double)all[nsamples*99/100]/1e3,
+                (double)all[nsamples*999/1000]/1e3, (double)all[nsamples-1]/1e3);
+    }
+    if (after.batches > before.batches) {
+        uint64_t batches = after.batches - before.batches;
+
+        fprintf(report, "daemon: %lu batches, %.1f requests and %.1f blocks per batch, %lu replies deferred\n",
+                (unsigned long)batches, (double)(after.requests - before.requests)/(double)batches,
+                (double)(after.blocks - before.blocks)/(double)batches,
+                (unsigned long)(after.deferred - before.deferred));
+    }
+    free(conns);
+    free(all);
+    return (int32_t)((errors < INT32_MAX) ? errors : INT32_MAX);
+}
+
+#undef AES_DAEMON_C
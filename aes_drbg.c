@@ -0,0 +1,354 @@
+/**
+ * @file aes_drbg.c
+ * @brief libaes CTR_DRBG (NIST SP 800-90A) and per-thread random bytes
+ *
+ * The DRBG uses AES-256 without derivation function: entropy input is
+ * seedlen (48) bytes of full-entropy data. aes_rand_bytes keeps one
+ * instance per thread, refills a AES_DRBG_BUFFER byte buffer with one
+ * generate request and serves callers from it, so a nonce costs a memcpy;
+ * getrandom() is only called at first use, every AES_DRBG_RESEED_REFILLS
+ * refills and in a child after fork().
+*/
+
+#define AES_DRBG_C
+#define AES_LIB_PRIVATE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/random.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_engine.h"
+#include "aes_stats.h"
+#include "aes_lib.h"
+
+#define DRBG_KEY_SIZE   (AES256_KEY_SIZE/8)
+
+/* instances hold the DRBG key, they live in their own secure arena */
+static aes_arena_t drbg_arena;
+static pthread_once_t drbg_once = PTHREAD_ONCE_INIT;
+static pthread_key_t rand_key;
+static __thread aes_drbg_t *rand_self;
+/* bumped in the child after fork(), buffered output must not be shared */
+static uint64_t rand_fork_gen;
+
+static void drbg_atfork_child(void)
+{
+    __atomic_add_fetch(&rand_fork_gen, 1, __ATOMIC_RELAXED);
+}
+
+static void drbg_thread_exit(void *arg)
+{
+    aes_drbg_free(arg);
+}
+
+static void drbg_init(void)
+{
+    aes_arena_init(&drbg_arena, sizeof(aes_drbg_t), 16, AES_ARENA_SECURE);
+    pthread_key_create(&rand_key, drbg_thread_exit);
+    pthread_atfork(NULL, NULL, drbg_atfork_child);
+}
+
+/**
+ * @brief cipher the counter blocks V+1 .. V+nblocks, V ends at V+nblocks
+ * @param[in,out] drbg pointer to the instance
+ * @param[out] out nblocks*16 bytes of output
+ * @param[in] nblocks number of blocks, at least 1
+ */
+static void drbg_blocks(aes_drbg_t *drbg, uint8_t *out, size_t nblocks)
+{
+    /* V+1 first: aes_ctr_blocks starts at the counter it is given */
+    for (int32_t i=AES_BLOCK_SIZE-1;i>=0;i--) {
+        if (++drbg->v[i] != 0) {
+            break;
+        }
+    }
+    aes_ctr_blocks(out, drbg->v, nblocks);
+    memcpy(drbg->v, out + (nblocks-1)*AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+    drbg->engine->encrypt(&drbg->sched, out, out, nblocks);
+}
+
+/**
+ * @brief CTR_DRBG_Update: new Key and V from the current state and data
+ * @param[in,out] drbg pointer to the instance
+ * @param[in] provided seedlen bytes of provided data
+ */
+static void drbg_update(aes_drbg_t *drbg, const uint8_t provided[AES_DRBG_SEED_SIZE])
+{
+    uint8_t temp[AES_DRBG_SEED_SIZE];
+
+    drbg_blocks(drbg, temp, AES_DRBG_SEED_SIZE/AES_BLOCK_SIZE);
+    aes_xor_blocks(temp, temp, provided, AES_DRBG_SEED_SIZE);
+    drbg->engine->setkey(&drbg->sched, temp, DRBG_KEY_SIZE);
+    memcpy(drbg->v, temp + DRBG_KEY_SIZE, AES_BLOCK_SIZE);
+    aes_memzero(temp, sizeof(temp));
+}
+
+/**
+ * @brief entropy XOR optional string padded to seedlen, then update
+ * @param[in,out] drbg pointer to the instance
+ * @param[in] entropy seedlen bytes of entropy input
+ * @param[in] str personalization string or additional input, may be NULL
+ * @param[in] str_len length of str, at most seedlen
+ */
+static void drbg_seed(aes_drbg_t *drbg, const uint8_t *entropy, const uint8_t *str, size_t str_len)
+{
+    uint8_t seed[AES_DRBG_SEED_SIZE];
+
+    memcpy(seed, entropy, AES_DRBG_SEED_SIZE);
+    if (str_len != 0) {
+        aes_xor_blocks(seed, seed, str, str_len);
+    }
+    drbg_update(drbg, seed);
+    drbg->reseed_counter = 1;
+    aes_memzero(seed, sizeof(seed));
+}
+
+/**
+ * @brief instantiate a CTR_DRBG
+ * @param[out] drbg receives the instance, set to NULL on failure
+ * @param[in] entropy AES_DRBG_SEED_SIZE bytes of full-entropy input
+ * @param[in] pers personalization string, may be NULL if pers_len is 0
+ * @param[in] pers_len length of pers, at most AES_DRBG_SEED_SIZE
+ * @return AES_OK or an AES_ERR_* code
+ */
+aes_status_t aes_drbg_new(aes_drbg_t **drbg, const uint8_t entropy[AES_DRBG_SEED_SIZE],
+                          const uint8_t *pers, size_t pers_len)
+{
+    static const uint8_t zero_key[DRBG_KEY_SIZE];
+    const aes_engine_t *engine;
+    aes_drbg_t *new_drbg;
+
+    if (drbg == NULL) {
+        return AES_ERR_PARAM;
+    }
+    *drbg = NULL;
+    if ((entropy == NULL) || ((pers == NULL) && (pers_len != 0)) || (pers_len > AES_DRBG_SEED_SIZE)) {
+        return AES_ERR_PARAM;
+    }
+    engine = aes_engine_get();
+    if (engine == NULL) {
+        return AES_ERR_ENGINE;
+    }
+    pthread_once(&drbg_once, drbg_init);
+    new_drbg = aes_arena_alloc(&drbg_arena);
+    if (new_drbg == NULL) {
+        return AES_ERR_NOMEM;
+    }
+    /* Key = 0, V = 0 */
+    new_drbg->engine = engine;
+    engine->setkey(&new_drbg->sched, zero_key, DRBG_KEY_SIZE);
+    drbg_seed(new_drbg, entropy, pers, pers_len);
+    *drbg = new_drbg;
+    return AES_OK;
+}
+
+/**
+ * @brief reseed a CTR_DRBG
+ * @param[in,out] drbg pointer to the instance
+ * @param[in] entropy AES_DRBG_SEED_SIZE bytes of full-entropy input
+ * @param[in] add additional input, may be NULL if add_len is 0
+ * @param[in] add_len length of add, at most AES_DRBG_SEED_SIZE
+ * @return AES_OK or an AES_ERR_* code
+ */
+aes_status_t aes_drbg_reseed(aes_drbg_t *drbg, const uint8_t entropy[AES_DRBG_SEED_SIZE],
+                             const uint8_t *add, size_t add_len)
+{
+    if ((drbg == NULL) || (entropy == NULL) || ((add == NULL) && (add_len != 0)) ||
+        (add_len > AES_DRBG_SEED_SIZE)) {
+        return AES_ERR_PARAM;
+    }
+    drbg_seed(drbg, entropy, add, add_len);
+    return AES_OK;
+}
+
+/**
+ * @brief generate pseudo-random bytes
+ * @param[in,out] drbg pointer to the instance
+ * @param[out] out output buffer
+ * @param[in] len number of bytes, at most AES_DRBG_MAX_REQUEST
+ * @param[in] add additional input, may be NULL if add_len is 0
+ * @param[in] add_len length of add, at most AES_DRBG_SEED_SIZE
+ * @return AES_OK, AES_ERR_RESEED when the instance must be reseeded first,
+ * or another AES_ERR_* code
+ */
+aes_status_t aes_drbg_generate(aes_drbg_t *drbg, uint8_t *out, size_t len,
+                               const uint8_t *add, size_t add_len)
+{
+    uint8_t add_buf[AES_DRBG_SEED_SIZE];
+    size_t full = len/AES_BLOCK_SIZE;
+
+    if ((drbg == NULL) || ((out == NULL) && (len != 0)) || (len > AES_DRBG_MAX_REQUEST) ||
+        ((add == NULL) && (add_len != 0)) || (add_len > AES_DRBG_SEED_SIZE)) {
+        return AES_ERR_PARAM;
+    }
+    if (drbg->reseed_counter > AES_DRBG_RESEED_LIMIT) {
+        return AES_ERR_RESEED;
+    }
+    memset(add_buf, 0, sizeof(add_buf));
+    if (add_len != 0) {
+        memcpy(add_buf, add, add_len);
+        drbg_update(drbg, add_buf);
+    }
+    /* whole blocks are ciphered in place in the caller's buffer */
+    if (full != 0) {
+        drbg_blocks(drbg, out, full);
+    }
+    if (len % AES_BLOCK_SIZE != 0) {
+        uint8_t last[AES_BLOCK_SIZE];
+        drbg_blocks(drbg, last, 1);
+        memcpy(out + full*AES_BLOCK_SIZE, last, len % AES_BLOCK_SIZE);
+        aes_memzero(last, sizeof(last));
+    }
+    drbg_update(drbg, add_buf);
+    drbg->reseed_counter++;
+    aes_memzero(add_buf, sizeof(add_buf));
+    aes_stats_add_blocks(drbg->engine->id, AES_STATS_MODE_DRBG, DRBG_KEY_SIZE, AES_STATS_DIR_ENC,
+                         (len + AES_BLOCK_SIZE - 1)/AES_BLOCK_SIZE);
+    return AES_OK;
+}
+
+/**
+ * @brief clear and release a CTR_DRBG instance
+ * @param[in] drbg pointer to the instance, may be NULL
+ */
+void aes_drbg_free(aes_drbg_t *drbg)
+{
+    if (drbg == NULL) {
+        return;
+    }
+    aes_arena_free(&drbg_arena, drbg);
+}
+
+/**
+ * @brief read seedlen bytes from the kernel entropy pool
+ * @param[out] entropy output buffer
+ * @return AES_OK or AES_ERR_ENTROPY
+ */
+static aes_status_t rand_entropy(uint8_t entropy[AES_DRBG_SEED_SIZE])
+{
+    size_t got = 0;
+
+    while (got < AES_DRBG_SEED_SIZE) {
+        ssize_t n = getrandom(entropy + got, AES_DRBG_SEED_SIZE - got, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return AES_ERR_ENTROPY;
+        }
+        got += (size_t)n;
+    }
+    return AES_OK;
+}
+
+/**
+ * @brief reseed the per-thread instance and fill its buffer
+ * @param[in,out] drbg per-thread instance
+ * @return AES_OK or an AES_ERR_* code
+ */
+static aes_status_t rand_refill(aes_drbg_t *drbg)
+{
+    uint64_t fork_gen = __atomic_load_n(&rand_fork_gen, __ATOMIC_RELAXED);
+    aes_status_t status;
+
+    if ((drbg->fork_gen != fork_gen) || (drbg->reseed_counter > AES_DRBG_RESEED_REFILLS)) {
+        uint8_t entropy[AES_DRBG_SEED_SIZE];
+
+        status = rand_entropy(entropy);
+        if (status == AES_OK) {
+            drbg_seed(drbg, entropy, NULL, 0);
+            drbg->fork_gen = fork_gen;
+        }
+        aes_memzero(entropy, sizeof(entropy));
+        if (status != AES_OK) {
+            return status;
+        }
+    }
+    status = aes_drbg_generate(drbg, drbg->buf, AES_DRBG_BUFFER, NULL, 0);
+    if (status != AES_OK) {
+        return status;
+    }
+    drbg->pos = 0;
+    drbg->avail = AES_DRBG_BUFFER;
+    return AES_OK;
+}
+
+/**
+ * @brief return the instance of the calling thread, creating it on first use
+ * @param[out] drbg receives the instance
+ * @return AES_OK or an AES_ERR_* code
+ */
+static aes_status_t rand_get(aes_drbg_t **drbg)
+{
+    uint8_t entropy[AES_DRBG_SEED_SIZE];
+    aes_status_t status;
+
+    if (rand_self != NULL) {
+        *drbg = rand_self;
+        return AES_OK;
+    }
+    status = rand_entropy(entropy);
+    if (status == AES_OK) {
+        status = aes_drbg_new(drbg, entropy, NULL, 0);
+    }
+    aes_memzero(entropy, sizeof(entropy));
+    if (status != AES_OK) {
+        return status;
+    }
+    (*drbg)->fork_gen = __atomic_load_n(&rand_fork_gen, __ATOMIC_RELAXED);
+    pthread_setspecific(rand_key, *drbg);
+    rand_self = *drbg;
+    return AES_OK;
+}
+
+/**
+ * @brief fill a buffer with random bytes from the per-thread CTR_DRBG
+ * @param[out] out output buffer
+ * @param[in] len number of bytes
+ * @return AES_OK or an AES_ERR_* code
+ * @note served bytes are wiped from the buffer, so a later memory disclosure
+ * does not reveal output already handed out
+ */
+aes_status_t aes_rand_bytes(uint8_t *out, size_t len)
+{
+    aes_drbg_t *drbg;
+    aes_status_t status;
+
+    if ((out == NULL) && (len != 0)) {
+        return AES_ERR_PARAM;
+    }
+    status = rand_get(&drbg);
+    if (status != AES_OK) {
+        return status;
+    }
+    if (drbg->fork_gen != __atomic_load_n(&rand_fork_gen, __ATOMIC_RELAXED)) {
+        /* the parent may serve the same buffered bytes */
+        aes_memzero(drbg->buf + drbg->pos, drbg->avail);
+        drbg->avail = 0;
+    }
+    while (len != 0) {
+        size_t n;
+
+        if (drbg->avail == 0) {
+            status = rand_refill(drbg);
+            if (status != AES_OK) {
+                return status;
+            }
+        }
+        n = (len < drbg->avail) ? len : drbg->avail;
+        memcpy(out, drbg->buf + drbg->pos, n);
+        aes_memzero(drbg->buf + drbg->pos, n);
+        drbg->pos += n;
+        drbg->avail -= n;
+        out += n;
+        len -= n;
+    }
+    return AES_OK;
+}
+
+#undef AES_DRBG_C
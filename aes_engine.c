@@ -0,0 +1,455 @@
+/**
+ * @file aes_engine.c
+ * @brief AES block engines
+ *
+ * - ref: runs the step functions of aes.c on every block, used as the oracle
+ *   for the other engines.
+ * - ttable: 32-bit implementation merging SubBytes, ShiftRows and MixColumns
+ *   into four 1 KiB lookup tables, derived from the reference S-box.
+ *
+ * aes_engine_init() runs once: it checks which engines the CPU supports, runs
+ * the FIPS-197 known-answer tests on each of them and publishes the fastest
+ * engine that passed. Callers fetch it once (typically when a key context is
+ * created) and then call through its function pointers, so there is no
+ * feature check in the block loop.
+*/
+
+#define AES_ENGINE_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_engine.h"
+#include "aes_kat.h"
+
+#define GETU32(p)   (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | \
+                     ((uint32_t)(p)[2] << 8) | ((uint32_t)(p)[3]))
+#define PUTU32(p, v) do { (p)[0] = (uint8_t)((v) >> 24); (p)[1] = (uint8_t)((v) >> 16); \
+                          (p)[2] = (uint8_t)((v) >> 8); (p)[3] = (uint8_t)(v); } while (0)
+#define ROR32(v, n) (((v) >> (n)) | ((v) << (32 - (n))))
+
+/*
+ * reference engine
+ */
+
+static int32_t ref_supported(void)
+{
+    return 1;
+}
+
+/**
+ * @brief expand key with aes_keyexpansion_words and keep round keys as bytes
+ * @param[out] sched pointer to the key schedule
+ * @param[in] key pointer to the key bytes
+ * @param[in] length key length in bytes
+ */
+static void ref_setkey(aes_sched_t *sched, const uint8_t *key, uint32_t length)
+{
+    uint32_t nwords;
+
+    aes_keyexpansion_words(sched->enc.word, key, length);
+    sched->length = length;
+    sched->nr = aes_nr(length);
+    /* byte order in place, word i only overlaps its own 4 bytes */
+    nwords = AES_NB*(sched->nr+1);
+    for (uint32_t i=0;i<nwords;i++) {
+        uint32_t w = sched->enc.word[i];
+        PUTU32(sched->enc.byte[0] + 4*i, w);
+    }
+    /* the step-by-step inverse cipher uses the same round keys */
+    memcpy(&sched->dec, &sched->enc, sizeof(aes_rk_t));
+}
+
+/**
+ * @brief load round key r of the schedule into a key structure
+ * @param[out] round_key key structure used by aes_addroundkey
+ * @param[in] rk round key bytes
+ */
+static void ref_round_key(aes_key_t *round_key, const uint8_t *rk)
+{
+    memcpy(round_key->byte, rk, AES_BLOCK_SIZE);
+    round_key->length = AES128_KEY_SIZE/8;
+}
+
+static void ref_encrypt(const aes_sched_t *sched, uint8_t *out, const uint8_t *in, size_t nblocks)
+{
+    aes_block_t state;
+    aes_key_t round_key;
+
+    memset(&round_key, 0, sizeof(aes_key_t));
+    for (size_t b=0;b<nblocks;b++) {
+        memcpy(state.byte, in + b*AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+        aes_block2mat(&state);
+        ref_round_key(&round_key, sched->enc.byte[0]);
+        aes_addroundkey(&state, &round_key);
+        for (uint32_t r=1;r<sched->nr;r++) {
+            aes_subbytes(&state);
+            aes_shiftrows(&state);
+            aes_mixcolumns(&state);
+            ref_round_key(&round_key, sched->enc.byte[r]);
+            aes_addroundkey(&state, &round_key);
+        }
+        aes_subbytes(&state);
+        aes_shiftrows(&state);
+        ref_round_key(&round_key, sched->enc.byte[sched->nr]);
+        aes_addroundkey(&state, &round_key);
+        memcpy(out + b*AES_BLOCK_SIZE, state.byte, AES_BLOCK_SIZE);
+    }
+    /* once per call: the last round key copy is the only secret left */
+    aes_memzero(&round_key, sizeof(aes_key_t));
+}
+
+static void ref_decrypt(const aes_sched_t *sched, uint8_t *out, const uint8_t *in, size_t nblocks)
+{
+    aes_block_t state;
+    aes_key_t round_key;
+
+    memset(&round_key, 0, sizeof(aes_key_t));
+    for (size_t b=0;b<nblocks;b++) {
+        memcpy(state.byte, in + b*AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+        aes_block2mat(&state);
+        ref_round_key(&round_key, sched->dec.byte[sched->nr]);
+        aes_addroundkey(&state, &round_key);
+        aes_invshiftrows(&state);
+        aes_invsubbytes(&state);
+        for (uint32_t r=sched->nr-1;r>0;r--) {
+            ref_round_key(&round_key, sched->dec.byte[r]);
+            aes_addroundkey(&state, &round_key);
+            aes_invmixcolumns(&state);
+            aes_invshiftrows(&state);
+            aes_invsubbytes(&state);
+        }
+        ref_round_key(&round_key, sched->dec.byte[0]);
+        aes_addroundkey(&state, &round_key);
+        memcpy(out + b*AES_BLOCK_SIZE, state.byte, AES_BLOCK_SIZE);
+    }
+    /* once per call: the last round key copy is the only secret left */
+    aes_memzero(&round_key, sizeof(aes_key_t));
+}
+
+const aes_engine_t aes_engine_ref = {
+    .name = "ref",
+    .id = AES_ENGINE_REF,
+    .supported = ref_supported,
+    .setkey = ref_setkey,
+    .encrypt = ref_encrypt,
+    .decrypt = ref_decrypt,
+};
+
+/*
+ * T-table engine
+ */
+
+static uint8_t tt_sbox[256];
+static uint8_t tt_inv_sbox[256];
+static uint32_t tt_te[4][256];
+static uint32_t tt_td[4][256];
+static pthread_once_t tt_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief build the lookup tables from the reference S-boxes
+ */
+static void tt_init(void)
+{
+    aes_block_t block;
+
+    /* run the reference SubBytes/InvSubBytes over all byte values */
+    for (uint32_t i=0;i<256;i+=AES_BLOCK_SIZE) {
+        for (uint32_t j=0;j<AES_BLOCK_SIZE;j++) {
+            block.byte[j] = (uint8_t)(i + j);
+        }
+        aes_subbytes(&block);
+        memcpy(&tt_sbox[i], block.byte, AES_BLOCK_SIZE);
+        for (uint32_t j=0;j<AES_BLOCK_SIZE;j++) {
+            block.byte[j] = (uint8_t)(i + j);
+        }
+        aes_invsubbytes(&block);
+        memcpy(&tt_inv_sbox[i], block.byte, AES_BLOCK_SIZE);
+    }
+    for (uint32_t i=0;i<256;i++) {
+        uint8_t s = tt_sbox[i];
+        uint8_t s2 = aes_xtime(s);
+        uint8_t is = tt_inv_sbox[i];
+        uint32_t te = ((uint32_t)s2 << 24) | ((uint32_t)s << 16) | ((uint32_t)s << 8) | (uint8_t)(s2 ^ s);
+        uint32_t td = ((uint32_t)aes_multiply(is, 0x0e) << 24) | ((uint32_t)aes_multiply(is, 0x09) << 16) |
+                      ((uint32_t)aes_multiply(is, 0x0d) << 8) | aes_multiply(is, 0x0b);
+        for (uint32_t t=0;t<4;t++) {
+            tt_te[t][i] = (t == 0) ? te : ROR32(te, 8*t);
+            tt_td[t][i] = (t == 0) ? td : ROR32(td, 8*t);
+        }
+    }
+}
+
+static int32_t tt_supported(void)
+{
+    return 1;
+}
+
+/**
+ * @brief InvMixColumns of one word, used for the equivalent inverse cipher
+ * @param[in] w round key word
+ * @return transformed word
+ */
+static uint32_t tt_invmix(uint32_t w)
+{
+    return tt_td[0][tt_sbox[w >> 24]] ^ tt_td[1][tt_sbox[(w >> 16) & 0xff]] ^
+           tt_td[2][tt_sbox[(w >> 8) & 0xff]] ^ tt_td[3][tt_sbox[w & 0xff]];
+}
+
+static void tt_setkey(aes_sched_t *sched, const uint8_t *key, uint32_t length)
+{
+    uint32_t nr;
+    uint32_t *ek;
+    uint32_t *dk;
+
+    pthread_once(&tt_once, tt_init);
+    ek = sched->enc.word;
+    dk = sched->dec.word;
+    /* the T-table engine uses the big-endian words as they are */
+    aes_keyexpansion_words(ek, key, length);
+    sched->length = length;
+    sched->nr = aes_nr(length);
+    nr = sched->nr;
+    /* decryption schedule: reversed order, InvMixColumns on inner round keys */
+    for (uint32_t r=0;r<=nr;r++) {
+        for (uint32_t c=0;c<AES_NB;c++) {
+            uint32_t w = ek[AES_NB*(nr-r) + c];
+            dk[AES_NB*r + c] = ((r == 0) || (r == nr)) ? w : tt_invmix(w);
+        }
+    }
+}
+
+static void tt_encrypt(const aes_sched_t *sched, uint8_t *out, const uint8_t *in, size_t nblocks)
+{
+    const uint32_t *te0 = tt_te[0], *te1 = tt_te[1], *te2 = tt_te[2], *te3 = tt_te[3];
+    const uint8_t *sb = tt_sbox;
+    uint32_t nr = sched->nr;
+
+    for (size_t b=0;b<nblocks;b++, in+=AES_BLOCK_SIZE, out+=AES_BLOCK_SIZE) {
+        const uint32_t *rk = sched->enc.word;
+        uint32_t s0 = GETU32(in) ^ rk[0];
+        uint32_t s1 = GETU32(in + 4) ^ rk[1];
+        uint32_t s2 = GETU32(in + 8) ^ rk[2];
+        uint32_t s3 = GETU32(in + 12) ^ rk[3];
+        uint32_t t0, t1, t2, t3;
+
+        for (uint32_t r=1;r<nr;r++) {
+            rk += 4;
+            t0 = te0[s0 >> 24] ^ te1[(s1 >> 16) & 0xff] ^ te2[(s2 >> 8) & 0xff] ^ te3[s3 & 0xff] ^ rk[0];
+            t1 = te0[s1 >> 24] ^ te1[(s2 >> 16) & 0xff] ^ te2[(s3 >> 8) & 0xff] ^ te3[s0 & 0xff] ^ rk[1];
+            t2 = te0[s2 >> 24] ^ te1[(s3 >> 16) & 0xff] ^ te2[(s0 >> 8) & 0xff] ^ te3[s1 & 0xff] ^ rk[2];
+            t3 = te0[s3 >> 24] ^ te1[(s0 >> 16) & 0xff] ^ te2[(s1 >> 8) & 0xff] ^ te3[s2 & 0xff] ^ rk[3];
+            s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+        }
+        rk += 4;
+        t0 = ((uint32_t)sb[s0 >> 24] << 24) ^ ((uint32_t)sb[(s1 >> 16) & 0xff] << 16) ^
+             ((uint32_t)sb[(s2 >> 8) & 0xff] << 8) ^ sb[s3 & 0xff] ^ rk[0];
+        t1 = ((uint32_t)sb[s1 >> 24] << 24) ^ ((uint32_t)sb[(s2 >> 16) & 0xff] << 16) ^
+             ((uint32_t)sb[(s3 >> 8) & 0xff] << 8) ^ sb[s0 & 0xff] ^ rk[1];
+        t2 = ((uint32_t)sb[s2 >> 24] << 24) ^ ((uint32_t)sb[(s3 >> 16) & 0xff] << 16) ^
+             ((uint32_t)sb[(s0 >> 8) & 0xff] << 8) ^ sb[s1 & 0xff] ^ rk[2];
+        t3 = ((uint32_t)sb[s3 >> 24] << 24) ^ ((uint32_t)sb[(s0 >> 16) & 0xff] << 16) ^
+             ((uint32_t)sb[(s1 >> 8) & 0xff] << 8) ^ sb[s2 & 0xff] ^ rk[3];
+        PUTU32(out, t0);
+        PUTU32(out + 4, t1);
+        PUTU32(out + 8, t2);
+        PUTU32(out + 12, t3);
+    }
+}
+
+static void tt_decrypt(const aes_sched_t *sched, uint8_t *out, const uint8_t *in, size_t nblocks)
+{
+    const uint32_t *td0 = tt_td[0], *td1 = tt_td[1], *td2 = tt_td[2], *td3 = tt_td[3];
+    const uint8_t *isb = tt_inv_sbox;
+    uint32_t nr = sched->nr;
+
+    for (size_t b=0;b<nblocks;b++, in+=AES_BLOCK_SIZE, out+=AES_BLOCK_SIZE) {
+        const uint32_t *rk = sched->dec.word;
+        uint32_t s0 = GETU32(in) ^ rk[0];
+        uint32_t s1 = GETU32(in + 4) ^ rk[1];
+        uint32_t s2 = GETU32(in + 8) ^ rk[2];
+        uint32_t s3 = GETU32(in + 12) ^ rk[3];
+        uint32_t t0, t1, t2, t3;
+
+        for (uint32_t r=1;r<nr;r++) {
+            rk += 4;
+            t0 = td0[s0 >> 24] ^ td1[(s3 >> 16) & 0xff] ^ td2[(s2 >> 8) & 0xff] ^ td3[s1 & 0xff] ^ rk[0];
+            t1 = td0[s1 >> 24] ^ td1[(s0 >> 16) & 0xff] ^ td2[(s3 >> 8) & 0xff] ^ td3[s2 & 0xff] ^ rk[1];
+            t2 = td0[s2 >> 24] ^ td1[(s1 >> 16) & 0xff] ^ td2[(s0 >> 8) & 0xff] ^ td3[s3 & 0xff] ^ rk[2];
+            t3 = td0[s3 >> 24] ^ td1[(s2 >> 16) & 0xff] ^ td2[(s1 >> 8) & 0xff] ^ td3[s0 & 0xff] ^ rk[3];
+            s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+        }
+        rk += 4;
+        t0 = ((uint32_t)isb[s0 >> 24] << 24) ^ ((uint32_t)isb[(s3 >> 16) & 0xff] << 16) ^
+             ((uint32_t)isb[(s2 >> 8) & 0xff] << 8) ^ isb[s1 & 0xff] ^ rk[0];
+        t1 = ((uint32_t)isb[s1 >> 24] << 24) ^ ((uint32_t)isb[(s0 >> 16) & 0xff] << 16) ^
+             ((uint32_t)isb[(s3 >> 8) & 0xff] << 8) ^ isb[s2 & 0xff] ^ rk[1];
+        t2 = ((uint32_t)isb[s2 >> 24] << 24) ^ ((uint32_t)isb[(s1 >> 16) & 0xff] << 16) ^
+             ((uint32_t)isb[(s0 >> 8) & 0xff] << 8) ^ isb[s3 & 0xff] ^ rk[2];
+        t3 = ((uint32_t)isb[s3 >> 24] << 24) ^ ((uint32_t)isb[(s2 >> 16) & 0xff] << 16) ^
+             ((uint32_t)isb[(s1 >> 8) & 0xff] << 8) ^ isb[s0 & 0xff] ^ rk[3];
+        PUTU32(out, t0);
+        PUTU32(out + 4, t1);
+        PUTU32(out + 8, t2);
+        PUTU32(out + 12, t3);
+    }
+}
+
+const aes_engine_t aes_engine_ttable = {
+    .name = "ttable",
+    .id = AES_ENGINE_TTABLE,
+    .supported = tt_supported,
+    .setkey = tt_setkey,
+    .encrypt = tt_encrypt,
+    .decrypt = tt_decrypt,
+};
+
+static const aes_engine_t *engine_table[AES_ENGINE_MAX] = {
+    &aes_engine_ref,
+    &aes_engine_ttable,
+    &aes_engine_aesni,
+};
+
+/* static preference used when the micro-benchmark is not requested */
+static const uint32_t engine_preference[AES_ENGINE_MAX] = {
+    AES_ENGINE_AESNI, AES_ENGINE_TTABLE, AES_ENGINE_REF
+};
+
+#define ENGINE_BENCH_BLOCKS 256
+#define ENGINE_BENCH_RUNS   16
+
+static pthread_mutex_t engine_lock = PTHREAD_MUTEX_INITIALIZER;
+static const aes_engine_t *engine_selected;
+/* set once the selection has run, even if no engine passed */
+static uint32_t engine_done;
+static uint32_t engine_post[AES_ENGINE_MAX];
+
+/**
+ * @brief look up an engine by identifier
+ * @param[in] id AES_ENGINE_xxx
+ * @return pointer to the engine, NULL if unknown
+ */
+const aes_engine_t *aes_engine_by_id(uint32_t id)
+{
+    if (id >= AES_ENGINE_MAX) {
+        return NULL;
+    }
+    return engine_table[id];
+}
+
+/**
+ * @brief time a short ECB run of an engine
+ * @param[in] engine pointer to the engine
+ * @return best time in ns over a few runs
+ */
+static uint64_t engine_bench(const aes_engine_t *engine)
+{
+    static const uint8_t key[AES128_KEY_SIZE/8] = {0};
+    static uint8_t buf[ENGINE_BENCH_BLOCKS*AES_BLOCK_SIZE];
+    aes_sched_t sched;
+    uint64_t best = UINT64_MAX;
+
+    engine->setkey(&sched, key, sizeof(key));
+    for (uint32_t i=0;i<ENGINE_BENCH_RUNS;i++) {
+        uint64_t start = aes_stats_timestamp();
+        engine->encrypt(&sched, buf, buf, ENGINE_BENCH_BLOCKS);
+        uint64_t elapsed = aes_stats_timestamp() - start;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+    memset(&sched, 0, sizeof(aes_sched_t));
+    return best;
+}
+
+/**
+ * @brief detect, self-test and select the engine used by the library
+ * @param[in] flags AES_ENGINE_INIT_DEFAULT or AES_ENGINE_INIT_BENCH
+ * @return identifier of the selected engine, -1 if no engine passed
+ * @note only the first call does the work; later calls return the choice,
+ * including a failed one.
+ * Setting the AES_ENGINE environment variable to an engine name restricts
+ * the selection to that engine (it still has to pass its self-test).
+ */
+int32_t aes_engine_init(uint32_t flags)
+{
+    const aes_engine_t *best = NULL;
+    const char *forced = getenv("AES_ENGINE");
+    uint64_t best_time = UINT64_MAX;
+
+    pthread_mutex_lock(&engine_lock);
+    if (engine_done) {
+        pthread_mutex_unlock(&engine_lock);
+        return (engine_selected != NULL) ? (int32_t)engine_selected->id : -1;
+    }
+    for (uint32_t i=0;i<AES_ENGINE_MAX;i++) {
+        const aes_engine_t *engine = engine_table[engine_preference[i]];
+        if (!engine->supported()) {
+            engine_post[engine->id] = AES_ENGINE_UNSUPPORTED;
+            continue;
+        }
+        if (aes_kat_engine(engine, AES_KAT_QUICK, NULL) != 0) {
+            fprintf(stderr, "[ERROR] aes_engine_init: %s failed its self-test\n", engine->name);
+            engine_post[engine->id] = AES_ENGINE_FAILED;
+            continue;
+        }
+        engine_post[engine->id] = AES_ENGINE_PASSED;
+        if ((forced != NULL) && (strcmp(forced, engine->name) != 0)) {
+            continue;
+        }
+        if (flags & AES_ENGINE_INIT_BENCH) {
+            uint64_t t = engine_bench(engine);
+            if (t < best_time) {
+                best_time = t;
+                best = engine;
+            }
+        } else if (best == NULL) {
+            best = engine;
+        }
+    }
+    __atomic_store_n(&engine_selected, best, __ATOMIC_RELEASE);
+    __atomic_store_n(&engine_done, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&engine_lock);
+    return (best != NULL) ? (int32_t)best->id : -1;
+}
+
+/**
+ * @brief return the selected engine, running aes_engine_init on first use
+ * @return pointer to the engine, NULL if no engine passed its self-test
+ * @note a failed selection is not retried
+ */
+const aes_engine_t *aes_engine_get(void)
+{
+    const aes_engine_t *engine = __atomic_load_n(&engine_selected, __ATOMIC_ACQUIRE);
+
+    if ((engine == NULL) && !__atomic_load_n(&engine_done, __ATOMIC_ACQUIRE)) {
+        aes_engine_init(AES_ENGINE_INIT_DEFAULT);
+        engine = __atomic_load_n(&engine_selected, __ATOMIC_ACQUIRE);
+    }
+    return engine;
+}
+
+/**
+ * @brief power-on self-test status of an engine
+ * @param[in] id AES_ENGINE_xxx
+ * @return AES_ENGINE_UNTESTED, _PASSED, _FAILED or _UNSUPPORTED
+ */
+uint32_t aes_engine_status(uint32_t id)
+{
+    uint32_t status;
+
+    if (id >= AES_ENGINE_MAX) {
+        return AES_ENGINE_UNSUPPORTED;
+    }
+    pthread_mutex_lock(&engine_lock);
+    status = engine_post[id];
+    pthread_mutex_unlock(&engine_lock);
+    return status;
+}
+
+#undef AES_ENGINE_C
@@ -0,0 +1,490 @@
+/**
+ * @file aes_engine_aesni.c
+ * @brief AES block engine using the x86 AES-NI instructions
+ *
+ * Functions are compiled with a target attribute so the rest of the program
+ * keeps the default ISA; the engine is only selected after aesni_supported()
+ * confirmed the CPU has the instructions. Independent blocks are processed
+ * eight at a time to hide the latency of AESENC.
+*/
+
+#define AES_ENGINE_AESNI_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_engine.h"
+#include "aes_stats.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <wmmintrin.h>
+#include <emmintrin.h>
+
+#define AESNI_TARGET    __attribute__((target("aes,sse2")))
+#define AESNI_LANES     8
+
+static int32_t aesni_supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("aes") ? 1 : 0;
+}
+
+/**
+ * @brief fold a new key word into the previous four words
+ * @param[in] k previous four words
+ * @param[in] t AESKEYGENASSIST result, broadcast to every lane
+ * @return next four words
+ */
+AESNI_TARGET
+static inline __m128i aesni_key_fold(__m128i k, __m128i t)
+{
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 8));
+    return _mm_xor_si128(k, t);
+}
+
+/* rcon must be an immediate, hence macros rather than a loop */
+#define AESNI_EXP128(k, rcon) \
+    aesni_key_fold((k), _mm_shuffle_epi32(_mm_aeskeygenassist_si128((k), (rcon)), 0xff))
+
+AESNI_TARGET
+static void aesni_expand128(__m128i *rk, const uint8_t *key)
+{
+    rk[0] = _mm_loadu_si128((const __m128i *)key);
+    rk[1] = AESNI_EXP128(rk[0], 0x01);
+    rk[2] = AESNI_EXP128(rk[1], 0x02);
+    rk[3] = AESNI_EXP128(rk[2], 0x04);
+    rk[4] = AESNI_EXP128(rk[3], 0x08);
+    rk[5] = AESNI_EXP128(rk[4], 0x10);
+    rk[6] = AESNI_EXP128(rk[5], 0x20);
+    rk[7] = AESNI_EXP128(rk[6], 0x40);
+    rk[8] = AESNI_EXP128(rk[7], 0x80);
+    rk[9] = AESNI_EXP128(rk[8], 0x1b);
+    rk[10] = AESNI_EXP128(rk[9], 0x36);
+}
+
+/**
+ * @brief one step of the 192-bit schedule: six new words
+ * @param[in,out] lo words i..i+3 in, words i+6..i+9 out
+ * @param[in,out] hi words i+4..i+5 in its low half, words i+10..i+11 out
+ * @param[in] t AESKEYGENASSIST of hi
+ */
+AESNI_TARGET
+static inline void aesni_key192_step(__m128i *lo, __m128i *hi, __m128i t)
+{
+    *lo = aesni_key_fold(*lo, _mm_shuffle_epi32(t, 0x55));
+    *hi = _mm_xor_si128(*hi, _mm_slli_si128(*hi, 4));
+    *hi = _mm_xor_si128(*hi, _mm_shuffle_epi32(*lo, 0xff));
+}
+
+/* splice 64-bit halves: low of a with low of b, high of a with low of b */
+#define AESNI_LO_LO(a, b)   _mm_castpd_si128(_mm_shuffle_pd(_mm_castsi128_pd(a), _mm_castsi128_pd(b), 0))
+#define AESNI_HI_LO(a, b)   _mm_castpd_si128(_mm_shuffle_pd(_mm_castsi128_pd(a), _mm_castsi128_pd(b), 1))
+
+AESNI_TARGET
+static void aesni_expand192(__m128i *rk, const uint8_t *key)
+{
+    uint8_t buf[32];
+    __m128i lo, hi;
+
+    /* a 24-byte key must not be read with a second 16-byte load */
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, key, AES192_KEY_SIZE/8);
+    lo = _mm_loadu_si128((const __m128i *)buf);
+    hi = _mm_loadu_si128((const __m128i *)(buf + 16));
+    rk[0] = lo;
+    rk[1] = hi;
+    aesni_key192_step(&lo, &hi, _mm_aeskeygenassist_si128(hi, 0x01));
+    rk[1] = AESNI_LO_LO(rk[1], lo);
+    rk[2] = AESNI_HI_LO(lo, hi);
+    aesni_key192_step(&lo, &hi, _mm_aeskeygenassist_si128(hi, 0x02));
+    rk[3] = lo;
+    rk[4] = hi;
+    aesni_key192_step(&lo, &hi, _mm_aeskeygenassist_si128(hi, 0x04));
+    rk[4] = AESNI_LO_LO(rk[4], lo);
+    rk[5] = AESNI_HI_LO(lo, hi);
+    aesni_key192_step(&lo, &hi, _mm_aeskeygenassist_si128(hi, 0x08));
+    rk[6] = lo;
+    rk[7] = hi;
+    aesni_key192_step(&lo, &hi, _mm_aeskeygenassist_si128(hi, 0x10));
+    rk[7] = AESNI_LO_LO(rk[7], lo);
+    rk[8] = AESNI_HI_LO(lo, hi);
+    aesni_key192_step(&lo, &hi, _mm_aeskeygenassist_si128(hi, 0x20));
+    rk[9] = lo;
+    rk[10] = hi;
+    aesni_key192_step(&lo, &hi, _mm_aeskeygenassist_si128(hi, 0x40));
+    rk[10] = AESNI_LO_LO(rk[10], lo);
+    rk[11] = AESNI_HI_LO(lo, hi);
+    aesni_key192_step(&lo, &hi, _mm_aeskeygenassist_si128(hi, 0x80));
+    rk[12] = lo;
+    aes_memzero(buf, sizeof(buf));
+}
+
+/* 256-bit: even round keys take RotWord+Rcon, odd ones SubWord only */
+#define AESNI_EXP256_EVEN(a, b, rcon) \
+    aesni_key_fold((a), _mm_shuffle_epi32(_mm_aeskeygenassist_si128((b), (rcon)), 0xff))
+#define AESNI_EXP256_ODD(a, b) \
+    aesni_key_fold((b), _mm_shuffle_epi32(_mm_aeskeygenassist_si128((a), 0x00), 0xaa))
+
+AESNI_TARGET
+static void aesni_expand256(__m128i *rk, const uint8_t *key)
+{
+    rk[0] = _mm_loadu_si128((const __m128i *)key);
+    rk[1] = _mm_loadu_si128((const __m128i *)(key + 16));
+    rk[2] = AESNI_EXP256_EVEN(rk[0], rk[1], 0x01);
+    rk[3] = AESNI_EXP256_ODD(rk[2], rk[1]);
+    rk[4] = AESNI_EXP256_EVEN(rk[2], rk[3], 0x02);
+    rk[5] = AESNI_EXP256_ODD(rk[4], rk[3]);
+    rk[6] = AESNI_EXP256_EVEN(rk[4], rk[5], 0x04);
+    rk[7] = AESNI_EXP256_ODD(rk[6], rk[5]);
+    rk[8] = AESNI_EXP256_EVEN(rk[6], rk[7], 0x08);
+    rk[9] = AESNI_EXP256_ODD(rk[8], rk[7]);
+    rk[10] = AESNI_EXP256_EVEN(rk[8], rk[9], 0x10);
+    rk[11] = AESNI_EXP256_ODD(rk[10], rk[9]);
+    rk[12] = AESNI_EXP256_EVEN(rk[10], rk[11], 0x20);
+    rk[13] = AESNI_EXP256_ODD(rk[12], rk[11]);
+    rk[14] = AESNI_EXP256_EVEN(rk[12], rk[13], 0x40);
+}
+
+/**
+ * @brief expand key with AESKEYGENASSIST, then derive the decryption keys
+ * with AESIMC
+ * @param[out] sched pointer to the key schedule
+ * @param[in] key pointer to the key bytes
+ * @param[in] length key length in bytes
+ */
+AESNI_TARGET
+static void aesni_setkey(aes_sched_t *sched, const uint8_t *key, uint32_t length)
+{
+    __m128i *rk = (__m128i *)sched->enc.byte;
+    uint32_t nr;
+
+    switch (length) {
+        case AES128_KEY_SIZE/8:
+            nr = AES128_NR;
+            aesni_expand128(rk, key);
+            break;
+        case AES192_KEY_SIZE/8:
+            nr = AES192_NR;
+            aesni_expand192(rk, key);
+            break;
+        default:
+            nr = AES256_NR;
+            aesni_expand256(rk, key);
+            break;
+    }
+    sched->nr = nr;
+    sched->length = length;
+    aes_stats_add_keyexpansion(length);
+    /* dec[r] is used at round r of the equivalent inverse cipher */
+    for (uint32_t r=0;r<=nr;r++) {
+        __m128i k = _mm_load_si128((const __m128i *)sched->enc.byte[nr-r]);
+        if ((r != 0) && (r != nr)) {
+            k = _mm_aesimc_si128(k);
+        }
+        _mm_store_si128((__m128i *)sched->dec.byte[r], k);
+    }
+}
+
+AESNI_TARGET
+static void aesni_encrypt(const aes_sched_t *sched, uint8_t *out, const uint8_t *in, size_t nblocks)
+{
+    const __m128i *rk = (const __m128i *)sched->enc.byte;
+    uint32_t nr = sched->nr;
+    __m128i b[AESNI_LANES];
+    size_t i = 0;
+
+    for (;i+AESNI_LANES<=nblocks;i+=AESNI_LANES) {
+        for (uint32_t l=0;l<AESNI_LANES;l++) {
+            b[l] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + (i+l)*AES_BLOCK_SIZE)), rk[0]);
+        }
+        for (uint32_t r=1;r<nr;r++) {
+            __m128i k = rk[r];
+            for (uint32_t l=0;l<AESNI_LANES;l++) {
+                b[l] = _mm_aesenc_si128(b[l], k);
+            }
+        }
+        for (uint32_t l=0;l<AESNI_LANES;l++) {
+            b[l] = _mm_aesenclast_si128(b[l], rk[nr]);
+            _mm_storeu_si128((__m128i *)(out + (i+l)*AES_BLOCK_SIZE), b[l]);
+        }
+    }
+    for (;i<nblocks;i++) {
+        __m128i s = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + i*AES_BLOCK_SIZE)), rk[0]);
+        for (uint32_t r=1;r<nr;r++) {
+            s = _mm_aesenc_si128(s, rk[r]);
+        }
+        s = _mm_aesenclast_si128(s, rk[nr]);
+        _mm_storeu_si128((__m128i *)(out + i*AES_BLOCK_SIZE), s);
+    }
+}
+
+AESNI_TARGET
+static void aesni_decrypt(const aes_sched_t *sched, uint8_t *out, const uint8_t *in, size_t nblocks)
+{
+    const __m128i *rk = (const __m128i *)sched->dec.byte;
+    uint32_t nr = sched->nr;
+    __m128i b[AESNI_LANES];
+    size_t i = 0;
+
+    for (;i+AESNI_LANES<=nblocks;i+=AESNI_LANES) {
+        for (uint32_t l=0;l<AESNI_LANES;l++) {
+            b[l] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + (i+l)*AES_BLOCK_SIZE)), rk[0]);
+        }
+        for (uint32_t r=1;r<nr;r++) {
+            __m128i k = rk[r];
+            for (uint32_t l=0;l<AESNI_LANES;l++) {
+                b[l] = _mm_aesdec_si128(b[l], k);
+            }
+        }
+        for (uint32_t l=0;l<AESNI_LANES;l++) {
+            b[l] = _mm_aesdeclast_si128(b[l], rk[nr]);
+            _mm_storeu_si128((__m128i *)(out + (i+l)*AES_BLOCK_SIZE), b[l]);
+        }
+    }
+    for (;i<nblocks;i++) {
+        __m128i s = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + i*AES_BLOCK_SIZE)), rk[0]);
+        for (uint32_t r=1;r<nr;r++) {
+            s = _mm_aesdec_si128(s, rk[r]);
+        }
+        s = _mm_aesdeclast_si128(s, rk[nr]);
+        _mm_storeu_si128((__m128i *)(out + i*AES_BLOCK_SIZE), s);
+    }
+}
+
+/**
+ * @brief CCM payload blocks: each round of the CBC-MAC block is issued next
+ * to the same round of a keystream block, so the serial MAC chain and the
+ * CTR work share the latency of AESENC
+ * @param[in] sched pointer to the key schedule
+ * @param[in,out] mac CBC-MAC chaining value
+ * @param[out] out output blocks, may alias in
+ * @param[in] in input blocks
+ * @param[in] ctr nblocks counter blocks
+ * @param[in] nblocks number of blocks
+ * @param[in] decrypt 0 to encrypt, 1 to decrypt
+ * @note when deciphering the MAC input is the plaintext, known only once
+ * its keystream block is done, so the MAC runs one block behind the CTR
+ */
+AESNI_TARGET
+static void aesni_ccm(const aes_sched_t *sched, uint8_t mac[AES_BLOCK_SIZE], uint8_t *out,
+                      const uint8_t *in, const uint8_t *ctr, size_t nblocks, uint32_t decrypt)
+{
+    const __m128i *rk = (const __m128i *)sched->enc.byte;
+    uint32_t nr = sched->nr;
+    __m128i x = _mm_loadu_si128((const __m128i *)mac);
+    __m128i k;
+
+    if (nblocks == 0) {
+        return;
+    }
+    if (!decrypt) {
+        for (size_t i=0;i<nblocks;i++) {
+            __m128i p = _mm_loadu_si128((const __m128i *)(in + i*AES_BLOCK_SIZE));
+
+            x = _mm_xor_si128(_mm_xor_si128(x, p), rk[0]);
+            k = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(ctr + i*AES_BLOCK_SIZE)), rk[0]);
+            for (uint32_t r=1;r<nr;r++) {
+                x = _mm_aesenc_si128(x, rk[r]);
+                k = _mm_aesenc_si128(k, rk[r]);
+            }
+            x = _mm_aesenclast_si128(x, rk[nr]);
+            k = _mm_aesenclast_si128(k, rk[nr]);
+            _mm_storeu_si128((__m128i *)(out + i*AES_BLOCK_SIZE), _mm_xor_si128(p, k));
+        }
+        _mm_storeu_si128((__m128i *)mac, x);
+        return;
+    }
+    /* first keystream block alone, then MAC of block i with keystream i+1 */
+    k = _mm_xor_si128(_mm_loadu_si128((const __m128i *)ctr), rk[0]);
+    for (uint32_t r=1;r<nr;r++) {
+        k = _mm_aesenc_si128(k, rk[r]);
+    }
+    k = _mm_aesenclast_si128(k, rk[nr]);
+    for (size_t i=0;i<nblocks;i++) {
+        __m128i p = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + i*AES_BLOCK_SIZE)), k);
+
+        _mm_storeu_si128((__m128i *)(out + i*AES_BLOCK_SIZE), p);
+        x = _mm_xor_si128(_mm_xor_si128(x, p), rk[0]);
+        if (i + 1 == nblocks) {
+            for (uint32_t r=1;r<nr;r++) {
+                x = _mm_aesenc_si128(x, rk[r]);
+            }
+            x = _mm_aesenclast_si128(x, rk[nr]);
+            break;
+        }
+        k = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(ctr + (i+1)*AES_BLOCK_SIZE)), rk[0]);
+        for (uint32_t r=1;r<nr;r++) {
+            x = _mm_aesenc_si128(x, rk[r]);
+            k = _mm_aesenc_si128(k, rk[r]);
+        }
+        x = _mm_aesenclast_si128(x, rk[nr]);
+        k = _mm_aesenclast_si128(k, rk[nr]);
+    }
+    _mm_storeu_si128((__m128i *)mac, x);
+}
+
+/**
+ * @brief one OCB block outside a full batch
+ * @param[in] rk round keys, encryption or decryption schedule
+ * @param[in] nr number of rounds
+ * @param[out] out output block, may alias in
+ * @param[in] in input block
+ * @param[in] l L_{ntz(i)} of the block
+ * @param[in,out] o offset, advanced to the block
+ * @param[in,out] c checksum
+ * @param[in] decrypt 0 to encrypt, 1 to decrypt
+ */
+AESNI_TARGET
+static inline void aesni_ocb_one(const __m128i *rk, uint32_t nr, uint8_t *out, const uint8_t *in,
+                                 const uint8_t *l, __m128i *o, __m128i *c, uint32_t decrypt)
+{
+    __m128i p = _mm_loadu_si128((const __m128i *)in);
+    __m128i s;
+
+    *o = _mm_xor_si128(*o, _mm_loadu_si128((const __m128i *)l));
+    s = _mm_xor_si128(_mm_xor_si128(p, *o), rk[0]);
+    if (decrypt) {
+        for (uint32_t r=1;r<nr;r++) {
+            s = _mm_aesdec_si128(s, rk[r]);
+        }
+        s = _mm_xor_si128(_mm_aesdeclast_si128(s, rk[nr]), *o);
+        *c = _mm_xor_si128(*c, s);
+    } else {
+        for (uint32_t r=1;r<nr;r++) {
+            s = _mm_aesenc_si128(s, rk[r]);
+        }
+        s = _mm_xor_si128(_mm_aesenclast_si128(s, rk[nr]), *o);
+        *c = _mm_xor_si128(*c, p);
+    }
+    _mm_storeu_si128((__m128i *)out, s);
+}
+
+/**
+ * @brief OCB blocks, AESNI_LANES at a time: the offsets of an aligned batch
+ * are its base XOR constants, computed side by side, and masking and
+ * checksum are folded into the first and last rounds
+ * @param[in] sched pointer to the key schedule
+ * @param[out] out output blocks, may alias in
+ * @param[in] in input blocks
+ * @param[in] nblocks number of blocks
+ * @param[in] index number of blocks already processed in the message
+ * @param[in,out] offset offset of block index, receives the offset of the last block
+ * @param[in,out] checksum XOR of the plaintext blocks
+ * @param[in] l L_i table, covering ntz(index+nblocks)
+ * @param[in] decrypt 0 to encrypt, 1 to decrypt
+ */
+AESNI_TARGET
+static void aesni_ocb(const aes_sched_t *sched, uint8_t *out, const uint8_t *in, size_t nblocks,
+                      uint64_t index, uint8_t offset[AES_BLOCK_SIZE], uint8_t checksum[AES_BLOCK_SIZE],
+                      const uint8_t (*l)[AES_BLOCK_SIZE], uint32_t decrypt)
+{
+    const __m128i *rk = (const __m128i *)(decrypt ? sched->dec.byte : sched->enc.byte);
+    uint32_t nr = sched->nr;
+    __m128i o = _mm_loadu_si128((const __m128i *)offset);
+    __m128i c = _mm_loadu_si128((const __m128i *)checksum);
+    __m128i b[AESNI_LANES], off[AESNI_LANES], pre[AESNI_LANES];
+    size_t i = 0;
+
+    /* pre[j] = L_{ntz(1)} ^ ... ^ L_{ntz(j)}, the offsets of an aligned batch relative to its base */
+    pre[0] = _mm_setzero_si128();
+    for (uint32_t j=1;j<AESNI_LANES;j++) {
+        pre[j] = _mm_xor_si128(pre[j-1], _mm_loadu_si128((const __m128i *)l[__builtin_ctz(j)]));
+    }
+    /* single blocks up to a batch boundary, so that every batch starts aligned */
+    for (;(i<nblocks) && ((index + i) % AESNI_LANES != 0);i++) {
+        aesni_ocb_one(rk, nr, out + i*AES_BLOCK_SIZE, in + i*AES_BLOCK_SIZE,
+                      l[__builtin_ctzll(index + i + 1)], &o, &c, decrypt);
+    }
+    for (;i+AESNI_LANES<=nblocks;i+=AESNI_LANES) {
+        /* independent offsets, only the last one depends on the batch number */
+        for (uint32_t j=0;j+1<AESNI_LANES;j++) {
+            off[j] = _mm_xor_si128(o, pre[j+1]);
+        }
+        o = _mm_xor_si128(_mm_xor_si128(o, pre[AESNI_LANES-1]),
+                          _mm_loadu_si128((const __m128i *)l[__builtin_ctzll(index + i + AESNI_LANES)]));
+        off[AESNI_LANES-1] = o;
+        for (uint32_t j=0;j<AESNI_LANES;j++) {
+            __m128i p = _mm_loadu_si128((const __m128i *)(in + (i+j)*AES_BLOCK_SIZE));
+
+            if (!decrypt) {
+                c = _mm_xor_si128(c, p);
+            }
+            b[j] = _mm_xor_si128(_mm_xor_si128(p, off[j]), rk[0]);
+        }
+        if (decrypt) {
+            for (uint32_t r=1;r<nr;r++) {
+                __m128i k = rk[r];
+                for (uint32_t j=0;j<AESNI_LANES;j++) {
+                    b[j] = _mm_aesdec_si128(b[j], k);
+                }
+            }
+            for (uint32_t j=0;j<AESNI_LANES;j++) {
+                b[j] = _mm_xor_si128(_mm_aesdeclast_si128(b[j], rk[nr]), off[j]);
+                c = _mm_xor_si128(c, b[j]);
+                _mm_storeu_si128((__m128i *)(out + (i+j)*AES_BLOCK_SIZE), b[j]);
+            }
+        } else {
+            for (uint32_t r=1;r<nr;r++) {
+                __m128i k = rk[r];
+                for (uint32_t j=0;j<AESNI_LANES;j++) {
+                    b[j] = _mm_aesenc_si128(b[j], k);
+                }
+            }
+            for (uint32_t j=0;j<AESNI_LANES;j++) {
+                b[j] = _mm_xor_si128(_mm_aesenclast_si128(b[j], rk[nr]), off[j]);
+                _mm_storeu_si128((__m128i *)(out + (i+j)*AES_BLOCK_SIZE), b[j]);
+            }
+        }
+    }
+    for (;i<nblocks;i++) {
+        aesni_ocb_one(rk, nr, out + i*AES_BLOCK_SIZE, in + i*AES_BLOCK_SIZE,
+                      l[__builtin_ctzll(index + i + 1)], &o, &c, decrypt);
+    }
+    _mm_storeu_si128((__m128i *)offset, o);
+    _mm_storeu_si128((__m128i *)checksum, c);
+}
+
+#else /* not x86 */
+
+static int32_t aesni_supported(void)
+{
+    return 0;
+}
+
+static void aesni_setkey(aes_sched_t *sched, const uint8_t *key, uint32_t length)
+{
+    aes_engine_ref.setkey(sched, key, length);
+}
+
+static void aesni_encrypt(const aes_sched_t *sched, uint8_t *out, const uint8_t *in, size_t nblocks)
+{
+    aes_engine_ref.encrypt(sched, out, in, nblocks);
+}
+
+static void aesni_decrypt(const aes_sched_t *sched, uint8_t *out, const uint8_t *in, size_t nblocks)
+{
+    aes_engine_ref.decrypt(sched, out, in, nblocks);
+}
+
+#endif
+
+const aes_engine_t aes_engine_aesni = {
+    .name = "aesni",
+    .id = AES_ENGINE_AESNI,
+    .supported = aesni_supported,
+    .setkey = aesni_setkey,
+    .encrypt = aesni_encrypt,
+    .decrypt = aesni_decrypt,
+#if defined(__x86_64__) || defined(__i386__)
+    .ccm = aesni_ccm,
+    .ocb = aesni_ocb,
+#endif
+};
+
+#undef AES_ENGINE_AESNI_C
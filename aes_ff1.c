@@ -0,0 +1,673 @@
+/**
+ * @file aes_ff1.c
+ * @brief libaes FF1 format-preserving encryption (NIST SP 800-38G)
+ *
+ * An FF1 round is a CBC-MAC over P || Q. P and the leading blocks of Q only
+ * depend on the key, radix, tweak and string length, so their chaining
+ * value is computed once per length when the FF1 object is created; a round
+ * then costs the one or two blocks holding the round number and NUM(B).
+ * Those blocks depend on the previous round, so a single string is a chain
+ * of serial block encryptions. The batch calls advance AES_FF1_BATCH
+ * strings through each round together, one wide engine call per block, and
+ * the engine keeps its lanes full with blocks from different strings.
+ *
+ * The numeral arithmetic works on 32-bit words holding as many numerals as
+ * fit, so NUM_radix and the reduction of y modulo radix^m take one step
+ * per word instead of one per numeral. When each half fits a single word
+ * (up to 18 decimal digits) the halves stay integers through all the rounds
+ * and are converted to numerals only once at the end.
+*/
+
+#define AES_FF1_C
+#define AES_LIB_PRIVATE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_engine.h"
+#include "aes_stats.h"
+#include "aes_lib.h"
+
+/* minimum number of FF1 objects mapped at a time by the arena */
+#define FF1_CHUNK       16
+/* 32-bit words of the largest number handled: radix^AES_FF1_LEN_MAX/2 and S */
+#define FF1_WORDS       18
+/* SP 800-38G rev 1: radix^minlen >= 1000000 */
+#define FF1_DOMAIN_MIN  1000000
+
+/* FF1 objects hold MAC chaining values derived from the key */
+static aes_arena_t ff1_arena;
+static pthread_once_t ff1_once = PTHREAD_ONCE_INIT;
+
+static void ff1_init_arena(void)
+{
+    aes_arena_init(&ff1_arena, sizeof(aes_ff1_t), FF1_CHUNK, AES_ARENA_SECURE);
+}
+
+/**
+ * @brief byte length of radix^v - 1, the b of SP 800-38G
+ * @param[in] ff1 pointer to the FF1 object, radix set
+ * @param[in] v numerals
+ * @return ceil(ceil(v * log2(radix)) / 8)
+ */
+static uint32_t ff1_bytes(const aes_ff1_t *ff1, uint32_t v)
+{
+    uint32_t w[FF1_WORDS];
+    uint32_t used = 1;
+    uint32_t bits;
+
+    w[0] = 1;
+    for (uint32_t i=0;i<v;i++) {
+        uint64_t carry = 0;
+
+        for (uint32_t j=0;j<used;j++) {
+            uint64_t t = (uint64_t)w[j]*ff1->radix + carry;
+
+            w[j] = (uint32_t)t;
+            carry = t >> 32;
+        }
+        if (carry != 0) {
+            w[used++] = (uint32_t)carry;
+        }
+    }
+    /* radix^v - 1, then its bit length */
+    for (uint32_t j=0;j<used;j++) {
+        if (w[j]-- != 0) {
+            break;
+        }
+    }
+    while ((used > 0) && (w[used-1] == 0)) {
+        used--;
+    }
+    bits = (used == 0) ? 0 : 32*(used - 1) + (32 - (uint32_t)__builtin_clz(w[used-1]));
+    return (bits + 7)/8;
+}
+
+/**
+ * @brief NUM_radix of a numeral string as a b-byte big-endian integer
+ * @param[in] ff1 pointer to the FF1 object
+ * @param[in] x numerals, most significant first
+ * @param[in] len number of numerals
+ * @param[out] out b bytes
+ * @param[in] b output length, large enough for radix^len - 1
+ */
+static void ff1_num(const aes_ff1_t *ff1, const uint16_t *x, size_t len, uint8_t *out, size_t b)
+{
+    uint32_t w[FF1_WORDS];
+    uint32_t used = 0;
+
+    for (size_t i=0;i<len;) {
+        uint32_t k = ((len - i) < ff1->group) ? (uint32_t)(len - i) : ff1->group;
+        uint64_t carry = 0;
+
+        for (uint32_t j=0;j<k;j++) {
+            carry = carry*ff1->radix + x[i+j];
+        }
+        for (uint32_t j=0;j<used;j++) {
+            uint64_t t = (uint64_t)w[j]*ff1->pow[k] + carry;
+
+            w[j] = (uint32_t)t;
+            carry = t >> 32;
+        }
+        if (carry != 0) {
+            w[used++] = (uint32_t)carry;
+        }
+        i += k;
+    }
+    for (size_t j=0;j<b;j++) {
+        out[b-1-j] = (j/4 < used) ? (uint8_t)(w[j/4] >> (8*(j % 4))) : 0;
+    }
+}
+
+/**
+ * @brief divide by the radix with its reciprocal
+ * @param[in] ff1 pointer to the FF1 object
+ * @param[in,out] x dividend, receives the quotient
+ * @return remainder
+ * @note inv = floor(2^32 / radix) gives the quotient or one less, a single
+ * correction step fixes it without a division instruction
+ */
+static inline uint32_t ff1_divmod(const aes_ff1_t *ff1, uint32_t *x)
+{
+    uint32_t q = (uint32_t)(((uint64_t)*x*ff1->inv) >> 32);
+    uint32_t r = *x - q*ff1->radix;
+    uint32_t c = (r >= ff1->radix) ? 1 : 0;
+
+    *x = q + c;
+    return r - (ff1->radix & (0u - c));
+}
+
+/**
+ * @brief NUM_radix of a numeral string below 2^32
+ * @param[in] ff1 pointer to the FF1 object
+ * @param[in] x numerals, most significant first
+ * @param[in] len number of numerals, at most group
+ * @return value
+ */
+static inline uint32_t ff1_word(const aes_ff1_t *ff1, const uint16_t *x, size_t len)
+{
+    uint32_t w = 0;
+
+    for (size_t j=0;j<len;j++) {
+        w = w*ff1->radix + x[j];
+    }
+    return w;
+}
+
+/**
+ * @brief STR^len_radix of a value below 2^32
+ * @param[in] ff1 pointer to the FF1 object
+ * @param[in] w value, below radix^len
+ * @param[out] x len numerals, most significant first
+ * @param[in] len number of numerals
+ */
+static inline void ff1_str(const aes_ff1_t *ff1, uint32_t w, uint16_t *x, size_t len)
+{
+    for (size_t j=len;j>0;j--) {
+        x[j-1] = (uint16_t)ff1_divmod(ff1, &w);
+    }
+}
+
+/**
+ * @brief divide a number by radix^k in place, without a division instruction
+ * @param[in] ff1 pointer to the FF1 object
+ * @param[in] k numerals per step, 1 to group
+ * @param[in,out] y big-endian 32-bit words, receives the quotient
+ * @param[in] words number of words
+ * @return remainder
+ * @note the divisor is normalized so its top bit is set and each 2-by-1
+ * word step uses the precomputed reciprocal (Moller and Granlund,
+ * "Improved division by invariant integers"); the dividend is shifted by
+ * the same amount on the fly, which leaves the quotient unchanged
+ */
+static uint32_t ff1_short_div(const aes_ff1_t *ff1, uint32_t k, uint32_t *y, size_t words)
+{
+    uint32_t s = ff1->shift[k];
+    uint32_t d = ff1->pow[k] << s;
+    uint32_t v = ff1->recip[k];
+    uint32_t r = (s == 0 || words == 0) ? 0 : (y[0] >> (32 - s));
+
+    for (size_t j=0;j<words;j++) {
+        uint32_t u0 = y[j] << s;
+        uint64_t p;
+        uint32_t q;
+
+        if ((s != 0) && (j + 1 < words)) {
+            u0 |= y[j+1] >> (32 - s);
+        }
+        p = (uint64_t)v*r + (((uint64_t)r << 32) | u0);
+        q = (uint32_t)(p >> 32) + 1;
+        r = u0 - q*d;
+        if (r > (uint32_t)p) {
+            q--;
+            r += d;
+        }
+        if (r >= d) {
+            q++;
+            r -= d;
+        }
+        y[j] = q;
+    }
+    return r >> s;
+}
+
+/**
+ * @brief a = (NUM_radix(a) +/- NUM(s)) mod radix^m, written back as m numerals
+ * @param[in] ff1 pointer to the FF1 object
+ * @param[in,out] a m numerals, most significant first
+ * @param[in] m number of numerals
+ * @param[in] s y as d big-endian bytes
+ * @param[in] d multiple of 4, at most 4*FF1_WORDS
+ * @param[in] sub 0 to add y, 1 to subtract it
+ * @note only the low m numerals of y matter, they are peeled off a word of
+ * numerals at a time by short division and added or subtracted with carry
+ */
+static void ff1_add(const aes_ff1_t *ff1, uint16_t *a, size_t m, const uint8_t *s, size_t d,
+                    uint32_t sub)
+{
+    uint32_t y[FF1_WORDS];
+    size_t words = d/4;
+    size_t top = 0;
+    uint32_t carry = 0;
+
+    for (size_t j=0;j<words;j++) {
+        y[j] = ((uint32_t)s[4*j] << 24) | ((uint32_t)s[4*j+1] << 16) |
+               ((uint32_t)s[4*j+2] << 8) | (uint32_t)s[4*j+3];
+    }
+    for (size_t i=m;i>0;) {
+        uint32_t k = (i < ff1->group) ? (uint32_t)i : ff1->group;
+        uint32_t word;
+
+        while ((top < words) && (y[top] == 0)) {
+            top++;
+        }
+        word = ff1_short_div(ff1, k, y + top, words - top);
+        for (uint32_t j=0;j<k;j++) {
+            uint32_t digit = ff1_divmod(ff1, &word) + carry;
+
+            i--;
+            if (sub) {
+                carry = (a[i] < digit) ? 1 : 0;
+                a[i] = (uint16_t)(a[i] + (carry ? ff1->radix : 0) - digit);
+            } else {
+                uint32_t t = a[i] + digit;
+
+                carry = (t >= ff1->radix) ? 1 : 0;
+                a[i] = (uint16_t)(t - (carry ? ff1->radix : 0));
+            }
+        }
+    }
+    aes_memzero(y, sizeof(y));
+}
+
+/**
+ * @brief precompute the round-independent part of the PRF for one length
+ * @param[in,out] ff1 pointer to the FF1 object, radix set
+ * @param[in] n string length
+ * @param[in] tweak tweak bytes
+ * @param[in] t tweak length
+ */
+static void ff1_prepare(aes_ff1_t *ff1, uint32_t n, const uint8_t *tweak, size_t t)
+{
+    const aes_ctx_t *ctx = ff1->ctx;
+    aes_ff1_len_t *l = &ff1->len[n];
+    uint32_t u = n/2;
+    uint8_t block[AES_BLOCK_SIZE];
+    size_t pad, fixed;
+
+    l->b = (uint8_t)ff1_bytes(ff1, n - u);
+    l->d = (uint8_t)(4*((l->b + 3)/4) + 4);
+    /* P = [1]^1 || [2]^1 || [1]^1 || [radix]^3 || [10]^1 || [u mod 256]^1 || [n]^4 || [t]^4 */
+    block[0] = 1;
+    block[1] = 2;
+    block[2] = 1;
+    block[3] = (uint8_t)(ff1->radix >> 16);
+    block[4] = (uint8_t)(ff1->radix >> 8);
+    block[5] = (uint8_t)ff1->radix;
+    block[6] = AES_FF1_ROUNDS;
+    block[7] = (uint8_t)u;
+    for (uint32_t i=0;i<4;i++) {
+        block[8+i] = (uint8_t)(n >> (24 - 8*i));
+        block[12+i] = (uint8_t)(t >> (24 - 8*i));
+    }
+    ctx->engine->encrypt(&ctx->sched, l->mac, block, 1);
+    /* Q = T || [0]^((-t-b-1) mod 16) || [i]^1 || [NUM_radix(B)]^b: whole blocks before [i] are fixed */
+    pad = (AES_BLOCK_SIZE - (t + l->b + 1) % AES_BLOCK_SIZE) % AES_BLOCK_SIZE;
+    fixed = (t + pad)/AES_BLOCK_SIZE;
+    for (size_t j=0;j<fixed;j++) {
+        for (size_t i=0;i<AES_BLOCK_SIZE;i++) {
+            size_t pos = j*AES_BLOCK_SIZE + i;
+
+            l->mac[i] ^= (pos < t) ? tweak[pos] : 0;
+        }
+        ctx->engine->encrypt(&ctx->sched, l->mac, l->mac, 1);
+    }
+    l->prefix_len = (uint8_t)((t + pad) % AES_BLOCK_SIZE);
+    for (size_t i=0;i<(t + pad) % AES_BLOCK_SIZE;i++) {
+        size_t pos = fixed*AES_BLOCK_SIZE + i;
+
+        l->prefix[i] = (pos < t) ? tweak[pos] : 0;
+    }
+    l->blocks = (uint8_t)((l->prefix_len + 1 + l->b)/AES_BLOCK_SIZE);
+    aes_memzero(block, sizeof(block));
+}
+
+/**
+ * @brief ff1_batch for strings whose halves are below 2^32
+ * @param[in] ff1 pointer to the FF1 object
+ * @param[in,out] x cnt strings of n numerals, contiguous
+ * @param[in] n string length, n - n/2 at most group
+ * @param[in] cnt number of strings
+ * @param[in] decrypt 0 to encrypt, 1 to decrypt
+ * @note the halves stay integers through the rounds and are converted to
+ * numerals once at the end: NUM(B) is the word itself, b <= 4 so Q ends in
+ * a single varying block and S is R, and y mod radix^m is one short
+ * division of a 64-bit y
+ */
+static void ff1_batch_word(const aes_ff1_t *ff1, uint16_t *x, size_t n, size_t cnt,
+                           uint32_t decrypt)
+{
+    const aes_ctx_t *ctx = ff1->ctx;
+    const aes_ff1_len_t *l = &ff1->len[n];
+    uint32_t h[AES_FF1_BATCH][2];
+    uint8_t r[AES_FF1_BATCH*AES_BLOCK_SIZE];
+    uint8_t base[AES_BLOCK_SIZE];
+    size_t u = n/2;
+    size_t v = n - u;
+    uint32_t a = 0;     /* h[k][a] is A, h[k][a^1] is B */
+
+    /* chaining value XOR the fixed prefix of the varying block */
+    aes_xor_blocks(base, l->mac, l->prefix, AES_BLOCK_SIZE);
+    for (size_t k=0;k<cnt;k++) {
+        h[k][0] = ff1_word(ff1, x + k*n, u);
+        h[k][1] = ff1_word(ff1, x + k*n + u, v);
+    }
+    for (uint32_t round=0;round<AES_FF1_ROUNDS;round++) {
+        uint32_t i = decrypt ? (AES_FF1_ROUNDS - 1 - round) : round;
+        size_t m = (i % 2 == 0) ? u : v;
+        uint32_t mod = ff1->pow[m];
+
+        for (size_t k=0;k<cnt;k++) {
+            uint8_t *rk = r + k*AES_BLOCK_SIZE;
+            uint32_t w = h[k][decrypt ? a : (a ^ 1)];
+
+            memcpy(rk, base, AES_BLOCK_SIZE);
+            rk[l->prefix_len] ^= (uint8_t)i;
+            for (uint32_t j=0;j<l->b;j++) {
+                rk[AES_BLOCK_SIZE-1-j] ^= (uint8_t)(w >> (8*j));
+            }
+        }
+        ctx->engine->encrypt(&ctx->sched, r, r, cnt);
+        for (size_t k=0;k<cnt;k++) {
+            const uint8_t *rk = r + k*AES_BLOCK_SIZE;
+            uint32_t y[2];
+            uint32_t ym;
+
+            y[0] = ((uint32_t)rk[0] << 24) | ((uint32_t)rk[1] << 16) | ((uint32_t)rk[2] << 8) | rk[3];
+            y[1] = ((uint32_t)rk[4] << 24) | ((uint32_t)rk[5] << 16) | ((uint32_t)rk[6] << 8) | rk[7];
+            ym = ff1_short_div(ff1, (uint32_t)m, y, 2);
+            if (decrypt) {
+                uint32_t w = h[k][a ^ 1];
+
+                h[k][a ^ 1] = (w >= ym) ? (w - ym) : (uint32_t)((uint64_t)w + mod - ym);
+            } else {
+                uint64_t c = (uint64_t)h[k][a] + ym;
+
+                h[k][a] = (uint32_t)((c >= mod) ? (c - mod) : c);
+            }
+        }
+        a ^= 1;
+    }
+    for (size_t k=0;k<cnt;k++) {
+        ff1_str(ff1, h[k][a], x + k*n, u);
+        ff1_str(ff1, h[k][a ^ 1], x + k*n + u, v);
+    }
+    aes_memzero(h, sizeof(h));
+    aes_memzero(r, sizeof(r));
+    aes_memzero(base, sizeof(base));
+}
+
+/**
+ * @brief run up to AES_FF1_BATCH strings of one length through the ten rounds
+ * @param[in] ff1 pointer to the FF1 object
+ * @param[in,out] x cnt strings of n numerals, contiguous
+ * @param[in] n string length
+ * @param[in] cnt number of strings
+ * @param[in] decrypt 0 to encrypt, 1 to decrypt
+ */
+static void ff1_batch(const aes_ff1_t *ff1, uint16_t *x, size_t n, size_t cnt, uint32_t decrypt)
+{
+    const aes_ctx_t *ctx = ff1->ctx;
+    const aes_ff1_len_t *l = &ff1->len[n];
+    uint16_t h[AES_FF1_BATCH][2][AES_FF1_LEN_MAX - AES_FF1_LEN_MAX/2];
+    uint8_t q[AES_FF1_BATCH][AES_FF1_BLOCKS*AES_BLOCK_SIZE];
+    uint8_t r[AES_FF1_BATCH*AES_BLOCK_SIZE];
+    uint8_t ext[AES_FF1_BATCH*(AES_FF1_BLOCKS - 1)*AES_BLOCK_SIZE];
+    uint8_t s[AES_FF1_BLOCKS*AES_BLOCK_SIZE];
+    uint64_t mac[2];
+    size_t u = n/2;
+    size_t v = n - u;
+    size_t sb = (l->d + AES_BLOCK_SIZE - 1)/AES_BLOCK_SIZE;
+    uint32_t a = 0;     /* h[k][a] is A, h[k][a^1] is B: the Feistel swap flips a */
+
+    memcpy(mac, l->mac, sizeof(mac));
+    for (size_t k=0;k<cnt;k++) {
+        memcpy(h[k][0], x + k*n, u*sizeof(uint16_t));
+        memcpy(h[k][1], x + k*n + u, v*sizeof(uint16_t));
+        memcpy(q[k], l->prefix, AES_BLOCK_SIZE);
+    }
+    for (uint32_t round=0;round<AES_FF1_ROUNDS;round++) {
+        uint32_t i = decrypt ? (AES_FF1_ROUNDS - 1 - round) : round;
+        size_t m = (i % 2 == 0) ? u : v;
+
+        /* Q tails: round number and NUM_radix(B), A when deciphering, after the fixed prefix */
+        for (size_t k=0;k<cnt;k++) {
+            q[k][l->prefix_len] = (uint8_t)i;
+            ff1_num(ff1, h[k][decrypt ? a : (a ^ 1)], n - m, q[k] + l->prefix_len + 1, l->b);
+        }
+        /* R = PRF(P || Q), the chains of all strings in one engine call per block */
+        for (uint32_t j=0;j<l->blocks;j++) {
+            for (size_t k=0;k<cnt;k++) {
+                uint64_t c[2], t[2];
+
+                if (j == 0) {
+                    c[0] = mac[0];
+                    c[1] = mac[1];
+                } else {
+                    memcpy(c, r + k*AES_BLOCK_SIZE, sizeof(c));
+                }
+                memcpy(t, q[k] + j*AES_BLOCK_SIZE, sizeof(t));
+                c[0] ^= t[0];
+                c[1] ^= t[1];
+                memcpy(r + k*AES_BLOCK_SIZE, c, sizeof(c));
+            }
+            ctx->engine->encrypt(&ctx->sched, r, r, cnt);
+        }
+        /* S = R || CIPH(R ^ [1]^16) || CIPH(R ^ [2]^16) || ... */
+        if (sb > 1) {
+            for (size_t k=0;k<cnt;k++) {
+                for (size_t j=1;j<sb;j++) {
+                    uint8_t *e = ext + (k*(sb - 1) + j - 1)*AES_BLOCK_SIZE;
+
+                    memcpy(e, r + k*AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+                    e[AES_BLOCK_SIZE-1] ^= (uint8_t)j;
+                }
+            }
+            ctx->engine->encrypt(&ctx->sched, ext, ext, cnt*(sb - 1));
+        }
+        /* C = A + y into A (encrypt) or B - y into B (decrypt), then swap the halves */
+        for (size_t k=0;k<cnt;k++) {
+            const uint8_t *y = r + k*AES_BLOCK_SIZE;
+
+            if (sb > 1) {
+                memcpy(s, y, AES_BLOCK_SIZE);
+                memcpy(s + AES_BLOCK_SIZE, ext + k*(sb - 1)*AES_BLOCK_SIZE,
+                       (sb - 1)*AES_BLOCK_SIZE);
+                y = s;
+            }
+            ff1_add(ff1, h[k][decrypt ? (a ^ 1) : a], m, y, l->d, decrypt);
+        }
+        a ^= 1;
+    }
+    for (size_t k=0;k<cnt;k++) {
+        memcpy(x + k*n, h[k][a], u*sizeof(uint16_t));
+        memcpy(x + k*n + u, h[k][a ^ 1], v*sizeof(uint16_t));
+    }
+    aes_memzero(h, sizeof(h));
+    aes_memzero(q, sizeof(q));
+    aes_memzero(r, sizeof(r));
+    aes_memzero(ext, sizeof(ext));
+    aes_memzero(s, sizeof(s));
+    aes_memzero(mac, sizeof(mac));
+}
+
+/**
+ * @brief shared body of the encrypt and decrypt calls
+ * @return AES_OK or an AES_ERR_* code
+ */
+static aes_status_t ff1_crypt(const aes_ff1_t *ff1, uint16_t *out, const uint16_t *in,
+                              size_t len, size_t count, uint32_t decrypt)
+{
+    const aes_ctx_t *ctx;
+
+    if ((ff1 == NULL) || ((count != 0) && ((out == NULL) || (in == NULL)))) {
+        return AES_ERR_PARAM;
+    }
+    if ((len < ff1->min_len) || (len > AES_FF1_LEN_MAX)) {
+        return AES_ERR_LENGTH;
+    }
+    for (size_t i=0;i<count*len;i++) {
+        if (in[i] >= ff1->radix) {
+            return AES_ERR_PARAM;
+        }
+    }
+    if ((count != 0) && (out != in)) {
+        memmove(out, in, count*len*sizeof(uint16_t));
+    }
+    for (size_t done=0;done<count;) {
+        size_t cnt = (count - done < AES_FF1_BATCH) ? (count - done) : AES_FF1_BATCH;
+
+        if (len - len/2 <= ff1->group) {
+            ff1_batch_word(ff1, out + done*len, len, cnt, decrypt);
+        } else {
+            ff1_batch(ff1, out + done*len, len, cnt, decrypt);
+        }
+        done += cnt;
+    }
+    ctx = ff1->ctx;
+    aes_stats_add_blocks(ctx->engine->id, AES_STATS_MODE_FF1, ctx->sched.length,
+                         decrypt ? AES_STATS_DIR_DEC : AES_STATS_DIR_ENC,
+                         (uint64_t)count*AES_FF1_ROUNDS*
+                         (ff1->len[len].blocks + (ff1->len[len].d + AES_BLOCK_SIZE - 1)/AES_BLOCK_SIZE - 1));
+    return AES_OK;
+}
+
+/**
+ * @brief create an FF1 object bound to a key context, a radix and a tweak
+ * @param[out] ff1 receives the object, set to NULL on failure
+ * @param[in] ctx pointer to the key context, must outlive the object
+ * @param[in] radix 2 to AES_FF1_RADIX_MAX
+ * @param[in] tweak tweak, may be NULL if tweak_len is 0
+ * @param[in] tweak_len 0 to AES_FF1_TWEAK_MAX
+ * @return AES_OK or an AES_ERR_* code
+ * @note the PRF prefix of every string length is computed here, an object
+ * per tweak is the cache: reuse it for every string under that tweak
+ */
+aes_status_t aes_ff1_new(aes_ff1_t **ff1, const aes_ctx_t *ctx, uint32_t radix,
+                         const uint8_t *tweak, size_t tweak_len)
+{
+    aes_ff1_t *new_ff1;
+    uint64_t p = 1;
+    uint32_t min_len = 0;
+
+    if (ff1 == NULL) {
+        return AES_ERR_PARAM;
+    }
+    *ff1 = NULL;
+    if ((ctx == NULL) || ((tweak_len != 0) && (tweak == NULL)) || (radix < 2) ||
+        (radix > AES_FF1_RADIX_MAX)) {
+        return AES_ERR_PARAM;
+    }
+    if (tweak_len > AES_FF1_TWEAK_MAX) {
+        return AES_ERR_LENGTH;
+    }
+    pthread_once(&ff1_once, ff1_init_arena);
+    new_ff1 = aes_arena_alloc(&ff1_arena);
+    if (new_ff1 == NULL) {
+        return AES_ERR_NOMEM;
+    }
+    new_ff1->ctx = ctx;
+    new_ff1->radix = radix;
+    new_ff1->inv = (uint32_t)(((uint64_t)1 << 32)/radix);
+    while ((p < FF1_DOMAIN_MIN) || (min_len < 2)) {
+        p *= radix;
+        min_len++;
+    }
+    new_ff1->min_len = min_len;
+    new_ff1->pow[0] = 1;
+    new_ff1->group = 0;
+    while ((uint64_t)new_ff1->pow[new_ff1->group]*radix <= UINT32_MAX) {
+        new_ff1->pow[new_ff1->group + 1] = new_ff1->pow[new_ff1->group]*radix;
+        new_ff1->group++;
+    }
+    for (uint32_t k=1;k<=new_ff1->group;k++) {
+        uint32_t d;
+
+        new_ff1->shift[k] = (uint8_t)__builtin_clz(new_ff1->pow[k]);
+        d = new_ff1->pow[k] << new_ff1->shift[k];
+        new_ff1->recip[k] = (uint32_t)(UINT64_MAX/d - ((uint64_t)1 << 32));
+    }
+    for (uint32_t n=min_len;n<=AES_FF1_LEN_MAX;n++) {
+        ff1_prepare(new_ff1, n, tweak, tweak_len);
+    }
+    *ff1 = new_ff1;
+    return AES_OK;
+}
+
+/**
+ * @brief clear and release an FF1 object
+ * @param[in] ff1 pointer to the object, may be NULL
+ */
+void aes_ff1_free(aes_ff1_t *ff1)
+{
+    if (ff1 == NULL) {
+        return;
+    }
+    aes_arena_free(&ff1_arena, ff1);
+}
+
+/**
+ * @brief shortest string accepted by an FF1 object
+ * @param[in] ff1 pointer to the object
+ * @return smallest length with radix^len >= 1000000, at least 2
+ */
+uint32_t aes_ff1_min_len(const aes_ff1_t *ff1)
+{
+    return (ff1 != NULL) ? ff1->min_len : 0;
+}
+
+/**
+ * @brief encrypt one numeral string with FF1
+ * @param[in] ff1 pointer to the FF1 object
+ * @param[out] out len numerals, may be equal to in
+ * @param[in] in len numerals, each below the radix
+ * @param[in] len aes_ff1_min_len() to AES_FF1_LEN_MAX
+ * @return AES_OK or an AES_ERR_* code
+ */
+aes_status_t aes_ff1_encrypt(const aes_ff1_t *ff1, uint16_t *out, const uint16_t *in, size_t len)
+{
+    return ff1_crypt(ff1, out, in, len, 1, 0);
+}
+
+/**
+ * @brief decrypt one numeral string with FF1
+ * @param[in] ff1 pointer to the FF1 object
+ * @param[out] out len numerals, may be equal to in
+ * @param[in] in len numerals, each below the radix
+ * @param[in] len aes_ff1_min_len() to AES_FF1_LEN_MAX
+ * @return AES_OK or an AES_ERR_* code
+ */
+aes_status_t aes_ff1_decrypt(const aes_ff1_t *ff1, uint16_t *out, const uint16_t *in, size_t len)
+{
+    return ff1_crypt(ff1, out, in, len, 1, 1);
+}
+
+/**
+ * @brief encrypt count numeral strings of the same length with FF1
+ * @param[in] ff1 pointer to the FF1 object
+ * @param[out] out count*len numerals, may be equal to in
+ * @param[in] in count strings of len numerals, contiguous
+ * @param[in] len aes_ff1_min_len() to AES_FF1_LEN_MAX
+ * @param[in] count number of strings
+ * @return AES_OK or an AES_ERR_* code, nothing is written if a numeral is
+ * out of range
+ * @note AES_FF1_BATCH strings go through each round together, so the
+ * engine ciphers that many independent blocks per call
+ */
+aes_status_t aes_ff1_encrypt_batch(const aes_ff1_t *ff1, uint16_t *out, const uint16_t *in,
+                                   size_t len, size_t count)
+{
+    return ff1_crypt(ff1, out, in, len, count, 0);
+}
+
+/**
+ * @brief decrypt count numeral strings of the same length with FF1
+ * @param[in] ff1 pointer to the FF1 object
+ * @param[out] out count*len numerals, may be equal to in
+ * @param[in] in count strings of len numerals, contiguous
+ * @param[in] len aes_ff1_min_len() to AES_FF1_LEN_MAX
+ * @param[in] count number of strings
+ * @return AES_OK or an AES_ERR_* code, nothing is written if a numeral is
+ * out of range
+ */
+aes_status_t aes_ff1_decrypt_batch(const aes_ff1_t *ff1, uint16_t *out, const uint16_t *in,
+                                   size_t len, size_t count)
+{
+    return ff1_crypt(ff1, out, in, len, count, 1);
+}
+
+#undef AES_FF1_C
@@ -0,0 +1,435 @@
+/**
+ * @file aes_gcm.c
+ * @brief libaes AES-GCM (NIST SP 800-38D), flat and scatter/gather
+ *
+ * The GHASH key is derived once per context. A message is processed as a
+ * stream of spans: keystream for AES_LIB_BATCH blocks is made with one
+ * engine call, XORed, and the ciphertext of the batch is hashed while it
+ * is still in L1. A block cut by a span edge is finished from the saved
+ * keystream and hash buffer, so the flat calls are the one-span case of
+ * the iovec calls.
+*/
+
+#define AES_GCM_C
+#define AES_LIB_PRIVATE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_engine.h"
+#include "aes_polyval.h"
+#include "aes_stats.h"
+#include "aes_lib.h"
+
+/* per-message state */
+typedef struct gcm_state_s {
+    const aes_ctx_t *ctx;
+    uint8_t j0[AES_BLOCK_SIZE];     /* pre-counter block, masks the tag */
+    uint8_t ctr[AES_BLOCK_SIZE];    /* next counter block */
+    uint8_t ks[AES_BLOCK_SIZE];     /* keystream of a block cut by a span edge */
+    uint32_t ks_used;               /* bytes of ks consumed, 0 if none pending */
+    uint8_t s[AES_BLOCK_SIZE];      /* GHASH accumulator */
+    uint8_t part[AES_BLOCK_SIZE];   /* ciphertext not hashed yet */
+    uint32_t part_len;
+    uint64_t nblocks;               /* blocks ciphered, for the counters */
+} gcm_state_t;
+
+static inline void gcm_put_be64(uint8_t *p, uint64_t v)
+{
+    for (uint32_t i=0;i<8;i++) {
+        p[i] = (uint8_t)(v >> (56 - 8*i));
+    }
+}
+
+/**
+ * @brief write nblocks counter blocks, incrementing the low 32 bits only
+ * @param[out] blocks nblocks*16 bytes
+ * @param[in,out] ctr counter block, advanced by nblocks
+ * @param[in] nblocks number of blocks
+ */
+static void gcm_inc32_blocks(uint8_t *blocks, uint8_t *ctr, size_t nblocks)
+{
+    uint32_t c = ((uint32_t)ctr[12] << 24) | ((uint32_t)ctr[13] << 16) |
+                 ((uint32_t)ctr[14] << 8) | ctr[15];
+
+    for (size_t b=0;b<nblocks;b++) {
+        uint8_t *p = blocks + b*AES_BLOCK_SIZE;
+
+        memcpy(p, ctr, 12);
+        p[12] = (uint8_t)(c >> 24);
+        p[13] = (uint8_t)(c >> 16);
+        p[14] = (uint8_t)(c >> 8);
+        p[15] = (uint8_t)c;
+        c++;
+    }
+    ctr[12] = (uint8_t)(c >> 24);
+    ctr[13] = (uint8_t)(c >> 16);
+    ctr[14] = (uint8_t)(c >> 8);
+    ctr[15] = (uint8_t)c;
+}
+
+/**
+ * @brief hash a complete field (AAD or IV), zero padding the last block
+ * @param[in] ctx pointer to the key context
+ * @param[in,out] s GHASH accumulator
+ * @param[in] data bytes to hash, may be NULL if len is 0
+ * @param[in] len number of bytes
+ */
+static void gcm_hash_padded(const aes_ctx_t *ctx, uint8_t *s, const uint8_t *data, size_t len)
+{
+    uint8_t last[AES_BLOCK_SIZE];
+    size_t full = len/AES_BLOCK_SIZE;
+
+    aes_ghash_update(&ctx->gcm_h, s, data, full);
+    if (len % AES_BLOCK_SIZE != 0) {
+        memset(last, 0, sizeof(last));
+        memcpy(last, data + full*AES_BLOCK_SIZE, len % AES_BLOCK_SIZE);
+        aes_ghash_update(&ctx->gcm_h, s, last, 1);
+    }
+}
+
+/**
+ * @brief hash ciphertext that may arrive in pieces of any size
+ * @param[in,out] st per-message state
+ * @param[in] data ciphertext
+ * @param[in] len number of bytes
+ */
+static void gcm_hash_stream(gcm_state_t *st, const uint8_t *data, size_t len)
+{
+    size_t full;
+
+    if (st->part_len != 0) {
+        size_t take = AES_BLOCK_SIZE - st->part_len;
+
+        take = (len < take) ? len : take;
+        memcpy(st->part + st->part_len, data, take);
+        st->part_len += (uint32_t)take;
+        data += take;
+        len -= take;
+        if (st->part_len < AES_BLOCK_SIZE) {
+            return;
+        }
+        aes_ghash_update(&st->ctx->gcm_h, st->s, st->part, 1);
+        st->part_len = 0;
+    }
+    full = len/AES_BLOCK_SIZE;
+    aes_ghash_update(&st->ctx->gcm_h, st->s, data, full);
+    memcpy(st->part, data + full*AES_BLOCK_SIZE, len - full*AES_BLOCK_SIZE);
+    st->part_len = (uint32_t)(len - full*AES_BLOCK_SIZE);
+}
+
+/**
+ * @brief derive J0, hash the AAD and position the counter
+ * @param[out] st per-message state
+ * @param[in] ctx pointer to the key context
+ * @param[in] iv initialization vector
+ * @param[in] iv_len IV length in bytes, 12 is the fast path
+ * @param[in] aad additional authenticated data
+ * @param[in] aad_len AAD length in bytes
+ */
+static void gcm_start(gcm_state_t *st, const aes_ctx_t *ctx, const uint8_t *iv, size_t iv_len,
+                      const uint8_t *aad, size_t aad_len)
+{
+    uint8_t lengths[AES_BLOCK_SIZE];
+
+    memset(st, 0, sizeof(gcm_state_t));
+    st->ctx = ctx;
+    if (iv_len == AES_GCM_IV_SIZE) {
+        memcpy(st->j0, iv, AES_GCM_IV_SIZE);
+        st->j0[AES_BLOCK_SIZE-1] = 1;
+    } else {
+        /* J0 = GHASH(IV || 0-pad || 0^64 || [len(IV)]64) */
+        gcm_hash_padded(ctx, st->j0, iv, iv_len);
+        memset(lengths, 0, 8);
+        gcm_put_be64(lengths + 8, (uint64_t)iv_len*8);
+        aes_ghash_update(&ctx->gcm_h, st->j0, lengths, 1);
+    }
+    memcpy(st->ctr, st->j0, AES_BLOCK_SIZE);
+    gcm_inc32_blocks(st->ks, st->ctr, 1);
+    memset(st->ks, 0, sizeof(st->ks));
+    gcm_hash_padded(ctx, st->s, aad, aad_len);
+}
+
+/**
+ * @brief cipher one span and hash its ciphertext
+ * @param[in,out] st per-message state
+ * @param[out] out output, may be equal to in
+ * @param[in] in input
+ * @param[in] len number of bytes
+ * @param[in] dir AES_STATS_DIR_ENC or AES_STATS_DIR_DEC
+ * @note the ciphertext is hashed before it is overwritten when deciphering
+ * in place, after it is produced when enciphering
+ */
+static void gcm_crypt(gcm_state_t *st, uint8_t *out, const uint8_t *in, size_t len, uint32_t dir)
+{
+    uint8_t ks[AES_LIB_BATCH*AES_BLOCK_SIZE];
+    const aes_ctx_t *ctx = st->ctx;
+
+    if (st->ks_used != 0) {
+        size_t use = AES_BLOCK_SIZE - st->ks_used;
+
+        use = (len < use) ? len : use;
+        if (dir == AES_STATS_DIR_DEC) {
+            gcm_hash_stream(st, in, use);
+        }
+        aes_xor_blocks(out, in, st->ks + st->ks_used, use);
+        if (dir == AES_STATS_DIR_ENC) {
+            gcm_hash_stream(st, out, use);
+        }
+        st->ks_used = (uint32_t)((st->ks_used + use) % AES_BLOCK_SIZE);
+        out += use;
+        in += use;
+        len -= use;
+    }
+    while (len != 0) {
+        size_t nblocks = (len + AES_BLOCK_SIZE - 1)/AES_BLOCK_SIZE;
+        size_t n;
+
+        nblocks = (nblocks < AES_LIB_BATCH) ? nblocks : AES_LIB_BATCH;
+        n = (len < nblocks*AES_BLOCK_SIZE) ? len : nblocks*AES_BLOCK_SIZE;
+        gcm_inc32_blocks(ks, st->ctr, nblocks);
+        ctx->engine->encrypt(&ctx->sched, ks, ks, nblocks);
+        st->nblocks += nblocks;
+        if (dir == AES_STATS_DIR_DEC) {
+            gcm_hash_stream(st, in, n);
+        }
+        aes_xor_blocks(out, in, ks, n);
+        if (dir == AES_STATS_DIR_ENC) {
+            gcm_hash_stream(st, out, n);
+        }
+        if (n % AES_BLOCK_SIZE != 0) {
+            /* keep the rest of the last keystream block for the next span */
+            memcpy(st->ks, ks + (nblocks-1)*AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+            st->ks_used = (uint32_t)(n % AES_BLOCK_SIZE);
+        }
+        out += n;
+        in += n;
+        len -= n;
+    }
+    aes_memzero(ks, sizeof(ks));
+}
+
+/**
+ * @brief hash the lengths and compute the tag
+ * @param[in,out] st per-message state, cleared on return
+ * @param[out] tag 16-byte tag
+ * @param[in] len text length in bytes
+ * @param[in] aad_len AAD length in bytes
+ * @param[in] dir AES_STATS_DIR_ENC or AES_STATS_DIR_DEC
+ */
+static void gcm_finish(gcm_state_t *st, uint8_t *tag, size_t len, size_t aad_len, uint32_t dir)
+{
+    const aes_ctx_t *ctx = st->ctx;
+    uint8_t lengths[AES_BLOCK_SIZE];
+
+    if (st->part_len != 0) {
+        memset(st->part + st->part_len, 0, AES_BLOCK_SIZE - st->part_len);
+        aes_ghash_update(&ctx->gcm_h, st->s, st->part, 1);
+    }
+    gcm_put_be64(lengths, (uint64_t)aad_len*8);
+    gcm_put_be64(lengths + 8, (uint64_t)len*8);
+    aes_ghash_update(&ctx->gcm_h, st->s, lengths, 1);
+    ctx->engine->encrypt(&ctx->sched, tag, st->j0, 1);
+    aes_xor_blocks(tag, tag, st->s, AES_GCM_TAG_SIZE);
+    aes_stats_add_blocks(ctx->engine->id, AES_STATS_MODE_GCM, ctx->sched.length, dir,
+                         st->nblocks + 1);
+    aes_memzero(st, sizeof(gcm_state_t));
+}
+
+/**
+ * @brief derive the GHASH key H = E(K, 0^128) of a context
+ * @param[in,out] ctx pointer to a context whose schedule is set
+ */
+void aes_gcm_subkey(aes_ctx_t *ctx)
+{
+    uint8_t h[AES_BLOCK_SIZE];
+
+    memset(h, 0, sizeof(h));
+    ctx->engine->encrypt(&ctx->sched, h, h, 1);
+    aes_ghash_init(&ctx->gcm_h, h,
+                   (ctx->engine->id == AES_ENGINE_AESNI) && aes_polyval_clmul_supported());
+    aes_memzero(h, sizeof(h));
+}
+
+/**
+ * @brief check the parameters shared by all GCM calls
+ * @return AES_OK or an AES_ERR_* code
+ */
+static aes_status_t gcm_check(const aes_ctx_t *ctx, const uint8_t *iv, size_t iv_len,
+                              const uint8_t *tag, const uint8_t *aad, size_t aad_len)
+{
+    if ((ctx == NULL) || (iv == NULL) || (iv_len == 0) || (tag == NULL) ||
+        ((aad_len != 0) && (aad == NULL))) {
+        return AES_ERR_PARAM;
+    }
+    return AES_OK;
+}
+
+/**
+ * @brief encrypt and authenticate scattered data with AES-GCM
+ * @param[in] ctx pointer to the key context
+ * @param[in] iv initialization vector, unique per message under a key
+ * @param[in] iv_len IV length in bytes, AES_GCM_IV_SIZE recommended
+ * @param[in] out ciphertext fragments, at least as long as the input in total
+ * @param[in] out_cnt number of output fragments
+ * @param[out] tag 16-byte tag
+ * @param[in] in plaintext fragments
+ * @param[in] in_cnt number of input fragments
+ * @param[in] aad additional authenticated data, may be NULL if aad_len is 0
+ * @param[in] aad_len AAD length in bytes
+ * @return AES_OK or an AES_ERR_* code
+ * @note output and input fragments may be cut differently; they may
+ * overlap only as the same bytes (in place)
+ */
+aes_status_t aes_gcm_encrypt_iov(const aes_ctx_t *ctx, const uint8_t *iv, size_t iv_len,
+                                 const struct iovec *out, size_t out_cnt,
+                                 uint8_t tag[AES_GCM_TAG_SIZE],
+                                 const struct iovec *in, size_t in_cnt,
+                                 const uint8_t *aad, size_t aad_len)
+{
+    aes_iov_cursor_t cin, cout;
+    gcm_state_t st;
+    const uint8_t *src;
+    uint8_t *dst;
+    size_t len, n;
+    aes_status_t status = gcm_check(ctx, iv, iv_len, tag, aad, aad_len);
+
+    if (status == AES_OK) {
+        status = aes_iov_check(out, out_cnt, in, in_cnt, &len);
+    }
+    if (status != AES_OK) {
+        return status;
+    }
+    if ((uint64_t)len > AES_GCM_MAX_LENGTH) {
+        return AES_ERR_LENGTH;
+    }
+    gcm_start(&st, ctx, iv, iv_len, aad, aad_len);
+    aes_iov_cursor_init(&cin, in, in_cnt);
+    aes_iov_cursor_init(&cout, out, out_cnt);
+    while ((n = aes_iov_span(&cin, &cout, &src, &dst)) != 0) {
+        gcm_crypt(&st, dst, src, n, AES_STATS_DIR_ENC);
+    }
+    gcm_finish(&st, tag, len, aad_len, AES_STATS_DIR_ENC);
+    return AES_OK;
+}
+
+/**
+ * @brief decrypt and verify scattered data with AES-GCM
+ * @param[in] ctx pointer to the key context
+ * @param[in] iv initialization vector
+ * @param[in] iv_len IV length in bytes
+ * @param[in] out plaintext fragments, at least as long as the input in total
+ * @param[in] out_cnt number of output fragments
+ * @param[in] in ciphertext fragments
+ * @param[in] in_cnt number of input fragments
+ * @param[in] tag 16-byte tag
+ * @param[in] aad additional authenticated data, may be NULL if aad_len is 0
+ * @param[in] aad_len AAD length in bytes
+ * @return AES_OK, AES_ERR_AUTH if the tag does not match, or another
+ * AES_ERR_* code
+ * @note on AES_ERR_AUTH the written output is cleared
+ */
+aes_status_t aes_gcm_decrypt_iov(const aes_ctx_t *ctx, const uint8_t *iv, size_t iv_len,
+                                 const struct iovec *out, size_t out_cnt,
+                                 const struct iovec *in, size_t in_cnt,
+                                 const uint8_t tag[AES_GCM_TAG_SIZE],
+                                 const uint8_t *aad, size_t aad_len)
+{
+    aes_iov_cursor_t cin, cout;
+    gcm_state_t st;
+    uint8_t expected[AES_GCM_TAG_SIZE];
+    const uint8_t *src;
+    uint8_t *dst;
+    uint8_t diff = 0;
+    size_t len, n;
+    aes_status_t status = gcm_check(ctx, iv, iv_len, tag, aad, aad_len);
+
+    if (status == AES_OK) {
+        status = aes_iov_check(out, out_cnt, in, in_cnt, &len);
+    }
+    if (status != AES_OK) {
+        return status;
+    }
+    if ((uint64_t)len > AES_GCM_MAX_LENGTH) {
+        return AES_ERR_LENGTH;
+    }
+    gcm_start(&st, ctx, iv, iv_len, aad, aad_len);
+    aes_iov_cursor_init(&cin, in, in_cnt);
+    aes_iov_cursor_init(&cout, out, out_cnt);
+    while ((n = aes_iov_span(&cin, &cout, &src, &dst)) != 0) {
+        gcm_crypt(&st, dst, src, n, AES_STATS_DIR_DEC);
+    }
+    gcm_finish(&st, expected, len, aad_len, AES_STATS_DIR_DEC);
+    /* constant time: the position of the first differing byte is not leaked */
+    for (uint32_t i=0;i<AES_GCM_TAG_SIZE;i++) {
+        diff |= expected[i] ^ tag[i];
+    }
+    aes_memzero(expected, sizeof(expected));
+    if (diff != 0) {
+        for (size_t i=0, left=len;(i<out_cnt)&&(left!=0);i++) {
+            size_t wipe = (out[i].iov_len < left) ? out[i].iov_len : left;
+
+            if (wipe != 0) {
+                aes_memzero(out[i].iov_base, wipe);
+            }
+            left -= wipe;
+        }
+        return AES_ERR_AUTH;
+    }
+    return AES_OK;
+}
+
+/**
+ * @brief encrypt and authenticate a message with AES-GCM
+ * @param[in] ctx pointer to the key context
+ * @param[in] iv initialization vector, unique per message under a key
+ * @param[in] iv_len IV length in bytes, AES_GCM_IV_SIZE recommended
+ * @param[out] out ciphertext, len bytes, may be equal to in
+ * @param[out] tag 16-byte tag
+ * @param[in] in plaintext, may be NULL if len is 0
+ * @param[in] len plaintext length in bytes, at most AES_GCM_MAX_LENGTH
+ * @param[in] aad additional authenticated data, may be NULL if aad_len is 0
+ * @param[in] aad_len AAD length in bytes
+ * @return AES_OK or an AES_ERR_* code
+ */
+aes_status_t aes_gcm_encrypt(const aes_ctx_t *ctx, const uint8_t *iv, size_t iv_len,
+                             uint8_t *out, uint8_t tag[AES_GCM_TAG_SIZE],
+                             const uint8_t *in, size_t len, const uint8_t *aad, size_t aad_len)
+{
+    struct iovec vin = {(void *)(uintptr_t)in, len};
+    struct iovec vout = {out, len};
+
+    return aes_gcm_encrypt_iov(ctx, iv, iv_len, &vout, 1, tag, &vin, 1, aad, aad_len);
+}
+
+/**
+ * @brief decrypt and verify a message with AES-GCM
+ * @param[in] ctx pointer to the key context
+ * @param[in] iv initialization vector
+ * @param[in] iv_len IV length in bytes
+ * @param[out] out plaintext, len bytes, may be equal to in
+ * @param[in] in ciphertext, may be NULL if len is 0
+ * @param[in] len ciphertext length in bytes, at most AES_GCM_MAX_LENGTH
+ * @param[in] tag 16-byte tag
+ * @param[in] aad additional authenticated data, may be NULL if aad_len is 0
+ * @param[in] aad_len AAD length in bytes
+ * @return AES_OK, AES_ERR_AUTH if the tag does not match, or another
+ * AES_ERR_* code
+ * @note on AES_ERR_AUTH out is cleared
+ */
+aes_status_t aes_gcm_decrypt(const aes_ctx_t *ctx, const uint8_t *iv, size_t iv_len,
+                             uint8_t *out, const uint8_t *in, size_t len,
+                             const uint8_t tag[AES_GCM_TAG_SIZE],
+                             const uint8_t *aad, size_t aad_len)
+{
+    struct iovec vin = {(void *)(uintptr_t)in, len};
+    struct iovec vout = {out, len};
+
+    return aes_gcm_decrypt_iov(ctx, iv, iv_len, &vout, 1, &vin, 1, tag, aad, aad_len);
+}
+
+#undef AES_GCM_C
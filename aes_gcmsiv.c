@@ -0,0 +1,278 @@
+/**
+ * @file aes_gcmsiv.c
+ * @brief libaes AES-GCM-SIV (RFC 8452), nonce-misuse resistant AEAD
+ *
+ * The context key is the key-generating key; every nonce derives its own
+ * POLYVAL and encryption keys. Encryption has to hash the whole plaintext
+ * before the tag, which is the CTR initial counter, is known, so its two
+ * passes are sequential. Decryption walks the data in AES_GCMSIV_CHUNK
+ * pieces and hashes each deciphered chunk while it is still in L1, the
+ * input and output are only streamed through once.
+*/
+
+#define AES_GCMSIV_C
+#define AES_LIB_PRIVATE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_engine.h"
+#include "aes_polyval.h"
+#include "aes_stats.h"
+#include "aes_lib.h"
+
+/* per-message state, derived from the key-generating key and the nonce */
+typedef struct gcmsiv_state_s {
+    aes_sched_t sched;              /* message-encryption key */
+    aes_polyval_t pv;               /* message-authentication key */
+    const aes_engine_t *engine;
+    uint8_t s[AES_POLYVAL_SIZE];    /* POLYVAL accumulator */
+    uint64_t nblocks;               /* blocks ciphered, for the counters */
+} gcmsiv_state_t;
+
+static inline void gcmsiv_put_le32(uint8_t *p, uint32_t v)
+{
+    for (uint32_t i=0;i<4;i++) {
+        p[i] = (uint8_t)(v >> (8*i));
+    }
+}
+
+static inline void gcmsiv_put_le64(uint8_t *p, uint64_t v)
+{
+    for (uint32_t i=0;i<8;i++) {
+        p[i] = (uint8_t)(v >> (8*i));
+    }
+}
+
+/**
+ * @brief check the parameters shared by encryption and decryption
+ * @return AES_OK or an AES_ERR_* code
+ */
+static aes_status_t gcmsiv_check(const aes_ctx_t *ctx, const uint8_t *nonce, const uint8_t *tag,
+                                 uint8_t *out, const uint8_t *in, size_t len,
+                                 const uint8_t *aad, size_t aad_len)
+{
+    if ((ctx == NULL) || (nonce == NULL) || (tag == NULL) ||
+        ((len != 0) && ((out == NULL) || (in == NULL))) || ((aad_len != 0) && (aad == NULL))) {
+        return AES_ERR_PARAM;
+    }
+    if (ctx->sched.length == AES192_KEY_SIZE/8) {
+        return AES_ERR_KEY_LENGTH;
+    }
+    if (((uint64_t)len > AES_GCMSIV_MAX_LENGTH) || ((uint64_t)aad_len > AES_GCMSIV_MAX_LENGTH)) {
+        return AES_ERR_LENGTH;
+    }
+    return AES_OK;
+}
+
+/**
+ * @brief derive the per-nonce keys and start the hash
+ * @param[in] ctx pointer to the key-generating key context
+ * @param[in] nonce 12-byte nonce
+ * @param[out] st per-message state
+ * @note the 4 or 6 derivation blocks go through the engine in one call
+ */
+static void gcmsiv_setup(const aes_ctx_t *ctx, const uint8_t *nonce, gcmsiv_state_t *st)
+{
+    uint8_t blocks[6*AES_BLOCK_SIZE];
+    uint8_t keys[6*8];
+    uint32_t n = (ctx->sched.length == AES256_KEY_SIZE/8) ? 6 : 4;
+
+    for (uint32_t i=0;i<n;i++) {
+        gcmsiv_put_le32(blocks + i*AES_BLOCK_SIZE, i);
+        memcpy(blocks + i*AES_BLOCK_SIZE + 4, nonce, AES_GCMSIV_NONCE_SIZE);
+    }
+    ctx->engine->encrypt(&ctx->sched, blocks, blocks, n);
+    /* only the first half of every block is kept */
+    for (uint32_t i=0;i<n;i++) {
+        memcpy(keys + i*8, blocks + i*AES_BLOCK_SIZE, 8);
+    }
+    st->engine = ctx->engine;
+    st->nblocks = n;
+    aes_polyval_init(&st->pv, keys,
+                     (ctx->engine->id == AES_ENGINE_AESNI) && aes_polyval_clmul_supported());
+    st->engine->setkey(&st->sched, keys + 16, ctx->sched.length);
+    memset(st->s, 0, sizeof(st->s));
+    aes_memzero(blocks, sizeof(blocks));
+    aes_memzero(keys, sizeof(keys));
+}
+
+/**
+ * @brief hash a byte string, the last partial block is zero padded
+ * @param[in,out] st per-message state
+ * @param[in] data bytes to hash
+ * @param[in] len number of bytes
+ */
+static void gcmsiv_hash(gcmsiv_state_t *st, const uint8_t *data, size_t len)
+{
+    uint8_t last[AES_BLOCK_SIZE];
+    size_t full = len/AES_BLOCK_SIZE;
+
+    aes_polyval_update(&st->pv, st->s, data, full);
+    if (len % AES_BLOCK_SIZE != 0) {
+        memset(last, 0, sizeof(last));
+        memcpy(last, data + full*AES_BLOCK_SIZE, len % AES_BLOCK_SIZE);
+        aes_polyval_update(&st->pv, st->s, last, 1);
+    }
+}
+
+/**
+ * @brief hash the length block and compute the tag
+ * @param[in,out] st per-message state
+ * @param[in] nonce 12-byte nonce
+ * @param[out] tag 16-byte tag
+ * @param[in] len plaintext length in bytes
+ * @param[in] aad_len AAD length in bytes
+ */
+static void gcmsiv_tag(gcmsiv_state_t *st, const uint8_t *nonce, uint8_t *tag,
+                       size_t len, size_t aad_len)
+{
+    uint8_t lengths[AES_BLOCK_SIZE];
+
+    gcmsiv_put_le64(lengths, (uint64_t)aad_len*8);
+    gcmsiv_put_le64(lengths + 8, (uint64_t)len*8);
+    aes_polyval_update(&st->pv, st->s, lengths, 1);
+    aes_xor_blocks(st->s, st->s, nonce, AES_GCMSIV_NONCE_SIZE);
+    st->s[AES_BLOCK_SIZE-1] &= 0x7f;
+    st->engine->encrypt(&st->sched, tag, st->s, 1);
+    st->nblocks++;
+}
+
+/**
+ * @brief CTR with a 32-bit little-endian counter in the first word
+ * @param[in,out] st per-message state
+ * @param[in,out] counter counter block, advanced by the blocks used
+ * @param[out] out output buffer, may be equal to in
+ * @param[in] in input buffer
+ * @param[in] len number of bytes, multiple of 16 except for the last call
+ */
+static void gcmsiv_ctr(gcmsiv_state_t *st, uint8_t *counter, uint8_t *out,
+                       const uint8_t *in, size_t len)
+{
+    uint8_t ks[AES_LIB_BATCH*AES_BLOCK_SIZE];
+    uint32_t ctr = (uint32_t)counter[0] | ((uint32_t)counter[1] << 8) |
+                   ((uint32_t)counter[2] << 16) | ((uint32_t)counter[3] << 24);
+
+    for (size_t off=0;off<len;off+=sizeof(ks)) {
+        size_t n = (len - off < sizeof(ks)) ? (len - off) : sizeof(ks);
+        size_t nblocks = (n + AES_BLOCK_SIZE - 1)/AES_BLOCK_SIZE;
+
+        for (size_t b=0;b<nblocks;b++) {
+            memcpy(ks + b*AES_BLOCK_SIZE, counter, AES_BLOCK_SIZE);
+            gcmsiv_put_le32(ks + b*AES_BLOCK_SIZE, ctr++);
+        }
+        st->engine->encrypt(&st->sched, ks, ks, nblocks);
+        aes_xor_blocks(out + off, in + off, ks, n);
+        st->nblocks += nblocks;
+    }
+    gcmsiv_put_le32(counter, ctr);
+}
+
+/**
+ * @brief clear the per-message state and count its blocks
+ * @param[in,out] st per-message state
+ * @param[in] ctx pointer to the key context
+ * @param[in] dir AES_STATS_DIR_ENC or AES_STATS_DIR_DEC
+ */
+static void gcmsiv_done(gcmsiv_state_t *st, const aes_ctx_t *ctx, uint32_t dir)
+{
+    aes_stats_add_blocks(ctx->engine->id, AES_STATS_MODE_GCMSIV, ctx->sched.length,
+                         dir, st->nblocks);
+    aes_memzero(st, sizeof(gcmsiv_state_t));
+}
+
+/**
+ * @brief encrypt and authenticate a message with AES-GCM-SIV
+ * @param[in] ctx pointer to a context with a 16 or 32-byte key
+ * @param[in] nonce 12-byte nonce
+ * @param[out] out ciphertext, len bytes, may be equal to in
+ * @param[out] tag 16-byte tag
+ * @param[in] in plaintext, may be NULL if len is 0
+ * @param[in] len plaintext length in bytes, at most AES_GCMSIV_MAX_LENGTH
+ * @param[in] aad additional authenticated data, may be NULL if aad_len is 0
+ * @param[in] aad_len AAD length in bytes, at most AES_GCMSIV_MAX_LENGTH
+ * @return AES_OK or an AES_ERR_* code
+ * @note repeating a nonce only reveals whether the same message was sent
+ */
+aes_status_t aes_gcmsiv_encrypt(const aes_ctx_t *ctx, const uint8_t nonce[AES_GCMSIV_NONCE_SIZE],
+                                uint8_t *out, uint8_t tag[AES_GCMSIV_TAG_SIZE],
+                                const uint8_t *in, size_t len, const uint8_t *aad, size_t aad_len)
+{
+    gcmsiv_state_t st;
+    uint8_t counter[AES_BLOCK_SIZE];
+    aes_status_t status = gcmsiv_check(ctx, nonce, tag, out, in, len, aad, aad_len);
+
+    if (status != AES_OK) {
+        return status;
+    }
+    gcmsiv_setup(ctx, nonce, &st);
+    gcmsiv_hash(&st, aad, aad_len);
+    gcmsiv_hash(&st, in, len);
+    gcmsiv_tag(&st, nonce, tag, len, aad_len);
+    memcpy(counter, tag, AES_BLOCK_SIZE);
+    counter[AES_BLOCK_SIZE-1] |= 0x80;
+    gcmsiv_ctr(&st, counter, out, in, len);
+    gcmsiv_done(&st, ctx, AES_STATS_DIR_ENC);
+    return AES_OK;
+}
+
+/**
+ * @brief decrypt and verify a message with AES-GCM-SIV
+ * @param[in] ctx pointer to a context with a 16 or 32-byte key
+ * @param[in] nonce 12-byte nonce
+ * @param[out] out plaintext, len bytes, may be equal to in
+ * @param[in] in ciphertext, may be NULL if len is 0
+ * @param[in] len ciphertext length in bytes, at most AES_GCMSIV_MAX_LENGTH
+ * @param[in] tag 16-byte tag
+ * @param[in] aad additional authenticated data, may be NULL if aad_len is 0
+ * @param[in] aad_len AAD length in bytes, at most AES_GCMSIV_MAX_LENGTH
+ * @return AES_OK, AES_ERR_AUTH if the tag does not match, or another
+ * AES_ERR_* code
+ * @note on AES_ERR_AUTH out is cleared, no unauthenticated plaintext is
+ * released
+ */
+aes_status_t aes_gcmsiv_decrypt(const aes_ctx_t *ctx, const uint8_t nonce[AES_GCMSIV_NONCE_SIZE],
+                                uint8_t *out, const uint8_t *in, size_t len,
+                                const uint8_t tag[AES_GCMSIV_TAG_SIZE],
+                                const uint8_t *aad, size_t aad_len)
+{
+    gcmsiv_state_t st;
+    uint8_t counter[AES_BLOCK_SIZE];
+    uint8_t expected[AES_GCMSIV_TAG_SIZE];
+    uint8_t diff = 0;
+    aes_status_t status = gcmsiv_check(ctx, nonce, tag, out, in, len, aad, aad_len);
+
+    if (status != AES_OK) {
+        return status;
+    }
+    gcmsiv_setup(ctx, nonce, &st);
+    gcmsiv_hash(&st, aad, aad_len);
+    memcpy(counter, tag, AES_BLOCK_SIZE);
+    counter[AES_BLOCK_SIZE-1] |= 0x80;
+    /* hash each chunk right after deciphering it, while it is cache-hot */
+    for (size_t off=0;off<len;off+=AES_GCMSIV_CHUNK) {
+        size_t n = (len - off < AES_GCMSIV_CHUNK) ? (len - off) : AES_GCMSIV_CHUNK;
+
+        gcmsiv_ctr(&st, counter, out + off, in + off, n);
+        gcmsiv_hash(&st, out + off, n);
+    }
+    gcmsiv_tag(&st, nonce, expected, len, aad_len);
+    gcmsiv_done(&st, ctx, AES_STATS_DIR_DEC);
+    /* constant time: the position of the first differing byte is not leaked */
+    for (uint32_t i=0;i<AES_GCMSIV_TAG_SIZE;i++) {
+        diff |= expected[i] ^ tag[i];
+    }
+    aes_memzero(expected, sizeof(expected));
+    if (diff != 0) {
+        if (len != 0) {
+            aes_memzero(out, len);
+        }
+        return AES_ERR_AUTH;
+    }
+    return AES_OK;
+}
+
+#undef AES_GCMSIV_C
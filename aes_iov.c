@@ -0,0 +1,161 @@
+/**
+ * @file aes_iov.c
+ * @brief libaes scatter/gather helpers and vectored CTR
+ *
+ * An input and an output iovec array are walked together as a sequence of
+ * spans, each span being contiguous on both sides. The modes carry their
+ * partial block state from one span to the next, so a block straddling two
+ * fragments is handled without linearizing the data, and the bulk of each
+ * span still reaches the engine in AES_LIB_BATCH block calls.
+*/
+
+#define AES_IOV_C
+#define AES_LIB_PRIVATE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_engine.h"
+#include "aes_stats.h"
+#include "aes_lib.h"
+
+/**
+ * @brief check a pair of iovec arrays
+ * @param[in] out output fragments
+ * @param[in] out_cnt number of output fragments
+ * @param[in] in input fragments
+ * @param[in] in_cnt number of input fragments
+ * @param[out] len receives the total input length
+ * @return AES_OK, AES_ERR_PARAM on a NULL fragment of non-zero length or
+ * AES_ERR_LENGTH if the output is shorter than the input
+ */
+aes_status_t aes_iov_check(const struct iovec *out, size_t out_cnt,
+                           const struct iovec *in, size_t in_cnt, size_t *len)
+{
+    size_t in_len = 0;
+    size_t out_len = 0;
+
+    if (((in_cnt != 0) && (in == NULL)) || ((out_cnt != 0) && (out == NULL))) {
+        return AES_ERR_PARAM;
+    }
+    for (size_t i=0;i<in_cnt;i++) {
+        if ((in[i].iov_base == NULL) && (in[i].iov_len != 0)) {
+            return AES_ERR_PARAM;
+        }
+        in_len += in[i].iov_len;
+    }
+    for (size_t i=0;i<out_cnt;i++) {
+        if ((out[i].iov_base == NULL) && (out[i].iov_len != 0)) {
+            return AES_ERR_PARAM;
+        }
+        out_len += out[i].iov_len;
+    }
+    if (out_len < in_len) {
+        return AES_ERR_LENGTH;
+    }
+    *len = in_len;
+    return AES_OK;
+}
+
+/**
+ * @brief position a cursor on the first byte of an iovec array
+ * @param[out] c pointer to the cursor
+ * @param[in] iov fragments
+ * @param[in] cnt number of fragments
+ */
+void aes_iov_cursor_init(aes_iov_cursor_t *c, const struct iovec *iov, size_t cnt)
+{
+    c->iov = iov;
+    c->cnt = cnt;
+    c->idx = 0;
+    c->off = 0;
+}
+
+/**
+ * @brief next span contiguous in both the input and the output
+ * @param[in,out] in input cursor, advanced past the span
+ * @param[in,out] out output cursor, advanced past the span
+ * @param[out] src receives the input address of the span
+ * @param[out] dst receives the output address of the span
+ * @return span length in bytes, 0 once the input is exhausted
+ * @note empty fragments are skipped; the caller checked with aes_iov_check
+ * that the output is long enough
+ */
+size_t aes_iov_span(aes_iov_cursor_t *in, aes_iov_cursor_t *out, const uint8_t **src, uint8_t **dst)
+{
+    size_t n;
+
+    while ((in->idx < in->cnt) && (in->off == in->iov[in->idx].iov_len)) {
+        in->idx++;
+        in->off = 0;
+    }
+    while ((out->idx < out->cnt) && (out->off == out->iov[out->idx].iov_len)) {
+        out->idx++;
+        out->off = 0;
+    }
+    if ((in->idx == in->cnt) || (out->idx == out->cnt)) {
+        return 0;
+    }
+    n = in->iov[in->idx].iov_len - in->off;
+    if (out->iov[out->idx].iov_len - out->off < n) {
+        n = out->iov[out->idx].iov_len - out->off;
+    }
+    *src = (const uint8_t *)in->iov[in->idx].iov_base + in->off;
+    *dst = (uint8_t *)out->iov[out->idx].iov_base + out->off;
+    in->off += n;
+    out->off += n;
+    return n;
+}
+
+/**
+ * @brief cipher or decipher scattered data in CTR mode
+ * @param[in] ctx pointer to the key context
+ * @param[in,out] counter 128-bit big-endian counter block, advanced by the
+ * number of blocks used
+ * @param[in] out output fragments, at least as long as the input in total
+ * @param[in] out_cnt number of output fragments
+ * @param[in] in input fragments
+ * @param[in] in_cnt number of input fragments
+ * @return AES_OK or an AES_ERR_* code
+ * @note output and input fragments may be cut differently; they may
+ * overlap only as the same bytes (in place). As with aes_ctr_crypt the
+ * keystream left in a final partial block is discarded.
+ */
+aes_status_t aes_ctr_crypt_iov(const aes_ctx_t *ctx, uint8_t counter[AES_LIB_BLOCK_SIZE],
+                               const struct iovec *out, size_t out_cnt,
+                               const struct iovec *in, size_t in_cnt)
+{
+    aes_iov_cursor_t cin, cout;
+    aes_stream_t st;
+    const uint8_t *src;
+    uint8_t *dst;
+    size_t len, n, done;
+    aes_status_t status;
+
+    if ((ctx == NULL) || (counter == NULL)) {
+        return AES_ERR_PARAM;
+    }
+    status = aes_iov_check(out, out_cnt, in, in_cnt, &len);
+    if (status != AES_OK) {
+        return status;
+    }
+    /* a stack stream carries the keystream of a block cut by a fragment edge */
+    memset(&st, 0, sizeof(st));
+    st.ctx = ctx;
+    st.mode = AES_STREAM_CTR;
+    aes_stream_init(&st, counter);
+    aes_iov_cursor_init(&cin, in, in_cnt);
+    aes_iov_cursor_init(&cout, out, out_cnt);
+    while ((n = aes_iov_span(&cin, &cout, &src, &dst)) != 0) {
+        aes_stream_update(&st, dst, &done, src, n);
+    }
+    memcpy(counter, st.iv, AES_BLOCK_SIZE);
+    aes_memzero(&st, sizeof(st));
+    return AES_OK;
+}
+
+#undef AES_IOV_C
@@ -0,0 +1,1794 @@
+/**
+ * @file aes_kat.c
+ * @brief AES known-answer tests and differential check of the engines
+ *
+ * Vectors come from FIPS-197 appendix B/C, NIST SP 800-38A and the NIST
+ * CAVP AESAVS files (GFSbox, KeySbox, VarTxt, ECBMCT). Each test prints one
+ * line to the report stream (when not NULL) and the functions return the
+ * number of failures.
+*/
+
+#define AES_KAT_C
+#define AES_LIB_PRIVATE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+
+#include "aes.h"
+#include "aes_engine.h"
+#include "aes_kat.h"
+#include "aes_lib.h"
+#include "aes_daemon.h"
+#include "aes_container.h"
+#include "aes_pool.h"
+#include "aes_async.h"
+#include "aes_polyval.h"
+#include "aes_crc32c.h"
+
+typedef struct aes_kat_vector_s {
+    const char *name;
+    uint32_t level;
+    uint32_t length;            /* key size in number of bytes */
+    uint8_t key[AES256_KEY_SIZE/8];
+    uint8_t clear[AES_BLOCK_SIZE];
+    uint8_t ciphered[AES_BLOCK_SIZE];
+} aes_kat_vector_t;
+
+static const aes_kat_vector_t kat_vectors[] = {
+    {"FIPS-197 C.1 AES-128", AES_KAT_QUICK, 16,
+     {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f},
+     {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff},
+     {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a}},
+    {"FIPS-197 C.2 AES-192", AES_KAT_QUICK, 24,
+     {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+      0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17},
+     {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff},
+     {0xdd, 0xa9, 0x7c, 0xa4, 0x86, 0x4c, 0xdf, 0xe0, 0x6e, 0xaf, 0x70, 0xa0, 0xec, 0x0d, 0x71, 0x91}},
+    {"FIPS-197 C.3 AES-256", AES_KAT_QUICK, 32,
+     {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+      0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f},
+     {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff},
+     {0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf, 0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89}},
+    {"FIPS-197 B AES-128", AES_KAT_FULL, 16,
+     {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c},
+     {0x32, 0x43, 0xf6, 0xa8, 0x88, 0x5a, 0x30, 0x8d, 0x31, 0x31, 0x98, 0xa2, 0xe0, 0x37, 0x07, 0x34},
+     {0x39, 0x25, 0x84, 0x1d, 0x02, 0xdc, 0x09, 0xfb, 0xdc, 0x11, 0x85, 0x97, 0x19, 0x6a, 0x0b, 0x32}},
+    {"SP800-38A F.1.1 ECB-AES128", AES_KAT_FULL, 16,
+     {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c},
+     {0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a},
+     {0x3a, 0xd7, 0x7b, 0xb4, 0x0d, 0x7a, 0x36, 0x60, 0xa8, 0x9e, 0xca, 0xf3, 0x24, 0x66, 0xef, 0x97}},
+    {"SP800-38A F.1.3 ECB-AES192", AES_KAT_FULL, 24,
+     {0x8e, 0x73, 0xb0, 0xf7, 0xda, 0x0e, 0x64, 0x52, 0xc8, 0x10, 0xf3, 0x2b, 0x80, 0x90, 0x79, 0xe5,
+      0x62, 0xf8, 0xea, 0xd2, 0x52, 0x2c, 0x6b, 0x7b},
+     {0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a},
+     {0xbd, 0x33, 0x4f, 0x1d, 0x6e, 0x45, 0xf2, 0x5f, 0xf7, 0x12, 0xa2, 0x14, 0x57, 0x1f, 0xa5, 0xcc}},
+    {"SP800-38A F.1.5 ECB-AES256", AES_KAT_FULL, 32,
+     {0x60, 0x3d, 0xeb, 0x10, 0x15, 0xca, 0x71, 0xbe, 0x2b, 0x73, 0xae, 0xf0, 0x85, 0x7d, 0x77, 0x81,
+      0x1f, 0x35, 0x2c, 0x07, 0x3b, 0x61, 0x08, 0xd7, 0x2d, 0x98, 0x10, 0xa3, 0x09, 0x14, 0xdf, 0xf4},
+     {0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a},
+     {0xf3, 0xee, 0xd1, 0xbd, 0xb5, 0xd2, 0xa0, 0x3c, 0x06, 0x4b, 0x5a, 0x7e, 0x3d, 0xb1, 0x81, 0xf8}},
+    {"CAVP ECBGFSbox128 #0", AES_KAT_FULL, 16,
+     {0},
+     {0xf3, 0x44, 0x81, 0xec, 0x3c, 0xc6, 0x27, 0xba, 0xcd, 0x5d, 0xc3, 0xfb, 0x08, 0xf2, 0x73, 0xe6},
+     {0x03, 0x36, 0x76, 0x3e, 0x96, 0x6d, 0x92, 0x59, 0x5a, 0x56, 0x7c, 0xc9, 0xce, 0x53, 0x7f, 0x5e}},
+    {"CAVP ECBVarTxt128 #0", AES_KAT_FULL, 16,
+     {0},
+     {0x80},
+     {0x3a, 0xd7, 0x8e, 0x72, 0x6c, 0x1e, 0xc0, 0x2b, 0x7e, 0xbf, 0xe9, 0x2b, 0x23, 0xd9, 0xec, 0x34}},
+    {"CAVP ECBKeySbox128 #0", AES_KAT_FULL, 16,
+     {0x10, 0xa5, 0x88, 0x69, 0xd7, 0x4b, 0xe5, 0xa3, 0x74, 0xcf, 0x86, 0x7c, 0xfb, 0x47, 0x38, 0x59},
+     {0},
+     {0x6d, 0x25, 0x1e, 0x69, 0x44, 0xb0, 0x51, 0xe0, 0x4e, 0xaa, 0x6f, 0xb4, 0xdb, 0xf7, 0x84, 0x65}},
+    {"CAVP ECBGFSbox192 #0", AES_KAT_FULL, 24,
+     {0},
+     {0x1b, 0x07, 0x7a, 0x6a, 0xf4, 0xb7, 0xf9, 0x82, 0x29, 0xde, 0x78, 0x6d, 0x75, 0x16, 0xb6, 0x39},
+     {0x27, 0x5c, 0xfc, 0x04, 0x13, 0xd8, 0xcc, 0xb7, 0x05, 0x13, 0xc3, 0x85, 0x9b, 0x1d, 0x0f, 0x72}},
+    {"CAVP ECBGFSbox256 #0", AES_KAT_FULL, 32,
+     {0},
+     {0x01, 0x47, 0x30, 0xf8, 0x0a, 0xc6, 0x25, 0xfe, 0x84, 0xf0, 0x26, 0xc6, 0x0b, 0xfd, 0x54, 0x7d},
+     {0x5c, 0x9d, 0x84, 0x4e, 0xd4, 0x6f, 0x98, 0x85, 0x08, 0x5e, 0x5d, 0x6a, 0x4f, 0x94, 0xc7, 0xd7}},
+};
+
+/*
+ * Monte Carlo test, AESAVS 6.4.1 encryption procedure, first outer iteration
+ * (1000 chained encryptions). The AES-128 seed is COUNT=0 of ECBMCT128; the
+ * AES-192/256 results were cross-checked against OpenSSL.
+ */
+static const aes_kat_vector_t kat_mct_vectors[] = {
+    {"CAVP ECBMCT128 #0", AES_KAT_FULL, 16,
+     {0x13, 0x9a, 0x35, 0x42, 0x2f, 0x1d, 0x61, 0xde, 0x3c, 0x91, 0x78, 0x7f, 0xe0, 0x50, 0x7a, 0xfd},
+     {0xb9, 0x14, 0x5a, 0x76, 0x8b, 0x7d, 0xc4, 0x89, 0xa0, 0x96, 0xb5, 0x46, 0xf4, 0x3b, 0x23, 0x1f},
+     {0xd7, 0xc3, 0xff, 0xac, 0x90, 0x31, 0x23, 0x86, 0x50, 0x90, 0x1e, 0x15, 0x73, 0x64, 0xc3, 0x86}},
+    {"MCT ECB-AES192", AES_KAT_FULL, 24,
+     {0xb9, 0xa6, 0x3e, 0x09, 0xe1, 0xdf, 0xc4, 0x2e, 0x93, 0xa9, 0x0d, 0x9b, 0xad, 0x73, 0x9e, 0x59,
+      0x67, 0xae, 0xf6, 0x72, 0xee, 0xdd, 0x5d, 0xa9},
+     {0x85, 0xa1, 0xf7, 0xa5, 0x81, 0x67, 0xb3, 0x89, 0xcd, 0xdc, 0x8a, 0x9f, 0xf1, 0x75, 0xee, 0x26},
+     {0xee, 0x83, 0xd8, 0x52, 0x79, 0xe0, 0x22, 0xd2, 0x04, 0x80, 0x31, 0xab, 0xee, 0xfb, 0xc4, 0xa4}},
+    {"MCT ECB-AES256", AES_KAT_FULL, 32,
+     {0xf9, 0xe8, 0x38, 0x9f, 0x5b, 0x80, 0x71, 0x2e, 0x38, 0x86, 0xcc, 0x1f, 0xa2, 0xd2, 0x8a, 0x3b,
+      0x8c, 0x9c, 0xd8, 0x8a, 0x2d, 0x4a, 0x54, 0xc6, 0xaa, 0x86, 0xce, 0x0f, 0xef, 0x94, 0x4b, 0xe0},
+     {0xb3, 0x79, 0x77, 0x7f, 0x90, 0x50, 0xe2, 0xa8, 0x18, 0xf2, 0x94, 0x0c, 0xbb, 0xd9, 0xab, 0xa4},
+     {0x68, 0x93, 0xeb, 0xaf, 0x0a, 0x1f, 0xcc, 0xc7, 0x04, 0x32, 0x65, 0x29, 0xfd, 0xfb, 0x60, 0xdb}},
+};
+
+#define KAT_MCT_ITERATIONS  1000
+
+/* SP 800-38A F.2.1 and F.5.1: AES-128, four blocks */
+static const uint8_t kat_sp800_38a_key[16] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+static const uint8_t kat_sp800_38a_clear[64] = {
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+    0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+    0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+    0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10
+};
+static const uint8_t kat_cbc_iv[16] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+};
+static const uint8_t kat_cbc_ciphered[64] = {
+    0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46, 0xce, 0xe9, 0x8e, 0x9b, 0x12, 0xe9, 0x19, 0x7d,
+    0x50, 0x86, 0xcb, 0x9b, 0x50, 0x72, 0x19, 0xee, 0x95, 0xdb, 0x11, 0x3a, 0x91, 0x76, 0x78, 0xb2,
+    0x73, 0xbe, 0xd6, 0xb8, 0xe3, 0xc1, 0x74, 0x3b, 0x71, 0x16, 0xe6, 0x9e, 0x22, 0x22, 0x95, 0x16,
+    0x3f, 0xf1, 0xca, 0xa1, 0x68, 0x1f, 0xac, 0x09, 0x12, 0x0e, 0xca, 0x30, 0x75, 0x86, 0xe1, 0xa7
+};
+static const uint8_t kat_ctr_counter[16] = {
+    0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
+};
+static const uint8_t kat_ctr_ciphered[64] = {
+    0x87, 0x4d, 0x61, 0x91, 0xb6, 0x20, 0xe3, 0x26, 0x1b, 0xef, 0x68, 0x64, 0x99, 0x0d, 0xb6, 0xce,
+    0x98, 0x06, 0xf6, 0x6b, 0x79, 0x70, 0xfd, 0xff, 0x86, 0x17, 0x18, 0x7b, 0xb9, 0xff, 0xfd, 0xff,
+    0x5a, 0xe4, 0xdf, 0x3e, 0xdb, 0xd5, 0xd3, 0x5e, 0x5b, 0x4f, 0x09, 0x02, 0x0d, 0xb0, 0x3e, 0xab,
+    0x1e, 0x03, 0x1d, 0xda, 0x2f, 0xbe, 0x03, 0xd1, 0x79, 0x21, 0x70, 0xa0, 0xf3, 0x00, 0x9c, 0xee
+};
+
+/* RFC 4493 section 4: AES-128 CMAC of the first 0, 16, 40 and 64 bytes above */
+static const size_t kat_cmac_lens[4] = {0, 16, 40, 64};
+/* more messages than CMAC lanes, so finished lanes get refilled */
+#define KAT_CMAC_MESSAGES   12
+static const uint8_t kat_cmac_tags[4][16] = {
+    {0xbb, 0x1d, 0x69, 0x29, 0xe9, 0x59, 0x37, 0x28, 0x7f, 0xa3, 0x7d, 0x12, 0x9b, 0x75, 0x67, 0x46},
+    {0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44, 0xf7, 0x9b, 0xdd, 0x9d, 0xd0, 0x4a, 0x28, 0x7c},
+    {0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30, 0x30, 0xca, 0x32, 0x61, 0x14, 0x97, 0xc8, 0x27},
+    {0x51, 0xf0, 0xbe, 0xbf, 0x7e, 0x3b, 0x9d, 0x92, 0xfc, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3c, 0xfe}
+};
+
+/*
+ * CTR_DRBG AES-256 no df: entropy = 00 01 .. 2f, personalization = 80 .. af,
+ * additional input = 40 .. 6f on both generate calls, second 512-bit output
+ * (CAVP procedure). Cross-checked against the OpenSSL CTR-DRBG.
+ */
+static const uint8_t kat_drbg_out[64] = {
+    0x65, 0x47, 0x5e, 0x35, 0x96, 0xd5, 0x22, 0x9f, 0xe7, 0x16, 0xe0, 0xaa, 0xbc, 0x2a, 0x2d, 0x99,
+    0xd5, 0x26, 0x95, 0xb5, 0x01, 0x75, 0xf9, 0x04, 0x64, 0xf5, 0x6a, 0xdb, 0xe6, 0xe5, 0xaa, 0x0c,
+    0x3c, 0xe6, 0x4e, 0x55, 0xed, 0xc8, 0x08, 0x78, 0x27, 0x08, 0xed, 0x39, 0x36, 0xf2, 0xb3, 0x67,
+    0x3d, 0x7f, 0x83, 0x7d, 0x65, 0x3a, 0xa8, 0xfd, 0x89, 0x52, 0x25, 0x6d, 0xdb, 0x55, 0x3d, 0xe2
+};
+
+/*
+ * RFC 8452 appendix C.1/C.2 (key 01 00 .., nonce 03 00 ..) and the POLYVAL
+ * example of appendix A
+ */
+typedef struct kat_gcmsiv_vector_s {
+    const char *name;
+    uint32_t key_len;
+    uint8_t key[32];
+    size_t aad_len;
+    uint8_t aad[1];
+    size_t len;
+    uint8_t clear[16];
+    uint8_t ciphered[16];
+    uint8_t tag[16];
+} kat_gcmsiv_vector_t;
+
+static const uint8_t kat_gcmsiv_nonce[12] = {0x03};
+static const kat_gcmsiv_vector_t kat_gcmsiv_vectors[] = {
+    {"RFC 8452 C.1 AES-128-GCM-SIV PT=8", 16, {0x01}, 0, {0}, 8,
+     {0x01},
+     {0xb5, 0xd8, 0x39, 0x33, 0x0a, 0xc7, 0xb7, 0x86},
+     {0x57, 0x87, 0x82, 0xff, 0xf6, 0x01, 0x3b, 0x81, 0x5b, 0x28, 0x7c, 0x22, 0x49, 0x3a, 0x36, 0x4c}},
+    {"RFC 8452 C.1 AES-128-GCM-SIV PT=16", 16, {0x01}, 0, {0}, 16,
+     {0x01},
+     {0x74, 0x3f, 0x7c, 0x80, 0x77, 0xab, 0x25, 0xf8, 0x62, 0x4e, 0x2e, 0x94, 0x85, 0x79, 0xcf, 0x77},
+     {0x30, 0x3a, 0xaf, 0x90, 0xf6, 0xfe, 0x21, 0x19, 0x9c, 0x60, 0x68, 0x57, 0x74, 0x37, 0xa0, 0xc4}},
+    {"RFC 8452 C.1 AES-128-GCM-SIV AAD=1 PT=8", 16, {0x01}, 1, {0x01}, 8,
+     {0x02},
+     {0x1e, 0x6d, 0xab, 0xa3, 0x56, 0x69, 0xf4, 0x27},
+     {0x3b, 0x0a, 0x1a, 0x25, 0x60, 0x96, 0x9c, 0xdf, 0x79, 0x0d, 0x99, 0x75, 0x9a, 0xbd, 0x15, 0x08}},
+    {"RFC 8452 C.2 AES-256-GCM-SIV PT=8", 32, {0x01}, 0, {0}, 8,
+     {0x01},
+     {0xc2, 0xef, 0x32, 0x8e, 0x5c, 0x71, 0xc8, 0x3b},
+     {0x84, 0x31, 0x22, 0x13, 0x0f, 0x73, 0x64, 0xb7, 0x61, 0xe0, 0xb9, 0x74, 0x27, 0xe3, 0xdf, 0x28}},
+};
+static const uint8_t kat_polyval_h[16] = {0x25, 0x62, 0x93, 0x47, 0x58, 0x92, 0x42, 0x76, 0x1d, 0x31, 0xf8, 0x26, 0xba, 0x4b, 0x75, 0x7b};
+static const uint8_t kat_polyval_x[32] = {
+    0x4f, 0x4f, 0x95, 0x66, 0x8c, 0x83, 0xdf, 0xb6, 0x40, 0x17, 0x62, 0xbb, 0x2d, 0x01, 0xa2, 0x62,
+    0xd1, 0xa2, 0x4d, 0xdd, 0x27, 0x21, 0xd0, 0x06, 0xbb, 0xe4, 0x5f, 0x20, 0xd3, 0xc9, 0xf3, 0x62
+};
+static const uint8_t kat_polyval_out[16] = {0xf7, 0xa3, 0xb4, 0x7b, 0x84, 0x61, 0x19, 0xfa, 0xe5, 0xb7, 0x86, 0x6c, 0xf5, 0xe5, 0xb7, 0x7e};
+
+/*
+ * GCM test cases 3 and 4 of the original GCM specification (McGrew, Viega),
+ * case 4 enciphers the first 60 bytes of case 3 with AAD
+ */
+static const uint8_t kat_gcm_key[16] = {
+    0xfe, 0xff, 0xe9, 0x92, 0x86, 0x65, 0x73, 0x1c, 0x6d, 0x6a, 0x8f, 0x94, 0x67, 0x30, 0x83, 0x08
+};
+static const uint8_t kat_gcm_iv[AES_GCM_IV_SIZE] = {
+    0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad, 0xde, 0xca, 0xf8, 0x88
+};
+static const uint8_t kat_gcm_aad[20] = {
+    0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef, 0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+    0xab, 0xad, 0xda, 0xd2
+};
+static const uint8_t kat_gcm_clear[64] = {
+    0xd9, 0x31, 0x32, 0x25, 0xf8, 0x84, 0x06, 0xe5, 0xa5, 0x59, 0x09, 0xc5, 0xaf, 0xf5, 0x26, 0x9a,
+    0x86, 0xa7, 0xa9, 0x53, 0x15, 0x34, 0xf7, 0xda, 0x2e, 0x4c, 0x30, 0x3d, 0x8a, 0x31, 0x8a, 0x72,
+    0x1c, 0x3c, 0x0c, 0x95, 0x95, 0x68, 0x09, 0x53, 0x2f, 0xcf, 0x0e, 0x24, 0x49, 0xa6, 0xb5, 0x25,
+    0xb1, 0x6a, 0xed, 0xf5, 0xaa, 0x0d, 0xe6, 0x57, 0xba, 0x63, 0x7b, 0x39, 0x1a, 0xaf, 0xd2, 0x55
+};
+static const uint8_t kat_gcm_ciphered[64] = {
+    0x42, 0x83, 0x1e, 0xc2, 0x21, 0x77, 0x74, 0x24, 0x4b, 0x72, 0x21, 0xb7, 0x84, 0xd0, 0xd4, 0x9c,
+    0xe3, 0xaa, 0x21, 0x2f, 0x2c, 0x02, 0xa4, 0xe0, 0x35, 0xc1, 0x7e, 0x23, 0x29, 0xac, 0xa1, 0x2e,
+    0x21, 0xd5, 0x14, 0xb2, 0x54, 0x66, 0x93, 0x1c, 0x7d, 0x8f, 0x6a, 0x5a, 0xac, 0x84, 0xaa, 0x05,
+    0x1b, 0xa3, 0x0b, 0x39, 0x6a, 0x0a, 0xac, 0x97, 0x3d, 0x58, 0xe0, 0x91, 0x47, 0x3f, 0x59, 0x85
+};
+static const uint8_t kat_gcm_tag3[16] = {
+    0x4d, 0x5c, 0x2a, 0xf3, 0x27, 0xcd, 0x64, 0xa6, 0x2c, 0xf3, 0x5a, 0xbd, 0x2b, 0xa6, 0xfa, 0xb4
+};
+static const uint8_t kat_gcm_tag4[16] = {
+    0x5b, 0xc9, 0x4f, 0xbc, 0x32, 0x21, 0xa5, 0xdb, 0x94, 0xfa, 0xe9, 0x5a, 0xe7, 0x12, 0x1a, 0x47
+};
+
+/* NIST SP 800-38C appendix C, examples 1 to 3: one key, growing nonce, AAD and tag */
+typedef struct kat_ccm_vector_s {
+    size_t nonce_len;
+    size_t aad_len;
+    size_t len;
+    size_t tag_len;
+    uint8_t ciphered[32];       /* ciphertext then tag */
+} kat_ccm_vector_t;
+
+static const uint8_t kat_ccm_key[16] = {
+    0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x4b, 0x4c, 0x4d, 0x4e, 0x4f
+};
+static const kat_ccm_vector_t kat_ccm_vectors[] = {
+    {7, 8, 4, 4,
+     {0x71, 0x62, 0x01, 0x5b, 0x4d, 0xac, 0x25, 0x5d}},
+    {8, 16, 16, 6,
+     {0xd2, 0xa1, 0xf0, 0xe0, 0x51, 0xea, 0x5f, 0x62, 0x08, 0x1a, 0x77, 0x92, 0x07, 0x3d, 0x59, 0x3d,
+      0x1f, 0xc6, 0x4f, 0xbf, 0xac, 0xcd}},
+    {12, 20, 24, 8,
+     {0xe3, 0xb2, 0x01, 0xa9, 0xf5, 0xb7, 0x1a, 0x7a, 0x9b, 0x1c, 0xea, 0xec, 0xcd, 0x97, 0xe7, 0x0b,
+      0x61, 0x76, 0xaa, 0xd9, 0xa4, 0x42, 0x8a, 0xa5, 0x48, 0x43, 0x92, 0xfb, 0xc1, 0xb0, 0x99, 0x51}},
+};
+
+/*
+ * RFC 7253 appendix A: key 000102..0f, nonce BBAA99887766554433221100 with
+ * the last byte replaced, A and P count up from 00
+ */
+typedef struct kat_ocb_vector_s {
+    uint8_t nonce_last;
+    size_t aad_len;
+    size_t len;
+    uint8_t ciphered[56];       /* ciphertext then tag */
+} kat_ocb_vector_t;
+
+static const kat_ocb_vector_t kat_ocb_vectors[] = {
+    {0x00, 0, 0,
+     {0x78, 0x54, 0x07, 0xbf, 0xff, 0xc8, 0xad, 0x9e, 0xdc, 0xc5, 0x52, 0x0a, 0xc9, 0x11, 0x1e, 0xe6}},
+    {0x01, 8, 8,
+     {0x68, 0x20, 0xb3, 0x65, 0x7b, 0x6f, 0x61, 0x5a, 0x57, 0x25, 0xbd, 0xa0, 0xd3, 0xb4, 0xeb, 0x3a,
+      0x25, 0x7c, 0x9a, 0xf1, 0xf8, 0xf0, 0x30, 0x09}},
+    {0x02, 8, 0,
+     {0x81, 0x01, 0x7f, 0x82, 0x03, 0xf0, 0x81, 0x27, 0x71, 0x52, 0xfa, 0xde, 0x69, 0x4a, 0x0a, 0x00}},
+    {0x03, 0, 8,
+     {0x45, 0xdd, 0x69, 0xf8, 0xf5, 0xaa, 0xe7, 0x24, 0x14, 0x05, 0x4c, 0xd1, 0xf3, 0x5d, 0x82, 0x76,
+      0x0b, 0x2c, 0xd0, 0x0d, 0x2f, 0x99, 0xbf, 0xa9}},
+    {0x0d, 40, 40,
+     {0xd5, 0xca, 0x91, 0x74, 0x84, 0x10, 0xc1, 0x75, 0x1f, 0xf8, 0xa2, 0xf6, 0x18, 0x25, 0x5b, 0x68,
+      0xa0, 0xa1, 0x2e, 0x09, 0x3f, 0xf4, 0x54, 0x60, 0x6e, 0x59, 0xf9, 0xc1, 0xd0, 0xdd, 0xc5, 0x4b,
+      0x65, 0xe8, 0x62, 0x8e, 0x56, 0x8b, 0xad, 0x7a, 0xed, 0x07, 0xba, 0x06, 0xa4, 0xa6, 0x94, 0x83,
+      0xa7, 0x03, 0x54, 0x90, 0xc5, 0x76, 0x9e, 0x60}},
+    {0x0f, 0, 40,
+     {0x44, 0x12, 0x92, 0x34, 0x93, 0xc5, 0x7d, 0x5d, 0xe0, 0xd7, 0x00, 0xf7, 0x53, 0xcc, 0xe0, 0xd1,
+      0xd2, 0xd9, 0x50, 0x60, 0x12, 0x2e, 0x9f, 0x15, 0xa5, 0xdd, 0xbf, 0xc5, 0x78, 0x7e, 0x50, 0xb5,
+      0xcc, 0x55, 0xee, 0x50, 0x7b, 0xcb, 0x08, 0x4e, 0x47, 0x9a, 0xd3, 0x63, 0xac, 0x36, 0x6b, 0x95,
+      0xa9, 0x8c, 0xa5, 0xf3, 0x00, 0x0b, 0x14, 0x79}},
+};
+/* RFC 7253 appendix A iterative test, TAGLEN 128 */
+static const uint8_t kat_ocb_iter_tag[16] = {
+    0x67, 0xe9, 0x44, 0xd2, 0x32, 0x56, 0xc5, 0xe0, 0xb6, 0xc6, 0x1f, 0xa2, 0x2f, 0xdf, 0x1e, 0xa2
+};
+/* 300-byte P and 24-byte A, nonce ending in 0x20: crosses the batches of the engine kernels */
+static const uint32_t kat_ocb_long_crc = 0x1e1d479e;   /* CRC32C of the ciphertext */
+static const uint8_t kat_ocb_long_tag[16] = {
+    0x38, 0xe0, 0x7a, 0xad, 0xcc, 0x54, 0x02, 0x69, 0x88, 0x72, 0xc7, 0x3c, 0x22, 0x26, 0xcd, 0x21
+};
+
+/*
+ * SP 800-38G FF1 samples 1 to 9: key 2B7E151628AED2A6ABF7158809CF4F3C,
+ * extended by EF4359D8D580AA4F and 7F036D6F04FC6A94 for AES-192 and AES-256;
+ * numerals are written as the characters 0-9a-z
+ */
+typedef struct kat_ff1_vector_s {
+    uint32_t key_len;
+    uint32_t radix;
+    size_t tweak_len;
+    uint8_t tweak[11];
+    const char *clear;
+    const char *ciphered;
+} kat_ff1_vector_t;
+
+static const uint8_t kat_ff1_key[32] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    0xef, 0x43, 0x59, 0xd8, 0xd5, 0x80, 0xaa, 0x4f, 0x7f, 0x03, 0x6d, 0x6f, 0x04, 0xfc, 0x6a, 0x94
+};
+#define KAT_FF1_TWEAK10 {0x39, 0x38, 0x37, 0x36, 0x35, 0x34, 0x33, 0x32, 0x31, 0x30}
+#define KAT_FF1_TWEAK36 {0x37, 0x37, 0x37, 0x37, 0x70, 0x71, 0x72, 0x73, 0x37, 0x37, 0x37}
+static const kat_ff1_vector_t kat_ff1_vectors[] = {
+    {16, 10, 0, {0}, "0123456789", "2433477484"},
+    {16, 10, 10, KAT_FF1_TWEAK10, "0123456789", "6124200773"},
+    {16, 36, 11, KAT_FF1_TWEAK36, "0123456789abcdefghi", "a9tv40mll9kdu509eum"},
+    {24, 10, 0, {0}, "0123456789", "2830668132"},
+    {24, 10, 10, KAT_FF1_TWEAK10, "0123456789", "2496655549"},
+    {24, 36, 11, KAT_FF1_TWEAK36, "0123456789abcdefghi", "xbj3kv35jrawxv32ysr"},
+    {32, 10, 0, {0}, "0123456789", "6657667009"},
+    {32, 10, 10, KAT_FF1_TWEAK10, "0123456789", "1001623463"},
+    {32, 36, 11, KAT_FF1_TWEAK36, "0123456789abcdefghi", "xs8a0azh2avyalyzuwd"},
+};
+
+/* RFC 3394 section 4.1 and 4.6, RFC 5649 section 6 */
+typedef struct kat_kw_vector_s {
+    const char *name;
+    uint32_t variant;
+    uint32_t kek_len;
+    uint8_t kek[32];
+    size_t len;
+    uint8_t key[32];
+    uint8_t wrapped[40];
+} kat_kw_vector_t;
+
+/* more wrapped keys than unwrap lanes, so finished lanes get refilled */
+#define KAT_KW_BATCH    20
+static const kat_kw_vector_t kat_kw_vectors[] = {
+    {"RFC 3394 4.1 KW-AES128 128-bit key", AES_KW_RFC3394, 16,
+     {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f}, 16,
+     {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff},
+     {0x1f, 0xa6, 0x8b, 0x0a, 0x81, 0x12, 0xb4, 0x47, 0xae, 0xf3, 0x4b, 0xd8, 0xfb, 0x5a, 0x7b, 0x82,
+      0x9d, 0x3e, 0x86, 0x23, 0x71, 0xd2, 0xcf, 0xe5}},
+    {"RFC 3394 4.6 KW-AES256 256-bit key", AES_KW_RFC3394, 32,
+     {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+      0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f}, 32,
+     {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+      0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f},
+     {0x28, 0xc9, 0xf4, 0x04, 0xc4, 0xb8, 0x10, 0xf4, 0xcb, 0xcc, 0xb3, 0x5c, 0xfb, 0x87, 0xf8, 0x26,
+      0x3f, 0x57, 0x86, 0xe2, 0xd8, 0x0e, 0xd3, 0x26, 0xcb, 0xc7, 0xf0, 0xe7, 0x1a, 0x99, 0xf4, 0x3b,
+      0xfb, 0x98, 0x8b, 0x9b, 0x7a, 0x02, 0xdd, 0x21}},
+    {"RFC 5649 6 KWP-AES192 20-byte key", AES_KW_RFC5649, 24,
+     {0x58, 0x40, 0xdf, 0x6e, 0x29, 0xb0, 0x2a, 0xf1, 0xab, 0x49, 0x3b, 0x70, 0x5b, 0xf1, 0x6e, 0xa1,
+      0xae, 0x83, 0x38, 0xf4, 0xdc, 0xc1, 0x76, 0xa8}, 20,
+     {0xc3, 0x7b, 0x7e, 0x64, 0x92, 0x58, 0x43, 0x40, 0xbe, 0xd1, 0x22, 0x07, 0x80, 0x89, 0x41, 0x15,
+      0x50, 0x68, 0xf7, 0x38},
+     {0x13, 0x8b, 0xde, 0xaa, 0x9b, 0x8f, 0xa7, 0xfc, 0x61, 0xf9, 0x77, 0x42, 0xe7, 0x22, 0x48, 0xee,
+      0x5a, 0xe6, 0xae, 0x53, 0x60, 0xd1, 0xae, 0x6a, 0x5f, 0x54, 0xf3, 0x73, 0xfa, 0x54, 0x3b, 0x6a}},
+    {"RFC 5649 6 KWP-AES192 7-byte key", AES_KW_RFC5649, 24,
+     {0x58, 0x40, 0xdf, 0x6e, 0x29, 0xb0, 0x2a, 0xf1, 0xab, 0x49, 0x3b, 0x70, 0x5b, 0xf1, 0x6e, 0xa1,
+      0xae, 0x83, 0x38, 0xf4, 0xdc, 0xc1, 0x76, 0xa8}, 7,
+     {0x46, 0x6f, 0x72, 0x50, 0x61, 0x73, 0x69},
+     {0xaf, 0xbe, 0xb0, 0xf0, 0x7d, 0xfb, 0xf5, 0x41, 0x92, 0x00, 0xf2, 0xcc, 0xb5, 0x0b, 0xb2, 0x4f}},
+};
+
+/**
+ * @brief print the result of one test
+ * @param[in] report output stream, may be NULL
+ * @param[in] impl name of the implementation under test
+ * @param[in] test name of the test
+ * @param[in] ok 1 if the test passed
+ * @return 0 if the test passed, 1 otherwise
+ */
+static int32_t kat_result(FILE *report, const char *impl, const char *test, int32_t ok)
+{
+    if (report != NULL) {
+        fprintf(report, "[%s] %-8s %s\n", ok ? "PASS" : "FAIL", impl, test);
+    }
+    return ok ? 0 : 1;
+}
+
+/**
+ * @brief cipher one block with the step-by-step aes_cipher
+ * @param[out] out ciphered bytes
+ * @param[in] in clear bytes
+ * @param[in] key key bytes
+ * @param[in] length key length in bytes
+ */
+static void kat_ref_cipher(uint8_t *out, const uint8_t *in, const uint8_t *key, uint32_t length)
+{
+    aes_key_t cipher_key;
+    aes_block_t clear_block, ciphered_block;
+
+    memset(&cipher_key, 0, sizeof(aes_key_t));
+    memset(&clear_block, 0, sizeof(aes_block_t));
+    memset(&ciphered_block, 0, sizeof(aes_block_t));
+    memcpy(cipher_key.byte, key, length);
+    cipher_key.length = length;
+    aes_key2mat(&cipher_key);
+    memcpy(clear_block.byte, in, AES_BLOCK_SIZE);
+    aes_block2mat(&clear_block);
+    aes_cipher(&ciphered_block, &clear_block, &cipher_key);
+    memcpy(out, ciphered_block.byte, AES_BLOCK_SIZE);
+}
+
+/**
+ * @brief decipher one block with the step-by-step aes_decipher
+ * @param[out] out clear bytes
+ * @param[in] in ciphered bytes
+ * @param[in] key key bytes
+ * @param[in] length key length in bytes
+ */
+static void kat_ref_decipher(uint8_t *out, const uint8_t *in, const uint8_t *key, uint32_t length)
+{
+    aes_key_t decipher_key;
+    aes_block_t clear_block, ciphered_block;
+
+    memset(&decipher_key, 0, sizeof(aes_key_t));
+    memset(&clear_block, 0, sizeof(aes_block_t));
+    memset(&ciphered_block, 0, sizeof(aes_block_t));
+    memcpy(decipher_key.byte, key, length);
+    decipher_key.length = length;
+    aes_key2mat(&decipher_key);
+    memcpy(ciphered_block.byte, in, AES_BLOCK_SIZE);
+    aes_block2mat(&ciphered_block);
+    aes_decipher(&clear_block, &ciphered_block, &decipher_key);
+    memcpy(out, clear_block.byte, AES_BLOCK_SIZE);
+}
+
+/**
+ * @brief run the vectors against the step-by-step aes_cipher/aes_decipher
+ * @param[in] level AES_KAT_QUICK or AES_KAT_FULL
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+int32_t aes_kat_reference(uint32_t level, FILE *report)
+{
+    int32_t fail = 0;
+    uint8_t out[AES_BLOCK_SIZE];
+
+    for (size_t i=0;i<sizeof(kat_vectors)/sizeof(kat_vectors[0]);i++) {
+        const aes_kat_vector_t *v = &kat_vectors[i];
+        if (v->level > level) {
+            continue;
+        }
+        kat_ref_cipher(out, v->clear, v->key, v->length);
+        fail += kat_result(report, "step", v->name,
+                           memcmp(out, v->ciphered, AES_BLOCK_SIZE) == 0);
+        kat_ref_decipher(out, v->ciphered, v->key, v->length);
+        fail += kat_result(report, "step", v->name,
+                           memcmp(out, v->clear, AES_BLOCK_SIZE) == 0);
+    }
+    if (level < AES_KAT_FULL) {
+        return fail;
+    }
+    for (size_t i=0;i<sizeof(kat_mct_vectors)/sizeof(kat_mct_vectors[0]);i++) {
+        const aes_kat_vector_t *v = &kat_mct_vectors[i];
+        memcpy(out, v->clear, AES_BLOCK_SIZE);
+        for (uint32_t j=0;j<KAT_MCT_ITERATIONS;j++) {
+            kat_ref_cipher(out, out, v->key, v->length);
+        }
+        fail += kat_result(report, "step", v->name,
+                           memcmp(out, v->ciphered, AES_BLOCK_SIZE) == 0);
+    }
+    return fail;
+}
+
+/**
+ * @brief run the vectors against one engine
+ * @param[in] engine pointer to the engine under test
+ * @param[in] level AES_KAT_QUICK or AES_KAT_FULL
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+int32_t aes_kat_engine(const aes_engine_t *engine, uint32_t level, FILE *report)
+{
+    int32_t fail = 0;
+    aes_sched_t sched;
+    uint8_t out[AES_BLOCK_SIZE];
+
+    for (size_t i=0;i<sizeof(kat_vectors)/sizeof(kat_vectors[0]);i++) {
+        const aes_kat_vector_t *v = &kat_vectors[i];
+        if (v->level > level) {
+            continue;
+        }
+        engine->setkey(&sched, v->key, v->length);
+        engine->encrypt(&sched, out, v->clear, 1);
+        fail += kat_result(report, engine->name, v->name,
+                           memcmp(out, v->ciphered, AES_BLOCK_SIZE) == 0);
+        engine->decrypt(&sched, out, v->ciphered, 1);
+        fail += kat_result(report, engine->name, v->name,
+                           memcmp(out, v->clear, AES_BLOCK_SIZE) == 0);
+    }
+    if (level >= AES_KAT_FULL) {
+        for (size_t i=0;i<sizeof(kat_mct_vectors)/sizeof(kat_mct_vectors[0]);i++) {
+            const aes_kat_vector_t *v = &kat_mct_vectors[i];
+            engine->setkey(&sched, v->key, v->length);
+            memcpy(out, v->clear, AES_BLOCK_SIZE);
+            for (uint32_t j=0;j<KAT_MCT_ITERATIONS;j++) {
+                engine->encrypt(&sched, out, out, 1);
+            }
+            fail += kat_result(report, engine->name, v->name,
+                               memcmp(out, v->ciphered, AES_BLOCK_SIZE) == 0);
+            /* walk the chain back with the decipher */
+            for (uint32_t j=0;j<KAT_MCT_ITERATIONS;j++) {
+                engine->decrypt(&sched, out, out, 1);
+            }
+            fail += kat_result(report, engine->name, v->name,
+                               memcmp(out, v->clear, AES_BLOCK_SIZE) == 0);
+        }
+    }
+    memset(&sched, 0, sizeof(aes_sched_t));
+    return fail;
+}
+
+/**
+ * @brief RFC 4493 vectors, one at a time and interleaved
+ * @param[in] ctx context keyed with kat_sp800_38a_key
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+static int32_t kat_cmac(const aes_ctx_t *ctx, FILE *report)
+{
+    const uint8_t *msgs[KAT_CMAC_MESSAGES];
+    size_t lens[KAT_CMAC_MESSAGES];
+    uint8_t macs[KAT_CMAC_MESSAGES][AES_CMAC_SIZE];
+    uint8_t mac[AES_CMAC_SIZE];
+    int32_t fail = 0;
+    int32_t ok = 1;
+
+    for (uint32_t i=0;i<4;i++) {
+        char name[48];
+
+        snprintf(name, sizeof(name), "RFC 4493 AES-CMAC-128 Mlen=%u", (unsigned)kat_cmac_lens[i]);
+        aes_cmac(ctx, mac, kat_sp800_38a_clear, kat_cmac_lens[i]);
+        fail += kat_result(report, "lib", name, memcmp(mac, kat_cmac_tags[i], AES_CMAC_SIZE) == 0);
+    }
+    for (uint32_t i=0;i<KAT_CMAC_MESSAGES;i++) {
+        msgs[i] = kat_sp800_38a_clear;
+        lens[i] = kat_cmac_lens[(i*3) % 4];
+    }
+    aes_cmac_multi(ctx, macs, msgs, lens, KAT_CMAC_MESSAGES);
+    for (uint32_t i=0;i<KAT_CMAC_MESSAGES;i++) {
+        ok &= (memcmp(macs[i], kat_cmac_tags[(i*3) % 4], AES_CMAC_SIZE) == 0);
+    }
+    fail += kat_result(report, "lib", "RFC 4493 AES-CMAC-128 multi-message", ok);
+    return fail;
+}
+
+/**
+ * @brief CTR_DRBG vector and a smoke test of the per-thread generator
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+static int32_t kat_drbg(FILE *report)
+{
+    uint8_t entropy[AES_DRBG_SEED_SIZE];
+    uint8_t pers[AES_DRBG_SEED_SIZE];
+    uint8_t add[AES_DRBG_SEED_SIZE];
+    uint8_t out[64];
+    uint8_t out2[64];
+    aes_drbg_t *drbg;
+    int32_t fail = 0;
+    int32_t ok;
+
+    for (uint32_t i=0;i<AES_DRBG_SEED_SIZE;i++) {
+        entropy[i] = (uint8_t)i;
+        pers[i] = (uint8_t)(0x80 + i);
+        add[i] = (uint8_t)(0x40 + i);
+    }
+    ok = (aes_drbg_new(&drbg, entropy, pers, sizeof(pers)) == AES_OK);
+    if (ok) {
+        aes_drbg_generate(drbg, out, sizeof(out), add, sizeof(add));
+        aes_drbg_generate(drbg, out, sizeof(out), add, sizeof(add));
+        ok = (memcmp(out, kat_drbg_out, sizeof(out)) == 0);
+        aes_drbg_free(drbg);
+    }
+    fail += kat_result(report, "lib", "CTR_DRBG AES-256 no df", ok);
+    ok = (aes_rand_bytes(out, sizeof(out)) == AES_OK) && (aes_rand_bytes(out2, sizeof(out2)) == AES_OK) &&
+         (memcmp(out, out2, sizeof(out)) != 0);
+    fail += kat_result(report, "lib", "aes_rand_bytes", ok);
+    return fail;
+}
+
+/**
+ * @brief POLYVAL on both implementations and the AES-GCM-SIV vectors
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+static int32_t kat_gcmsiv(FILE *report)
+{
+    uint8_t s[AES_POLYVAL_SIZE];
+    uint8_t out[16];
+    uint8_t tag[AES_GCMSIV_TAG_SIZE];
+    aes_polyval_t pv;
+    int32_t fail = 0;
+
+    for (uint32_t clmul=0;clmul<=(uint32_t)aes_polyval_clmul_supported();clmul++) {
+        aes_polyval_init(&pv, kat_polyval_h, clmul);
+        memset(s, 0, sizeof(s));
+        aes_polyval_update(&pv, s, kat_polyval_x, 2);
+        fail += kat_result(report, clmul ? "pclmul" : "table", "RFC 8452 POLYVAL",
+                           memcmp(s, kat_polyval_out, sizeof(s)) == 0);
+    }
+    for (uint32_t i=0;i<sizeof(kat_gcmsiv_vectors)/sizeof(kat_gcmsiv_vectors[0]);i++) {
+        const kat_gcmsiv_vector_t *v = &kat_gcmsiv_vectors[i];
+        aes_ctx_t *ctx;
+        int32_t ok;
+
+        if (aes_ctx_new(&ctx, v->key, v->key_len) != AES_OK) {
+            fail += kat_result(report, "lib", v->name, 0);
+            continue;
+        }
+        ok = (aes_gcmsiv_encrypt(ctx, kat_gcmsiv_nonce, out, tag, v->clear, v->len,
+                                 v->aad, v->aad_len) == AES_OK) &&
+             (memcmp(out, v->ciphered, v->len) == 0) && (memcmp(tag, v->tag, sizeof(tag)) == 0);
+        ok = ok && (aes_gcmsiv_decrypt(ctx, kat_gcmsiv_nonce, out, v->ciphered, v->len, v->tag,
+                                       v->aad, v->aad_len) == AES_OK) &&
+             (memcmp(out, v->clear, v->len) == 0);
+        /* a flipped ciphertext bit must be rejected and the output cleared */
+        memcpy(out, v->ciphered, v->len);
+        out[0] ^= 1;
+        ok = ok && (aes_gcmsiv_decrypt(ctx, kat_gcmsiv_nonce, out, out, v->len, v->tag,
+                                       v->aad, v->aad_len) == AES_ERR_AUTH) && (out[0] == 0);
+        fail += kat_result(report, "lib", v->name, ok);
+        aes_ctx_free(ctx);
+    }
+    return fail;
+}
+
+/**
+ * @brief batched unwrap of the RFC 3394 4.6 key, one copy corrupted
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+static int32_t kat_kw_batch(FILE *report)
+{
+    const kat_kw_vector_t *v = &kat_kw_vectors[1];
+    const uint8_t *wrapped[KAT_KW_BATCH];
+    size_t lens[KAT_KW_BATCH];
+    aes_ctx_t *ctxs[KAT_KW_BATCH];
+    aes_status_t status[KAT_KW_BATCH];
+    uint8_t out[40];
+    uint8_t block[2][AES_BLOCK_SIZE];
+    aes_ctx_t *kek;
+    aes_ctx_t *ref;
+    int32_t ok;
+
+    if ((aes_ctx_new(&kek, v->kek, v->kek_len) != AES_OK) ||
+        (aes_ctx_new(&ref, v->key, v->len) != AES_OK)) {
+        return kat_result(report, "lib", "KW batch unwrap into contexts", 0);
+    }
+    memcpy(out, v->wrapped, sizeof(out));
+    out[5] ^= 0x80;
+    for (uint32_t i=0;i<KAT_KW_BATCH;i++) {
+        wrapped[i] = (i == KAT_KW_BATCH/2) ? out : v->wrapped;
+        lens[i] = sizeof(v->wrapped);
+    }
+    ok = (aes_kw_unwrap_ctx(kek, v->variant, ctxs, status, wrapped, lens, KAT_KW_BATCH) == AES_ERR_AUTH);
+    memset(block[0], 0, sizeof(block[0]));
+    aes_ecb_encrypt(ref, block[0], block[0], AES_BLOCK_SIZE);
+    for (uint32_t i=0;i<KAT_KW_BATCH;i++) {
+        if (i == KAT_KW_BATCH/2) {
+            ok &= (ctxs[i] == NULL) && (status[i] == AES_ERR_AUTH);
+            continue;
+        }
+        ok &= (ctxs[i] != NULL) && (status[i] == AES_OK);
+        if (ctxs[i] != NULL) {
+            memset(block[1], 0, sizeof(block[1]));
+            aes_ecb_encrypt(ctxs[i], block[1], block[1], AES_BLOCK_SIZE);
+            ok &= (memcmp(block[0], block[1], AES_BLOCK_SIZE) == 0);
+            aes_ctx_free(ctxs[i]);
+        }
+    }
+    aes_ctx_free(ref);
+    aes_ctx_free(kek);
+    return kat_result(report, "lib", "KW batch unwrap into contexts", ok);
+}
+
+/**
+ * @brief key wrap vectors, single and batched unwrap into contexts
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+static int32_t kat_kw(FILE *report)
+{
+    uint8_t out[40];
+    int32_t fail = 0;
+
+    for (uint32_t i=0;i<sizeof(kat_kw_vectors)/sizeof(kat_kw_vectors[0]);i++) {
+        const kat_kw_vector_t *v = &kat_kw_vectors[i];
+        size_t wlen = AES_KW_WRAPPED_SIZE(v->len);
+        size_t len;
+        aes_ctx_t *kek;
+        int32_t ok;
+
+        if (aes_ctx_new(&kek, v->kek, v->kek_len) != AES_OK) {
+            fail += kat_result(report, "lib", v->name, 0);
+            continue;
+        }
+        ok = (aes_kw_wrap(kek, v->variant, out, &len, v->key, v->len) == AES_OK) &&
+             (len == wlen) && (memcmp(out, v->wrapped, wlen) == 0);
+        ok = ok && (aes_kw_unwrap(kek, v->variant, out, &len, v->wrapped, wlen) == AES_OK) &&
+             (len == v->len) && (memcmp(out, v->key, v->len) == 0);
+        memcpy(out, v->wrapped, wlen);
+        out[wlen-1] ^= 1;
+        ok = ok && (aes_kw_unwrap(kek, v->variant, out, &len, out, wlen) == AES_ERR_AUTH);
+        fail += kat_result(report, "lib", v->name, ok);
+        aes_ctx_free(kek);
+    }
+    return fail + kat_kw_batch(report);
+}
+
+/**
+ * @brief feed a buffer through a stream in uneven chunks
+ * @param[in,out] st pointer to a started stream
+ * @param[out] out output buffer, NULL for CMAC
+ * @param[in] in input buffer
+ * @param[in] len number of bytes
+ * @return number of bytes written
+ */
+static size_t kat_stream_feed(aes_stream_t *st, uint8_t *out, const uint8_t *in, size_t len)
+{
+    static const size_t chunks[] = {1, 5, 16, 19, 0, 23};
+    size_t done = 0;
+    size_t written = 0;
+
+    for (uint32_t i=0;done<len;i++) {
+        size_t n = chunks[i % (sizeof(chunks)/sizeof(chunks[0]))];
+        size_t out_len;
+
+        n = (n < len - done) ? n : len - done;
+        aes_stream_update(st, (out != NULL) ? out + written : NULL, &out_len, in + done, n);
+        done += n;
+        written += out_len;
+    }
+    return written;
+}
+
+/**
+ * @brief SP 800-38A and RFC 4493 vectors through the streaming interface
+ * @param[in] ctx pointer to the SP 800-38A key context
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+static int32_t kat_stream(const aes_ctx_t *ctx, FILE *report)
+{
+    uint8_t out[64];
+    uint8_t mac[AES_CMAC_SIZE];
+    aes_stream_t *st;
+    size_t len;
+    size_t tail;
+    int32_t fail = 0;
+    int32_t ok;
+
+    ok = (aes_stream_new(&st, ctx, AES_STREAM_CBC, AES_STREAM_ENCRYPT) == AES_OK);
+    if (ok) {
+        aes_stream_init(st, kat_cbc_iv);
+        len = kat_stream_feed(st, out, kat_sp800_38a_clear, sizeof(out));
+        ok = (aes_stream_final(st, NULL, &tail) == AES_OK) && (len == sizeof(out)) &&
+             (memcmp(out, kat_cbc_ciphered, sizeof(out)) == 0);
+        aes_stream_free(st);
+    }
+    fail += kat_result(report, "lib", "stream CBC-AES128.Encrypt", ok);
+    ok = (aes_stream_new(&st, ctx, AES_STREAM_CTR, AES_STREAM_DECRYPT) == AES_OK);
+    if (ok) {
+        aes_stream_init(st, kat_ctr_counter);
+        len = kat_stream_feed(st, out, kat_ctr_ciphered, sizeof(out));
+        ok = (aes_stream_final(st, NULL, &tail) == AES_OK) && (len == sizeof(out)) &&
+             (memcmp(out, kat_sp800_38a_clear, sizeof(out)) == 0);
+        aes_stream_free(st);
+    }
+    fail += kat_result(report, "lib", "stream CTR-AES128.Decrypt", ok);
+    ok = (aes_stream_new(&st, ctx, AES_STREAM_CMAC, AES_STREAM_ENCRYPT) == AES_OK);
+    if (ok) {
+        for (uint32_t i=0;i<4;i++) {
+            aes_stream_init(st, NULL);
+            kat_stream_feed(st, NULL, kat_sp800_38a_clear, kat_cmac_lens[i]);
+            ok &= (aes_stream_final(st, mac, &len) == AES_OK) && (len == AES_CMAC_SIZE) &&
+                  (memcmp(mac, kat_cmac_tags[i], AES_CMAC_SIZE) == 0);
+        }
+        aes_stream_free(st);
+    }
+    fail += kat_result(report, "lib", "stream AES-CMAC-128", ok);
+    return fail;
+}
+
+/**
+ * @brief split a buffer into iovec fragments of the given sizes
+ * @param[out] iov fragments, one per size
+ * @param[in] buf buffer to split
+ * @param[in] sizes fragment sizes, their sum is the buffer length
+ * @param[in] cnt number of fragments
+ */
+static void kat_iov_split(struct iovec *iov, const uint8_t *buf, const size_t *sizes, size_t cnt)
+{
+    for (size_t i=0;i<cnt;i++) {
+        iov[i].iov_base = (void *)(uintptr_t)buf;
+        iov[i].iov_len = sizes[i];
+        buf += sizes[i];
+    }
+}
+
+/**
+ * @brief SP 800-38A CTR vector through the iovec call, fragments cut
+ * differently on each side and across block edges
+ * @param[in] ctx pointer to the SP 800-38A key context
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+static int32_t kat_iov(const aes_ctx_t *ctx, FILE *report)
+{
+    static const size_t in_sizes[] = {5, 0, 27, 1, 31};
+    static const size_t out_sizes[] = {16, 17, 0, 3, 28};
+    struct iovec in[5], out[5];
+    uint8_t buf[64];
+    uint8_t counter[AES_BLOCK_SIZE];
+
+    memcpy(counter, kat_ctr_counter, sizeof(counter));
+    kat_iov_split(in, kat_sp800_38a_clear, in_sizes, 5);
+    kat_iov_split(out, buf, out_sizes, 5);
+    return kat_result(report, "lib", "iovec CTR-AES128.Encrypt",
+                      (aes_ctr_crypt_iov(ctx, counter, out, 5, in, 5) == AES_OK) &&
+                      (memcmp(buf, kat_ctr_ciphered, sizeof(buf)) == 0));
+}
+
+/**
+ * @brief CRC32C check value on both paths, then the SP 800-38A CTR vector
+ * through the fused call in three pieces, against separate passes
+ * @param[in] ctx pointer to the SP 800-38A key context
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+static int32_t kat_crc32c(const aes_ctx_t *ctx, FILE *report)
+{
+    static const uint8_t check[9] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    static const size_t cuts[] = {0, 16, 48, 64};
+    uint8_t counter[AES_BLOCK_SIZE];
+    uint8_t buf[64];
+    uint32_t crc_in = 0;
+    uint32_t crc_out = 0;
+    int32_t fail = 0;
+    int32_t ok;
+
+    ok = (~aes_crc32c_raw(0xffffffff, check, sizeof(check), 0) == 0xe3069283) &&
+         (~aes_crc32c_raw(0xffffffff, check, sizeof(check), 1) == 0xe3069283) &&
+         (aes_crc32c(aes_crc32c(0, check, 4), check + 4, 5) == 0xe3069283);
+    fail += kat_result(report, "lib", "CRC32C check value", ok);
+    memcpy(counter, kat_ctr_counter, sizeof(counter));
+    ok = 1;
+    for (size_t i=0;i+1<sizeof(cuts)/sizeof(cuts[0]);i++) {
+        ok = ok && (aes_ctr_crypt_crc32c(ctx, counter, buf + cuts[i], kat_sp800_38a_clear + cuts[i],
+                                         cuts[i+1] - cuts[i], AES_CRC32C_INPUT, &crc_in) == AES_OK);
+    }
+    /* decipher in place, summing the deciphered side */
+    memcpy(counter, kat_ctr_counter, sizeof(counter));
+    ok = ok && (memcmp(buf, kat_ctr_ciphered, sizeof(buf)) == 0) &&
+         (aes_ctr_crypt_crc32c(ctx, counter, buf, buf, sizeof(buf), AES_CRC32C_OUTPUT,
+                               &crc_out) == AES_OK) &&
+         (memcmp(buf, kat_sp800_38a_clear, sizeof(buf)) == 0) &&
+         (crc_in == aes_crc32c(0, kat_sp800_38a_clear, sizeof(buf))) && (crc_out == crc_in);
+    fail += kat_result(report, "lib", "CTR-AES128 fused CRC32C", ok);
+    return fail;
+}
+
+/**
+ * @brief GCM test cases 3 and 4, flat and through iovecs, and a rejected tag
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+static int32_t kat_gcm(FILE *report)
+{
+    static const size_t in_sizes[] = {7, 33, 20};
+    static const size_t out_sizes[] = {16, 1, 43};
+    struct iovec in[3], out[3];
+    uint8_t buf[64];
+    uint8_t tag[AES_GCM_TAG_SIZE];
+    aes_ctx_t *ctx;
+    int32_t fail = 0;
+    int32_t ok;
+
+    if (aes_ctx_new(&ctx, kat_gcm_key, sizeof(kat_gcm_key)) != AES_OK) {
+        return kat_result(report, "lib", "GCM context creation", 0);
+    }
+    ok = (aes_gcm_encrypt(ctx, kat_gcm_iv, sizeof(kat_gcm_iv), buf, tag, kat_gcm_clear,
+                          sizeof(buf), NULL, 0) == AES_OK) &&
+         (memcmp(buf, kat_gcm_ciphered, sizeof(buf)) == 0) &&
+         (memcmp(tag, kat_gcm_tag3, sizeof(tag)) == 0);
+    ok = ok && (aes_gcm_decrypt(ctx, kat_gcm_iv, sizeof(kat_gcm_iv), buf, buf, sizeof(buf),
+                                kat_gcm_tag3, NULL, 0) == AES_OK) &&
+         (memcmp(buf, kat_gcm_clear, sizeof(buf)) == 0);
+    fail += kat_result(report, "lib", "GCM test case 3", ok);
+    kat_iov_split(in, kat_gcm_clear, in_sizes, 3);
+    kat_iov_split(out, buf, out_sizes, 3);
+    ok = (aes_gcm_encrypt_iov(ctx, kat_gcm_iv, sizeof(kat_gcm_iv), out, 3, tag, in, 3,
+                              kat_gcm_aad, sizeof(kat_gcm_aad)) == AES_OK) &&
+         (memcmp(buf, kat_gcm_ciphered, 60) == 0) && (memcmp(tag, kat_gcm_tag4, sizeof(tag)) == 0);
+    /* decipher in place with the fragment layouts swapped */
+    kat_iov_split(in, buf, out_sizes, 3);
+    ok = ok && (aes_gcm_decrypt_iov(ctx, kat_gcm_iv, sizeof(kat_gcm_iv), in, 3, in, 3,
+                                    kat_gcm_tag4, kat_gcm_aad, sizeof(kat_gcm_aad)) == AES_OK) &&
+         (memcmp(buf, kat_gcm_clear, 60) == 0);
+    fail += kat_result(report, "lib", "iovec GCM test case 4", ok);
+    /* a truncated AAD must be rejected and the output cleared */
+    memcpy(buf, kat_gcm_ciphered, 60);
+    ok = (aes_gcm_decrypt(ctx, kat_gcm_iv, sizeof(kat_gcm_iv), buf, buf, 60, kat_gcm_tag4,
+                          kat_gcm_aad, sizeof(kat_gcm_aad) - 1) == AES_ERR_AUTH) && (buf[0] == 0);
+    fail += kat_result(report, "lib", "GCM reject bad tag", ok);
+    aes_ctx_free(ctx);
+    return fail;
+}
+
+/**
+ * @brief CCM examples 1 to 3 of SP 800-38C, deciphered in place, and a
+ * rejected tag
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+static int32_t kat_ccm(FILE *report)
+{
+    uint8_t nonce[AES_CCM_NONCE_MAX];
+    uint8_t aad[20];
+    uint8_t clear[24];
+    uint8_t buf[24];
+    uint8_t tag[AES_CCM_TAG_MAX];
+    aes_ctx_t *ctx;
+    int32_t fail = 0;
+
+    if (aes_ctx_new(&ctx, kat_ccm_key, sizeof(kat_ccm_key)) != AES_OK) {
+        return kat_result(report, "lib", "CCM context creation", 0);
+    }
+    for (uint32_t i=0;i<sizeof(nonce);i++) {
+        nonce[i] = (uint8_t)(0x10 + i);
+    }
+    for (uint32_t i=0;i<sizeof(aad);i++) {
+        aad[i] = (uint8_t)i;
+    }
+    for (uint32_t i=0;i<sizeof(clear);i++) {
+        clear[i] = (uint8_t)(0x20 + i);
+    }
+    for (uint32_t i=0;i<sizeof(kat_ccm_vectors)/sizeof(kat_ccm_vectors[0]);i++) {
+        const kat_ccm_vector_t *v = &kat_ccm_vectors[i];
+        char name[32];
+        int32_t ok;
+
+        ok = (aes_ccm_encrypt(ctx, nonce, v->nonce_len, buf, tag, v->tag_len, clear, v->len,
+                              aad, v->aad_len) == AES_OK) &&
+             (memcmp(buf, v->ciphered, v->len) == 0) &&
+             (memcmp(tag, v->ciphered + v->len, v->tag_len) == 0);
+        ok = ok && (aes_ccm_decrypt(ctx, nonce, v->nonce_len, buf, buf, v->len, tag, v->tag_len,
+                                    aad, v->aad_len) == AES_OK) &&
+             (memcmp(buf, clear, v->len) == 0);
+        snprintf(name, sizeof(name), "SP800-38C C.%u CCM", i + 1);
+        fail += kat_result(report, "lib", name, ok);
+    }
+    /* a flipped ciphertext bit must be rejected and the output cleared */
+    memcpy(buf, kat_ccm_vectors[2].ciphered, 24);
+    buf[5] ^= 0x01;
+    fail += kat_result(report, "lib", "CCM reject bad tag",
+                       (aes_ccm_decrypt(ctx, nonce, 12, buf, buf, 24, kat_ccm_vectors[2].ciphered + 24,
+                                        8, aad, 20) == AES_ERR_AUTH) && (buf[0] == 0));
+    aes_ctx_free(ctx);
+    return fail;
+}
+
+/**
+ * @brief RFC 7253 iterative test: 384 encryptions of growing length, whose
+ * outputs are authenticated as the AAD of a last one
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+static int32_t kat_ocb_iterative(FILE *report)
+{
+    uint8_t key[16];
+    uint8_t nonce[12];
+    uint8_t s[128];
+    uint8_t tag[AES_OCB_TAG_MAX];
+    uint8_t *c;
+    size_t len = 0;
+    aes_ctx_t *ctx;
+    int32_t ok;
+
+    memset(key, 0, sizeof(key));
+    key[15] = 128;
+    memset(nonce, 0, sizeof(nonce));
+    memset(s, 0, sizeof(s));
+    c = malloc(128*(2*sizeof(s) + 3*AES_OCB_TAG_MAX));
+    if ((c == NULL) || (aes_ctx_new(&ctx, key, sizeof(key)) != AES_OK)) {
+        free(c);
+        return kat_result(report, "lib", "RFC7253 OCB iterative", 0);
+    }
+    ok = 1;
+    for (uint32_t i=0;i<128;i++) {
+        nonce[10] = (uint8_t)((3*i + 1) >> 8);
+        nonce[11] = (uint8_t)(3*i + 1);
+        ok = ok && (aes_ocb_encrypt(ctx, nonce, sizeof(nonce), c + len, c + len + i, 16,
+                                    s, i, s, i) == AES_OK);
+        len += i + 16;
+        nonce[10] = (uint8_t)((3*i + 2) >> 8);
+        nonce[11] = (uint8_t)(3*i + 2);
+        ok = ok && (aes_ocb_encrypt(ctx, nonce, sizeof(nonce), c + len, c + len + i, 16,
+                                    s, i, NULL, 0) == AES_OK);
+        len += i + 16;
+        nonce[10] = (uint8_t)((3*i + 3) >> 8);
+        nonce[11] = (uint8_t)(3*i + 3);
+        ok = ok && (aes_ocb_encrypt(ctx, nonce, sizeof(nonce), NULL, c + len, 16,
+                                    NULL, 0, s, i) == AES_OK);
+        len += 16;
+    }
+    nonce[10] = (uint8_t)(385 >> 8);
+    nonce[11] = (uint8_t)385;
+    ok = ok && (aes_ocb_encrypt(ctx, nonce, sizeof(nonce), NULL, tag, 16, NULL, 0, c, len) == AES_OK) &&
+         (memcmp(tag, kat_ocb_iter_tag, sizeof(kat_ocb_iter_tag)) == 0);
+    aes_ctx_free(ctx);
+    free(c);
+    return kat_result(report, "lib", "RFC7253 OCB iterative", ok);
+}
+
+/**
+ * @brief OCB sample results of RFC 7253, deciphered in place, a message
+ * longer than the engine batches and a rejected tag
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+static int32_t kat_ocb(FILE *report)
+{
+    uint8_t key[16];
+    uint8_t nonce[12] = {0xbb, 0xaa, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x00};
+    uint8_t clear[300];
+    uint8_t buf[300];
+    uint8_t tag[AES_OCB_TAG_MAX];
+    aes_ctx_t *ctx;
+    int32_t fail = 0;
+    int32_t ok;
+
+    for (uint32_t i=0;i<sizeof(key);i++) {
+        key[i] = (uint8_t)i;
+    }
+    for (uint32_t i=0;i<sizeof(clear);i++) {
+        clear[i] = (uint8_t)i;
+    }
+    if (aes_ctx_new(&ctx, key, sizeof(key)) != AES_OK) {
+        return kat_result(report, "lib", "OCB context creation", 0);
+    }
+    for (uint32_t i=0;i<sizeof(kat_ocb_vectors)/sizeof(kat_ocb_vectors[0]);i++) {
+        const kat_ocb_vector_t *v = &kat_ocb_vectors[i];
+        char name[40];
+
+        nonce[11] = v->nonce_last;
+        ok = (aes_ocb_encrypt(ctx, nonce, sizeof(nonce), buf, tag, 16, clear, v->len,
+                              clear, v->aad_len) == AES_OK) &&
+             (memcmp(buf, v->ciphered, v->len) == 0) &&
+             (memcmp(tag, v->ciphered + v->len, 16) == 0);
+        ok = ok && (aes_ocb_decrypt(ctx, nonce, sizeof(nonce), buf, buf, v->len, tag, 16,
+                                    clear, v->aad_len) == AES_OK) &&
+             (memcmp(buf, clear, v->len) == 0);
+        snprintf(name, sizeof(name), "RFC7253 OCB-AES128 N=..%02X", v->nonce_last);
+        fail += kat_result(report, "lib", name, ok);
+    }
+    nonce[11] = 0x20;
+    ok = (aes_ocb_encrypt(ctx, nonce, sizeof(nonce), buf, tag, 16, clear, sizeof(buf),
+                          clear, 24) == AES_OK) &&
+         (aes_crc32c(0, buf, sizeof(buf)) == kat_ocb_long_crc) &&
+         (memcmp(tag, kat_ocb_long_tag, sizeof(kat_ocb_long_tag)) == 0);
+    ok = ok && (aes_ocb_decrypt(ctx, nonce, sizeof(nonce), buf, buf, sizeof(buf), tag, 16,
+                                clear, 24) == AES_OK) &&
+         (memcmp(buf, clear, sizeof(buf)) == 0);
+    fail += kat_result(report, "lib", "OCB-AES128 300-byte message", ok);
+    /* a flipped ciphertext bit must be rejected and the output cleared */
+    nonce[11] = 0x0d;
+    memcpy(buf, kat_ocb_vectors[4].ciphered, 40);
+    buf[3] ^= 0x01;
+    fail += kat_result(report, "lib", "OCB reject bad tag",
+                       (aes_ocb_decrypt(ctx, nonce, sizeof(nonce), buf, buf, 40,
+                                        kat_ocb_vectors[4].ciphered + 40, 16, clear, 40) == AES_ERR_AUTH) &&
+                       (buf[3] == 0));
+    aes_ctx_free(ctx);
+    return fail + kat_ocb_iterative(report);
+}
+
+/**
+ * @brief convert a KAT string of characters 0-9a-z to numerals
+ * @param[out] x numerals
+ * @param[in] str characters
+ * @return number of numerals
+ */
+static size_t kat_ff1_numerals(uint16_t *x, const char *str)
+{
+    size_t len = strlen(str);
+
+    for (size_t i=0;i<len;i++) {
+        x[i] = (uint16_t)((str[i] <= '9') ? (str[i] - '0') : (str[i] - 'a' + 10));
+    }
+    return len;
+}
+
+/**
+ * @brief batched FF1 against single calls, for a length whose halves fit a
+ * word and one that does not, over more strings than one batch
+ * @param[in] ff1 radix 10 FF1 object
+ * @param[in] len string length
+ * @return 1 if the batch matches and deciphers back, 0 otherwise
+ */
+static int32_t kat_ff1_batch(const aes_ff1_t *ff1, size_t len)
+{
+    uint16_t clear[40*40];
+    uint16_t batch[40*40];
+    uint16_t one[40];
+    int32_t ok;
+
+    for (size_t i=0;i<40*len;i++) {
+        clear[i] = (uint16_t)((i*7 + i/len) % 10);
+    }
+    ok = (aes_ff1_encrypt_batch(ff1, batch, clear, len, 40) == AES_OK);
+    for (size_t k=0;ok && (k<40);k++) {
+        ok = (aes_ff1_encrypt(ff1, one, clear + k*len, len) == AES_OK) &&
+             (memcmp(one, batch + k*len, len*sizeof(one[0])) == 0);
+    }
+    ok = ok && (aes_ff1_decrypt_batch(ff1, batch, batch, len, 40) == AES_OK) &&
+         (memcmp(batch, clear, 40*len*sizeof(clear[0])) == 0);
+    return ok;
+}
+
+/**
+ * @brief FF1 samples of SP 800-38G, batched against single calls and the
+ * rejection of out-of-range inputs
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+static int32_t kat_ff1(FILE *report)
+{
+    uint16_t clear[AES_FF1_LEN_MAX];
+    uint16_t expected[AES_FF1_LEN_MAX];
+    uint16_t buf[AES_FF1_LEN_MAX];
+    aes_ctx_t *ctx;
+    aes_ff1_t *ff1;
+    int32_t fail = 0;
+    int32_t ok;
+
+    for (uint32_t i=0;i<sizeof(kat_ff1_vectors)/sizeof(kat_ff1_vectors[0]);i++) {
+        const kat_ff1_vector_t *v = &kat_ff1_vectors[i];
+        size_t len = kat_ff1_numerals(clear, v->clear);
+        char name[40];
+
+        kat_ff1_numerals(expected, v->ciphered);
+        ok = 0;
+        if (aes_ctx_new(&ctx, kat_ff1_key, v->key_len) == AES_OK) {
+            if (aes_ff1_new(&ff1, ctx, v->radix, v->tweak, v->tweak_len) == AES_OK) {
+                ok = (aes_ff1_encrypt(ff1, buf, clear, len) == AES_OK) &&
+                     (memcmp(buf, expected, len*sizeof(buf[0])) == 0);
+                ok = ok && (aes_ff1_decrypt(ff1, buf, buf, len) == AES_OK) &&
+                     (memcmp(buf, clear, len*sizeof(buf[0])) == 0);
+                aes_ff1_free(ff1);
+            }
+            aes_ctx_free(ctx);
+        }
+        snprintf(name, sizeof(name), "SP800-38G FF1-AES%u sample %u", v->key_len*8, i + 1);
+        fail += kat_result(report, "lib", name, ok);
+    }
+    if (aes_ctx_new(&ctx, kat_ff1_key, 16) != AES_OK) {
+        return fail + kat_result(report, "lib", "FF1 context creation", 0);
+    }
+    if (aes_ff1_new(&ff1, ctx, 10, NULL, 0) != AES_OK) {
+        aes_ctx_free(ctx);
+        return fail + kat_result(report, "lib", "FF1 object creation", 0);
+    }
+    fail += kat_result(report, "lib", "FF1 batch of 16-numeral strings", kat_ff1_batch(ff1, 16));
+    fail += kat_result(report, "lib", "FF1 batch of 40-numeral strings", kat_ff1_batch(ff1, 40));
+    kat_ff1_numerals(clear, "0123456789");
+    clear[4] = 10;
+    ok = (aes_ff1_encrypt(ff1, buf, clear, 10) == AES_ERR_PARAM) &&
+         (aes_ff1_encrypt(ff1, buf, clear, aes_ff1_min_len(ff1) - 1) == AES_ERR_LENGTH) &&
+         (aes_ff1_encrypt(ff1, buf, clear, AES_FF1_LEN_MAX + 1) == AES_ERR_LENGTH);
+    fail += kat_result(report, "lib", "FF1 reject bad numeral and length", ok);
+    aes_ff1_free(ff1);
+    aes_ctx_free(ctx);
+    return fail;
+}
+
+/**
+ * @brief compare aes_ctr_crypt_pool with aes_ctr_crypt on one pool, for
+ * lengths around the task size and counters carrying past 64 and 128 bits
+ * @param[in] pool pool under test
+ * @param[in] ctx key context
+ * @return 1 if every output and final counter match, 0 otherwise
+ */
+static int32_t kat_pool_ctr(aes_pool_t *pool, const aes_ctx_t *ctx)
+{
+    static const uint8_t wraps[2][AES_BLOCK_SIZE] = {
+        {0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00},
+        {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xf0}
+    };
+    const size_t chunk = aes_pool_chunk_size(pool);
+    const size_t lens[] = {1, 17, chunk - 1, chunk + 1, 3*chunk + 5, 5*chunk + 37};
+    const size_t max = 5*chunk + 37;
+    uint8_t counter[AES_BLOCK_SIZE];
+    uint8_t ref_counter[AES_BLOCK_SIZE];
+    uint8_t *clear = malloc(max);
+    uint8_t *out = malloc(max);
+    uint8_t *ref = malloc(max);
+    int32_t ok = (clear != NULL) && (out != NULL) && (ref != NULL);
+
+    for (size_t i=0;ok&&(i<max);i++) {
+        clear[i] = (uint8_t)(i*131 + (i >> 12));
+    }
+    for (uint32_t w=0;ok&&(w<2);w++) {
+        for (uint32_t i=0;ok&&(i<sizeof(lens)/sizeof(lens[0]));i++) {
+            memcpy(counter, wraps[w], sizeof(counter));
+            memcpy(ref_counter, wraps[w], sizeof(ref_counter));
+            ok = (aes_ctr_crypt(ctx, ref_counter, ref, clear, lens[i]) == AES_OK) &&
+                 (aes_ctr_crypt_pool(pool, ctx, counter, out, clear, lens[i]) == AES_OK) &&
+                 (memcmp(out, ref, lens[i]) == 0) &&
+                 (memcmp(counter, ref_counter, sizeof(counter)) == 0);
+        }
+    }
+    free(clear);
+    free(out);
+    free(ref);
+    return ok;
+}
+
+/**
+ * @brief parallel CTR against the serial one, on a working pool and on a
+ * pool whose workers all failed to allocate their key replica
+ * @param[in] ctx key context
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+static int32_t kat_pool(const aes_ctx_t *ctx, FILE *report)
+{
+    aes_pool_t *pool;
+    int32_t fail = 0;
+    int32_t ok;
+
+    ok = (aes_pool_new(&pool, 3) == AES_OK);
+    ok = ok && kat_pool_ctr(pool, ctx);
+    aes_pool_free(pool);
+    fail += kat_result(report, "lib", "pool CTR against aes_ctr_crypt", ok);
+    /* the caller then runs every task */
+    aes_pool_fail_workers(1);
+    ok = (aes_pool_new(&pool, 3) == AES_OK);
+    aes_pool_fail_workers(0);
+    ok = ok && kat_pool_ctr(pool, ctx);
+    aes_pool_free(pool);
+    fail += kat_result(report, "lib", "pool CTR without worker key replicas", ok);
+    return fail;
+}
+
+/**
+ * @brief seal a multi-chunk file, open it whole and by ranges, and check
+ * that altering a chunk or the header is detected
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+static int32_t kat_container(FILE *report)
+{
+    const uint32_t chunk = 4096;
+    const size_t len = 3*4096 + 100;
+    aes_container_info_t info;
+    FILE *in = tmpfile();
+    FILE *sealed = tmpfile();
+    uint8_t *clear = malloc(len);
+    uint8_t *buf = malloc(len);
+    uint8_t byte;
+    aes_ctx_t *ctx = NULL;
+    int pipe_fd[2];
+    int fd;
+    int32_t fail = 0;
+    int32_t ok;
+
+    if ((in == NULL) || (sealed == NULL) || (clear == NULL) || (buf == NULL) ||
+        (aes_ctx_new(&ctx, kat_sp800_38a_key, sizeof(kat_sp800_38a_key)) != AES_OK)) {
+        fail += kat_result(report, "lib", "container setup", 0);
+        goto done;
+    }
+    for (size_t i=0;i<len;i++) {
+        clear[i] = (uint8_t)(i ^ (i >> 8));
+    }
+    fd = fileno(sealed);
+    ok = (fwrite(clear, 1, len, in) == len) && (fflush(in) == 0) &&
+         (aes_container_seal(ctx, fd, fileno(in), chunk, 2) == AES_OK) &&
+         (aes_container_info(fd, &info) == AES_OK) &&
+         (info.length == len) && (info.nchunks == 4) && (info.chunk_size == chunk) &&
+         (aes_container_read(ctx, fd, buf, 0, len, 2) == AES_OK) &&
+         (memcmp(buf, clear, len) == 0);
+    fail += kat_result(report, "lib", "container seal and open", ok);
+    /* ranges across a chunk boundary and at the end of the last chunk */
+    ok = ok && (aes_container_read(ctx, fd, buf, 4000, 5000, 1) == AES_OK) &&
+         (memcmp(buf, clear + 4000, 5000) == 0) &&
+         (aes_container_read(ctx, fd, buf, len - 7, 7, 1) == AES_OK) &&
+         (memcmp(buf, clear + len - 7, 7) == 0) &&
+         (aes_container_read(ctx, fd, buf, len - 7, 8, 1) != AES_OK);
+    fail += kat_result(report, "lib", "container range reads", ok);
+    /* a flipped bit in chunk 2 fails the ranges covering it, not the others */
+    ok = ok && (pread(fd, &byte, 1, (off_t)(info.data_offset + 2*chunk + 10)) == 1);
+    byte ^= 0x01;
+    ok = ok && (pwrite(fd, &byte, 1, (off_t)(info.data_offset + 2*chunk + 10)) == 1) &&
+         (aes_container_read(ctx, fd, buf, 3*chunk - 1, 2, 1) == AES_ERR_AUTH) &&
+         (aes_container_read(ctx, fd, buf, 0, chunk, 1) == AES_OK) &&
+         (memcmp(buf, clear, chunk) == 0);
+    byte ^= 0x01;
+    ok = ok && (pwrite(fd, &byte, 1, (off_t)(info.data_offset + 2*chunk + 10)) == 1);
+    fail += kat_result(report, "lib", "container reject altered chunk", ok);
+    /* the header, here the last byte of its nonce at 32..43, is authenticated by every chunk */
+    ok = ok && (pread(fd, &byte, 1, 43) == 1);
+    byte ^= 0x80;
+    ok = ok && (pwrite(fd, &byte, 1, 43) == 1) &&
+         (aes_container_read(ctx, fd, buf, 0, 16, 1) == AES_ERR_AUTH);
+    fail += kat_result(report, "lib", "container reject altered header", ok);
+    /* the size of a pipe is not its length */
+    ok = (pipe(pipe_fd) == 0);
+    if (ok) {
+        ok = (aes_container_seal(ctx, fd, pipe_fd[0], chunk, 1) == AES_ERR_PARAM);
+        close(pipe_fd[0]);
+        close(pipe_fd[1]);
+    }
+    fail += kat_result(report, "lib", "container reject non-regular input", ok);
+done:
+    aes_ctx_free(ctx);
+    if (in != NULL) {
+        fclose(in);
+    }
+    if (sealed != NULL) {
+        fclose(sealed);
+    }
+    free(clear);
+    free(buf);
+    return fail;
+}
+
+/* asynchronous jobs and the synchronous results they must match */
+#define KAT_ASYNC_JOBS  96
+#define KAT_ASYNC_SLOT  4096
+
+typedef struct kat_async_s {
+    aes_job_t jobs[KAT_ASYNC_JOBS];
+    aes_job_t refs[KAT_ASYNC_JOBS];
+    uint8_t clear[KAT_ASYNC_JOBS*KAT_ASYNC_SLOT];
+    uint8_t sealed[KAT_ASYNC_JOBS*KAT_ASYNC_SLOT];
+    uint8_t out[KAT_ASYNC_JOBS*KAT_ASYNC_SLOT];
+    uint8_t ref[KAT_ASYNC_JOBS*KAT_ASYNC_SLOT];
+    uint32_t done;                  /* atomic */
+} kat_async_t;
+
+static void kat_async_cb(aes_job_t *job, void *user)
+{
+    (void)job;
+    __atomic_add_fetch((uint32_t *)user, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief run a job through the synchronous call of its mode
+ * @param[in,out] job job, its iv and tag updated as by the call
+ * @return status of the call
+ */
+static aes_status_t kat_async_sync(aes_job_t *job)
+{
+    switch (job->op) {
+        case AES_JOB_CTR:
+            return aes_ctr_crypt(job->ctx, job->iv, job->out, job->in, job->len);
+        case AES_JOB_ECB_ENCRYPT:
+            return aes_ecb_encrypt(job->ctx, job->out, job->in, job->len);
+        case AES_JOB_ECB_DECRYPT:
+            return aes_ecb_decrypt(job->ctx, job->out, job->in, job->len);
+        case AES_JOB_GCM_ENCRYPT:
+            return aes_gcm_encrypt(job->ctx, job->iv, job->iv_len, job->out, job->tag,
+                                   job->in, job->len, job->aad, job->aad_len);
+        default:
+            return aes_gcm_decrypt(job->ctx, job->iv, job->iv_len, job->out, job->in,
+                                   job->len, job->tag, job->aad, job->aad_len);
+    }
+}
+
+/**
+ * @brief fill the jobs: CTR with wrapping counters, ECB, GCM, and GCM
+ * decryptions of which every other one has a bad tag, small ones that a
+ * worker coalesces and large ones, alternating between two keys; then
+ * compute their expected results synchronously
+ */
+static void kat_async_setup(kat_async_t *k, aes_ctx_t *ctxs[2])
+{
+    static const uint32_t ops[5] = {AES_JOB_CTR, AES_JOB_ECB_ENCRYPT, AES_JOB_ECB_DECRYPT,
+                                    AES_JOB_GCM_ENCRYPT, AES_JOB_GCM_DECRYPT};
+
+    memset(k->out, 0xa5, sizeof(k->out));
+    k->done = 0;
+    for (uint32_t i=0;i<KAT_ASYNC_JOBS;i++) {
+        aes_job_t *job = &k->jobs[i];
+        size_t off = (size_t)i*KAT_ASYNC_SLOT;
+
+        memset(job, 0, sizeof(aes_job_t));
+        job->ctx = ctxs[i%2];
+        job->op = ops[i%5];
+        job->len = (i*389 + 7) % KAT_ASYNC_SLOT;
+        job->in = k->clear + off;
+        job->out = k->out + off;
+        job->cb = kat_async_cb;
+        job->user = &k->done;
+        if ((job->op == AES_JOB_ECB_ENCRYPT) || (job->op == AES_JOB_ECB_DECRYPT)) {
+            job->len &= ~(size_t)(AES_BLOCK_SIZE - 1);
+        } else if (job->op == AES_JOB_CTR) {
+            memset(job->iv, 0xff, sizeof(job->iv));
+            job->iv[AES_BLOCK_SIZE-1] = (uint8_t)(0xff - i);
+        } else {
+            job->iv_len = 12;
+            for (uint32_t j=0;j<job->iv_len;j++) {
+                job->iv[j] = (uint8_t)(i + j);
+            }
+            job->aad = k->clear + off + KAT_ASYNC_SLOT - 32;
+            job->aad_len = i % 21;
+        }
+        if (job->op == AES_JOB_GCM_DECRYPT) {
+            aes_gcm_encrypt(job->ctx, job->iv, job->iv_len, k->sealed + off, job->tag,
+                            job->in, job->len, job->aad, job->aad_len);
+            job->in = k->sealed + off;
+            job->tag[0] ^= (uint8_t)(i % 2);
+        }
+        k->refs[i] = *job;
+        k->refs[i].out = k->ref + off;
+        k->refs[i].status = kat_async_sync(&k->refs[i]);
+    }
+}
+
+/**
+ * @brief check the first jobs against their synchronous result
+ * @param[in] k jobs
+ * @param[in] n number of jobs submitted
+ * @return 1 if all n completed and match, 0 otherwise
+ */
+static int32_t kat_async_check(const kat_async_t *k, uint32_t n)
+{
+    int32_t ok = (__atomic_load_n(&k->done, __ATOMIC_ACQUIRE) == n);
+
+    for (uint32_t i=0;ok&&(i<n);i++) {
+        const aes_job_t *job = &k->jobs[i];
+        const aes_job_t *ref = &k->refs[i];
+
+        ok = (job->status == ref->status) && (memcmp(job->out, ref->out, job->len) == 0) &&
+             (memcmp(job->iv, ref->iv, sizeof(job->iv)) == 0) &&
+             (memcmp(job->tag, ref->tag, sizeof(job->tag)) == 0);
+    }
+    return ok;
+}
+
+/**
+ * @brief submit mixed jobs through a queue shallower than their number
+ * and compare them with the synchronous API, once with callbacks on the
+ * workers and once delivered by aes_async_poll on the eventfd
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+static int32_t kat_async(FILE *report)
+{
+    kat_async_t *k = malloc(sizeof(kat_async_t));
+    aes_ctx_t *ctxs[2] = {NULL, NULL};
+    aes_async_t *async;
+    int32_t fail = 0;
+    int32_t ok;
+
+    if ((k == NULL) ||
+        (aes_ctx_new(&ctxs[0], kat_sp800_38a_key, sizeof(kat_sp800_38a_key)) != AES_OK) ||
+        (aes_ctx_new(&ctxs[1], kat_ff1_key, sizeof(kat_ff1_key)) != AES_OK)) {
+        fail += kat_result(report, "lib", "async setup", 0);
+        goto done;
+    }
+    for (size_t i=0;i<sizeof(k->clear);i++) {
+        k->clear[i] = (uint8_t)(i*7 + (i >> 9));
+    }
+    /* completions on the workers, the submitter retries while the queue is full */
+    kat_async_setup(k, ctxs);
+    ok = (aes_async_new(&async, 3, 16, AES_ASYNC_CB_WORKER) == AES_OK);
+    if (ok) {
+        for (uint32_t i=0;ok&&(i<KAT_ASYNC_JOBS);i++) {
+            aes_status_t status;
+
+            while ((status = aes_async_submit(async, &k->jobs[i])) == AES_ERR_AGAIN) {
+                usleep(50);
+            }
+            ok = (status == AES_OK);
+        }
+        for (uint32_t t=0;ok&&(t<10000)&&(__atomic_load_n(&k->done, __ATOMIC_ACQUIRE) < KAT_ASYNC_JOBS);t++) {
+            usleep(1000);
+        }
+        aes_async_free(async);
+    }
+    fail += kat_result(report, "lib", "async worker callbacks against the synchronous API",
+                       ok && kat_async_check(k, KAT_ASYNC_JOBS));
+    /* completions delivered on this thread, submitting again as they free slots */
+    kat_async_setup(k, ctxs);
+    ok = (aes_async_new(&async, 3, 16, AES_ASYNC_CB_POLL) == AES_OK);
+    if (ok) {
+        struct pollfd pfd = {aes_async_fd(async), POLLIN, 0};
+        uint32_t next = 0;
+        uint32_t idle = 0;
+
+        while ((__atomic_load_n(&k->done, __ATOMIC_ACQUIRE) < KAT_ASYNC_JOBS) && (idle < 50)) {
+            while ((next < KAT_ASYNC_JOBS) && (aes_async_submit(async, &k->jobs[next]) == AES_OK)) {
+                next++;
+            }
+            idle = (poll(&pfd, 1, 100) > 0) ? 0 : idle + 1;
+            aes_async_poll(async, 0);
+        }
+        aes_async_free(async);
+    }
+    fail += kat_result(report, "lib", "async eventfd polling against the synchronous API",
+                       ok && kat_async_check(k, KAT_ASYNC_JOBS));
+    /* one completion per call: the eventfd stays readable while some wait */
+    kat_async_setup(k, ctxs);
+    ok = (aes_async_new(&async, 1, 16, AES_ASYNC_CB_POLL) == AES_OK);
+    if (ok) {
+        struct pollfd pfd = {aes_async_fd(async), POLLIN, 0};
+
+        for (uint32_t i=0;ok&&(i<4);i++) {
+            ok = (aes_async_submit(async, &k->jobs[i]) == AES_OK);
+        }
+        /* the worker posts all four before the first delivery */
+        ok = ok && (poll(&pfd, 1, 1000) == 1);
+        usleep(20000);
+        for (uint32_t i=0;ok&&(i<4);i++) {
+            ok = (poll(&pfd, 1, 100) == 1) && (aes_async_poll(async, 1) == 1);
+        }
+        aes_async_free(async);
+    }
+    fail += kat_result(report, "lib", "async eventfd readable after a partial poll",
+                       ok && kat_async_check(k, 4));
+done:
+    aes_ctx_free(ctxs[0]);
+    aes_ctx_free(ctxs[1]);
+    free(k);
+    return fail;
+}
+
+/* daemon served by a thread of the self-test */
+typedef struct kat_daemon_s {
+    aes_daemon_cfg_t cfg;
+    volatile sig_atomic_t stop;
+    aes_status_t status;
+} kat_daemon_t;
+
+static void *kat_daemon_thread(void *arg)
+{
+    kat_daemon_t *k = arg;
+
+    k->status = aes_daemon_run(&k->cfg);
+    return NULL;
+}
+
+/**
+ * @brief run a daemon on a temporary socket and check its replies against
+ * the library, then pipeline full-size requests from two connections
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+static int32_t kat_daemon(FILE *report)
+{
+    char path[64];
+    kat_daemon_t k;
+    aes_loadgen_cfg_t lg;
+    aes_daemon_stats_t stats;
+    pthread_t thread;
+    uint8_t clear[1000];
+    uint8_t out[1000];
+    uint8_t ref[1000];
+    uint8_t counter[AES_BLOCK_SIZE];
+    uint8_t ref_counter[AES_BLOCK_SIZE];
+    aes_ctx_t *ctx;
+    int fd = -1;
+    int32_t fail = 0;
+    int32_t ok;
+
+    snprintf(path, sizeof(path), "/tmp/aes_kat_daemon.%ld.sock", (long)getpid());
+    memset(&k, 0, sizeof(k));
+    k.cfg.path = path;
+    k.cfg.key = kat_sp800_38a_key;
+    k.cfg.key_len = sizeof(kat_sp800_38a_key);
+    k.cfg.latency_usec = AES_DAEMON_LATENCY_USEC;
+    k.cfg.batch_blocks = AES_DAEMON_BATCH_BLOCKS;
+    k.cfg.stop = &k.stop;
+    if (aes_ctx_new(&ctx, kat_sp800_38a_key, sizeof(kat_sp800_38a_key)) != AES_OK) {
+        return kat_result(report, "lib", "daemon context creation", 0);
+    }
+    if (pthread_create(&thread, NULL, kat_daemon_thread, &k) != 0) {
+        aes_ctx_free(ctx);
+        return kat_result(report, "lib", "daemon start", 0);
+    }
+    /* the socket is bound by the daemon thread */
+    for (uint32_t i=0;(i<200) && (aes_daemon_connect(path, &fd) != AES_OK);i++) {
+        usleep(5000);
+    }
+    fail += kat_result(report, "lib", "daemon connect", fd >= 0);
+    if (fd >= 0) {
+        for (uint32_t i=0;i<sizeof(clear);i++) {
+            clear[i] = (uint8_t)(7*i);
+        }
+        /* a length that is not a block multiple, in place */
+        memcpy(counter, kat_ctr_counter, sizeof(counter));
+        memcpy(ref_counter, kat_ctr_counter, sizeof(ref_counter));
+        memcpy(out, clear, sizeof(out));
+        aes_ctr_crypt(ctx, ref_counter, ref, clear, sizeof(ref));
+        ok = (aes_daemon_ctr(fd, counter, out, out, sizeof(out)) == AES_OK) &&
+             (memcmp(out, ref, sizeof(out)) == 0) &&
+             (memcmp(counter, ref_counter, sizeof(counter)) == 0);
+        fail += kat_result(report, "lib", "daemon CTR against aes_ctr_crypt", ok);
+        aes_ecb_encrypt(ctx, ref, clear, 992);
+        ok = (aes_daemon_ecb(fd, AES_DAEMON_OP_ECB_ENCRYPT, out, clear, 992) == AES_OK) &&
+             (memcmp(out, ref, 992) == 0) &&
+             (aes_daemon_ecb(fd, AES_DAEMON_OP_ECB_DECRYPT, out, out, 992) == AES_OK) &&
+             (memcmp(out, clear, 992) == 0);
+        fail += kat_result(report, "lib", "daemon ECB against aes_ecb_encrypt", ok);
+        ok = (aes_daemon_stats(fd, &stats) == AES_OK) && (stats.requests >= 3);
+        fail += kat_result(report, "lib", "daemon stats", ok);
+        aes_daemon_close(fd);
+        /* requests sent ahead of their replies must all be answered */
+        memset(&lg, 0, sizeof(lg));
+        lg.path = path;
+        lg.clients = 2;
+        lg.depth = 16;
+        lg.payload = AES_DAEMON_MAX_PAYLOAD;
+        lg.seconds = 0;
+        fail += kat_result(report, "lib", "daemon pipelined requests", aes_loadgen_run(&lg, NULL) == 0);
+    }
+    k.stop = 1;
+    pthread_join(thread, NULL);
+    fail += kat_result(report, "lib", "daemon stop", k.status == AES_OK);
+    aes_ctx_free(ctx);
+    /* the connect retries and the event loop leave errno set, not an error */
+    errno = 0;
+    return fail;
+}
+
+/**
+ * @brief run the mode vectors through the library API and its selected engine
+ * @param[in] level AES_KAT_QUICK or AES_KAT_FULL
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+int32_t aes_kat_modes(uint32_t level, FILE *report)
+{
+    int32_t fail = 0;
+    uint8_t iv[AES_BLOCK_SIZE];
+    uint8_t out[64];
+    aes_ctx_t *ctx;
+
+    (void)level;
+    fail += kat_result(report, "lib", "reject 17-byte key",
+                       aes_ctx_new(&ctx, kat_sp800_38a_key, 17) == AES_ERR_KEY_LENGTH);
+    if (aes_ctx_new(&ctx, kat_sp800_38a_key, sizeof(kat_sp800_38a_key)) != AES_OK) {
+        return fail + kat_result(report, "lib", "context creation", 0);
+    }
+    memcpy(iv, kat_cbc_iv, sizeof(iv));
+    aes_cbc_encrypt(ctx, iv, out, kat_sp800_38a_clear, sizeof(out));
+    fail += kat_result(report, "lib", "SP800-38A F.2.1 CBC-AES128.Encrypt",
+                       memcmp(out, kat_cbc_ciphered, sizeof(out)) == 0);
+    memcpy(iv, kat_cbc_iv, sizeof(iv));
+    aes_cbc_decrypt(ctx, iv, out, kat_cbc_ciphered, sizeof(out));
+    fail += kat_result(report, "lib", "SP800-38A F.2.2 CBC-AES128.Decrypt",
+                       memcmp(out, kat_sp800_38a_clear, sizeof(out)) == 0);
+    memcpy(iv, kat_ctr_counter, sizeof(iv));
+    aes_ctr_crypt(ctx, iv, out, kat_sp800_38a_clear, sizeof(out));
+    fail += kat_result(report, "lib", "SP800-38A F.5.1 CTR-AES128.Encrypt",
+                       memcmp(out, kat_ctr_ciphered, sizeof(out)) == 0);
+    memcpy(iv, kat_ctr_counter, sizeof(iv));
+    aes_ctr_crypt(ctx, iv, out, kat_ctr_ciphered, sizeof(out));
+    fail += kat_result(report, "lib", "SP800-38A F.5.2 CTR-AES128.Decrypt",
+                       memcmp(out, kat_sp800_38a_clear, sizeof(out)) == 0);
+    fail += kat_cmac(ctx, report);
+    fail += kat_stream(ctx, report);
+    fail += kat_iov(ctx, report);
+    fail += kat_crc32c(ctx, report);
+    fail += kat_drbg(report);
+    fail += kat_gcmsiv(report);
+    fail += kat_gcm(report);
+    fail += kat_ccm(report);
+    fail += kat_ocb(report);
+    fail += kat_ff1(report);
+    fail += kat_pool(ctx, report);
+    fail += kat_async(report);
+    fail += kat_container(report);
+    fail += kat_daemon(report);
+    fail += kat_kw(report);
+    aes_ctx_free(ctx);
+    return fail;
+}
+
+/**
+ * @brief run the vectors against the step functions and every engine
+ * @param[in] level AES_KAT_QUICK or AES_KAT_FULL
+ * @param[in] report output stream, may be NULL
+ * @return number of failed tests
+ */
+int32_t aes_kat_run(uint32_t level, FILE *report)
+{
+    int32_t fail = aes_kat_reference(level, report);
+
+    for (uint32_t id=0;id<AES_ENGINE_MAX;id++) {
+        const aes_engine_t *engine = aes_engine_by_id(id);
+        if ((engine == NULL) || !engine->supported()) {
+            if ((report != NULL) && (engine != NULL)) {
+                fprintf(report, "[SKIP] %-8s not supported on this CPU\n", engine->name);
+            }
+            continue;
+        }
+        fail += aes_kat_engine(engine, level, report);
+    }
+    fail += aes_kat_modes(level, report);
+    return fail;
+}
+
+/**
+ * @brief compare every engine against the reference on arbitrary input
+ * @param[in] data fuzzer input: 1 byte key size selector, key, then blocks
+ * @param[in] size input size in bytes
+ * @return number of engines disagreeing with the reference
+ * @note suitable as the body of a libFuzzer/AFL harness: abort on non-zero
+ */
+int32_t aes_kat_differential(const uint8_t *data, size_t size)
+{
+    static const uint32_t lengths[3] = {AES128_KEY_SIZE/8, AES192_KEY_SIZE/8, AES256_KEY_SIZE/8};
+    uint8_t ref_out[AES_KAT_DIFF_MAX_BLOCKS*AES_BLOCK_SIZE];
+    uint8_t out[AES_KAT_DIFF_MAX_BLOCKS*AES_BLOCK_SIZE];
+    uint8_t step_out[AES_BLOCK_SIZE];
+    aes_sched_t ref_sched, sched;
+    const uint8_t *key;
+    const uint8_t *in;
+    uint32_t length;
+    size_t nblocks;
+    int32_t fail = 0;
+
+    if (size < 1) {
+        return 0;
+    }
+    length = lengths[data[0] % 3];
+    if (size < 1 + length + AES_BLOCK_SIZE) {
+        return 0;
+    }
+    key = data + 1;
+    in = key + length;
+    nblocks = (size - 1 - length) / AES_BLOCK_SIZE;
+    if (nblocks > AES_KAT_DIFF_MAX_BLOCKS) {
+        nblocks = AES_KAT_DIFF_MAX_BLOCKS;
+    }
+    aes_engine_ref.setkey(&ref_sched, key, length);
+    aes_engine_ref.encrypt(&ref_sched, ref_out, in, nblocks);
+    /* the engine wrapper must agree with the aes_cipher entry point */
+    kat_ref_cipher(step_out, in, key, length);
+    if (memcmp(step_out, ref_out, AES_BLOCK_SIZE) != 0) {
+        fail++;
+    }
+    for (uint32_t id=0;id<AES_ENGINE_MAX;id++) {
+        const aes_engine_t *engine = aes_engine_by_id(id);
+
+        if ((engine == NULL) || (id == AES_ENGINE_REF) || !engine->supported()) {
+            continue;
+        }
+        engine->setkey(&sched, key, length);
+        engine->encrypt(&sched, out, in, nblocks);
+        if (memcmp(out, ref_out, nblocks*AES_BLOCK_SIZE) != 0) {
+            fail++;
+            continue;
+        }
+        /* decipher the input as if it were ciphered data as well */
+        engine->decrypt(&sched, out, in, nblocks);
+        aes_engine_ref.decrypt(&ref_sched, ref_out, in, nblocks);
+        if (memcmp(out, ref_out, nblocks*AES_BLOCK_SIZE) != 0) {
+            fail++;
+        }
+        aes_engine_ref.encrypt(&ref_sched, ref_out, in, nblocks);
+    }
+    return fail;
+}
+
+#undef AES_KAT_C
@@ -0,0 +1,380 @@
+/**
+ * @file aes_kw.c
+ * @brief libaes key wrap, RFC 3394 (KW) and RFC 5649 (KWP)
+ *
+ * Unwrapping one key is a chain of 6*n dependent block decryptions, so it
+ * can not use the width of the engines. Unwrapping is done on AES_KW_LANES
+ * keys at a time instead: every step advances each lane by one semiblock
+ * and deciphers all lanes with a single engine call, a finished lane takes
+ * the next wrapped key. aes_kw_unwrap_ctx feeds the results straight into
+ * key contexts, the raw keys only exist in a stack buffer cleared on return.
+*/
+
+#define AES_KW_C
+#define AES_LIB_PRIVATE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_engine.h"
+#include "aes_stats.h"
+#include "aes_lib.h"
+
+#define KW_SEMI         AES_KW_SEMIBLOCK
+/* wrapped keys unwrapped per call of the lane core by aes_kw_unwrap_ctx */
+#define KW_CTX_GROUP    64
+/* largest wrapped key accepted by aes_kw_unwrap_ctx */
+#define KW_CTX_MAX      (AES256_KEY_SIZE/8 + KW_SEMI)
+
+/* RFC 3394 default IV and RFC 5649 alternative IV prefix */
+static const uint8_t kw_iv[KW_SEMI] = {0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6};
+static const uint8_t kwp_aiv[4] = {0xa6, 0x59, 0x59, 0xa6};
+
+/* one wrapped key being unwrapped */
+typedef struct kw_lane_s {
+    uint8_t *r;             /* R[1..n], unwrapped in place */
+    size_t n;               /* number of semiblocks in R */
+    size_t i;               /* semiblock of the next step, n down to 1 */
+    uint64_t t;             /* n*j + i of the next step, 0 when done */
+    size_t index;           /* position in the caller's arrays */
+} kw_lane_t;
+
+/**
+ * @brief XOR the 64-bit big-endian step counter t into A
+ * @param[in,out] a semiblock A
+ * @param[in] t step counter
+ */
+static inline void kw_xor_t(uint8_t *a, uint64_t t)
+{
+    for (uint32_t i=0;i<KW_SEMI;i++) {
+        a[i] ^= (uint8_t)(t >> (56 - 8*i));
+    }
+}
+
+/**
+ * @brief wrapping function W of RFC 3394, or the single block of RFC 5649
+ * @param[in] kek pointer to the key-encryption key context
+ * @param[out] out (n+1)*8 bytes, may overlap p
+ * @param[in] a initial value
+ * @param[in] p n semiblocks of plaintext
+ * @param[in] n number of semiblocks, 1 only for RFC 5649
+ * @return number of blocks ciphered
+ */
+static uint64_t kw_wrap_core(const aes_ctx_t *kek, uint8_t *out, const uint8_t *a,
+                             const uint8_t *p, size_t n)
+{
+    uint8_t b[AES_BLOCK_SIZE];
+    uint8_t *r = out + KW_SEMI;
+    uint64_t t = 0;
+
+    memmove(r, p, n*KW_SEMI);
+    memcpy(b, a, KW_SEMI);
+    if (n == 1) {
+        memcpy(b + KW_SEMI, r, KW_SEMI);
+        kek->engine->encrypt(&kek->sched, out, b, 1);
+        aes_memzero(b, sizeof(b));
+        return 1;
+    }
+    for (uint32_t j=0;j<6;j++) {
+        for (size_t i=0;i<n;i++) {
+            memcpy(b + KW_SEMI, r + i*KW_SEMI, KW_SEMI);
+            kek->engine->encrypt(&kek->sched, b, b, 1);
+            kw_xor_t(b, ++t);
+            memcpy(r + i*KW_SEMI, b + KW_SEMI, KW_SEMI);
+        }
+    }
+    memcpy(out, b, KW_SEMI);
+    aes_memzero(b, sizeof(b));
+    return t;
+}
+
+/**
+ * @brief unwrapping function W^-1 on many wrapped keys, lanes interleaved
+ * @param[in] kek pointer to the key-encryption key context
+ * @param[out] a count recovered initial values
+ * @param[in] r count output buffers of lens[i]-8 bytes, may overlap in[i]+8
+ * @param[in] in count wrapped keys
+ * @param[in] lens count lengths, multiples of 8 of at least 16 bytes
+ * @param[in] count number of wrapped keys
+ * @note a 16-byte input is the single block case of RFC 5649
+ */
+static void kw_unwrap_multi(const aes_ctx_t *kek, uint8_t (*a)[KW_SEMI], uint8_t *const *r,
+                            const uint8_t *const *in, const size_t *lens, size_t count)
+{
+    uint8_t x[AES_KW_LANES*AES_BLOCK_SIZE];
+    kw_lane_t lane[AES_KW_LANES];
+    uint32_t active = 0;
+    uint64_t nblocks = 0;
+    size_t next = 0;
+
+    for (;;) {
+        /* refill free lanes, A goes in the first half of the lane block */
+        while ((active < AES_KW_LANES) && (next < count)) {
+            kw_lane_t *p = &lane[active];
+
+            p->n = lens[next]/KW_SEMI - 1;
+            p->r = r[next];
+            p->i = p->n;
+            p->t = (p->n == 1) ? 1 : 6*(uint64_t)p->n;
+            p->index = next;
+            memcpy(x + active*AES_BLOCK_SIZE, in[next], KW_SEMI);
+            memmove(p->r, in[next] + KW_SEMI, p->n*KW_SEMI);
+            active++;
+            next++;
+        }
+        if (active == 0) {
+            break;
+        }
+        for (uint32_t l=0;l<active;l++) {
+            kw_lane_t *p = &lane[l];
+            uint8_t *xl = x + l*AES_BLOCK_SIZE;
+
+            if (p->n > 1) {
+                kw_xor_t(xl, p->t);
+            }
+            memcpy(xl + KW_SEMI, p->r + (p->i - 1)*KW_SEMI, KW_SEMI);
+        }
+        kek->engine->decrypt(&kek->sched, x, x, active);
+        nblocks += active;
+        for (uint32_t l=0;l<active;) {
+            kw_lane_t *p = &lane[l];
+            uint8_t *xl = x + l*AES_BLOCK_SIZE;
+
+            memcpy(p->r + (p->i - 1)*KW_SEMI, xl + KW_SEMI, KW_SEMI);
+            p->i = (p->i == 1) ? p->n : p->i - 1;
+            if (--p->t != 0) {
+                l++;
+                continue;
+            }
+            /* done: the last active lane moves into the hole */
+            memcpy(a[p->index], xl, KW_SEMI);
+            active--;
+            if (l != active) {
+                lane[l] = lane[active];
+                memcpy(xl, x + active*AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+            }
+        }
+    }
+    aes_memzero(x, sizeof(x));
+    aes_stats_add_blocks(kek->engine->id, AES_STATS_MODE_KW, kek->sched.length,
+                         AES_STATS_DIR_DEC, nblocks);
+}
+
+/**
+ * @brief check the initial value recovered by the unwrapping function
+ * @param[in] variant AES_KW_RFC3394 or AES_KW_RFC5649
+ * @param[in] a recovered initial value
+ * @param[in] r unwrapped semiblocks
+ * @param[in] n number of semiblocks
+ * @param[out] key_len length of the key without padding
+ * @return AES_OK or AES_ERR_AUTH
+ * @note the checks accumulate into one flag, the result does not tell
+ * which part of the integrity check failed
+ */
+static aes_status_t kw_check(uint32_t variant, const uint8_t *a, const uint8_t *r, size_t n,
+                             size_t *key_len)
+{
+    uint32_t diff = 0;
+    uint32_t mli;
+
+    if (variant == AES_KW_RFC3394) {
+        for (uint32_t i=0;i<KW_SEMI;i++) {
+            diff |= a[i] ^ kw_iv[i];
+        }
+        *key_len = n*KW_SEMI;
+        return (diff == 0) ? AES_OK : AES_ERR_AUTH;
+    }
+    for (uint32_t i=0;i<4;i++) {
+        diff |= a[i] ^ kwp_aiv[i];
+    }
+    mli = ((uint32_t)a[4] << 24) | ((uint32_t)a[5] << 16) | ((uint32_t)a[6] << 8) | a[7];
+    /* 8*(n-1) < MLI <= 8*n, padding bytes all zero */
+    if (((uint64_t)mli <= 8*((uint64_t)n - 1)) || ((uint64_t)mli > 8*(uint64_t)n)) {
+        diff |= 1;
+        mli = (uint32_t)(n*KW_SEMI);
+    }
+    for (size_t i=mli;i<n*KW_SEMI;i++) {
+        diff |= r[i];
+    }
+    *key_len = mli;
+    return (diff == 0) ? AES_OK : AES_ERR_AUTH;
+}
+
+/**
+ * @brief check the length of a wrapped key
+ * @param[in] variant AES_KW_RFC3394 or AES_KW_RFC5649
+ * @param[in] len wrapped length in bytes
+ * @return AES_OK, AES_ERR_PARAM on bad variant or AES_ERR_LENGTH
+ */
+static aes_status_t kw_unwrap_length(uint32_t variant, size_t len)
+{
+    if ((variant != AES_KW_RFC3394) && (variant != AES_KW_RFC5649)) {
+        return AES_ERR_PARAM;
+    }
+    if ((len % KW_SEMI != 0) || (len < ((variant == AES_KW_RFC3394) ? 3 : 2)*KW_SEMI)) {
+        return AES_ERR_LENGTH;
+    }
+    return AES_OK;
+}
+
+/**
+ * @brief wrap a key
+ * @param[in] kek pointer to the key-encryption key context
+ * @param[in] variant AES_KW_RFC3394 (len multiple of 8, at least 16) or
+ * AES_KW_RFC5649 (any len from 1 byte)
+ * @param[out] out AES_KW_WRAPPED_SIZE(len) bytes, may be equal to in
+ * @param[out] out_len receives the number of bytes written
+ * @param[in] in key to wrap
+ * @param[in] len key length in bytes
+ * @return AES_OK or an AES_ERR_* code
+ */
+aes_status_t aes_kw_wrap(const aes_ctx_t *kek, uint32_t variant, uint8_t *out, size_t *out_len,
+                         const uint8_t *in, size_t len)
+{
+    uint8_t a[KW_SEMI];
+    uint8_t last[KW_SEMI];
+    size_t n = (len + KW_SEMI - 1)/KW_SEMI;
+    uint64_t nblocks;
+
+    if ((kek == NULL) || (out == NULL) || (out_len == NULL) || (in == NULL)) {
+        return AES_ERR_PARAM;
+    }
+    if (variant == AES_KW_RFC3394) {
+        if ((len % KW_SEMI != 0) || (len < 2*KW_SEMI)) {
+            return AES_ERR_LENGTH;
+        }
+        memcpy(a, kw_iv, KW_SEMI);
+        nblocks = kw_wrap_core(kek, out, a, in, n);
+    } else if (variant == AES_KW_RFC5649) {
+        if ((len == 0) || ((uint64_t)len > UINT32_MAX)) {
+            return AES_ERR_LENGTH;
+        }
+        memcpy(a, kwp_aiv, 4);
+        for (uint32_t i=0;i<4;i++) {
+            a[4+i] = (uint8_t)(len >> (24 - 8*i));
+        }
+        /* the zero padding is appended after the move of the full semiblocks */
+        memset(last, 0, sizeof(last));
+        memcpy(last, in + (n-1)*KW_SEMI, len - (n-1)*KW_SEMI);
+        memmove(out + KW_SEMI, in, (n-1)*KW_SEMI);
+        memcpy(out + n*KW_SEMI, last, KW_SEMI);
+        nblocks = kw_wrap_core(kek, out, a, out + KW_SEMI, n);
+        aes_memzero(last, sizeof(last));
+    } else {
+        return AES_ERR_PARAM;
+    }
+    aes_stats_add_blocks(kek->engine->id, AES_STATS_MODE_KW, kek->sched.length,
+                         AES_STATS_DIR_ENC, nblocks);
+    *out_len = (n + 1)*KW_SEMI;
+    return AES_OK;
+}
+
+/**
+ * @brief unwrap a key
+ * @param[in] kek pointer to the key-encryption key context
+ * @param[in] variant AES_KW_RFC3394 or AES_KW_RFC5649
+ * @param[out] out len - 8 bytes, may be equal to in
+ * @param[out] out_len receives the key length
+ * @param[in] in wrapped key
+ * @param[in] len wrapped length in bytes
+ * @return AES_OK, AES_ERR_AUTH if the integrity check fails, or another
+ * AES_ERR_* code
+ * @note on AES_ERR_AUTH out is cleared
+ */
+aes_status_t aes_kw_unwrap(const aes_ctx_t *kek, uint32_t variant, uint8_t *out, size_t *out_len,
+                           const uint8_t *in, size_t len)
+{
+    uint8_t a[1][KW_SEMI];
+    aes_status_t status;
+
+    if ((kek == NULL) || (out == NULL) || (out_len == NULL) || (in == NULL)) {
+        return AES_ERR_PARAM;
+    }
+    status = kw_unwrap_length(variant, len);
+    if (status != AES_OK) {
+        return status;
+    }
+    kw_unwrap_multi(kek, a, &out, &in, &len, 1);
+    status = kw_check(variant, a[0], out, len/KW_SEMI - 1, out_len);
+    if (status != AES_OK) {
+        aes_memzero(out, len - KW_SEMI);
+        *out_len = 0;
+    }
+    return status;
+}
+
+/**
+ * @brief unwrap many keys straight into new key contexts
+ * @param[in] kek pointer to the key-encryption key context
+ * @param[in] variant AES_KW_RFC3394 or AES_KW_RFC5649
+ * @param[out] ctxs count contexts, ctxs[i] is NULL if wrapped[i] failed
+ * @param[out] status count per-key status codes, may be NULL
+ * @param[in] wrapped count wrapped keys
+ * @param[in] lens count wrapped lengths in bytes, a key of 16, 24 or 32 bytes
+ * @param[in] count number of wrapped keys
+ * @return AES_OK if every key was unwrapped, else the first failure found,
+ * status tells which keys failed
+ * @note the keys are unwrapped KW_CTX_GROUP at a time through the lane core
+ * and expanded by the context's engine as soon as they are checked
+ */
+aes_status_t aes_kw_unwrap_ctx(const aes_ctx_t *kek, uint32_t variant, aes_ctx_t **ctxs,
+                               aes_status_t *status, const uint8_t *const *wrapped,
+                               const size_t *lens, size_t count)
+{
+    uint8_t keys[KW_CTX_GROUP][KW_CTX_MAX - KW_SEMI];
+    uint8_t a[KW_CTX_GROUP][KW_SEMI];
+    uint8_t *r[KW_CTX_GROUP];
+    const uint8_t *in[KW_CTX_GROUP];
+    size_t in_lens[KW_CTX_GROUP];
+    size_t index[KW_CTX_GROUP];
+    aes_status_t first = AES_OK;
+
+    if ((kek == NULL) || ((count != 0) && ((ctxs == NULL) || (wrapped == NULL) || (lens == NULL)))) {
+        return AES_ERR_PARAM;
+    }
+    for (size_t base=0;base<count;) {
+        size_t n = 0;
+
+        /* gather up to KW_CTX_GROUP well-formed entries */
+        for (;(base < count) && (n < KW_CTX_GROUP);base++) {
+            aes_status_t s = (wrapped[base] == NULL) ? AES_ERR_PARAM : kw_unwrap_length(variant, lens[base]);
+
+            ctxs[base] = NULL;
+            if ((s == AES_OK) && (lens[base] > KW_CTX_MAX)) {
+                s = AES_ERR_KEY_LENGTH;
+            }
+            if (status != NULL) {
+                status[base] = s;
+            }
+            if (s != AES_OK) {
+                first = (first == AES_OK) ? s : first;
+                continue;
+            }
+            r[n] = keys[n];
+            in[n] = wrapped[base];
+            in_lens[n] = lens[base];
+            index[n] = base;
+            n++;
+        }
+        kw_unwrap_multi(kek, a, r, in, in_lens, n);
+        for (size_t k=0;k<n;k++) {
+            size_t key_len;
+            aes_status_t s = kw_check(variant, a[k], keys[k], in_lens[k]/KW_SEMI - 1, &key_len);
+
+            if (s == AES_OK) {
+                s = aes_ctx_new(&ctxs[index[k]], keys[k], key_len);
+            }
+            if (status != NULL) {
+                status[index[k]] = s;
+            }
+            first = ((first == AES_OK) && (s != AES_OK)) ? s : first;
+        }
+        aes_memzero(keys, sizeof(keys));
+    }
+    return first;
+}
+
+#undef AES_KW_C
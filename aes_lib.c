@@ -0,0 +1,339 @@
+/**
+ * @file aes_lib.c
+ * @brief libaes contexts and ECB/CBC/CTR modes
+*/
+
+#define AES_LIB_C
+#define AES_LIB_PRIVATE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_engine.h"
+#include "aes_stats.h"
+#include "aes_lib.h"
+
+/* key contexts live in a dedicated locked, guard-paged arena, cleared on release */
+static aes_arena_t lib_ctx_arena;
+static pthread_once_t lib_once = PTHREAD_ONCE_INIT;
+
+static void lib_init(void)
+{
+    aes_arena_init(&lib_ctx_arena, sizeof(aes_ctx_t), AES_LIB_CTX_CHUNK, AES_ARENA_SECURE);
+}
+
+/**
+ * @brief human readable description of a status code
+ * @param[in] status status code returned by the library
+ * @return static string
+ */
+const char *aes_strerror(aes_status_t status)
+{
+    switch (status) {
+        case AES_OK:
+            return "success";
+        case AES_ERR_PARAM:
+            return "bad input parameter";
+        case AES_ERR_KEY_LENGTH:
+            return "bad key length";
+        case AES_ERR_LENGTH:
+            return "bad data length for the mode";
+        case AES_ERR_NOMEM:
+            return "out of memory";
+        case AES_ERR_ENGINE:
+            return "no engine passed its self-test";
+        case AES_ERR_ENTROPY:
+            return "entropy source failure";
+        case AES_ERR_RESEED:
+            return "DRBG reseed required";
+        case AES_ERR_AUTH:
+            return "authentication failed";
+        case AES_ERR_IO:
+            return "file I/O error";
+        case AES_ERR_AGAIN:
+            return "queue full, try again";
+        default:
+            return "unknown error";
+    }
+}
+
+/**
+ * @brief create a key context
+ * @param[out] ctx receives the context, set to NULL on failure
+ * @param[in] key pointer to the key bytes
+ * @param[in] key_len key length in bytes (16, 24 or 32)
+ * @return AES_OK or an AES_ERR_* code
+ * @note this is the only place the key length is checked, the engines and
+ * the step functions trust it afterwards
+ */
+aes_status_t aes_ctx_new(aes_ctx_t **ctx, const uint8_t *key, size_t key_len)
+{
+    const aes_engine_t *engine;
+    aes_ctx_t *new_ctx;
+
+    if (ctx == NULL) {
+        return AES_ERR_PARAM;
+    }
+    *ctx = NULL;
+    if (key == NULL) {
+        return AES_ERR_PARAM;
+    }
+    if ((key_len != AES128_KEY_SIZE/8) && (key_len != AES192_KEY_SIZE/8) &&
+        (key_len != AES256_KEY_SIZE/8)) {
+        return AES_ERR_KEY_LENGTH;
+    }
+    engine = aes_engine_get();
+    if (engine == NULL) {
+        return AES_ERR_ENGINE;
+    }
+    pthread_once(&lib_once, lib_init);
+    new_ctx = aes_arena_alloc(&lib_ctx_arena);
+    if (new_ctx == NULL) {
+        return AES_ERR_NOMEM;
+    }
+    new_ctx->engine = engine;
+    engine->setkey(&new_ctx->sched, key, (uint32_t)key_len);
+    aes_cmac_subkeys(new_ctx);
+    aes_gcm_subkey(new_ctx);
+    aes_ocb_subkeys(new_ctx);
+    *ctx = new_ctx;
+    return AES_OK;
+}
+
+/**
+ * @brief clear and release a key context
+ * @param[in] ctx pointer to the context, may be NULL
+ * @note the slot is zeroed before it goes back to the arena
+ */
+void aes_ctx_free(aes_ctx_t *ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+    aes_arena_free(&lib_ctx_arena, ctx);
+}
+
+/**
+ * @brief name of the engine used by a context
+ * @param[in] ctx pointer to the context
+ * @return engine name
+ */
+const char *aes_ctx_engine(const aes_ctx_t *ctx)
+{
+    return (ctx != NULL) ? ctx->engine->name : NULL;
+}
+
+/**
+ * @brief write nblocks consecutive counter blocks, then advance the counter
+ * @param[out] blocks output buffer of nblocks*16 bytes
+ * @param[in,out] counter 128-bit big-endian counter
+ * @param[in] nblocks number of blocks
+ */
+void aes_ctr_blocks(uint8_t *blocks, uint8_t counter[AES_LIB_BLOCK_SIZE], size_t nblocks)
+{
+    uint64_t hi = 0, lo = 0;
+
+    for (uint32_t i=0;i<8;i++) {
+        hi = (hi << 8) | counter[i];
+        lo = (lo << 8) | counter[8+i];
+    }
+    for (size_t b=0;b<nblocks;b++) {
+        uint8_t *p = blocks + b*AES_BLOCK_SIZE;
+        for (uint32_t i=0;i<8;i++) {
+            p[i] = (uint8_t)(hi >> (56 - 8*i));
+            p[8+i] = (uint8_t)(lo >> (56 - 8*i));
+        }
+        lo++;
+        if (lo == 0) {
+            hi++;
+        }
+    }
+    for (uint32_t i=0;i<8;i++) {
+        counter[i] = (uint8_t)(hi >> (56 - 8*i));
+        counter[8+i] = (uint8_t)(lo >> (56 - 8*i));
+    }
+}
+
+/**
+ * @brief out = a ^ b over len bytes
+ * @param[out] out output buffer, may alias a or b
+ * @param[in] a first operand
+ * @param[in] b second operand
+ * @param[in] len number of bytes
+ */
+void aes_xor_blocks(uint8_t *out, const uint8_t *a, const uint8_t *b, size_t len)
+{
+    size_t i = 0;
+
+    for (;i+8<=len;i+=8) {
+        uint64_t x, y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        x ^= y;
+        memcpy(out + i, &x, 8);
+    }
+    for (;i<len;i++) {
+        out[i] = a[i] ^ b[i];
+    }
+}
+
+/**
+ * @brief cipher a buffer in ECB mode
+ * @param[in] ctx pointer to the key context
+ * @param[out] out output buffer, may be equal to in
+ * @param[in] in input buffer
+ * @param[in] len length in bytes, multiple of 16
+ * @return AES_OK or an AES_ERR_* code
+ */
+aes_status_t aes_ecb_encrypt(const aes_ctx_t *ctx, uint8_t *out, const uint8_t *in, size_t len)
+{
+    if ((ctx == NULL) || (out == NULL) || (in == NULL)) {
+        return AES_ERR_PARAM;
+    }
+    if (len % AES_BLOCK_SIZE != 0) {
+        return AES_ERR_LENGTH;
+    }
+    aes_stats_add_blocks(ctx->engine->id, AES_STATS_MODE_ECB, ctx->sched.length,
+                         AES_STATS_DIR_ENC, len/AES_BLOCK_SIZE);
+    ctx->engine->encrypt(&ctx->sched, out, in, len/AES_BLOCK_SIZE);
+    return AES_OK;
+}
+
+/**
+ * @brief decipher a buffer in ECB mode
+ * @param[in] ctx pointer to the key context
+ * @param[out] out output buffer, may be equal to in
+ * @param[in] in input buffer
+ * @param[in] len length in bytes, multiple of 16
+ * @return AES_OK or an AES_ERR_* code
+ */
+aes_status_t aes_ecb_decrypt(const aes_ctx_t *ctx, uint8_t *out, const uint8_t *in, size_t len)
+{
+    if ((ctx == NULL) || (out == NULL) || (in == NULL)) {
+        return AES_ERR_PARAM;
+    }
+    if (len % AES_BLOCK_SIZE != 0) {
+        return AES_ERR_LENGTH;
+    }
+    aes_stats_add_blocks(ctx->engine->id, AES_STATS_MODE_ECB, ctx->sched.length,
+                         AES_STATS_DIR_DEC, len/AES_BLOCK_SIZE);
+    ctx->engine->decrypt(&ctx->sched, out, in, len/AES_BLOCK_SIZE);
+    return AES_OK;
+}
+
+/**
+ * @brief cipher a buffer in CBC mode
+ * @param[in] ctx pointer to the key context
+ * @param[in,out] iv initialization vector, updated to chain the next call
+ * @param[out] out output buffer, may be equal to in
+ * @param[in] in input buffer
+ * @param[in] len length in bytes, multiple of 16
+ * @return AES_OK or an AES_ERR_* code
+ */
+aes_status_t aes_cbc_encrypt(const aes_ctx_t *ctx, uint8_t iv[AES_LIB_BLOCK_SIZE],
+                             uint8_t *out, const uint8_t *in, size_t len)
+{
+    uint8_t chain[AES_BLOCK_SIZE];
+
+    if ((ctx == NULL) || (iv == NULL) || (out == NULL) || (in == NULL)) {
+        return AES_ERR_PARAM;
+    }
+    if (len % AES_BLOCK_SIZE != 0) {
+        return AES_ERR_LENGTH;
+    }
+    aes_stats_add_blocks(ctx->engine->id, AES_STATS_MODE_CBC, ctx->sched.length,
+                         AES_STATS_DIR_ENC, len/AES_BLOCK_SIZE);
+    memcpy(chain, iv, AES_BLOCK_SIZE);
+    for (size_t i=0;i<len;i+=AES_BLOCK_SIZE) {
+        aes_xor_blocks(chain, chain, in + i, AES_BLOCK_SIZE);
+        ctx->engine->encrypt(&ctx->sched, chain, chain, 1);
+        memcpy(out + i, chain, AES_BLOCK_SIZE);
+    }
+    memcpy(iv, chain, AES_BLOCK_SIZE);
+    return AES_OK;
+}
+
+/**
+ * @brief decipher a buffer in CBC mode
+ * @param[in] ctx pointer to the key context
+ * @param[in,out] iv initialization vector, updated to chain the next call
+ * @param[out] out output buffer, may be equal to in
+ * @param[in] in input buffer
+ * @param[in] len length in bytes, multiple of 16
+ * @return AES_OK or an AES_ERR_* code
+ * @note blocks are deciphered AES_LIB_BATCH at a time through the engine
+ */
+aes_status_t aes_cbc_decrypt(const aes_ctx_t *ctx, uint8_t iv[AES_LIB_BLOCK_SIZE],
+                             uint8_t *out, const uint8_t *in, size_t len)
+{
+    uint8_t buf[AES_LIB_BATCH*AES_BLOCK_SIZE];
+    uint8_t chain[AES_BLOCK_SIZE];
+    uint8_t next[AES_BLOCK_SIZE];
+
+    if ((ctx == NULL) || (iv == NULL) || (out == NULL) || (in == NULL)) {
+        return AES_ERR_PARAM;
+    }
+    if (len % AES_BLOCK_SIZE != 0) {
+        return AES_ERR_LENGTH;
+    }
+    aes_stats_add_blocks(ctx->engine->id, AES_STATS_MODE_CBC, ctx->sched.length,
+                         AES_STATS_DIR_DEC, len/AES_BLOCK_SIZE);
+    memcpy(chain, iv, AES_BLOCK_SIZE);
+    for (size_t off=0;off<len;off+=sizeof(buf)) {
+        size_t n = (len - off < sizeof(buf)) ? (len - off) : sizeof(buf);
+        const uint8_t *src = in + off;
+        uint8_t *dst = out + off;
+
+        ctx->engine->decrypt(&ctx->sched, buf, src, n/AES_BLOCK_SIZE);
+        memcpy(next, src + n - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+        /* backwards, so in-place operation never overwrites a needed block */
+        for (size_t i=n-AES_BLOCK_SIZE;i>0;i-=AES_BLOCK_SIZE) {
+            aes_xor_blocks(dst + i, buf + i, src + i - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+        }
+        aes_xor_blocks(dst, buf, chain, AES_BLOCK_SIZE);
+        memcpy(chain, next, AES_BLOCK_SIZE);
+    }
+    memcpy(iv, chain, AES_BLOCK_SIZE);
+    return AES_OK;
+}
+
+/**
+ * @brief cipher or decipher a buffer in CTR mode
+ * @param[in] ctx pointer to the key context
+ * @param[in,out] counter 128-bit big-endian counter block, advanced by the
+ * number of blocks used
+ * @param[out] out output buffer, may be equal to in
+ * @param[in] in input buffer
+ * @param[in] len length in bytes, any value
+ * @return AES_OK or an AES_ERR_* code
+ * @note the unused keystream of a final partial block is discarded, so a
+ * stream split across calls must use multiples of 16 bytes except at the end
+ */
+aes_status_t aes_ctr_crypt(const aes_ctx_t *ctx, uint8_t counter[AES_LIB_BLOCK_SIZE],
+                           uint8_t *out, const uint8_t *in, size_t len)
+{
+    uint8_t ks[AES_LIB_BATCH*AES_BLOCK_SIZE];
+
+    if ((ctx == NULL) || (counter == NULL) || ((len != 0) && ((out == NULL) || (in == NULL)))) {
+        return AES_ERR_PARAM;
+    }
+    aes_stats_add_blocks(ctx->engine->id, AES_STATS_MODE_CTR, ctx->sched.length,
+                         AES_STATS_DIR_ENC, (len + AES_BLOCK_SIZE - 1)/AES_BLOCK_SIZE);
+    for (size_t off=0;off<len;off+=sizeof(ks)) {
+        size_t n = (len - off < sizeof(ks)) ? (len - off) : sizeof(ks);
+        size_t nblocks = (n + AES_BLOCK_SIZE - 1)/AES_BLOCK_SIZE;
+
+        aes_ctr_blocks(ks, counter, nblocks);
+        ctx->engine->encrypt(&ctx->sched, ks, ks, nblocks);
+        aes_xor_blocks(out + off, in + off, ks, n);
+    }
+    aes_memzero(ks, sizeof(ks));
+    return AES_OK;
+}
+
+#undef AES_LIB_C
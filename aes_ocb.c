@@ -0,0 +1,446 @@
+/**
+ * @file aes_ocb.c
+ * @brief libaes OCB3 mode (RFC 7253)
+ *
+ * Every OCB block is masked by its own offset, Offset_i = Offset_{i-1} ^
+ * L_{ntz(i)}, and the blocks are otherwise independent, so a whole chunk
+ * goes through the engine in one wide call. Within an aligned group of
+ * AES_OCB_GROUP blocks ntz(i) only depends on i mod AES_OCB_GROUP, so the
+ * first offsets of a group are the group base XOR a constant from the key
+ * context, with no dependency between them; the chain only advances once
+ * per group. The chunk is masked, enciphered (or deciphered) and unmasked
+ * in three passes over an L1-resident buffer. When the engine has an OCB
+ * kernel the payload goes through it instead, with the masking and the
+ * checksum folded into the round loop.
+*/
+
+#define AES_OCB_C
+#define AES_LIB_PRIVATE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_engine.h"
+#include "aes_stats.h"
+#include "aes_lib.h"
+
+/* ocb_run operations */
+#define OCB_ENCRYPT     0   /* out = O ^ E(in ^ O), checksum of in */
+#define OCB_DECRYPT     1   /* out = O ^ D(in ^ O), checksum of out */
+#define OCB_HASH        2   /* sum of E(in ^ O), HASH(K, A) */
+
+typedef struct ocb_offsets_s {
+    uint64_t base[2];       /* offset of the last block index multiple of AES_OCB_GROUP,
+                               not kept up to date by the engine kernel */
+    uint64_t offset[2];     /* offset of the last block processed */
+    uint64_t i;             /* blocks processed */
+} ocb_offsets_t;
+
+/**
+ * @brief multiply by x in GF(2^128), the RFC 7253 double()
+ * @param[out] out result, may be equal to in
+ * @param[in] in 16-byte block, big-endian
+ */
+static void ocb_double(uint8_t *out, const uint8_t *in)
+{
+    uint8_t carry = (uint8_t)(in[0] >> 7);
+
+    for (uint32_t i=0;i<AES_BLOCK_SIZE-1;i++) {
+        out[i] = (uint8_t)((in[i] << 1) | (in[i+1] >> 7));
+    }
+    out[AES_BLOCK_SIZE-1] = (uint8_t)((in[AES_BLOCK_SIZE-1] << 1) ^ (carry ? 0x87 : 0));
+}
+
+/**
+ * @brief derive the OCB offset table of a context
+ * @param[in,out] ctx pointer to a context whose schedule is set
+ */
+void aes_ocb_subkeys(aes_ctx_t *ctx)
+{
+    memset(ctx->ocb_lstar, 0, sizeof(ctx->ocb_lstar));
+    ctx->engine->encrypt(&ctx->sched, ctx->ocb_lstar, ctx->ocb_lstar, 1);
+    ocb_double(ctx->ocb_ldollar, ctx->ocb_lstar);
+    ocb_double(ctx->ocb_l[0], ctx->ocb_ldollar);
+    for (uint32_t i=1;i<AES_OCB_L_COUNT;i++) {
+        ocb_double(ctx->ocb_l[i], ctx->ocb_l[i-1]);
+    }
+    memset(ctx->ocb_pre[0], 0, sizeof(ctx->ocb_pre[0]));
+    for (uint32_t k=1;k<AES_OCB_GROUP;k++) {
+        aes_xor_blocks(ctx->ocb_pre[k], ctx->ocb_pre[k-1], ctx->ocb_l[__builtin_ctz(k)],
+                       AES_BLOCK_SIZE);
+    }
+}
+
+/**
+ * @brief Offset_0 from the nonce, RFC 7253 section 4.2
+ * @param[in] ctx pointer to the key context
+ * @param[in] nonce nonce, nonce_len bytes
+ * @param[in] nonce_len 1 to AES_OCB_NONCE_MAX
+ * @param[in] tag_len tag length in bytes
+ * @param[out] offset Offset_0
+ */
+static void ocb_offset0(const aes_ctx_t *ctx, const uint8_t *nonce, size_t nonce_len,
+                        size_t tag_len, uint64_t offset[2])
+{
+    uint8_t stretch[AES_BLOCK_SIZE + 8];
+    uint8_t block[AES_BLOCK_SIZE];
+    uint32_t bottom, shift;
+
+    memset(block, 0, sizeof(block));
+    block[0] = (uint8_t)(((tag_len*8) % 128) << 1);
+    block[AES_BLOCK_SIZE - 1 - nonce_len] |= 1;
+    memcpy(block + AES_BLOCK_SIZE - nonce_len, nonce, nonce_len);
+    bottom = block[AES_BLOCK_SIZE-1] & 0x3f;
+    block[AES_BLOCK_SIZE-1] &= 0xc0;
+    /* Ktop, then Stretch = Ktop || (Ktop[1..64] ^ Ktop[9..72]) */
+    ctx->engine->encrypt(&ctx->sched, stretch, block, 1);
+    for (uint32_t i=0;i<8;i++) {
+        stretch[AES_BLOCK_SIZE+i] = (uint8_t)(stretch[i] ^ stretch[i+1]);
+    }
+    /* Offset_0 = Stretch[1+bottom..128+bottom] */
+    shift = bottom % 8;
+    for (uint32_t i=0;i<AES_BLOCK_SIZE;i++) {
+        uint32_t b = bottom/8 + i;
+
+        block[i] = (shift == 0) ? stretch[b] :
+                   (uint8_t)((stretch[b] << shift) | (stretch[b+1] >> (8 - shift)));
+    }
+    memcpy(offset, block, AES_BLOCK_SIZE);
+    aes_memzero(stretch, sizeof(stretch));
+    aes_memzero(block, sizeof(block));
+}
+
+/**
+ * @brief run whole blocks through the offset-masked cipher
+ * @param[in] ctx pointer to the key context
+ * @param[in,out] o offsets, advanced by nblocks
+ * @param[out] out output, may be equal to in, unused for OCB_HASH
+ * @param[in] in input
+ * @param[in] nblocks number of blocks
+ * @param[in] op OCB_ENCRYPT, OCB_DECRYPT or OCB_HASH
+ * @param[in,out] sum checksum (OCB_ENCRYPT, OCB_DECRYPT) or hash sum (OCB_HASH)
+ */
+static void ocb_run(const aes_ctx_t *ctx, ocb_offsets_t *o, uint8_t *out, const uint8_t *in,
+                    size_t nblocks, uint32_t op, uint64_t sum[2])
+{
+    uint64_t off[AES_LIB_BATCH][2];
+    uint8_t buf[AES_LIB_BATCH*AES_BLOCK_SIZE];
+    uint64_t pre[AES_OCB_GROUP][2];
+
+    if (nblocks == 0) {
+        return;
+    }
+    if ((op != OCB_HASH) && (ctx->engine->ocb != NULL)) {
+        uint8_t offset[AES_BLOCK_SIZE], check[AES_BLOCK_SIZE];
+
+        memcpy(offset, o->offset, sizeof(offset));
+        memcpy(check, sum, sizeof(check));
+        ctx->engine->ocb(&ctx->sched, out, in, nblocks, o->i, offset, check, ctx->ocb_l,
+                         op == OCB_DECRYPT);
+        o->i += nblocks;
+        memcpy(o->offset, offset, sizeof(offset));
+        memcpy(sum, check, sizeof(check));
+        aes_memzero(offset, sizeof(offset));
+        aes_memzero(check, sizeof(check));
+        return;
+    }
+    memcpy(pre, ctx->ocb_pre, sizeof(pre));
+    for (size_t done=0;done<nblocks;) {
+        size_t n = (nblocks - done < AES_LIB_BATCH) ? (nblocks - done) : AES_LIB_BATCH;
+        size_t k = 0;
+
+        /* offsets: whole groups have no dependency inside, the rest goes one by one */
+        while (k < n) {
+            uint64_t l[2];
+
+            if ((o->i % AES_OCB_GROUP == 0) && (n - k >= AES_OCB_GROUP)) {
+                for (uint32_t g=1;g<AES_OCB_GROUP;g++) {
+                    off[k+g-1][0] = o->base[0] ^ pre[g][0];
+                    off[k+g-1][1] = o->base[1] ^ pre[g][1];
+                }
+                o->i += AES_OCB_GROUP;
+                memcpy(l, ctx->ocb_l[__builtin_ctzll(o->i)], sizeof(l));
+                o->base[0] ^= pre[AES_OCB_GROUP-1][0] ^ l[0];
+                o->base[1] ^= pre[AES_OCB_GROUP-1][1] ^ l[1];
+                off[k+AES_OCB_GROUP-1][0] = o->base[0];
+                off[k+AES_OCB_GROUP-1][1] = o->base[1];
+                k += AES_OCB_GROUP;
+                continue;
+            }
+            o->i++;
+            if (o->i % AES_OCB_GROUP == 0) {
+                memcpy(l, ctx->ocb_l[__builtin_ctzll(o->i)], sizeof(l));
+                o->base[0] ^= pre[AES_OCB_GROUP-1][0] ^ l[0];
+                o->base[1] ^= pre[AES_OCB_GROUP-1][1] ^ l[1];
+            }
+            off[k][0] = o->base[0] ^ pre[o->i % AES_OCB_GROUP][0];
+            off[k][1] = o->base[1] ^ pre[o->i % AES_OCB_GROUP][1];
+            k++;
+        }
+        for (k=0;k<n;k++) {
+            uint64_t x[2];
+
+            memcpy(x, in + k*AES_BLOCK_SIZE, sizeof(x));
+            if (op == OCB_ENCRYPT) {
+                sum[0] ^= x[0];
+                sum[1] ^= x[1];
+            }
+            x[0] ^= off[k][0];
+            x[1] ^= off[k][1];
+            memcpy(buf + k*AES_BLOCK_SIZE, x, sizeof(x));
+        }
+        if (op == OCB_DECRYPT) {
+            ctx->engine->decrypt(&ctx->sched, buf, buf, n);
+        } else {
+            ctx->engine->encrypt(&ctx->sched, buf, buf, n);
+        }
+        for (k=0;k<n;k++) {
+            uint64_t y[2];
+
+            memcpy(y, buf + k*AES_BLOCK_SIZE, sizeof(y));
+            if (op == OCB_HASH) {
+                sum[0] ^= y[0];
+                sum[1] ^= y[1];
+                continue;
+            }
+            y[0] ^= off[k][0];
+            y[1] ^= off[k][1];
+            memcpy(out + k*AES_BLOCK_SIZE, y, sizeof(y));
+            if (op == OCB_DECRYPT) {
+                sum[0] ^= y[0];
+                sum[1] ^= y[1];
+            }
+        }
+        o->offset[0] = off[n-1][0];
+        o->offset[1] = off[n-1][1];
+        done += n;
+        in += n*AES_BLOCK_SIZE;
+        if (op != OCB_HASH) {
+            out += n*AES_BLOCK_SIZE;
+        }
+    }
+    aes_memzero(off, sizeof(off));
+    aes_memzero(buf, sizeof(buf));
+}
+
+/**
+ * @brief HASH(K, A), RFC 7253 section 4.1
+ * @param[in] ctx pointer to the key context
+ * @param[in] aad additional authenticated data
+ * @param[in] aad_len AAD length in bytes
+ * @param[out] sum hash
+ */
+static void ocb_hash(const aes_ctx_t *ctx, const uint8_t *aad, size_t aad_len, uint64_t sum[2])
+{
+    ocb_offsets_t o;
+    size_t full = aad_len/AES_BLOCK_SIZE;
+    size_t rest = aad_len % AES_BLOCK_SIZE;
+
+    memset(&o, 0, sizeof(o));
+    sum[0] = 0;
+    sum[1] = 0;
+    ocb_run(ctx, &o, NULL, aad, full, OCB_HASH, sum);
+    if (rest != 0) {
+        uint8_t block[AES_BLOCK_SIZE];
+        uint64_t x[2], lstar[2];
+
+        memset(block, 0, sizeof(block));
+        memcpy(block, aad + full*AES_BLOCK_SIZE, rest);
+        block[rest] = 0x80;
+        memcpy(x, block, sizeof(x));
+        memcpy(lstar, ctx->ocb_lstar, sizeof(lstar));
+        x[0] ^= o.offset[0] ^ lstar[0];
+        x[1] ^= o.offset[1] ^ lstar[1];
+        memcpy(block, x, sizeof(x));
+        ctx->engine->encrypt(&ctx->sched, block, block, 1);
+        memcpy(x, block, sizeof(x));
+        sum[0] ^= x[0];
+        sum[1] ^= x[1];
+        aes_memzero(block, sizeof(block));
+    }
+    aes_memzero(&o, sizeof(o));
+}
+
+/**
+ * @brief process the final partial block and compute the full tag
+ * @param[in] ctx pointer to the key context
+ * @param[in,out] o offsets after the whole blocks
+ * @param[out] out last rest bytes of the output, may be equal to in
+ * @param[in] in last rest bytes of the input
+ * @param[in] rest 0 to 15
+ * @param[in] op OCB_ENCRYPT or OCB_DECRYPT
+ * @param[in,out] checksum checksum of the whole blocks
+ * @param[in] sum HASH(K, A)
+ * @param[out] tag 16-byte tag
+ */
+static void ocb_finish(const aes_ctx_t *ctx, ocb_offsets_t *o, uint8_t *out, const uint8_t *in,
+                       size_t rest, uint32_t op, uint64_t checksum[2], const uint64_t sum[2],
+                       uint8_t tag[AES_BLOCK_SIZE])
+{
+    uint8_t block[AES_BLOCK_SIZE];
+    uint64_t x[2];
+
+    if (rest != 0) {
+        uint8_t pad[AES_BLOCK_SIZE];
+
+        memcpy(x, ctx->ocb_lstar, sizeof(x));
+        o->offset[0] ^= x[0];
+        o->offset[1] ^= x[1];
+        memcpy(pad, o->offset, sizeof(pad));
+        ctx->engine->encrypt(&ctx->sched, pad, pad, 1);
+        memset(block, 0, sizeof(block));
+        for (size_t j=0;j<rest;j++) {
+            uint8_t a = in[j];
+            uint8_t b = (uint8_t)(a ^ pad[j]);
+
+            out[j] = b;
+            block[j] = (op == OCB_ENCRYPT) ? a : b;
+        }
+        block[rest] = 0x80;
+        memcpy(x, block, sizeof(x));
+        checksum[0] ^= x[0];
+        checksum[1] ^= x[1];
+        aes_memzero(pad, sizeof(pad));
+    }
+    /* Tag = E(Checksum ^ Offset ^ L_$) ^ HASH(K, A) */
+    memcpy(x, ctx->ocb_ldollar, sizeof(x));
+    x[0] ^= checksum[0] ^ o->offset[0];
+    x[1] ^= checksum[1] ^ o->offset[1];
+    memcpy(block, x, sizeof(x));
+    ctx->engine->encrypt(&ctx->sched, block, block, 1);
+    memcpy(x, block, sizeof(x));
+    x[0] ^= sum[0];
+    x[1] ^= sum[1];
+    memcpy(tag, x, sizeof(x));
+    aes_memzero(block, sizeof(block));
+}
+
+/**
+ * @brief check the parameters shared by encrypt and decrypt
+ * @return AES_OK or an AES_ERR_* code
+ */
+static aes_status_t ocb_check(const aes_ctx_t *ctx, const uint8_t *nonce, size_t nonce_len,
+                              const uint8_t *out, const uint8_t *tag, size_t tag_len,
+                              const uint8_t *in, size_t len, const uint8_t *aad, size_t aad_len)
+{
+    if ((ctx == NULL) || (nonce == NULL) || (tag == NULL) || ((len != 0) && ((out == NULL) || (in == NULL))) ||
+        ((aad_len != 0) && (aad == NULL))) {
+        return AES_ERR_PARAM;
+    }
+    if ((nonce_len == 0) || (nonce_len > AES_OCB_NONCE_MAX) || (tag_len == 0) ||
+        (tag_len > AES_OCB_TAG_MAX) || ((uint64_t)len > AES_OCB_MAX_LENGTH) ||
+        ((uint64_t)aad_len > AES_OCB_MAX_LENGTH)) {
+        return AES_ERR_LENGTH;
+    }
+    return AES_OK;
+}
+
+/**
+ * @brief shared body of encrypt and decrypt
+ * @param[out] tag full 16-byte tag
+ */
+static void ocb_crypt(const aes_ctx_t *ctx, const uint8_t *nonce, size_t nonce_len, size_t tag_len,
+                      uint8_t *out, const uint8_t *in, size_t len, const uint8_t *aad,
+                      size_t aad_len, uint32_t op, uint8_t tag[AES_BLOCK_SIZE])
+{
+    ocb_offsets_t o;
+    uint64_t checksum[2] = {0, 0};
+    uint64_t sum[2];
+    size_t full = len/AES_BLOCK_SIZE;
+
+    ocb_hash(ctx, aad, aad_len, sum);
+    ocb_offset0(ctx, nonce, nonce_len, tag_len, o.base);
+    o.offset[0] = o.base[0];
+    o.offset[1] = o.base[1];
+    o.i = 0;
+    ocb_run(ctx, &o, out, in, full, op, checksum);
+    ocb_finish(ctx, &o, (full != 0) ? out + full*AES_BLOCK_SIZE : out,
+               (full != 0) ? in + full*AES_BLOCK_SIZE : in, len % AES_BLOCK_SIZE, op,
+               checksum, sum, tag);
+    aes_stats_add_blocks(ctx->engine->id, AES_STATS_MODE_OCB, ctx->sched.length,
+                         (op == OCB_ENCRYPT) ? AES_STATS_DIR_ENC : AES_STATS_DIR_DEC,
+                         (aad_len + AES_BLOCK_SIZE - 1)/AES_BLOCK_SIZE +
+                         (len + AES_BLOCK_SIZE - 1)/AES_BLOCK_SIZE + 2);
+    aes_memzero(&o, sizeof(o));
+    aes_memzero(checksum, sizeof(checksum));
+    aes_memzero(sum, sizeof(sum));
+}
+
+/**
+ * @brief encrypt and authenticate a message with AES-OCB3
+ * @param[in] ctx pointer to the key context
+ * @param[in] nonce nonce, unique per message under a key
+ * @param[in] nonce_len nonce length, 1 to AES_OCB_NONCE_MAX (12 recommended)
+ * @param[out] out ciphertext, len bytes, may be equal to in
+ * @param[out] tag tag, tag_len bytes
+ * @param[in] tag_len tag length, 1 to AES_OCB_TAG_MAX
+ * @param[in] in plaintext, may be NULL if len is 0
+ * @param[in] len plaintext length in bytes, at most AES_OCB_MAX_LENGTH
+ * @param[in] aad additional authenticated data, may be NULL if aad_len is 0
+ * @param[in] aad_len AAD length in bytes, at most AES_OCB_MAX_LENGTH
+ * @return AES_OK or an AES_ERR_* code
+ */
+aes_status_t aes_ocb_encrypt(const aes_ctx_t *ctx, const uint8_t *nonce, size_t nonce_len,
+                             uint8_t *out, uint8_t *tag, size_t tag_len,
+                             const uint8_t *in, size_t len, const uint8_t *aad, size_t aad_len)
+{
+    uint8_t full_tag[AES_BLOCK_SIZE];
+    aes_status_t status = ocb_check(ctx, nonce, nonce_len, out, tag, tag_len, in, len, aad, aad_len);
+
+    if (status != AES_OK) {
+        return status;
+    }
+    ocb_crypt(ctx, nonce, nonce_len, tag_len, out, in, len, aad, aad_len, OCB_ENCRYPT, full_tag);
+    memcpy(tag, full_tag, tag_len);
+    aes_memzero(full_tag, sizeof(full_tag));
+    return AES_OK;
+}
+
+/**
+ * @brief decrypt and verify a message with AES-OCB3
+ * @param[in] ctx pointer to the key context
+ * @param[in] nonce nonce used to encrypt
+ * @param[in] nonce_len nonce length, 1 to AES_OCB_NONCE_MAX
+ * @param[out] out plaintext, len bytes, may be equal to in; zeroed if the
+ * tag does not match
+ * @param[in] in ciphertext, may be NULL if len is 0
+ * @param[in] len ciphertext length in bytes, at most AES_OCB_MAX_LENGTH
+ * @param[in] tag expected tag, tag_len bytes
+ * @param[in] tag_len tag length, 1 to AES_OCB_TAG_MAX
+ * @param[in] aad additional authenticated data, may be NULL if aad_len is 0
+ * @param[in] aad_len AAD length in bytes, at most AES_OCB_MAX_LENGTH
+ * @return AES_OK, AES_ERR_AUTH if the tag does not match, or another AES_ERR_* code
+ * @note the blocks go through the engine's inverse cipher, unlike the
+ * CTR-based modes
+ */
+aes_status_t aes_ocb_decrypt(const aes_ctx_t *ctx, const uint8_t *nonce, size_t nonce_len,
+                             uint8_t *out, const uint8_t *in, size_t len,
+                             const uint8_t *tag, size_t tag_len,
+                             const uint8_t *aad, size_t aad_len)
+{
+    uint8_t full_tag[AES_BLOCK_SIZE];
+    uint8_t diff = 0;
+    aes_status_t status = ocb_check(ctx, nonce, nonce_len, out, tag, tag_len, in, len, aad, aad_len);
+
+    if (status != AES_OK) {
+        return status;
+    }
+    ocb_crypt(ctx, nonce, nonce_len, tag_len, out, in, len, aad, aad_len, OCB_DECRYPT, full_tag);
+    /* constant time: the position of the first differing byte is not leaked */
+    for (size_t i=0;i<tag_len;i++) {
+        diff |= (uint8_t)(full_tag[i] ^ tag[i]);
+    }
+    aes_memzero(full_tag, sizeof(full_tag));
+    if (diff != 0) {
+        if (len != 0) {
+            aes_memzero(out, len);
+        }
+        return AES_ERR_AUTH;
+    }
+    return AES_OK;
+}
+
+#undef AES_OCB_C
@@ -0,0 +1,451 @@
+/**
+ * @file aes_perf.c
+ * @brief hardware performance-counter profiling of the cipher stages and engines
+ *
+ * The events are opened as one perf_event group on the calling thread,
+ * user space only, and read with a single read() per mark. Counts are
+ * scaled by time_enabled/time_running when the kernel had to multiplex
+ * the group. The reference engine is replayed stage by stage: every stage
+ * of a round runs over a slice of AES_PERF_SLICE blocks between two reads,
+ * so the cost of a read is spread over the slice, and the slice stays in
+ * L1 as it would in the block-by-block engine. The output is checked
+ * against aes_engine_ref so the profiled path is the real cipher.
+*/
+
+#define AES_PERF_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_engine.h"
+#include "aes_stats.h"
+#include "aes_perf.h"
+
+static const char *perf_event_name[AES_PERF_EVENTS] = {
+    "cycles", "instructions", "l1d-misses", "branch-misses"
+};
+static const char *perf_stage_name[AES_PERF_STAGES] = {
+    "addroundkey", "subbytes", "shiftrows", "mixcolumns"
+};
+
+/**
+ * @brief describe event e for perf_event_open
+ * @param[out] attr attribute structure, zeroed by the caller
+ * @param[in] event AES_PERF_xxx event
+ */
+static void perf_attr(struct perf_event_attr *attr, uint32_t event)
+{
+    attr->size = sizeof(struct perf_event_attr);
+    switch (event) {
+        case AES_PERF_CYCLES:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case AES_PERF_INSTRUCTIONS:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case AES_PERF_L1D_MISSES:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        default:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+    }
+    attr->read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+                        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr->exclude_kernel = 1;
+    attr->exclude_hv = 1;
+}
+
+/**
+ * @brief open the counters on the calling thread
+ * @param[out] perf counter group
+ * @return mask of the events counted, 0 if only the timing is available
+ * @note the counters follow the thread that opened them; close them with
+ * aes_perf_close even when the mask is 0
+ */
+uint32_t aes_perf_open(aes_perf_t *perf)
+{
+    memset(perf, 0, sizeof(aes_perf_t));
+    perf->leader = -1;
+    for (uint32_t e=0;e<AES_PERF_EVENTS;e++) {
+        struct perf_event_attr attr;
+        long fd;
+
+        perf->fd[e] = -1;
+        memset(&attr, 0, sizeof(attr));
+        perf_attr(&attr, e);
+        attr.disabled = (perf->leader < 0) ? 1 : 0;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, perf->leader, PERF_FLAG_FD_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        if (ioctl((int)fd, PERF_EVENT_IOC_ID, &perf->id[e]) != 0) {
+            close((int)fd);
+            continue;
+        }
+        perf->fd[e] = (int)fd;
+        perf->valid |= 1u << e;
+        if (perf->leader < 0) {
+            perf->leader = (int)fd;
+        }
+    }
+    if (perf->leader >= 0) {
+        ioctl(perf->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(perf->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    return perf->valid;
+}
+
+/**
+ * @brief close the counters
+ * @param[in,out] perf counter group
+ */
+void aes_perf_close(aes_perf_t *perf)
+{
+    for (uint32_t e=0;e<AES_PERF_EVENTS;e++) {
+        if (perf->fd[e] >= 0) {
+            close(perf->fd[e]);
+            perf->fd[e] = -1;
+        }
+    }
+    perf->leader = -1;
+    perf->valid = 0;
+}
+
+/**
+ * @brief name of an event
+ * @param[in] event AES_PERF_xxx event
+ * @return name, "?" if unknown
+ */
+const char *aes_perf_event_name(uint32_t event)
+{
+    return (event < AES_PERF_EVENTS) ? perf_event_name[event] : "?";
+}
+
+/**
+ * @brief name of a reference stage
+ * @param[in] stage AES_PERF_STAGE_xxx
+ * @return name, "?" if unknown
+ */
+const char *aes_perf_stage_name(uint32_t stage)
+{
+    return (stage < AES_PERF_STAGES) ? perf_stage_name[stage] : "?";
+}
+
+/**
+ * @brief read the raw group values
+ * @param[in] perf counter group
+ * @param[out] mark values, left zero for events not counted
+ */
+static void perf_read(const aes_perf_t *perf, aes_perf_mark_t *mark)
+{
+    aes_perf_group_t group;
+
+    memset(mark, 0, sizeof(aes_perf_mark_t));
+    if ((perf->leader < 0) || (read(perf->leader, &group, sizeof(group)) < (ssize_t)(3*sizeof(uint64_t)))) {
+        return;
+    }
+    mark->enabled = group.enabled;
+    mark->running = group.running;
+    for (uint64_t i=0;(i<group.nr) && (i<AES_PERF_EVENTS);i++) {
+        for (uint32_t e=0;e<AES_PERF_EVENTS;e++) {
+            if ((perf->valid & (1u << e)) && (perf->id[e] == group.event[i].id)) {
+                mark->value[e] = group.event[i].value;
+            }
+        }
+    }
+}
+
+/**
+ * @brief start a measured interval
+ * @param[in] perf counter group
+ * @param[out] mark start values
+ */
+void aes_perf_begin(const aes_perf_t *perf, aes_perf_mark_t *mark)
+{
+    perf_read(perf, mark);
+    mark->nsec = aes_stats_timestamp();
+}
+
+/**
+ * @brief end a measured interval and add it to a sample
+ * @param[in] perf counter group
+ * @param[in] mark start values from aes_perf_begin
+ * @param[in,out] sample accumulated sample, zeroed before its first interval
+ * @param[in] blocks number of blocks processed in the interval
+ */
+void aes_perf_end(const aes_perf_t *perf, const aes_perf_mark_t *mark,
+                  aes_perf_sample_t *sample, uint64_t blocks)
+{
+    aes_perf_mark_t now;
+    uint64_t nsec = aes_stats_timestamp();
+    uint64_t enabled, running;
+
+    perf_read(perf, &now);
+    if (sample->calls == 0) {
+        sample->valid = perf->valid;
+    }
+    enabled = now.enabled - mark->enabled;
+    running = now.running - mark->running;
+    if ((running == 0) && (enabled != 0)) {
+        /* the group never got the PMU during the interval */
+        sample->valid = 0;
+    }
+    for (uint32_t e=0;e<AES_PERF_EVENTS;e++) {
+        uint64_t delta = now.value[e] - mark->value[e];
+
+        if ((running != 0) && (running < enabled)) {
+            delta = (uint64_t)((double)delta*(double)enabled/(double)running);
+        }
+        sample->count[e] += delta;
+    }
+    sample->time_nsec += nsec - mark->nsec;
+    sample->blocks += blocks;
+    sample->calls++;
+}
+
+/**
+ * @brief fill a buffer with reproducible data
+ * @param[out] buf buffer
+ * @param[in] len buffer size in bytes
+ * @param[in] seed non-zero seed
+ */
+static void perf_fill(uint8_t *buf, size_t len, uint32_t seed)
+{
+    uint32_t x = seed;
+
+    for (size_t i=0;i<len;i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        buf[i] = (uint8_t)x;
+    }
+}
+
+/**
+ * @brief run one stage over a slice of states as one measured interval
+ * @param[in] perf counter group
+ * @param[in] stage AES_PERF_STAGE_xxx
+ * @param[in,out] state slice of states
+ * @param[in] n number of states
+ * @param[in] rk round key, AddRoundKey only
+ * @param[in,out] sample sample of the stage
+ */
+static void perf_stage(const aes_perf_t *perf, uint32_t stage, aes_block_t *state, size_t n,
+                       aes_key_t *rk, aes_perf_sample_t *sample)
+{
+    aes_perf_mark_t mark;
+
+    aes_perf_begin(perf, &mark);
+    switch (stage) {
+        case AES_PERF_STAGE_ADDROUNDKEY:
+            for (size_t i=0;i<n;i++) {
+                aes_addroundkey(&state[i], rk);
+            }
+            break;
+        case AES_PERF_STAGE_SUBBYTES:
+            for (size_t i=0;i<n;i++) {
+                aes_subbytes(&state[i]);
+            }
+            break;
+        case AES_PERF_STAGE_SHIFTROWS:
+            for (size_t i=0;i<n;i++) {
+                aes_shiftrows(&state[i]);
+            }
+            break;
+        default:
+            for (size_t i=0;i<n;i++) {
+                aes_mixcolumns(&state[i]);
+            }
+            break;
+    }
+    /* blocks are added per slice, a stage runs several times per block */
+    aes_perf_end(perf, &mark, sample, 0);
+}
+
+/**
+ * @brief profile the reference cipher stage by stage
+ * @param[in] perf counter group
+ * @param[in] key_length key size in bytes (16, 24 or 32)
+ * @param[in] nblocks number of blocks to cipher
+ * @param[out] stages one sample per AES_PERF_STAGE_xxx, blocks counts whole
+ * blocks so per-block figures cover every round of the stage
+ * @return 0, -1 on bad parameters or allocation failure, -2 if the staged
+ * cipher disagrees with the reference engine
+ */
+int32_t aes_perf_ref_stages(const aes_perf_t *perf, uint32_t key_length, size_t nblocks,
+                            aes_perf_sample_t stages[AES_PERF_STAGES])
+{
+    uint8_t key[AES256_KEY_SIZE/8];
+    uint8_t in[AES_PERF_SLICE*AES_BLOCK_SIZE];
+    uint8_t out[AES_PERF_SLICE*AES_BLOCK_SIZE];
+    aes_key_t rk[AES256_NR+1];
+    aes_sched_t *sched;
+    aes_block_t *state;
+    int32_t ret = 0;
+
+    if ((key_length != AES128_KEY_SIZE/8) && (key_length != AES192_KEY_SIZE/8) &&
+        (key_length != AES256_KEY_SIZE/8)) {
+        return -1;
+    }
+    sched = malloc(sizeof(aes_sched_t));
+    state = malloc(AES_PERF_SLICE*sizeof(aes_block_t));
+    if ((sched == NULL) || (state == NULL)) {
+        free(sched);
+        free(state);
+        return -1;
+    }
+    memset(stages, 0, AES_PERF_STAGES*sizeof(aes_perf_sample_t));
+    perf_fill(key, sizeof(key), 0x2b7e1516);
+    aes_engine_ref.setkey(sched, key, key_length);
+    memset(rk, 0, sizeof(rk));
+    for (uint32_t r=0;r<=sched->nr;r++) {
+        memcpy(rk[r].byte, sched->enc.byte[r], AES_BLOCK_SIZE);
+        rk[r].length = AES128_KEY_SIZE/8;
+    }
+    for (size_t off=0;off<nblocks;off+=AES_PERF_SLICE) {
+        size_t n = (nblocks - off < AES_PERF_SLICE) ? (nblocks - off) : AES_PERF_SLICE;
+
+        perf_fill(in, n*AES_BLOCK_SIZE, (uint32_t)off + 1);
+        for (size_t i=0;i<n;i++) {
+            memcpy(state[i].byte, in + i*AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+            aes_block2mat(&state[i]);
+        }
+        perf_stage(perf, AES_PERF_STAGE_ADDROUNDKEY, state, n, &rk[0], &stages[AES_PERF_STAGE_ADDROUNDKEY]);
+        for (uint32_t r=1;r<=sched->nr;r++) {
+            perf_stage(perf, AES_PERF_STAGE_SUBBYTES, state, n, NULL, &stages[AES_PERF_STAGE_SUBBYTES]);
+            perf_stage(perf, AES_PERF_STAGE_SHIFTROWS, state, n, NULL, &stages[AES_PERF_STAGE_SHIFTROWS]);
+            if (r != sched->nr) {
+                perf_stage(perf, AES_PERF_STAGE_MIXCOLUMNS, state, n, NULL, &stages[AES_PERF_STAGE_MIXCOLUMNS]);
+            }
+            perf_stage(perf, AES_PERF_STAGE_ADDROUNDKEY, state, n, &rk[r], &stages[AES_PERF_STAGE_ADDROUNDKEY]);
+        }
+        for (uint32_t s=0;s<AES_PERF_STAGES;s++) {
+            stages[s].blocks += n;
+        }
+        aes_engine_ref.encrypt(sched, out, in, n);
+        for (size_t i=0;i<n;i++) {
+            if (memcmp(state[i].byte, out + i*AES_BLOCK_SIZE, AES_BLOCK_SIZE) != 0) {
+                ret = -2;
+            }
+        }
+    }
+    aes_memzero(key, sizeof(key));
+    aes_memzero(rk, sizeof(rk));
+    aes_memzero(sched, sizeof(aes_sched_t));
+    free(sched);
+    free(state);
+    return ret;
+}
+
+/**
+ * @brief profile an engine, one measured interval per engine call
+ * @param[in] perf counter group
+ * @param[in] engine engine to profile, supported on this CPU
+ * @param[in] key_length key size in bytes (16, 24 or 32)
+ * @param[in] batch blocks per engine call
+ * @param[in] nblocks total number of blocks to encrypt
+ * @param[out] sample sample of all the calls
+ * @return 0, -1 on bad parameters or allocation failure
+ * @note every call ciphers the same batch in place, so the figures are
+ * those of the kernel with its data in cache
+ */
+int32_t aes_perf_engine(const aes_perf_t *perf, const aes_engine_t *engine, uint32_t key_length,
+                        size_t batch, size_t nblocks, aes_perf_sample_t *sample)
+{
+    uint8_t key[AES256_KEY_SIZE/8];
+    aes_sched_t *sched;
+    uint8_t *buf;
+
+    if ((engine == NULL) || (batch == 0) || ((key_length != AES128_KEY_SIZE/8) &&
+        (key_length != AES192_KEY_SIZE/8) && (key_length != AES256_KEY_SIZE/8))) {
+        return -1;
+    }
+    sched = malloc(sizeof(aes_sched_t));
+    buf = malloc(batch*AES_BLOCK_SIZE);
+    if ((sched == NULL) || (buf == NULL)) {
+        free(sched);
+        free(buf);
+        return -1;
+    }
+    memset(sample, 0, sizeof(aes_perf_sample_t));
+    perf_fill(key, sizeof(key), 0x2b7e1516);
+    perf_fill(buf, batch*AES_BLOCK_SIZE, 1);
+    engine->setkey(sched, key, key_length);
+    /* one untimed call warms the tables, the schedule and the buffer */
+    engine->encrypt(sched, buf, buf, batch);
+    for (size_t off=0;off<nblocks;off+=batch) {
+        size_t n = (nblocks - off < batch) ? (nblocks - off) : batch;
+        aes_perf_mark_t mark;
+
+        aes_perf_begin(perf, &mark);
+        engine->encrypt(sched, buf, buf, n);
+        aes_perf_end(perf, &mark, sample, n);
+    }
+    aes_memzero(key, sizeof(key));
+    aes_memzero(sched, sizeof(aes_sched_t));
+    free(sched);
+    free(buf);
+    return 0;
+}
+
+/**
+ * @brief print the column titles of aes_perf_report
+ * @param[in] fp output stream
+ */
+void aes_perf_report_header(FILE *fp)
+{
+    fprintf(fp, "%-24s %10s %10s %10s %8s %10s %10s %12s\n", "", "blocks", "calls",
+            "ns/block", "IPC", "cyc/block", "l1d/block", "brmiss/block");
+}
+
+/**
+ * @brief print a sample as one row: time, IPC and misses per block
+ * @param[in] fp output stream
+ * @param[in] label row title
+ * @param[in] sample sample to report
+ */
+void aes_perf_report(FILE *fp, const char *label, const aes_perf_sample_t *sample)
+{
+    double blocks = (sample->blocks != 0) ? (double)sample->blocks : 1.0;
+    uint32_t ipc = (1u << AES_PERF_CYCLES) | (1u << AES_PERF_INSTRUCTIONS);
+
+    fprintf(fp, "%-24s %10lu %10lu %10.2f", label, (unsigned long)sample->blocks,
+            (unsigned long)sample->calls, (double)sample->time_nsec/blocks);
+    if (((sample->valid & ipc) == ipc) && (sample->count[AES_PERF_CYCLES] != 0)) {
+        fprintf(fp, " %8.2f", (double)sample->count[AES_PERF_INSTRUCTIONS]/
+                (double)sample->count[AES_PERF_CYCLES]);
+    } else {
+        fprintf(fp, " %8s", "n/a");
+    }
+    if (sample->valid & (1u << AES_PERF_CYCLES)) {
+        fprintf(fp, " %10.1f", (double)sample->count[AES_PERF_CYCLES]/blocks);
+    } else {
+        fprintf(fp, " %10s", "n/a");
+    }
+    if (sample->valid & (1u << AES_PERF_L1D_MISSES)) {
+        fprintf(fp, " %10.3f", (double)sample->count[AES_PERF_L1D_MISSES]/blocks);
+    } else {
+        fprintf(fp, " %10s", "n/a");
+    }
+    if (sample->valid & (1u << AES_PERF_BRANCH_MISSES)) {
+        fprintf(fp, " %12.3f\n", (double)sample->count[AES_PERF_BRANCH_MISSES]/blocks);
+    } else {
+        fprintf(fp, " %12s\n", "n/a");
+    }
+}
+
+#undef AES_PERF_C
@@ -0,0 +1,428 @@
+/**
+ * @file aes_polyval.c
+ * @brief POLYVAL (RFC 8452) and GHASH (SP 800-38D) universal hashes
+ *
+ * POLYVAL works in GF(2^128) modulo x^128 + x^127 + x^126 + x^121 + 1 with
+ * little-endian blocks, and X*Y is the field product times x^-128. The
+ * carry-less path multiplies AES_POLYVAL_AGG blocks by H^AES_POLYVAL_AGG ..
+ * H and reduces once per group. The table path uses the identity of RFC
+ * 8452 appendix A, POLYVAL(H, X..) = ByteReverse(GHASH(mulX_GHASH(
+ * ByteReverse(H)), ByteReverse(X)..)), with a 4-bit Shoup table.
+ *
+ * GHASH is the same hash seen through the mirror: the table path runs it
+ * natively, the carry-less path byte-reverses every block and uses the key
+ * mulX_POLYVAL(ByteReverse(H)).
+*/
+
+#define AES_POLYVAL_C
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "aes_polyval.h"
+
+/* reduction of the 4 bits shifted out of the GHASH table product */
+static const uint64_t polyval_last4[16] = {
+    0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+static inline uint64_t polyval_le64(const uint8_t *p)
+{
+    uint64_t v = 0;
+
+    for (uint32_t i=0;i<8;i++) {
+        v |= (uint64_t)p[i] << (8*i);
+    }
+    return v;
+}
+
+static inline void polyval_put_le64(uint8_t *p, uint64_t v)
+{
+    for (uint32_t i=0;i<8;i++) {
+        p[i] = (uint8_t)(v >> (8*i));
+    }
+}
+
+static inline uint64_t polyval_be64(const uint8_t *p)
+{
+    uint64_t v = 0;
+
+    for (uint32_t i=0;i<8;i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static inline void polyval_put_be64(uint8_t *p, uint64_t v)
+{
+    for (uint32_t i=0;i<8;i++) {
+        p[i] = (uint8_t)(v >> (56 - 8*i));
+    }
+}
+
+/**
+ * @brief build the 4-bit GHASH table of a key
+ * @param[out] pv pointer to the hash key
+ * @param[in] vh high half of the GHASH key, as a big-endian integer
+ * @param[in] vl low half
+ */
+static void polyval_table_build(aes_polyval_t *pv, uint64_t vh, uint64_t vl)
+{
+    uint64_t carry;
+
+    pv->hl[0] = 0;
+    pv->hh[0] = 0;
+    pv->hl[8] = vl;
+    pv->hh[8] = vh;
+    for (uint32_t i=4;i>0;i>>=1) {
+        carry = vl & 1;
+        vl = (vh << 63) | (vl >> 1);
+        vh = (vh >> 1) ^ (carry * ((uint64_t)0xe1 << 56));
+        pv->hl[i] = vl;
+        pv->hh[i] = vh;
+    }
+    for (uint32_t i=2;i<=8;i*=2) {
+        for (uint32_t j=1;j<i;j++) {
+            pv->hh[i+j] = pv->hh[i] ^ pv->hh[j];
+            pv->hl[i+j] = pv->hl[i] ^ pv->hl[j];
+        }
+    }
+}
+
+/**
+ * @brief build the GHASH table of mulX_GHASH(ByteReverse(h))
+ * @param[out] pv pointer to the POLYVAL key
+ * @param[in] h POLYVAL key
+ * @note ByteReverse(h) read as a big-endian integer is le64(h+8):le64(h)
+ */
+static void polyval_table_init(aes_polyval_t *pv, const uint8_t *h)
+{
+    uint64_t vh = polyval_le64(h + 8);
+    uint64_t vl = polyval_le64(h);
+    uint64_t carry = vl & 1;
+
+    /* mulX_GHASH: one right shift in the reflected field */
+    vl = (vh << 63) | (vl >> 1);
+    vh = (vh >> 1) ^ (carry * ((uint64_t)0xe1 << 56));
+    polyval_table_build(pv, vh, vl);
+}
+
+/**
+ * @brief z = z*H in the GHASH field, z as a big-endian integer zh:zl
+ * @param[in] pv pointer to the hash key
+ * @param[in,out] zh high half
+ * @param[in,out] zl low half
+ */
+static inline void polyval_table_mult(const aes_polyval_t *pv, uint64_t *zh, uint64_t *zl)
+{
+    uint64_t xh = *zh;
+    uint64_t xl = *zl;
+    uint64_t h = 0;
+    uint64_t l = 0;
+    uint32_t rem;
+
+    /* nibbles from the last byte of the GHASH block, i.e. the low end of xl */
+    for (uint32_t i=0;i<16;i++) {
+        uint8_t byte = (uint8_t)((i < 8) ? (xl >> (8*i)) : (xh >> (8*(i-8))));
+
+        for (uint32_t n=0;n<2;n++) {
+            uint32_t nib = (n == 0) ? (byte & 0xf) : (byte >> 4);
+
+            if ((i != 0) || (n != 0)) {
+                rem = (uint32_t)l & 0xf;
+                l = (h << 60) | (l >> 4);
+                h = (h >> 4) ^ (polyval_last4[rem] << 48);
+            }
+            h ^= pv->hh[nib];
+            l ^= pv->hl[nib];
+        }
+    }
+    *zh = h;
+    *zl = l;
+}
+
+/**
+ * @brief POLYVAL through the GHASH table, any CPU
+ * @param[in] pv pointer to the POLYVAL key
+ * @param[in,out] s accumulator
+ * @param[in] data nblocks*16 bytes
+ * @param[in] nblocks number of blocks
+ * @note the accumulator stays byte-reversed (GHASH order) across blocks
+ */
+static void polyval_table_update(const aes_polyval_t *pv, uint8_t *s,
+                                 const uint8_t *data, size_t nblocks)
+{
+    uint64_t zh = polyval_le64(s + 8);
+    uint64_t zl = polyval_le64(s);
+
+    for (size_t b=0;b<nblocks;b++) {
+        const uint8_t *x = data + b*AES_POLYVAL_SIZE;
+
+        zh ^= polyval_le64(x + 8);
+        zl ^= polyval_le64(x);
+        polyval_table_mult(pv, &zh, &zl);
+    }
+    polyval_put_le64(s, zl);
+    polyval_put_le64(s + 8, zh);
+}
+
+/**
+ * @brief GHASH through the table, any CPU
+ * @param[in] pv pointer to the GHASH key
+ * @param[in,out] s accumulator
+ * @param[in] data nblocks*16 bytes
+ * @param[in] nblocks number of blocks
+ */
+static void ghash_table_update(const aes_polyval_t *pv, uint8_t *s,
+                               const uint8_t *data, size_t nblocks)
+{
+    uint64_t zh = polyval_be64(s);
+    uint64_t zl = polyval_be64(s + 8);
+
+    for (size_t b=0;b<nblocks;b++) {
+        const uint8_t *x = data + b*AES_POLYVAL_SIZE;
+
+        zh ^= polyval_be64(x);
+        zl ^= polyval_be64(x + 8);
+        polyval_table_mult(pv, &zh, &zl);
+    }
+    polyval_put_be64(s, zh);
+    polyval_put_be64(s + 8, zl);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <wmmintrin.h>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+
+#define POLYVAL_TARGET  __attribute__((target("pclmul,ssse3,sse2")))
+
+/**
+ * @brief 256-bit carry-less product of two blocks
+ * @param[in] a first operand
+ * @param[in] b second operand
+ * @param[out] lo low 128 bits
+ * @param[out] hi high 128 bits
+ */
+POLYVAL_TARGET
+static inline void polyval_clmul_wide(__m128i a, __m128i b, __m128i *lo, __m128i *hi)
+{
+    __m128i mid = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10),
+                                _mm_clmulepi64_si128(a, b, 0x01));
+
+    *lo = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x00), _mm_slli_si128(mid, 8));
+    *hi = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x11), _mm_srli_si128(mid, 8));
+}
+
+/**
+ * @brief reduce a 256-bit product to lo*x^-128 + hi modulo the POLYVAL polynomial
+ * @param[in] lo low 128 bits
+ * @param[in] hi high 128 bits
+ * @return reduced block
+ * @note two Montgomery folds of 64 bits each by x^127 + x^126 + x^121 + 1
+ */
+POLYVAL_TARGET
+static inline __m128i polyval_clmul_reduce(__m128i lo, __m128i hi)
+{
+    const __m128i poly = _mm_set_epi32((int)0xc2000000, 0, 0, 1);
+    __m128i t;
+
+    t = _mm_clmulepi64_si128(lo, poly, 0x10);
+    lo = _mm_xor_si128(_mm_shuffle_epi32(lo, 0x4e), t);
+    t = _mm_clmulepi64_si128(lo, poly, 0x10);
+    lo = _mm_xor_si128(_mm_shuffle_epi32(lo, 0x4e), t);
+    return _mm_xor_si128(hi, lo);
+}
+
+POLYVAL_TARGET
+static __m128i polyval_clmul_dot(__m128i a, __m128i b)
+{
+    __m128i lo, hi;
+
+    polyval_clmul_wide(a, b, &lo, &hi);
+    return polyval_clmul_reduce(lo, hi);
+}
+
+POLYVAL_TARGET
+static void polyval_clmul_init(aes_polyval_t *pv, const uint8_t *h)
+{
+    __m128i hk = _mm_loadu_si128((const __m128i *)h);
+    __m128i p = hk;
+
+    _mm_storeu_si128((__m128i *)pv->hpow[0], p);
+    for (uint32_t i=1;i<AES_POLYVAL_AGG;i++) {
+        p = polyval_clmul_dot(p, hk);
+        _mm_storeu_si128((__m128i *)pv->hpow[i], p);
+    }
+}
+
+/**
+ * @brief POLYVAL with PCLMULQDQ, optionally on byte-reversed blocks
+ * @param[in] pv pointer to the POLYVAL key
+ * @param[in,out] s accumulator
+ * @param[in] data nblocks*16 bytes
+ * @param[in] nblocks number of blocks
+ * @param[in] bswap 1 for GHASH: blocks and accumulator are byte-reversed
+ * @note (S+X1)*H^4 + X2*H^3 + X3*H^2 + X4*H is summed unreduced, the
+ * reduction being linear it runs once per AES_POLYVAL_AGG blocks
+ */
+POLYVAL_TARGET
+static void polyval_clmul_blocks(const aes_polyval_t *pv, uint8_t *s, const uint8_t *data,
+                                 size_t nblocks, uint32_t bswap)
+{
+    const __m128i rev = bswap ? _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)
+                              : _mm_set_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    __m128i h[AES_POLYVAL_AGG];
+    __m128i acc = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)s), rev);
+    const __m128i *x = (const __m128i *)data;
+    size_t b = 0;
+
+    for (uint32_t i=0;i<AES_POLYVAL_AGG;i++) {
+        h[i] = _mm_loadu_si128((const __m128i *)pv->hpow[i]);
+    }
+    for (;b+AES_POLYVAL_AGG<=nblocks;b+=AES_POLYVAL_AGG) {
+        __m128i lo, hi, plo, phi;
+
+        polyval_clmul_wide(_mm_xor_si128(acc, _mm_shuffle_epi8(_mm_loadu_si128(x + b), rev)),
+                           h[AES_POLYVAL_AGG-1], &lo, &hi);
+        for (uint32_t i=1;i<AES_POLYVAL_AGG;i++) {
+            polyval_clmul_wide(_mm_shuffle_epi8(_mm_loadu_si128(x + b + i), rev),
+                               h[AES_POLYVAL_AGG-1-i], &plo, &phi);
+            lo = _mm_xor_si128(lo, plo);
+            hi = _mm_xor_si128(hi, phi);
+        }
+        acc = polyval_clmul_reduce(lo, hi);
+    }
+    for (;b<nblocks;b++) {
+        acc = polyval_clmul_dot(_mm_xor_si128(acc, _mm_shuffle_epi8(_mm_loadu_si128(x + b), rev)),
+                                h[0]);
+    }
+    _mm_storeu_si128((__m128i *)s, _mm_shuffle_epi8(acc, rev));
+}
+
+/**
+ * @brief check the CPU for carry-less multiply
+ * @return 1 if PCLMULQDQ (and SSSE3 for the byte swaps) is available
+ */
+int32_t aes_polyval_clmul_supported(void)
+{
+    __builtin_cpu_init();
+    return (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3")) ? 1 : 0;
+}
+
+#else /* not x86 */
+
+static void polyval_clmul_init(aes_polyval_t *pv, const uint8_t *h)
+{
+    (void)pv;
+    (void)h;
+}
+
+static void polyval_clmul_blocks(const aes_polyval_t *pv, uint8_t *s, const uint8_t *data,
+                                 size_t nblocks, uint32_t bswap)
+{
+    (void)pv;
+    (void)s;
+    (void)data;
+    (void)nblocks;
+    (void)bswap;
+}
+
+int32_t aes_polyval_clmul_supported(void)
+{
+    return 0;
+}
+
+#endif
+
+/**
+ * @brief precompute a POLYVAL key
+ * @param[out] pv pointer to the POLYVAL key
+ * @param[in] h 16-byte hash key
+ * @param[in] clmul 1 to use carry-less multiply when the CPU has it, 0 for
+ * the table
+ */
+void aes_polyval_init(aes_polyval_t *pv, const uint8_t h[AES_POLYVAL_SIZE], uint32_t clmul)
+{
+    pv->clmul = (clmul && aes_polyval_clmul_supported()) ? 1 : 0;
+    if (pv->clmul) {
+        polyval_clmul_init(pv, h);
+    } else {
+        polyval_table_init(pv, h);
+    }
+}
+
+/**
+ * @brief absorb whole blocks into a POLYVAL accumulator
+ * @param[in] pv pointer to a key set by aes_polyval_init
+ * @param[in,out] s accumulator, all zero at the start of a message
+ * @param[in] data nblocks*16 bytes
+ * @param[in] nblocks number of blocks
+ */
+void aes_polyval_update(const aes_polyval_t *pv, uint8_t s[AES_POLYVAL_SIZE],
+                        const uint8_t *data, size_t nblocks)
+{
+    if (nblocks == 0) {
+        return;
+    }
+    if (pv->clmul) {
+        polyval_clmul_blocks(pv, s, data, nblocks, 0);
+    } else {
+        polyval_table_update(pv, s, data, nblocks);
+    }
+}
+
+/**
+ * @brief precompute a GHASH key
+ * @param[out] pv pointer to the GHASH key
+ * @param[in] h 16-byte hash key, E(K, 0^128) for GCM
+ * @param[in] clmul 1 to use carry-less multiply when the CPU has it, 0 for
+ * the table
+ */
+void aes_ghash_init(aes_polyval_t *pv, const uint8_t h[AES_POLYVAL_SIZE], uint32_t clmul)
+{
+    uint8_t k[AES_POLYVAL_SIZE];
+    uint64_t hi, lo, carry;
+
+    pv->clmul = (clmul && aes_polyval_clmul_supported()) ? 1 : 0;
+    if (!pv->clmul) {
+        polyval_table_build(pv, polyval_be64(h), polyval_be64(h + 8));
+        return;
+    }
+    /* mulX_POLYVAL(ByteReverse(h)), ByteReverse(h) read little-endian is be64(h):be64(h+8) */
+    hi = polyval_be64(h);
+    lo = polyval_be64(h + 8);
+    carry = hi >> 63;
+    hi = (hi << 1) | (lo >> 63);
+    lo <<= 1;
+    hi ^= carry * ((uint64_t)0xc2 << 56);
+    lo ^= carry;
+    polyval_put_le64(k, lo);
+    polyval_put_le64(k + 8, hi);
+    polyval_clmul_init(pv, k);
+}
+
+/**
+ * @brief absorb whole blocks into a GHASH accumulator
+ * @param[in] pv pointer to a key set by aes_ghash_init
+ * @param[in,out] s accumulator, all zero at the start of a message
+ * @param[in] data nblocks*16 bytes
+ * @param[in] nblocks number of blocks
+ */
+void aes_ghash_update(const aes_polyval_t *pv, uint8_t s[AES_POLYVAL_SIZE],
+                      const uint8_t *data, size_t nblocks)
+{
+    if (nblocks == 0) {
+        return;
+    }
+    if (pv->clmul) {
+        polyval_clmul_blocks(pv, s, data, nblocks, 1);
+    } else {
+        ghash_table_update(pv, s, data, nblocks);
+    }
+}
+
+#undef AES_POLYVAL_C
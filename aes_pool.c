@@ -0,0 +1,629 @@
+/**
+ * @file aes_pool.c
+ * @brief libaes topology-aware worker pool, and parallel CTR on top of it
+ *
+ * A job is a function called once per task number; workers take task
+ * numbers from a shared counter until none is left, so uneven tasks
+ * balance themselves. One job runs at a time per pool. Single-task jobs
+ * run on the caller, which avoids the wake-up latency for small calls.
+*/
+
+/* CPU_SET and pthread_setaffinity_np */
+#define _GNU_SOURCE
+
+#define AES_POOL_C
+#define AES_LIB_PRIVATE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_engine.h"
+#include "aes_stats.h"
+#include "aes_lib.h"
+#include "aes_pool.h"
+
+#define SYSFS_CPU   "/sys/devices/system/cpu"
+#define SYSFS_NODE  "/sys/devices/system/node"
+/* smallest task, below it the wake-up cost dominates */
+#define POOL_MIN_CHUNK  (16*1024)
+
+struct aes_pool_s {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;        /* new job or stop */
+    pthread_cond_t done;        /* workers finished or started */
+    pthread_mutex_t run_lock;   /* one job at a time */
+    uint32_t nworkers;
+    uint32_t ready;
+    uint32_t stop;
+    pthread_t *threads;
+    aes_pool_worker_t *workers;
+    aes_pool_worker_t caller;   /* runs single-task jobs */
+    size_t chunk;
+    aes_topology_t topo;
+    /* current job */
+    uint64_t generation;
+    aes_pool_fn_t fn;
+    void *arg;
+    const aes_ctx_t *ctx;
+    uint64_t ntasks;
+    uint64_t next;              /* atomic */
+    uint32_t participants;
+    uint32_t finished;
+};
+
+static aes_pool_t *pool_default;
+static pthread_once_t pool_default_once = PTHREAD_ONCE_INIT;
+/* set by the self-test, workers started afterwards get no key replica */
+static uint32_t pool_fail_workers;
+
+/**
+ * @brief read the first line of a sysfs file
+ * @return 0 on success, -1 if the file cannot be read
+ */
+static int32_t topo_read(const char *path, char *buf, size_t size)
+{
+    FILE *fp = fopen(path, "r");
+    int32_t ret = -1;
+
+    if (fp == NULL) {
+        return -1;
+    }
+    if (fgets(buf, (int)size, fp) != NULL) {
+        buf[strcspn(buf, "\n")] = '\0';
+        ret = 0;
+    }
+    fclose(fp);
+    return ret;
+}
+
+/**
+ * @brief parse a sysfs CPU list such as "0-3,8,10-11"
+ * @param[in] list CPU list
+ * @param[out] set set[cpu] is made non-zero for every listed CPU
+ * @return number of CPUs listed below AES_POOL_MAX_CPUS
+ */
+static uint32_t topo_parse_list(const char *list, uint8_t *set)
+{
+    uint32_t count = 0;
+
+    while (*list != '\0') {
+        char *end;
+        unsigned long lo = strtoul(list, &end, 10);
+        unsigned long hi = lo;
+
+        if (end == list) {
+            break;
+        }
+        if (*end == '-') {
+            list = end + 1;
+            hi = strtoul(list, &end, 10);
+        }
+        for (unsigned long c=lo;(c<=hi)&&(c<AES_POOL_MAX_CPUS);c++) {
+            count += (set[c] == 0);
+            set[c] = 1;
+        }
+        list = (*end == ',') ? end + 1 : end;
+        if ((*end != ',') && (*end != '\0')) {
+            break;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief L2 size of a CPU from its sysfs cache description
+ * @return bytes, AES_POOL_L2_DEFAULT if not reported
+ */
+static size_t topo_l2_size(uint32_t cpu)
+{
+    char path[128], buf[64];
+
+    for (uint32_t i=0;i<8;i++) {
+        char *end;
+        unsigned long size;
+
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%u/cache/index%u/level", cpu, i);
+        if (topo_read(path, buf, sizeof(buf)) != 0) {
+            break;
+        }
+        if (strcmp(buf, "2") != 0) {
+            continue;
+        }
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%u/cache/index%u/type", cpu, i);
+        if ((topo_read(path, buf, sizeof(buf)) != 0) || (strcmp(buf, "Instruction") == 0)) {
+            continue;
+        }
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%u/cache/index%u/size", cpu, i);
+        if (topo_read(path, buf, sizeof(buf)) != 0) {
+            continue;
+        }
+        size = strtoul(buf, &end, 10);
+        size <<= (*end == 'K') ? 10 : ((*end == 'M') ? 20 : 0);
+        if (size != 0) {
+            return size;
+        }
+    }
+    return AES_POOL_L2_DEFAULT;
+}
+
+/**
+ * @brief whether a CPU is the first SMT thread of its core
+ */
+static int32_t topo_primary_thread(uint32_t cpu)
+{
+    char path[128], buf[256];
+
+    snprintf(path, sizeof(path), SYSFS_CPU "/cpu%u/topology/thread_siblings_list", cpu);
+    if (topo_read(path, buf, sizeof(buf)) != 0) {
+        return 1;
+    }
+    return strtoul(buf, NULL, 10) == cpu;
+}
+
+/**
+ * @brief discover the online CPUs, their NUMA nodes and the L2 size
+ * @param[out] topo receives the topology, CPUs in placement order: one per
+ * node in turn, physical cores before SMT siblings
+ * @return AES_OK, or AES_ERR_PARAM if topo is NULL
+ * @note without sysfs the CPUs reported by sysconf form a single node
+ */
+aes_status_t aes_pool_topology(aes_topology_t *topo)
+{
+    static uint8_t online[AES_POOL_MAX_CPUS];
+    static uint8_t on_node[AES_POOL_MAX_CPUS];
+    static uint16_t node_of[AES_POOL_MAX_CPUS];
+    static pthread_mutex_t topo_lock = PTHREAD_MUTEX_INITIALIZER;
+    uint32_t nodes[AES_POOL_MAX_NODES];
+    uint32_t pos[AES_POOL_MAX_NODES];
+    uint32_t nnodes = 0;
+    char path[128], buf[1024];
+
+    if (topo == NULL) {
+        return AES_ERR_PARAM;
+    }
+    memset(topo, 0, sizeof(aes_topology_t));
+    pthread_mutex_lock(&topo_lock);
+    memset(online, 0, sizeof(online));
+    memset(node_of, 0, sizeof(node_of));
+    if ((topo_read(SYSFS_CPU "/online", buf, sizeof(buf)) != 0) || (topo_parse_list(buf, online) == 0)) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+        for (long c=0;(c<n)&&(c<AES_POOL_MAX_CPUS);c++) {
+            online[c] = 1;
+        }
+    }
+    for (uint32_t n=0;n<AES_POOL_MAX_NODES;n++) {
+        memset(on_node, 0, sizeof(on_node));
+        snprintf(path, sizeof(path), SYSFS_NODE "/node%u/cpulist", n);
+        if ((topo_read(path, buf, sizeof(buf)) != 0) || (topo_parse_list(buf, on_node) == 0)) {
+            continue;
+        }
+        for (uint32_t c=0;c<AES_POOL_MAX_CPUS;c++) {
+            if (on_node[c] && online[c]) {
+                node_of[c] = (uint16_t)nnodes;
+            }
+        }
+        nodes[nnodes++] = n;
+    }
+    if (nnodes == 0) {
+        nodes[nnodes++] = 0;
+    }
+    /* two passes: first SMT threads of every core, then their siblings */
+    for (uint32_t pass=0;pass<2;pass++) {
+        uint32_t added;
+
+        memset(pos, 0, sizeof(pos));
+        do {
+            added = 0;
+            for (uint32_t n=0;n<nnodes;n++) {
+                for (;pos[n]<AES_POOL_MAX_CPUS;pos[n]++) {
+                    uint32_t c = pos[n];
+
+                    if (online[c] && (node_of[c] == n) && ((topo_primary_thread(c) != 0) == (pass == 0))) {
+                        topo->cpu[topo->ncpus] = (uint16_t)c;
+                        topo->node[topo->ncpus] = (uint16_t)nodes[n];
+                        topo->ncpus++;
+                        pos[n]++;
+                        added++;
+                        break;
+                    }
+                }
+            }
+        } while (added != 0);
+    }
+    topo->nnodes = nnodes;
+    topo->l2_size = topo_l2_size((topo->ncpus != 0) ? topo->cpu[0] : 0);
+    pthread_mutex_unlock(&topo_lock);
+    return AES_OK;
+}
+
+/**
+ * @brief pin the calling thread to one CPU
+ * @param[in] cpu CPU number
+ * @return 0 on success, -1 otherwise
+ */
+int32_t aes_pool_pin(uint32_t cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) ? 0 : -1;
+}
+
+/**
+ * @brief allocate the per-worker key replica and scratch buffer
+ * @param[in,out] w worker, called from the thread that will use them
+ * @param[in] scratch_size bytes of scratch
+ * @return 0 on success, -1 if the key replica could not be allocated
+ * @note the scratch buffer is optional, tasks fall back to the heap
+ */
+static int32_t pool_worker_alloc(aes_pool_worker_t *w, size_t scratch_size)
+{
+    if (aes_arena_init(&w->arena, sizeof(aes_ctx_t), 1, AES_ARENA_SECURE) != 0) {
+        return -1;
+    }
+    w->ctx = aes_arena_alloc(&w->arena);
+    if (w->ctx == NULL) {
+        aes_arena_destroy(&w->arena);
+        return -1;
+    }
+    if (aes_arena_init(&w->scratch_arena, scratch_size, 1, AES_ARENA_DEFAULT) == 0) {
+        w->scratch = aes_arena_alloc(&w->scratch_arena);
+        if (w->scratch == NULL) {
+            aes_arena_destroy(&w->scratch_arena);
+        } else {
+            /* first touch on this thread's node */
+            memset(w->scratch, 0, scratch_size);
+            w->scratch_size = scratch_size;
+        }
+    }
+    return 0;
+}
+
+static void pool_worker_release(aes_pool_worker_t *w)
+{
+    if (w->ctx != NULL) {
+        aes_arena_free(&w->arena, w->ctx);
+        aes_arena_destroy(&w->arena);
+        w->ctx = NULL;
+    }
+    if (w->scratch != NULL) {
+        aes_arena_free(&w->scratch_arena, w->scratch);
+        aes_arena_destroy(&w->scratch_arena);
+        w->scratch = NULL;
+    }
+}
+
+/**
+ * @brief run the tasks of the current job on one worker
+ * @param[in,out] pool pool running the job
+ * @param[in,out] w worker
+ */
+static void pool_tasks(aes_pool_t *pool, aes_pool_worker_t *w)
+{
+    uint64_t task;
+
+    if (pool->ctx != NULL) {
+        memcpy(w->ctx, pool->ctx, sizeof(aes_ctx_t));
+    }
+    while ((task = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->ntasks) {
+        pool->fn(pool->arg, task, w);
+    }
+    if (pool->ctx != NULL) {
+        aes_memzero(w->ctx, sizeof(aes_ctx_t));
+    }
+}
+
+/**
+ * @brief worker thread: pin, allocate locally, then serve jobs
+ * @param[in] arg pointer to the aes_pool_worker_t of the thread
+ * @return NULL
+ */
+static void *pool_thread(void *arg)
+{
+    aes_pool_worker_t *w = arg;
+    aes_pool_t *pool = w->pool;
+    uint64_t seen = 0;
+    int32_t ok;
+
+    if ((w->cpu >= 0) && (aes_pool_pin((uint32_t)w->cpu) != 0)) {
+        w->cpu = -1;
+    }
+    ok = !__atomic_load_n(&pool_fail_workers, __ATOMIC_RELAXED) && (pool_worker_alloc(w, pool->chunk) == 0);
+    pthread_mutex_lock(&pool->lock);
+    pool->ready++;
+    pthread_cond_broadcast(&pool->done);
+    for (;;) {
+        while ((pool->generation == seen) && !pool->stop) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+        seen = pool->generation;
+        if (w->id >= pool->participants) {
+            continue;
+        }
+        /* without a key replica the others take its share of the tasks */
+        if (ok) {
+            pthread_mutex_unlock(&pool->lock);
+            pool_tasks(pool, w);
+            pthread_mutex_lock(&pool->lock);
+        }
+        if (++pool->finished == pool->participants) {
+            pthread_cond_broadcast(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    pool_worker_release(w);
+    return NULL;
+}
+
+/**
+ * @brief create a pool of pinned workers
+ * @param[out] pool receives the pool, set to NULL on failure
+ * @param[in] threads number of workers, 0 for one per online CPU
+ * @return AES_OK or an AES_ERR_* code
+ * @note workers beyond the number of online CPUs are not pinned; a worker
+ * whose key replica cannot be allocated leaves its tasks to the others, and
+ * to the caller of aes_pool_run if none has one
+ */
+aes_status_t aes_pool_new(aes_pool_t **pool, uint32_t threads)
+{
+    aes_pool_t *p;
+    uint32_t started = 0;
+
+    if (pool == NULL) {
+        return AES_ERR_PARAM;
+    }
+    *pool = NULL;
+    p = calloc(1, sizeof(aes_pool_t));
+    if (p == NULL) {
+        return AES_ERR_NOMEM;
+    }
+    aes_pool_topology(&p->topo);
+    threads = (threads != 0) ? threads : ((p->topo.ncpus != 0) ? p->topo.ncpus : 1);
+    /* input and output of a task stay in L2 together */
+    p->chunk = (p->topo.l2_size/2) & ~(size_t)4095;
+    p->chunk = (p->chunk > POOL_MIN_CHUNK) ? p->chunk : POOL_MIN_CHUNK;
+    p->threads = calloc(threads, sizeof(pthread_t));
+    p->workers = calloc(threads, sizeof(aes_pool_worker_t));
+    if ((p->threads == NULL) || (p->workers == NULL) || (pool_worker_alloc(&p->caller, p->chunk) != 0)) {
+        free(p->threads);
+        free(p->workers);
+        free(p);
+        return AES_ERR_NOMEM;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_mutex_init(&p->run_lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+    pthread_cond_init(&p->done, NULL);
+    p->caller.pool = p;
+    p->caller.cpu = -1;
+    for (uint32_t i=0;i<threads;i++) {
+        aes_pool_worker_t *w = &p->workers[started];
+
+        w->pool = p;
+        w->id = started;
+        w->cpu = (i < p->topo.ncpus) ? p->topo.cpu[i] : -1;
+        w->node = (i < p->topo.ncpus) ? p->topo.node[i] : 0;
+        if (pthread_create(&p->threads[started], NULL, pool_thread, w) == 0) {
+            started++;
+        }
+    }
+    p->nworkers = started;
+    /* placement and local allocation are done before the first job */
+    pthread_mutex_lock(&p->lock);
+    while (p->ready < started) {
+        pthread_cond_wait(&p->done, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    *pool = p;
+    return AES_OK;
+}
+
+/**
+ * @brief stop the workers and release the pool
+ * @param[in] pool pointer to the pool, may be NULL
+ */
+void aes_pool_free(aes_pool_t *pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (uint32_t i=0;i<pool->nworkers;i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pool_worker_release(&pool->caller);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->run_lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    free(pool->workers);
+    free(pool);
+}
+
+/**
+ * @brief number of worker threads
+ */
+uint32_t aes_pool_threads(const aes_pool_t *pool)
+{
+    return (pool != NULL) ? pool->nworkers : 0;
+}
+
+/**
+ * @brief task size used by the parallel modes, half of the L2
+ */
+size_t aes_pool_chunk_size(const aes_pool_t *pool)
+{
+    return (pool != NULL) ? pool->chunk : 0;
+}
+
+/**
+ * @brief run fn for every task number on the pool and wait for the end
+ * @param[in] pool pointer to the pool
+ * @param[in] fn task function
+ * @param[in] arg passed to fn
+ * @param[in] ctx key context replicated on each participating worker, may
+ * be NULL
+ * @param[in] ntasks number of tasks
+ * @param[in] max_workers most workers to use, 0 for all
+ * @return AES_OK or AES_ERR_PARAM
+ * @note every task has run on return, on the caller for those the workers
+ * could not take
+ */
+aes_status_t aes_pool_run(aes_pool_t *pool, aes_pool_fn_t fn, void *arg, const aes_ctx_t *ctx,
+                          uint64_t ntasks, uint32_t max_workers)
+{
+    uint32_t participants;
+
+    if ((pool == NULL) || (fn == NULL)) {
+        return AES_ERR_PARAM;
+    }
+    if (ntasks == 0) {
+        return AES_OK;
+    }
+    participants = ((max_workers != 0) && (max_workers < pool->nworkers)) ? max_workers : pool->nworkers;
+    participants = (ntasks < participants) ? (uint32_t)ntasks : participants;
+    pthread_mutex_lock(&pool->run_lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->ctx = ctx;
+    pool->ntasks = ntasks;
+    pool->next = 0;
+    if (participants <= 1) {
+        pool_tasks(pool, &pool->caller);
+    } else {
+        pthread_mutex_lock(&pool->lock);
+        pool->participants = participants;
+        pool->finished = 0;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->wake);
+        while (pool->finished < participants) {
+            pthread_cond_wait(&pool->done, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+        /* tasks left by participants without a key replica */
+        if (__atomic_load_n(&pool->next, __ATOMIC_RELAXED) < ntasks) {
+            pool_tasks(pool, &pool->caller);
+        }
+    }
+    pthread_mutex_unlock(&pool->run_lock);
+    return AES_OK;
+}
+
+/**
+ * @brief make the key replica allocation of workers started from now on
+ * fail, or stop doing so
+ * @param[in] fail non-zero to fail
+ * @note self-test only, for the path where the caller runs the tasks
+ */
+void aes_pool_fail_workers(uint32_t fail)
+{
+    __atomic_store_n(&pool_fail_workers, fail, __ATOMIC_RELAXED);
+}
+
+static void pool_default_init(void)
+{
+    aes_pool_new(&pool_default, 0);
+}
+
+/**
+ * @brief process-wide pool with one worker per online CPU
+ * @return the pool, NULL if it could not be created
+ * @note created on first use and kept for the life of the process
+ */
+aes_pool_t *aes_pool_default(void)
+{
+    pthread_once(&pool_default_once, pool_default_init);
+    return pool_default;
+}
+
+/* parallel CTR job */
+typedef struct pool_ctr_job_s {
+    uint8_t counter[AES_BLOCK_SIZE];
+    uint8_t *out;
+    const uint8_t *in;
+    size_t len;
+    size_t chunk;
+} pool_ctr_job_t;
+
+/**
+ * @brief add to a 128-bit big-endian counter
+ */
+static void pool_ctr_add(uint8_t counter[AES_BLOCK_SIZE], uint64_t n)
+{
+    for (int32_t i=AES_BLOCK_SIZE-1;(i>=0)&&(n!=0);i--) {
+        uint64_t sum = counter[i] + (n & 0xff);
+
+        counter[i] = (uint8_t)sum;
+        n = (n >> 8) + (sum >> 8);
+    }
+}
+
+static void pool_ctr_task(void *arg, uint64_t task, aes_pool_worker_t *w)
+{
+    pool_ctr_job_t *job = arg;
+    size_t off = (size_t)task*job->chunk;
+    size_t n = (job->len - off < job->chunk) ? job->len - off : job->chunk;
+    uint8_t counter[AES_BLOCK_SIZE];
+
+    memcpy(counter, job->counter, sizeof(counter));
+    pool_ctr_add(counter, off/AES_BLOCK_SIZE);
+    aes_ctr_crypt(w->ctx, counter, job->out + off, job->in + off, n);
+}
+
+/**
+ * @brief cipher or decipher in CTR mode on the workers of a pool
+ * @param[in] pool pointer to the pool, NULL for the process-wide pool
+ * @param[in] ctx pointer to the key context
+ * @param[in,out] counter 128-bit big-endian counter block, advanced as by
+ * aes_ctr_crypt
+ * @param[out] out output buffer, may be equal to in
+ * @param[in] in input buffer
+ * @param[in] len number of bytes
+ * @return AES_OK or an AES_ERR_* code
+ * @note tasks are aes_pool_chunk_size bytes; each worker ciphers with its
+ * node-local copy of the key schedule
+ */
+aes_status_t aes_ctr_crypt_pool(aes_pool_t *pool, const aes_ctx_t *ctx,
+                                uint8_t counter[AES_LIB_BLOCK_SIZE],
+                                uint8_t *out, const uint8_t *in, size_t len)
+{
+    pool_ctr_job_t job;
+    aes_status_t status;
+
+    if ((ctx == NULL) || (counter == NULL) || ((len != 0) && ((out == NULL) || (in == NULL)))) {
+        return AES_ERR_PARAM;
+    }
+    pool = (pool != NULL) ? pool : aes_pool_default();
+    if (pool == NULL) {
+        return aes_ctr_crypt(ctx, counter, out, in, len);
+    }
+    memcpy(job.counter, counter, sizeof(job.counter));
+    job.out = out;
+    job.in = in;
+    job.len = len;
+    job.chunk = pool->chunk;
+    status = aes_pool_run(pool, pool_ctr_task, &job, ctx, (len + job.chunk - 1)/job.chunk, 0);
+    if (status == AES_OK) {
+        pool_ctr_add(counter, (len + AES_BLOCK_SIZE - 1)/AES_BLOCK_SIZE);
+    }
+    aes_memzero(&job, sizeof(job));
+    return status;
+}
+
+#undef AES_POOL_C
@@ -0,0 +1,488 @@
+/**
+ * @file aes_replay.c
+ * @brief workload-replay benchmark: traces, synthetic workloads, replay
+ *
+ * Every record is timed from the key lookup to the end of the mode call, so
+ * a key cache miss (context creation and key expansion) is charged to the
+ * request that caused it, as it would be in a server. The cache is
+ * direct-mapped on the key id: constant-time lookups, and the miss rate
+ * under a skewed key distribution is what the size of the cache buys.
+ * Data buffers are allocated and touched once, before the clock starts.
+*/
+
+#define AES_REPLAY_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_stats.h"
+#include "aes_lib.h"
+#include "aes_replay.h"
+
+/* records allocated at a time by the trace reader */
+#define REPLAY_GROW     4096
+
+static const char *replay_mode_name[AES_REPLAY_MODES] = {
+    "ecb", "cbc", "ctr", "gcm", "cmac"
+};
+static const char *replay_op_name[2] = {
+    "enc", "dec"
+};
+
+/**
+ * @brief splitmix64 step, the generator of the synthetic workloads and keys
+ * @param[in,out] state generator state
+ * @return next 64-bit value
+ */
+static uint64_t replay_next(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15);
+
+    z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27))*0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+/* uniform in (0, 1] */
+static double replay_uniform(uint64_t *state)
+{
+    return ((double)(replay_next(state) >> 11) + 1.0)/9007199254740992.0;
+}
+
+/**
+ * @brief fill the default synthetic workload: 100k records over 1000 keys
+ * with Zipf(1) popularity, Pareto(1.1) sizes from 64 bytes to 64 KiB, every
+ * mode, half decrypt
+ * @param[out] synth distribution parameters
+ */
+void aes_replay_synth_default(aes_replay_synth_t *synth)
+{
+    synth->records = 100000;
+    synth->keys = 1000;
+    synth->key_skew = 1.0;
+    synth->min_size = 64;
+    synth->max_size = 65536;
+    synth->size_alpha = 1.1;
+    synth->modes = (1u << AES_REPLAY_MODES) - 1;
+    synth->decrypt_pct = 50;
+    synth->seed = 1;
+}
+
+/**
+ * @brief draw a synthetic workload
+ * @param[in] synth distribution parameters
+ * @param[out] recs receives the records, release with free()
+ * @param[out] n receives the number of records
+ * @return AES_OK, AES_ERR_PARAM or AES_ERR_NOMEM
+ */
+aes_status_t aes_replay_synth(const aes_replay_synth_t *synth, aes_replay_rec_t **recs, size_t *n)
+{
+    uint32_t modes[AES_REPLAY_MODES];
+    uint32_t nmodes = 0;
+    uint64_t state;
+    double *cdf;
+    double sum = 0.0;
+
+    if ((synth == NULL) || (recs == NULL) || (n == NULL) || (synth->keys == 0) ||
+        (synth->min_size > synth->max_size) || (synth->max_size > AES_REPLAY_MAX_SIZE) ||
+        (synth->size_alpha <= 0.0) || (synth->decrypt_pct > 100)) {
+        return AES_ERR_PARAM;
+    }
+    for (uint32_t m=0;m<AES_REPLAY_MODES;m++) {
+        if (synth->modes & (1u << m)) {
+            modes[nmodes++] = m;
+        }
+    }
+    if (nmodes == 0) {
+        return AES_ERR_PARAM;
+    }
+    *recs = malloc((synth->records != 0 ? synth->records : 1)*sizeof(aes_replay_rec_t));
+    cdf = malloc(synth->keys*sizeof(double));
+    if ((*recs == NULL) || (cdf == NULL)) {
+        free(*recs);
+        free(cdf);
+        *recs = NULL;
+        return AES_ERR_NOMEM;
+    }
+    /* key id k has weight 1/(k+1)^skew */
+    for (uint32_t k=0;k<synth->keys;k++) {
+        sum += pow((double)k + 1.0, -synth->key_skew);
+        cdf[k] = sum;
+    }
+    state = synth->seed;
+    for (size_t i=0;i<synth->records;i++) {
+        aes_replay_rec_t *r = &(*recs)[i];
+        double u = replay_uniform(&state)*sum;
+        double size = (double)synth->min_size*pow(replay_uniform(&state), -1.0/synth->size_alpha);
+        uint32_t lo = 0, hi = synth->keys - 1;
+
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo)/2;
+
+            if (cdf[mid] < u) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        r->key_id = lo;
+        r->size = (size < (double)synth->max_size) ? (uint32_t)size : synth->max_size;
+        r->mode = (uint8_t)modes[replay_next(&state) % nmodes];
+        r->op = ((replay_next(&state) % 100) < synth->decrypt_pct) ? AES_REPLAY_DECRYPT : AES_REPLAY_ENCRYPT;
+    }
+    free(cdf);
+    *n = synth->records;
+    return AES_OK;
+}
+
+/**
+ * @brief parse a mode or operation name
+ * @param[in] word name to look up
+ * @param[in] names table of names
+ * @param[in] count number of names
+ * @return index, -1 if unknown
+ */
+static int32_t replay_lookup(const char *word, const char *const *names, uint32_t count)
+{
+    for (uint32_t i=0;i<count;i++) {
+        if (strcmp(word, names[i]) == 0) {
+            return (int32_t)i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief read a trace file
+ * @param[in] path trace file
+ * @param[out] recs receives the records, release with free()
+ * @param[out] n receives the number of records
+ * @return AES_OK, AES_ERR_PARAM on a malformed line (reported on stderr),
+ * AES_ERR_IO or AES_ERR_NOMEM
+ */
+aes_status_t aes_replay_load(const char *path, aes_replay_rec_t **recs, size_t *n)
+{
+    char line[256];
+    size_t cap = 0, count = 0, lineno = 0;
+    aes_status_t status = AES_OK;
+    FILE *fp;
+
+    if ((path == NULL) || (recs == NULL) || (n == NULL)) {
+        return AES_ERR_PARAM;
+    }
+    *recs = NULL;
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        return AES_ERR_IO;
+    }
+    while ((status == AES_OK) && (fgets(line, sizeof(line), fp) != NULL)) {
+        char mode[16], op[16];
+        unsigned long size, key_id;
+        int32_t m, o;
+        int fields;
+
+        lineno++;
+        fields = sscanf(line, "%lu %lu %15s %15s", &size, &key_id, mode, op);
+        if ((fields <= 0) || (line[strspn(line, " \t")] == '#')) {
+            continue;
+        }
+        m = (fields == 4) ? replay_lookup(mode, replay_mode_name, AES_REPLAY_MODES) : -1;
+        o = (fields == 4) ? replay_lookup(op, replay_op_name, 2) : -1;
+        if ((m < 0) || (o < 0) || (size > AES_REPLAY_MAX_SIZE) || (key_id > UINT32_MAX)) {
+            fprintf(stderr, "[ERROR] %s:%lu: expected <size> <key id> <mode> <enc|dec>\n",
+                    path, (unsigned long)lineno);
+            status = AES_ERR_PARAM;
+            break;
+        }
+        if (count == cap) {
+            aes_replay_rec_t *grown = realloc(*recs, (cap + REPLAY_GROW)*sizeof(aes_replay_rec_t));
+
+            if (grown == NULL) {
+                status = AES_ERR_NOMEM;
+                break;
+            }
+            *recs = grown;
+            cap += REPLAY_GROW;
+        }
+        (*recs)[count].size = (uint32_t)size;
+        (*recs)[count].key_id = (uint32_t)key_id;
+        (*recs)[count].mode = (uint8_t)m;
+        (*recs)[count].op = (uint8_t)o;
+        count++;
+    }
+    if ((status == AES_OK) && ferror(fp)) {
+        status = AES_ERR_IO;
+    }
+    fclose(fp);
+    if (status != AES_OK) {
+        free(*recs);
+        *recs = NULL;
+        return status;
+    }
+    *n = count;
+    return AES_OK;
+}
+
+/**
+ * @brief write records as a trace file
+ * @param[in] path trace file, replaced
+ * @param[in] recs records
+ * @param[in] n number of records
+ * @return AES_OK, AES_ERR_PARAM or AES_ERR_IO
+ */
+aes_status_t aes_replay_save(const char *path, const aes_replay_rec_t *recs, size_t n)
+{
+    FILE *fp;
+    int32_t fail;
+
+    if ((path == NULL) || ((recs == NULL) && (n != 0))) {
+        return AES_ERR_PARAM;
+    }
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+        return AES_ERR_IO;
+    }
+    fprintf(fp, "# size key_id mode op\n");
+    for (size_t i=0;i<n;i++) {
+        if ((recs[i].mode >= AES_REPLAY_MODES) || (recs[i].op > AES_REPLAY_DECRYPT)) {
+            continue;
+        }
+        fprintf(fp, "%lu %lu %s %s\n", (unsigned long)recs[i].size, (unsigned long)recs[i].key_id,
+                replay_mode_name[recs[i].mode], replay_op_name[recs[i].op]);
+    }
+    fail = ferror(fp);
+    fail |= fclose(fp);
+    return (fail == 0) ? AES_OK : AES_ERR_IO;
+}
+
+/**
+ * @brief derive the key of a key id
+ * @param[out] key key bytes
+ * @param[in] len key length
+ * @param[in] key_id key id
+ */
+static void replay_key(uint8_t *key, size_t len, uint32_t key_id)
+{
+    uint64_t state = ((uint64_t)key_id << 32) | 0x6b6579;
+
+    for (size_t i=0;i<len;i+=8) {
+        uint64_t v = replay_next(&state);
+
+        memcpy(key + i, &v, (len - i < 8) ? (len - i) : 8);
+    }
+}
+
+/**
+ * @brief run one record
+ * @param[in] ctx key context of the record
+ * @param[in] r record
+ * @param[out] out output buffer
+ * @param[in] in input buffer
+ * @param[in] len message length
+ * @return status of the mode call
+ */
+static aes_status_t replay_one(const aes_ctx_t *ctx, const aes_replay_rec_t *r, uint8_t *out,
+                               const uint8_t *in, size_t len)
+{
+    uint8_t iv[AES_LIB_BLOCK_SIZE];
+    uint8_t tag[AES_GCM_TAG_SIZE];
+    aes_status_t status;
+
+    memset(iv, 0, sizeof(iv));
+    memset(tag, 0, sizeof(tag));
+    switch (r->mode) {
+        case AES_REPLAY_ECB:
+            return (r->op == AES_REPLAY_ENCRYPT) ? aes_ecb_encrypt(ctx, out, in, len) :
+                                                   aes_ecb_decrypt(ctx, out, in, len);
+        case AES_REPLAY_CBC:
+            return (r->op == AES_REPLAY_ENCRYPT) ? aes_cbc_encrypt(ctx, iv, out, in, len) :
+                                                   aes_cbc_decrypt(ctx, iv, out, in, len);
+        case AES_REPLAY_CTR:
+            return aes_ctr_crypt(ctx, iv, out, in, len);
+        case AES_REPLAY_GCM:
+            if (r->op == AES_REPLAY_ENCRYPT) {
+                return aes_gcm_encrypt(ctx, iv, AES_GCM_IV_SIZE, out, tag, in, len, NULL, 0);
+            }
+            /* the trace carries no tags: the full pass runs, the tag is rejected and out cleared */
+            status = aes_gcm_decrypt(ctx, iv, AES_GCM_IV_SIZE, out, in, len, tag, NULL, 0);
+            return (status == AES_ERR_AUTH) ? AES_OK : status;
+        default:
+            return aes_cmac(ctx, tag, in, len);
+    }
+}
+
+static int replay_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief print one row of the report
+ * @param[in] report output stream
+ * @param[in] label row title
+ * @param[in] lat sorted latencies in ns
+ * @param[in] count number of latencies
+ * @param[in] bytes bytes processed by the row
+ */
+static void replay_row(FILE *report, const char *label, const uint64_t *lat, size_t count,
+                       uint64_t bytes)
+{
+    uint64_t busy = 0;
+
+    for (size_t i=0;i<count;i++) {
+        busy += lat[i];
+    }
+    fprintf(report, "%-6s %9lu %10.1f %10.0f %9.2f %9.2f %9.2f %9.2f %10.2f\n", label,
+            (unsigned long)count, (busy != 0) ? (double)bytes*1e3/(double)busy : 0.0,
+            (busy != 0) ? (double)count*1e9/(double)busy : 0.0,
+            (double)lat[count/2]/1e3, (double)lat[count*9/10]/1e3, (double)lat[count*99/100]/1e3,
+            (double)lat[count*999/1000]/1e3, (double)lat[count-1]/1e3);
+}
+
+/**
+ * @brief replay records through the library and report throughput and
+ * latency percentiles, overall and per mode
+ * @param[in] cfg key cache size and key length
+ * @param[in] recs records
+ * @param[in] n number of records
+ * @param[in] report output stream
+ * @return AES_OK, or the first failing status of the setup or a mode call
+ * @note GCM decrypt records are measured as full passes rejected on the
+ * tag; the rejection also clears the output, so they cost one more write
+ * of the message than an accepted decryption and slightly overstate it
+ */
+aes_status_t aes_replay_run(const aes_replay_cfg_t *cfg, const aes_replay_rec_t *recs, size_t n,
+                            FILE *report)
+{
+    uint8_t key[AES256_KEY_SIZE/8];
+    uint64_t bytes[AES_REPLAY_MODES + 1] = {0};
+    size_t count[AES_REPLAY_MODES + 1] = {0};
+    size_t pos[AES_REPLAY_MODES];
+    uint64_t hits = 0, misses = 0, start, elapsed;
+    uint64_t *lat, *sorted;
+    uint32_t *slot_id;
+    aes_ctx_t **slot;
+    uint8_t *in, *out;
+    size_t max = AES_LIB_BLOCK_SIZE;
+    aes_status_t status = AES_OK;
+
+    if ((cfg == NULL) || (report == NULL) || ((recs == NULL) && (n != 0)) || (cfg->key_cache == 0) ||
+        ((cfg->key_length != 16) && (cfg->key_length != 24) && (cfg->key_length != 32))) {
+        return AES_ERR_PARAM;
+    }
+    for (size_t i=0;i<n;i++) {
+        if ((recs[i].mode >= AES_REPLAY_MODES) || (recs[i].op > AES_REPLAY_DECRYPT) ||
+            (recs[i].size > AES_REPLAY_MAX_SIZE)) {
+            return AES_ERR_PARAM;
+        }
+        max = (recs[i].size > max) ? recs[i].size : max;
+    }
+    max = (max + AES_LIB_BLOCK_SIZE - 1) & ~(size_t)(AES_LIB_BLOCK_SIZE - 1);
+    in = malloc(max);
+    out = malloc(max);
+    lat = malloc((n + 1)*sizeof(uint64_t));
+    sorted = malloc((n + 1)*sizeof(uint64_t));
+    slot = calloc(cfg->key_cache, sizeof(aes_ctx_t *));
+    slot_id = calloc(cfg->key_cache, sizeof(uint32_t));
+    if ((in == NULL) || (out == NULL) || (lat == NULL) || (sorted == NULL) || (slot == NULL) ||
+        (slot_id == NULL)) {
+        status = AES_ERR_NOMEM;
+        goto done;
+    }
+    /* first touch outside the measured loop */
+    for (size_t i=0;i<max;i++) {
+        in[i] = (uint8_t)(i*131);
+    }
+    memset(out, 0, max);
+    start = aes_stats_timestamp();
+    for (size_t i=0;i<n;i++) {
+        const aes_replay_rec_t *r = &recs[i];
+        uint32_t s = r->key_id % cfg->key_cache;
+        size_t len = r->size;
+        uint64_t t0 = aes_stats_timestamp();
+
+        if ((slot[s] != NULL) && (slot_id[s] == r->key_id)) {
+            hits++;
+            aes_stats_add_cache(1);
+        } else {
+            misses++;
+            aes_stats_add_cache(0);
+            aes_ctx_free(slot[s]);
+            slot[s] = NULL;
+            replay_key(key, cfg->key_length, r->key_id);
+            status = aes_ctx_new(&slot[s], key, cfg->key_length);
+            if (status != AES_OK) {
+                break;
+            }
+            slot_id[s] = r->key_id;
+        }
+        if ((r->mode == AES_REPLAY_ECB) || (r->mode == AES_REPLAY_CBC)) {
+            len = (len + AES_LIB_BLOCK_SIZE - 1) & ~(size_t)(AES_LIB_BLOCK_SIZE - 1);
+        }
+        status = replay_one(slot[s], r, out, in, len);
+        lat[i] = aes_stats_timestamp() - t0;
+        if (status != AES_OK) {
+            break;
+        }
+        bytes[r->mode] += len;
+        count[r->mode]++;
+    }
+    elapsed = aes_stats_timestamp() - start;
+    aes_memzero(key, sizeof(key));
+    if (status != AES_OK) {
+        goto done;
+    }
+    /* group the latencies by mode, each group sorted, then all of them */
+    pos[0] = 0;
+    for (uint32_t m=1;m<AES_REPLAY_MODES;m++) {
+        pos[m] = pos[m-1] + count[m-1];
+    }
+    for (size_t i=0;i<n;i++) {
+        sorted[pos[recs[i].mode]++] = lat[i];
+    }
+    for (uint32_t m=0;m<AES_REPLAY_MODES;m++) {
+        bytes[AES_REPLAY_MODES] += bytes[m];
+        count[AES_REPLAY_MODES] += count[m];
+    }
+    fprintf(report, "%lu records, %.1f MB, %.3f s wall, key cache %u slots: %lu hits, %lu misses (%.1f%%)\n",
+            (unsigned long)n, (double)bytes[AES_REPLAY_MODES]/1e6, (double)elapsed/1e9,
+            cfg->key_cache, (unsigned long)hits, (unsigned long)misses,
+            (n != 0) ? 100.0*(double)hits/(double)n : 0.0);
+    fprintf(report, "%-6s %9s %10s %10s %9s %9s %9s %9s %10s\n", "mode", "records", "MB/s", "ops/s",
+            "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+    for (uint32_t m=0;m<AES_REPLAY_MODES;m++) {
+        uint64_t *group = sorted + pos[m] - count[m];
+
+        if (count[m] != 0) {
+            qsort(group, count[m], sizeof(uint64_t), replay_cmp);
+            replay_row(report, replay_mode_name[m], group, count[m], bytes[m]);
+        }
+    }
+    if (n != 0) {
+        qsort(lat, n, sizeof(uint64_t), replay_cmp);
+        replay_row(report, "all", lat, n, bytes[AES_REPLAY_MODES]);
+    }
+done:
+    if (slot != NULL) {
+        for (uint32_t s=0;s<cfg->key_cache;s++) {
+            aes_ctx_free(slot[s]);
+        }
+    }
+    free(slot);
+    free(slot_id);
+    free(in);
+    free(out);
+    free(lat);
+    free(sorted);
+    return status;
+}
+
+#undef AES_REPLAY_C
@@ -0,0 +1,410 @@
+/**
+ * @file aes_stats.c
+ * @brief AES performance counters
+ *
+ * Every thread owns an aes_stats_thread_t record allocated on its first
+ * update. The owner is the only writer of its record, so increments are plain
+ * relaxed stores (no lock prefix); readers walk the list of records under a
+ * mutex and sum them. Records of terminated threads are folded into a retired
+ * total so their counts are not lost.
+*/
+
+#define AES_STATS_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "aes.h"
+#include "aes_stats.h"
+
+/* owner-only increment, readable from other threads without tearing */
+#define STATS_ADD(field, n) \
+    __atomic_store_n(&(field), (field) + (n), __ATOMIC_RELAXED)
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stats_key;
+static aes_stats_thread_t *stats_list;
+static aes_stats_t stats_retired;
+static __thread aes_stats_thread_t *stats_self;
+/* set once the record of the thread has been retired by its destructor */
+static __thread uint32_t stats_exited;
+
+static const char *stats_backend_name[AES_STATS_BACKEND_MAX] = {
+    "ref", "ttable", "aesni"
+};
+static const char *stats_mode_name[AES_STATS_MODE_MAX] = {
+    "block", "ecb", "cbc", "ctr", "cmac", "drbg", "gcmsiv", "kw", "gcm", "ccm", "ocb", "ff1"
+};
+static const char *stats_key_name[AES_STATS_KEY_MAX] = {
+    "128", "192", "256"
+};
+static const char *stats_dir_name[AES_STATS_DIR_MAX] = {
+    "encrypt", "decrypt"
+};
+
+/**
+ * @brief add every counter of src to dst
+ * @param[in,out] dst accumulated counters
+ * @param[in] src counters to add, read with relaxed loads
+ */
+static void stats_accumulate(aes_stats_t *dst, aes_stats_t *src)
+{
+    uint64_t *d = (uint64_t *)dst;
+    uint64_t *s = (uint64_t *)src;
+    for (size_t i=0;i<sizeof(aes_stats_t)/sizeof(uint64_t);i++) {
+        d[i] += __atomic_load_n(&s[i], __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief thread exit destructor: fold the record into the retired total
+ * @param[in] arg record of the terminating thread
+ */
+static void stats_thread_exit(void *arg)
+{
+    aes_stats_thread_t *rec = arg;
+    aes_stats_thread_t **it;
+
+    pthread_mutex_lock(&stats_lock);
+    for (it=&stats_list;*it!=NULL;it=&(*it)->next) {
+        if (*it == rec) {
+            *it = rec->next;
+            break;
+        }
+    }
+    stats_accumulate(&stats_retired, &rec->counters);
+    pthread_mutex_unlock(&stats_lock);
+    /* later destructors of this thread must not reach the freed record */
+    stats_self = NULL;
+    stats_exited = 1;
+    free(rec);
+}
+
+static void stats_init(void)
+{
+    pthread_key_create(&stats_key, stats_thread_exit);
+}
+
+/**
+ * @brief return the record of the calling thread, creating it on first use
+ * @return pointer to the thread record, NULL if it could not be allocated or
+ * the thread is past its stats destructor
+ * @note updates made after the destructor, e.g. from another TLS destructor,
+ * are dropped rather than registering a record nothing would free
+ */
+static aes_stats_thread_t *stats_get(void)
+{
+    aes_stats_thread_t *rec = stats_self;
+
+    if ((rec != NULL) || stats_exited) {
+        return rec;
+    }
+    pthread_once(&stats_once, stats_init);
+    rec = aligned_alloc(64, sizeof(aes_stats_thread_t));
+    if (rec == NULL) {
+        return NULL;
+    }
+    memset(rec, 0, sizeof(aes_stats_thread_t));
+    pthread_mutex_lock(&stats_lock);
+    rec->next = stats_list;
+    stats_list = rec;
+    pthread_mutex_unlock(&stats_lock);
+    pthread_setspecific(stats_key, rec);
+    stats_self = rec;
+    return rec;
+}
+
+/**
+ * @brief convert a key length in bytes to a key size index
+ * @param[in] key_length key length in bytes
+ * @return AES_STATS_KEY_xxx index
+ */
+static uint32_t stats_key_index(uint32_t key_length)
+{
+    switch (key_length) {
+        case AES192_KEY_SIZE/8:
+            return AES_STATS_KEY_192;
+        case AES256_KEY_SIZE/8:
+            return AES_STATS_KEY_256;
+        default:
+            return AES_STATS_KEY_128;
+    }
+}
+
+/**
+ * @brief count blocks processed by one call
+ * @param[in] backend AES_STATS_BACKEND_xxx
+ * @param[in] mode AES_STATS_MODE_xxx
+ * @param[in] key_length key length in bytes
+ * @param[in] dir AES_STATS_DIR_ENC or AES_STATS_DIR_DEC
+ * @param[in] nblocks number of blocks processed by the call
+ */
+void aes_stats_add_blocks(uint32_t backend, uint32_t mode, uint32_t key_length,
+                          uint32_t dir, uint64_t nblocks)
+{
+    aes_stats_thread_t *rec = stats_get();
+    uint32_t k = stats_key_index(key_length);
+    uint32_t bucket = 0;
+
+    if (rec == NULL) {
+        return;
+    }
+    STATS_ADD(rec->counters.blocks[backend][mode][k][dir], nblocks);
+    STATS_ADD(rec->counters.calls[backend][mode][k][dir], 1);
+    if (nblocks > 1) {
+        bucket = 63 - (uint32_t)__builtin_clzll(nblocks);
+        if (bucket >= AES_STATS_BATCH_BUCKETS) {
+            bucket = AES_STATS_BATCH_BUCKETS-1;
+        }
+    }
+    STATS_ADD(rec->counters.batch_hist[bucket], 1);
+}
+
+/**
+ * @brief accumulate time spent in a backend/mode
+ * @param[in] backend AES_STATS_BACKEND_xxx
+ * @param[in] mode AES_STATS_MODE_xxx
+ * @param[in] nsec elapsed time in ns
+ */
+void aes_stats_add_time(uint32_t backend, uint32_t mode, uint64_t nsec)
+{
+    aes_stats_thread_t *rec = stats_get();
+
+    if (rec != NULL) {
+        STATS_ADD(rec->counters.time_nsec[backend][mode], nsec);
+    }
+}
+
+/**
+ * @brief count one key expansion
+ * @param[in] key_length key length in bytes
+ */
+void aes_stats_add_keyexpansion(uint32_t key_length)
+{
+    aes_stats_thread_t *rec = stats_get();
+
+    if (rec != NULL) {
+        STATS_ADD(rec->counters.key_expansions[stats_key_index(key_length)], 1);
+    }
+}
+
+/**
+ * @brief count one key cache lookup
+ * @param[in] hit 1 if the key context was found in cache, 0 otherwise
+ */
+void aes_stats_add_cache(uint32_t hit)
+{
+    aes_stats_thread_t *rec = stats_get();
+
+    if (rec == NULL) {
+        return;
+    }
+    if (hit) {
+        STATS_ADD(rec->counters.cache_hits, 1);
+    } else {
+        STATS_ADD(rec->counters.cache_misses, 1);
+    }
+}
+
+/**
+ * @brief sum the counters of all threads
+ * @param[out] snapshot pointer to the structure receiving the totals
+ */
+void aes_stats_snapshot(aes_stats_t *snapshot)
+{
+    aes_stats_thread_t *rec;
+
+    memset(snapshot, 0, sizeof(aes_stats_t));
+    pthread_mutex_lock(&stats_lock);
+    memcpy(snapshot, &stats_retired, sizeof(aes_stats_t));
+    for (rec=stats_list;rec!=NULL;rec=rec->next) {
+        stats_accumulate(snapshot, &rec->counters);
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
+
+/**
+ * @brief clear the counters of all threads
+ * @note counts made concurrently with the reset may be lost
+ */
+void aes_stats_reset(void)
+{
+    aes_stats_thread_t *rec;
+    uint64_t *p;
+
+    pthread_mutex_lock(&stats_lock);
+    memset(&stats_retired, 0, sizeof(aes_stats_t));
+    for (rec=stats_list;rec!=NULL;rec=rec->next) {
+        p = (uint64_t *)&rec->counters;
+        for (size_t i=0;i<sizeof(aes_stats_t)/sizeof(uint64_t);i++) {
+            __atomic_store_n(&p[i], 0, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
+
+/**
+ * @brief print the HELP and TYPE lines opening a Prometheus metric family
+ * @param[in] fp output stream
+ * @param[in] name metric name
+ * @param[in] help description
+ * @param[in] type metric type
+ */
+static void stats_prom_header(FILE *fp, const char *name, const char *help, const char *type)
+{
+    fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/**
+ * @brief print one sample per backend, mode, key size and direction used
+ * @param[in] fp output stream
+ * @param[in] name metric name
+ * @param[in] s snapshot, its calls select the label sets printed
+ * @param[in] v counters to print, s->blocks or s->calls
+ */
+static void stats_prom_counts(FILE *fp, const char *name, const aes_stats_t *s,
+                              const uint64_t (*v)[AES_STATS_MODE_MAX][AES_STATS_KEY_MAX][AES_STATS_DIR_MAX])
+{
+    for (uint32_t b=0;b<AES_STATS_BACKEND_MAX;b++) {
+        for (uint32_t m=0;m<AES_STATS_MODE_MAX;m++) {
+            for (uint32_t k=0;k<AES_STATS_KEY_MAX;k++) {
+                for (uint32_t d=0;d<AES_STATS_DIR_MAX;d++) {
+                    if (s->calls[b][m][k][d] == 0) {
+                        continue;
+                    }
+                    fprintf(fp, "%s{backend=\"%s\",mode=\"%s\",key=\"%s\",op=\"%s\"} %lu\n",
+                            name, stats_backend_name[b], stats_mode_name[m], stats_key_name[k],
+                            stats_dir_name[d], (unsigned long)v[b][m][k][d]);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief print a snapshot of the counters
+ * @param[in] fp output stream
+ * @param[in] format AES_STATS_FMT_JSON or AES_STATS_FMT_PROMETHEUS
+ * @return 0 on success, -1 on bad parameter
+ */
+int32_t aes_stats_export(FILE *fp, uint32_t format)
+{
+    aes_stats_t s;
+    uint32_t first = 1;
+
+    if ((fp == NULL) || (format > AES_STATS_FMT_PROMETHEUS)) {
+        return -1;
+    }
+    aes_stats_snapshot(&s);
+
+    if (format == AES_STATS_FMT_PROMETHEUS) {
+        /* one contiguous block per metric family, each with its own header */
+        stats_prom_header(fp, "aes_blocks_total", "Blocks processed.", "counter");
+        stats_prom_counts(fp, "aes_blocks_total", &s, s.blocks);
+        stats_prom_header(fp, "aes_calls_total", "API calls.", "counter");
+        stats_prom_counts(fp, "aes_calls_total", &s, s.calls);
+        stats_prom_header(fp, "aes_time_nanoseconds_total", "Time spent in the engines.", "counter");
+        for (uint32_t b=0;b<AES_STATS_BACKEND_MAX;b++) {
+            for (uint32_t m=0;m<AES_STATS_MODE_MAX;m++) {
+                if (s.time_nsec[b][m] != 0) {
+                    fprintf(fp, "aes_time_nanoseconds_total{backend=\"%s\",mode=\"%s\"} %lu\n",
+                            stats_backend_name[b], stats_mode_name[m],
+                            (unsigned long)s.time_nsec[b][m]);
+                }
+            }
+        }
+        stats_prom_header(fp, "aes_key_expansions_total", "Key expansions.", "counter");
+        for (uint32_t k=0;k<AES_STATS_KEY_MAX;k++) {
+            fprintf(fp, "aes_key_expansions_total{key=\"%s\"} %lu\n",
+                    stats_key_name[k], (unsigned long)s.key_expansions[k]);
+        }
+        stats_prom_header(fp, "aes_key_cache_total", "Key cache lookups.", "counter");
+        fprintf(fp, "aes_key_cache_total{result=\"hit\"} %lu\n", (unsigned long)s.cache_hits);
+        fprintf(fp, "aes_key_cache_total{result=\"miss\"} %lu\n", (unsigned long)s.cache_misses);
+        stats_prom_header(fp, "aes_batch_blocks", "Blocks per call.", "histogram");
+        {
+            uint64_t cumul = 0;
+            uint64_t sum = 0;
+            for (uint32_t b=0;b<AES_STATS_BACKEND_MAX;b++) {
+                for (uint32_t m=0;m<AES_STATS_MODE_MAX;m++) {
+                    for (uint32_t k=0;k<AES_STATS_KEY_MAX;k++) {
+                        sum += s.blocks[b][m][k][AES_STATS_DIR_ENC] + s.blocks[b][m][k][AES_STATS_DIR_DEC];
+                    }
+                }
+            }
+            for (uint32_t i=0;i<AES_STATS_BATCH_BUCKETS;i++) {
+                cumul += s.batch_hist[i];
+                if (i < AES_STATS_BATCH_BUCKETS-1) {
+                    fprintf(fp, "aes_batch_blocks_bucket{le=\"%lu\"} %lu\n",
+                            (unsigned long)((2ul << i) - 1), (unsigned long)cumul);
+                }
+            }
+            fprintf(fp, "aes_batch_blocks_bucket{le=\"+Inf\"} %lu\n", (unsigned long)cumul);
+            fprintf(fp, "aes_batch_blocks_sum %lu\n", (unsigned long)sum);
+            fprintf(fp, "aes_batch_blocks_count %lu\n", (unsigned long)cumul);
+        }
+        return 0;
+    }
+
+    fprintf(fp, "{\n  \"blocks\": [");
+    for (uint32_t b=0;b<AES_STATS_BACKEND_MAX;b++) {
+        for (uint32_t m=0;m<AES_STATS_MODE_MAX;m++) {
+            for (uint32_t k=0;k<AES_STATS_KEY_MAX;k++) {
+                for (uint32_t d=0;d<AES_STATS_DIR_MAX;d++) {
+                    if (s.calls[b][m][k][d] == 0) {
+                        continue;
+                    }
+                    fprintf(fp, "%s\n    {\"backend\": \"%s\", \"mode\": \"%s\", \"key\": %s, "
+                            "\"op\": \"%s\", \"blocks\": %lu, \"calls\": %lu}",
+                            first ? "" : ",", stats_backend_name[b], stats_mode_name[m],
+                            stats_key_name[k], stats_dir_name[d],
+                            (unsigned long)s.blocks[b][m][k][d], (unsigned long)s.calls[b][m][k][d]);
+                    first = 0;
+                }
+            }
+        }
+    }
+    fprintf(fp, "\n  ],\n  \"time_nsec\": [");
+    first = 1;
+    for (uint32_t b=0;b<AES_STATS_BACKEND_MAX;b++) {
+        for (uint32_t m=0;m<AES_STATS_MODE_MAX;m++) {
+            if (s.time_nsec[b][m] == 0) {
+                continue;
+            }
+            fprintf(fp, "%s\n    {\"backend\": \"%s\", \"mode\": \"%s\", \"nsec\": %lu}",
+                    first ? "" : ",", stats_backend_name[b], stats_mode_name[m],
+                    (unsigned long)s.time_nsec[b][m]);
+            first = 0;
+        }
+    }
+    fprintf(fp, "\n  ],\n  \"key_expansions\": {\"128\": %lu, \"192\": %lu, \"256\": %lu},\n",
+            (unsigned long)s.key_expansions[AES_STATS_KEY_128],
+            (unsigned long)s.key_expansions[AES_STATS_KEY_192],
+            (unsigned long)s.key_expansions[AES_STATS_KEY_256]);
+    fprintf(fp, "  \"key_cache\": {\"hits\": %lu, \"misses\": %lu},\n",
+            (unsigned long)s.cache_hits, (unsigned long)s.cache_misses);
+    fprintf(fp, "  \"batch_blocks_log2_hist\": [");
+    for (uint32_t i=0;i<AES_STATS_BATCH_BUCKETS;i++) {
+        fprintf(fp, "%s%lu", (i == 0) ? "" : ", ", (unsigned long)s.batch_hist[i]);
+    }
+    fprintf(fp, "]\n}\n");
+    return 0;
+}
+
+/**
+ * @brief monotonic timestamp used by the optional timing counters
+ * @return timestamp value in ns
+ */
+uint64_t aes_stats_timestamp(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * (uint64_t)1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+#undef AES_STATS_C
@@ -0,0 +1,292 @@
+/**
+ * @file aes_stream.c
+ * @brief libaes streaming interface, init/update/final over any chunk sizes
+ *
+ * A stream keeps at most one partial block. Each update first completes
+ * that block, then hands the block-aligned middle of the caller's buffer
+ * straight to the one-shot mode functions, and keeps the tail. Streams are
+ * allocated once by aes_stream_new; init, update and final never allocate.
+*/
+
+#define AES_STREAM_C
+#define AES_LIB_PRIVATE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "aes.h"
+#include "aes_arena.h"
+#include "aes_engine.h"
+#include "aes_stats.h"
+#include "aes_lib.h"
+
+/* minimum number of streams mapped at a time by the stream arena */
+#define STREAM_CHUNK    64
+
+/* stream states hold chaining values and keystream, same arena policy as contexts */
+static aes_arena_t stream_arena;
+static pthread_once_t stream_once = PTHREAD_ONCE_INIT;
+
+static void stream_init_arena(void)
+{
+    aes_arena_init(&stream_arena, sizeof(aes_stream_t), STREAM_CHUNK, AES_ARENA_SECURE);
+}
+
+/**
+ * @brief cipher whole blocks with the mode of the stream
+ * @param[in,out] st pointer to the stream
+ * @param[out] out output buffer
+ * @param[in] in input buffer
+ * @param[in] len number of bytes, multiple of 16
+ */
+static void stream_blocks(aes_stream_t *st, uint8_t *out, const uint8_t *in, size_t len)
+{
+    const aes_ctx_t *ctx = st->ctx;
+
+    switch (st->mode) {
+        case AES_STREAM_ECB:
+            if (st->dir == AES_STREAM_ENCRYPT) {
+                aes_ecb_encrypt(ctx, out, in, len);
+            } else {
+                aes_ecb_decrypt(ctx, out, in, len);
+            }
+            break;
+        case AES_STREAM_CBC:
+            if (st->dir == AES_STREAM_ENCRYPT) {
+                aes_cbc_encrypt(ctx, st->iv, out, in, len);
+            } else {
+                aes_cbc_decrypt(ctx, st->iv, out, in, len);
+            }
+            break;
+        case AES_STREAM_CTR:
+            aes_ctr_crypt(ctx, st->iv, out, in, len);
+            break;
+        case AES_STREAM_CMAC:
+            for (size_t off=0;off<len;off+=AES_BLOCK_SIZE) {
+                aes_xor_blocks(st->iv, st->iv, in + off, AES_BLOCK_SIZE);
+                ctx->engine->encrypt(&ctx->sched, st->iv, st->iv, 1);
+            }
+            aes_stats_add_blocks(ctx->engine->id, AES_STATS_MODE_CMAC, ctx->sched.length,
+                                 AES_STATS_DIR_ENC, len/AES_BLOCK_SIZE);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief CTR update: keystream left in the buffer, whole blocks, new tail
+ * @param[in,out] st pointer to the stream
+ * @param[out] out len bytes
+ * @param[in] in input buffer
+ * @param[in] len number of bytes
+ */
+static void stream_ctr(aes_stream_t *st, uint8_t *out, const uint8_t *in, size_t len)
+{
+    const aes_ctx_t *ctx = st->ctx;
+    size_t full;
+
+    if (st->buf_len != 0) {
+        size_t use = AES_BLOCK_SIZE - st->buf_len;
+
+        use = (len < use) ? len : use;
+        aes_xor_blocks(out, in, st->buf + st->buf_len, use);
+        st->buf_len = (st->buf_len + use) % AES_BLOCK_SIZE;
+        out += use;
+        in += use;
+        len -= use;
+    }
+    full = len & ~(size_t)(AES_BLOCK_SIZE - 1);
+    if (full != 0) {
+        aes_ctr_crypt(ctx, st->iv, out, in, full);
+    }
+    if (len != full) {
+        aes_ctr_blocks(st->buf, st->iv, 1);
+        ctx->engine->encrypt(&ctx->sched, st->buf, st->buf, 1);
+        aes_stats_add_blocks(ctx->engine->id, AES_STATS_MODE_CTR, ctx->sched.length,
+                             AES_STATS_DIR_ENC, 1);
+        aes_xor_blocks(out + full, in + full, st->buf, len - full);
+        st->buf_len = len - full;
+    }
+}
+
+/**
+ * @brief create a stream bound to a key context
+ * @param[out] st receives the stream, set to NULL on failure
+ * @param[in] ctx pointer to the key context, must outlive the stream
+ * @param[in] mode AES_STREAM_ECB, _CBC, _CTR or _CMAC
+ * @param[in] dir AES_STREAM_ENCRYPT or AES_STREAM_DECRYPT, CTR and CMAC
+ * ignore it
+ * @return AES_OK or an AES_ERR_* code
+ * @note the only allocation of the stream, call aes_stream_init to start a
+ * message
+ */
+aes_status_t aes_stream_new(aes_stream_t **st, const aes_ctx_t *ctx, uint32_t mode, uint32_t dir)
+{
+    aes_stream_t *new_st;
+
+    if (st == NULL) {
+        return AES_ERR_PARAM;
+    }
+    *st = NULL;
+    if ((ctx == NULL) || (mode > AES_STREAM_CMAC) || (dir > AES_STREAM_DECRYPT)) {
+        return AES_ERR_PARAM;
+    }
+    pthread_once(&stream_once, stream_init_arena);
+    new_st = aes_arena_alloc(&stream_arena);
+    if (new_st == NULL) {
+        return AES_ERR_NOMEM;
+    }
+    new_st->ctx = ctx;
+    new_st->mode = mode;
+    new_st->dir = dir;
+    *st = new_st;
+    return AES_OK;
+}
+
+/**
+ * @brief clear and release a stream
+ * @param[in] st pointer to the stream, may be NULL
+ */
+void aes_stream_free(aes_stream_t *st)
+{
+    if (st == NULL) {
+        return;
+    }
+    aes_arena_free(&stream_arena, st);
+}
+
+/**
+ * @brief start a message, dropping any state of the previous one
+ * @param[in,out] st pointer to the stream
+ * @param[in] iv CBC initialization vector or CTR 128-bit big-endian
+ * counter, ignored (may be NULL) for ECB and CMAC
+ * @return AES_OK or an AES_ERR_* code
+ */
+aes_status_t aes_stream_init(aes_stream_t *st, const uint8_t iv[AES_LIB_BLOCK_SIZE])
+{
+    if (st == NULL) {
+        return AES_ERR_PARAM;
+    }
+    if ((iv == NULL) && ((st->mode == AES_STREAM_CBC) || (st->mode == AES_STREAM_CTR))) {
+        return AES_ERR_PARAM;
+    }
+    if ((st->mode == AES_STREAM_CBC) || (st->mode == AES_STREAM_CTR)) {
+        memcpy(st->iv, iv, AES_BLOCK_SIZE);
+    } else {
+        memset(st->iv, 0, AES_BLOCK_SIZE);
+    }
+    aes_memzero(st->buf, sizeof(st->buf));
+    st->buf_len = 0;
+    return AES_OK;
+}
+
+/**
+ * @brief process the next chunk of a message
+ * @param[in,out] st pointer to the stream
+ * @param[out] out output buffer, unused by CMAC (may be NULL)
+ * @param[out] out_len receives the number of bytes written: len for CTR,
+ * a multiple of 16 of at most len+15 for ECB/CBC, 0 for CMAC
+ * @param[in] in input chunk, any alignment
+ * @param[in] len chunk length in bytes, any value
+ * @return AES_OK or an AES_ERR_* code
+ * @note CTR may work in place. ECB/CBC may only work in place while no
+ * partial block is pending, i.e. all previous chunks were multiples of 16,
+ * since buffered bytes shift the output against the input.
+ */
+aes_status_t aes_stream_update(aes_stream_t *st, uint8_t *out, size_t *out_len,
+                               const uint8_t *in, size_t len)
+{
+    size_t produced = 0;
+    size_t full;
+
+    if ((st == NULL) || (out_len == NULL) || ((len != 0) && (in == NULL)) ||
+        ((len != 0) && (out == NULL) && (st->mode != AES_STREAM_CMAC))) {
+        return AES_ERR_PARAM;
+    }
+    *out_len = 0;
+    if (len == 0) {
+        return AES_OK;
+    }
+    if (st->mode == AES_STREAM_CTR) {
+        stream_ctr(st, out, in, len);
+        *out_len = len;
+        return AES_OK;
+    }
+    /* CMAC holds back the last block, even a full one, for the final subkey */
+    if ((st->mode == AES_STREAM_CMAC) && (st->buf_len + len <= AES_BLOCK_SIZE)) {
+        memcpy(st->buf + st->buf_len, in, len);
+        st->buf_len += (uint32_t)len;
+        return AES_OK;
+    }
+    if (st->buf_len != 0) {
+        size_t take = AES_BLOCK_SIZE - st->buf_len;
+
+        take = (len < take) ? len : take;
+        memcpy(st->buf + st->buf_len, in, take);
+        st->buf_len += (uint32_t)take;
+        in += take;
+        len -= take;
+        if (st->buf_len < AES_BLOCK_SIZE) {
+            return AES_OK;
+        }
+        stream_blocks(st, out, st->buf, AES_BLOCK_SIZE);
+        produced = (st->mode == AES_STREAM_CMAC) ? 0 : AES_BLOCK_SIZE;
+        st->buf_len = 0;
+    }
+    full = len & ~(size_t)(AES_BLOCK_SIZE - 1);
+    if ((st->mode == AES_STREAM_CMAC) && (full == len) && (full != 0)) {
+        full -= AES_BLOCK_SIZE;
+    }
+    if (full != 0) {
+        stream_blocks(st, out + produced, in, full);
+        produced += (st->mode == AES_STREAM_CMAC) ? 0 : full;
+    }
+    memcpy(st->buf, in + full, len - full);
+    st->buf_len = (uint32_t)(len - full);
+    *out_len = produced;
+    return AES_OK;
+}
+
+/**
+ * @brief finish a message
+ * @param[in,out] st pointer to the stream
+ * @param[out] out CMAC tag (16 bytes), unused by the other modes (may be NULL)
+ * @param[out] out_len receives the number of bytes written
+ * @return AES_OK or an AES_ERR_* code, AES_ERR_LENGTH if ECB/CBC data was
+ * not a multiple of 16
+ * @note the CBC chaining value and CTR counter stay in the stream, only the
+ * buffered bytes are cleared; aes_stream_init starts the next message
+ */
+aes_status_t aes_stream_final(aes_stream_t *st, uint8_t *out, size_t *out_len)
+{
+    aes_status_t status = AES_OK;
+
+    if ((st == NULL) || (out_len == NULL) || ((out == NULL) && (st->mode == AES_STREAM_CMAC))) {
+        return AES_ERR_PARAM;
+    }
+    *out_len = 0;
+    switch (st->mode) {
+        case AES_STREAM_ECB:
+        case AES_STREAM_CBC:
+            status = (st->buf_len == 0) ? AES_OK : AES_ERR_LENGTH;
+            break;
+        case AES_STREAM_CMAC:
+            aes_cmac_last(st->ctx, st->iv, st->buf, st->buf_len);
+            st->ctx->engine->encrypt(&st->ctx->sched, out, st->iv, 1);
+            aes_stats_add_blocks(st->ctx->engine->id, AES_STATS_MODE_CMAC, st->ctx->sched.length,
+                                 AES_STATS_DIR_ENC, 1);
+            aes_memzero(st->iv, sizeof(st->iv));
+            *out_len = AES_CMAC_SIZE;
+            break;
+        default:
+            break;
+    }
+    aes_memzero(st->buf, sizeof(st->buf));
+    st->buf_len = 0;
+    return status;
+}
+
+#undef AES_STREAM_C
@@ -0,0 +1,71 @@
+/**
+ * @file aes_arena.h
+ * @brief header file for the fixed-size slot arena
+ *
+ * An arena hands out zeroed, 64-byte aligned slots of one size carved from
+ * large mmap'ed chunks. Released slots are cleared and kept on a free list,
+ * so steady-state allocation never reaches malloc or the kernel.
+ *
+ * A secure arena keeps key material: its chunks are locked in RAM, left out
+ * of core dumps and surrounded by PROT_NONE guard pages, so an overrun of a
+ * neighbouring buffer faults instead of reading or corrupting keys.
+*/
+
+#ifndef AES_ARENA_H
+#define AES_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * PUBLIC API
+ */
+
+#define AES_ARENA_ALIGN         64
+
+/* aes_arena_init flags */
+#define AES_ARENA_DEFAULT       0
+#define AES_ARENA_HUGEPAGE      1   /* back chunks with huge pages when available */
+#define AES_ARENA_LOCKED        2   /* mlock chunks and exclude them from core dumps */
+#define AES_ARENA_GUARD         4   /* guard page before and after every chunk */
+#define AES_ARENA_SECURE        (AES_ARENA_LOCKED | AES_ARENA_GUARD)
+
+typedef struct aes_arena_chunk_s aes_arena_chunk_t;
+
+typedef struct aes_arena_s {
+    pthread_mutex_t lock;
+    void *free_list;
+    aes_arena_chunk_t *chunks;
+    size_t slot_size;       /* rounded up to AES_ARENA_ALIGN */
+    size_t chunk_size;      /* bytes mapped per chunk */
+    size_t in_use;          /* slots currently allocated */
+    uint32_t flags;
+} aes_arena_t;
+
+int32_t aes_arena_init(aes_arena_t *arena, size_t slot_size, size_t chunk_slots,
+                       uint32_t flags);
+void aes_arena_destroy(aes_arena_t *arena);
+void *aes_arena_alloc(aes_arena_t *arena);
+void aes_arena_free(aes_arena_t *arena, void *ptr);
+void aes_memzero(void *ptr, size_t len);
+
+/*
+ * PRIVATE API
+ */
+#ifdef AES_ARENA_C
+/* huge page size assumed when rounding hugepage-backed chunks */
+#define AES_ARENA_HUGEPAGE_SIZE (2u*1024u*1024u)
+
+/* chunk header, one cache line so the first slot stays aligned */
+struct aes_arena_chunk_s {
+    aes_arena_chunk_t *next;
+    size_t size;            /* usable bytes, header included */
+    void *map;              /* whole mapping, guard pages included */
+    size_t map_size;
+    uint32_t huge;          /* 1 if mapped with MAP_HUGETLB */
+    uint32_t locked;        /* 1 if mlock succeeded */
+} __attribute__((aligned(AES_ARENA_ALIGN)));
+#endif
+
+#endif /* AES_ARENA_H */
@@ -0,0 +1,76 @@
+/**
+ * @file aes_async.h
+ * @brief header file for the asynchronous job interface
+ *
+ * Jobs are described by caller-owned aes_job_t structures, queued without
+ * locks and run by a set of worker threads. A job completes either by a
+ * callback on the worker, or, for single-threaded reactors, through an
+ * eventfd that becomes readable and aes_async_poll, which runs the
+ * callbacks on the polling thread.
+*/
+
+#ifndef AES_ASYNC_H
+#define AES_ASYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aes_lib.h"
+
+/*
+ * PUBLIC API
+ */
+
+/* job operations */
+#define AES_JOB_ECB_ENCRYPT     0
+#define AES_JOB_ECB_DECRYPT     1
+#define AES_JOB_CBC_ENCRYPT     2
+#define AES_JOB_CBC_DECRYPT     3
+#define AES_JOB_CTR             4
+#define AES_JOB_GCM_ENCRYPT     5
+#define AES_JOB_GCM_DECRYPT     6
+
+/* aes_async_new flags: where callbacks run */
+#define AES_ASYNC_CB_WORKER     0   /* on the worker that ran the job */
+#define AES_ASYNC_CB_POLL       1   /* in aes_async_poll, signalled by the eventfd */
+
+typedef struct aes_async_s aes_async_t;
+typedef struct aes_job_s aes_job_t;
+typedef void (*aes_job_cb_t)(aes_job_t *job, void *user);
+
+/* owned by the caller from submission until its callback returns */
+struct aes_job_s {
+    const aes_ctx_t *ctx;
+    uint32_t op;                        /* AES_JOB_xxx */
+    uint8_t iv[AES_LIB_BLOCK_SIZE];     /* CBC IV, CTR counter or GCM IV, updated as by the mode call */
+    size_t iv_len;                      /* GCM only */
+    uint8_t *out;
+    const uint8_t *in;
+    size_t len;
+    const uint8_t *aad;                 /* GCM only */
+    size_t aad_len;
+    uint8_t tag[AES_GCM_TAG_SIZE];      /* GCM: written on encrypt, checked on decrypt */
+    aes_job_cb_t cb;                    /* may be NULL */
+    void *user;
+    aes_status_t status;                /* result, valid in the callback */
+};
+
+aes_status_t aes_async_new(aes_async_t **async, uint32_t threads, uint32_t depth, uint32_t flags);
+void aes_async_free(aes_async_t *async);
+aes_status_t aes_async_submit(aes_async_t *async, aes_job_t *job);
+int aes_async_fd(const aes_async_t *async);
+uint32_t aes_async_poll(aes_async_t *async, uint32_t max);
+
+/*
+ * PRIVATE API
+ */
+#ifdef AES_ASYNC_C
+/* jobs up to this size are coalesced by a worker */
+#define AES_ASYNC_SMALL         2048
+/* most jobs coalesced into one engine call */
+#define AES_ASYNC_BATCH         32
+/* failed dequeues before a worker sleeps */
+#define AES_ASYNC_SPIN          256
+#endif
+
+#endif /* AES_ASYNC_H */
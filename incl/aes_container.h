@@ -0,0 +1,47 @@
+/**
+ * @file aes_container.h
+ * @brief header file for the seekable encrypted container
+ *
+ * Layout, integers big-endian:
+ *   header  64 bytes: "AESC", version, chunk size, plaintext length,
+ *           chunk count and a random 96-bit file nonce
+ *   index   one 16-byte GCM tag per chunk
+ *   data    the chunk ciphertexts, chunk_size bytes each, the last one
+ *           shorter
+ * Chunk i is AES-GCM under the file nonce with i folded in, its AAD being
+ * the header and i, so every chunk authenticates the header and its own
+ * position and any byte range is opened from the chunks it covers only.
+*/
+
+#ifndef AES_CONTAINER_H
+#define AES_CONTAINER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aes_lib.h"
+
+/*
+ * PUBLIC API
+ */
+
+#define AES_CONTAINER_HEADER_SIZE   64
+#define AES_CONTAINER_VERSION       1
+#define AES_CONTAINER_CHUNK_SIZE    65536       /* default plaintext bytes per chunk */
+#define AES_CONTAINER_MIN_CHUNK     AES_LIB_BLOCK_SIZE
+#define AES_CONTAINER_MAX_CHUNK     (1 << 24)
+
+typedef struct aes_container_info_s {
+    uint64_t length;            /* plaintext bytes */
+    uint64_t nchunks;
+    uint32_t chunk_size;
+    uint64_t data_offset;       /* file offset of the first chunk ciphertext */
+} aes_container_info_t;
+
+aes_status_t aes_container_seal(const aes_ctx_t *ctx, int out_fd, int in_fd,
+                                uint32_t chunk_size, uint32_t threads);
+aes_status_t aes_container_info(int fd, aes_container_info_t *info);
+aes_status_t aes_container_read(const aes_ctx_t *ctx, int fd, uint8_t *out,
+                                uint64_t offset, size_t len, uint32_t threads);
+
+#endif /* AES_CONTAINER_H */
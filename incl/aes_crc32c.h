@@ -0,0 +1,36 @@
+/**
+ * @file aes_crc32c.h
+ * @brief header file for CRC32C (Castagnoli), the integrity checksum of the
+ * storage path
+ *
+ * The checksum is computed with the SSE4.2 CRC32 instruction when the CPU
+ * has it, otherwise with slicing-by-8 tables. Both give the same value; a
+ * running checksum may be continued by either.
+*/
+
+#ifndef AES_CRC32C_H
+#define AES_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * PUBLIC API
+ */
+
+int32_t aes_crc32c_hw_supported(void);
+uint32_t aes_crc32c(uint32_t crc, const uint8_t *buf, size_t len);
+
+/*
+ * PRIVATE API
+ */
+#ifdef AES_LIB_PRIVATE
+/* reflected Castagnoli polynomial */
+#define AES_CRC32C_POLY     0x82f63b78
+
+uint32_t aes_crc32c_raw(uint32_t crc, const uint8_t *buf, size_t len, uint32_t hw);
+uint32_t aes_crc32c_xor(uint32_t crc, uint8_t *out, const uint8_t *in, const uint8_t *ks,
+                        size_t len, uint32_t sum_out, uint32_t hw);
+#endif
+
+#endif /* AES_CRC32C_H */
@@ -0,0 +1,74 @@
+/**
+ * @file aes_daemon.h
+ * @brief header file for the local encryption daemon and its clients
+ *
+ * The daemon owns one key context and serves requests from processes of
+ * the same host over a Unix domain socket. Requests arriving from all
+ * clients within a latency budget are ciphered together, so many small
+ * payloads share one wide engine call. The load generator drives a daemon
+ * through the client calls to measure the throughput/latency trade-off.
+*/
+
+#ifndef AES_DAEMON_H
+#define AES_DAEMON_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <signal.h>
+
+#include "aes_lib.h"
+
+/*
+ * PUBLIC API
+ */
+
+/* largest payload of one request */
+#define AES_DAEMON_MAX_PAYLOAD      65536
+/* default batching parameters */
+#define AES_DAEMON_LATENCY_USEC     100
+#define AES_DAEMON_BATCH_BLOCKS     1024
+
+/* request operations */
+#define AES_DAEMON_OP_CTR           0   /* CTR with the request counter */
+#define AES_DAEMON_OP_ECB_ENCRYPT   1
+#define AES_DAEMON_OP_ECB_DECRYPT   2
+#define AES_DAEMON_OP_STATS         3   /* batching counters, no payload */
+
+typedef struct aes_daemon_cfg_s {
+    const char *path;           /* socket path, replaced if it exists */
+    const uint8_t *key;
+    size_t key_len;
+    uint32_t latency_usec;      /* longest wait of a request for a batch, 0 flushes at once */
+    uint32_t batch_blocks;      /* blocks that flush a batch before the deadline */
+    volatile sig_atomic_t *stop; /* run until set to non-zero, may be NULL */
+} aes_daemon_cfg_t;
+
+/* counters returned by AES_DAEMON_OP_STATS */
+typedef struct aes_daemon_stats_s {
+    uint64_t batches;
+    uint64_t requests;
+    uint64_t blocks;
+    uint64_t deferred;          /* times a client socket was full and replies were queued */
+} aes_daemon_stats_t;
+
+typedef struct aes_loadgen_cfg_s {
+    const char *path;
+    uint32_t clients;           /* connections, one thread each */
+    uint32_t depth;             /* requests in flight per connection */
+    size_t payload;             /* bytes per request */
+    uint32_t seconds;
+} aes_loadgen_cfg_t;
+
+aes_status_t aes_daemon_run(const aes_daemon_cfg_t *cfg);
+
+aes_status_t aes_daemon_connect(const char *path, int *fd);
+void aes_daemon_close(int fd);
+aes_status_t aes_daemon_ctr(int fd, uint8_t counter[AES_LIB_BLOCK_SIZE],
+                            uint8_t *out, const uint8_t *in, size_t len);
+aes_status_t aes_daemon_ecb(int fd, uint32_t op, uint8_t *out, const uint8_t *in, size_t len);
+aes_status_t aes_daemon_stats(int fd, aes_daemon_stats_t *stats);
+
+int32_t aes_loadgen_run(const aes_loadgen_cfg_t *cfg, FILE *report);
+
+#endif /* AES_DAEMON_H */
@@ -0,0 +1,89 @@
+/**
+ * @file aes_engine.h
+ * @brief header file for AES block engines
+ *
+ * An engine ciphers whole arrays of independent 16-byte blocks with a
+ * precomputed key schedule. Modes of operation are built on top of the
+ * encrypt/decrypt entry points and never touch aes_block_t/aes_key_t.
+*/
+
+#ifndef AES_ENGINE_H
+#define AES_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "aes.h"
+#include "aes_stats.h"
+
+/*
+ * PUBLIC API
+ */
+
+/* engine identifiers, shared with the performance counters */
+#define AES_ENGINE_REF      AES_STATS_BACKEND_REF
+#define AES_ENGINE_TTABLE   AES_STATS_BACKEND_TTABLE
+#define AES_ENGINE_AESNI    AES_STATS_BACKEND_AESNI
+#define AES_ENGINE_MAX      AES_STATS_BACKEND_MAX
+
+/* aes_engine_init flags */
+#define AES_ENGINE_INIT_DEFAULT 0   /* fastest engine by static preference */
+#define AES_ENGINE_INIT_BENCH   1   /* time each engine and keep the fastest */
+
+/* power-on self-test status of an engine */
+#define AES_ENGINE_UNTESTED     0
+#define AES_ENGINE_PASSED       1
+#define AES_ENGINE_FAILED       2
+#define AES_ENGINE_UNSUPPORTED  3
+
+/* round keys, either as bytes (FIPS-197 order) or as big-endian words */
+typedef union aes_rk_u {
+    uint8_t  byte[AES256_NR+1][AES_BLOCK_SIZE];
+    uint32_t word[AES_NB*(AES256_NR+1)];
+} aes_rk_t;
+
+/* expanded key; the layout of enc/dec is private to the engine that built it */
+typedef struct aes_sched_s {
+    aes_rk_t enc;
+    aes_rk_t dec;
+    uint32_t nr;        /* number of rounds */
+    uint32_t length;    /* key size in number of bytes */
+} __attribute__((aligned(64))) aes_sched_t;
+
+typedef struct aes_engine_s {
+    const char *name;
+    uint32_t id;
+    /* return 1 if the engine can run on this CPU */
+    int32_t (*supported)(void);
+    /* expand key of length bytes (16, 24 or 32) into sched */
+    void (*setkey)(aes_sched_t *sched, const uint8_t *key, uint32_t length);
+    /* cipher/decipher nblocks independent blocks, in and out may alias */
+    void (*encrypt)(const aes_sched_t *sched, uint8_t *out, const uint8_t *in, size_t nblocks);
+    void (*decrypt)(const aes_sched_t *sched, uint8_t *out, const uint8_t *in, size_t nblocks);
+    /*
+     * optional, NULL when absent: CCM payload blocks, the CBC-MAC chain over
+     * the plaintext and the CTR keystream from the nblocks counter blocks of
+     * ctr computed in one round loop; in and out may alias
+     */
+    void (*ccm)(const aes_sched_t *sched, uint8_t mac[AES_BLOCK_SIZE], uint8_t *out,
+                const uint8_t *in, const uint8_t *ctr, size_t nblocks, uint32_t decrypt);
+    /*
+     * optional, NULL when absent: OCB blocks index+1 to index+nblocks,
+     * out = O_i ^ E(in ^ O_i) (D when decrypt) with O_i = O_{i-1} ^ l[ntz(i)]
+     * advanced from offset, and the plaintext XORed into checksum; in and out
+     * may alias
+     */
+    void (*ocb)(const aes_sched_t *sched, uint8_t *out, const uint8_t *in, size_t nblocks,
+                uint64_t index, uint8_t offset[AES_BLOCK_SIZE], uint8_t checksum[AES_BLOCK_SIZE],
+                const uint8_t (*l)[AES_BLOCK_SIZE], uint32_t decrypt);
+} aes_engine_t;
+
+extern const aes_engine_t aes_engine_ref;
+extern const aes_engine_t aes_engine_ttable;
+extern const aes_engine_t aes_engine_aesni;
+
+const aes_engine_t *aes_engine_by_id(uint32_t id);
+int32_t aes_engine_init(uint32_t flags);
+const aes_engine_t *aes_engine_get(void);
+uint32_t aes_engine_status(uint32_t id);
+
+#endif /* AES_ENGINE_H */
@@ -0,0 +1,30 @@
+/**
+ * @file aes_kat.h
+ * @brief header file for AES known-answer tests
+*/
+
+#ifndef AES_KAT_H
+#define AES_KAT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "aes_engine.h"
+
+/*
+ * PUBLIC API
+ */
+
+#define AES_KAT_QUICK   0   /* FIPS-197 appendix C vectors only */
+#define AES_KAT_FULL    1   /* adds NIST CAVP KAT and Monte Carlo tests */
+
+/* maximum input consumed by aes_kat_differential */
+#define AES_KAT_DIFF_MAX_BLOCKS 64
+
+int32_t aes_kat_reference(uint32_t level, FILE *report);
+int32_t aes_kat_engine(const aes_engine_t *engine, uint32_t level, FILE *report);
+int32_t aes_kat_modes(uint32_t level, FILE *report);
+int32_t aes_kat_run(uint32_t level, FILE *report);
+int32_t aes_kat_differential(const uint8_t *data, size_t size);
+
+#endif /* AES_KAT_H */
@@ -0,0 +1,323 @@
+/**
+ * @file aes_lib.h
+ * @brief public header of libaes, buffer-oriented AES API
+ *
+ * A context holds the expanded key and the engine selected at library init.
+ * All calls take plain byte buffers; aes_block_t/aes_key_t and the step
+ * functions of aes.h are not needed to use the library.
+*/
+
+#ifndef AES_LIB_H
+#define AES_LIB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+/*
+ * PUBLIC API
+ */
+
+#define AES_LIB_BLOCK_SIZE  16
+
+/* status codes returned by the library, never exits the process */
+#define AES_OK              0
+#define AES_ERR_PARAM       (-1)    /* NULL pointer */
+#define AES_ERR_KEY_LENGTH  (-2)    /* key length is not 16, 24 or 32 bytes */
+#define AES_ERR_LENGTH      (-3)    /* data length not valid for the mode */
+#define AES_ERR_NOMEM       (-4)    /* allocation failure */
+#define AES_ERR_ENGINE      (-5)    /* no engine passed its self-test */
+#define AES_ERR_ENTROPY     (-6)    /* the system entropy source failed */
+#define AES_ERR_RESEED      (-7)    /* the DRBG reached its reseed limit */
+#define AES_ERR_AUTH        (-8)    /* authentication tag mismatch */
+#define AES_ERR_IO          (-9)    /* file read or write failure */
+#define AES_ERR_AGAIN       (-10)   /* queue full, retry after completions */
+
+typedef int32_t aes_status_t;
+typedef struct aes_ctx_s aes_ctx_t;
+typedef struct aes_drbg_s aes_drbg_t;
+typedef struct aes_stream_s aes_stream_t;
+typedef struct aes_ff1_s aes_ff1_t;
+
+const char *aes_strerror(aes_status_t status);
+
+aes_status_t aes_ctx_new(aes_ctx_t **ctx, const uint8_t *key, size_t key_len);
+void aes_ctx_free(aes_ctx_t *ctx);
+const char *aes_ctx_engine(const aes_ctx_t *ctx);
+
+aes_status_t aes_ecb_encrypt(const aes_ctx_t *ctx, uint8_t *out, const uint8_t *in, size_t len);
+aes_status_t aes_ecb_decrypt(const aes_ctx_t *ctx, uint8_t *out, const uint8_t *in, size_t len);
+aes_status_t aes_cbc_encrypt(const aes_ctx_t *ctx, uint8_t iv[AES_LIB_BLOCK_SIZE],
+                             uint8_t *out, const uint8_t *in, size_t len);
+aes_status_t aes_cbc_decrypt(const aes_ctx_t *ctx, uint8_t iv[AES_LIB_BLOCK_SIZE],
+                             uint8_t *out, const uint8_t *in, size_t len);
+aes_status_t aes_ctr_crypt(const aes_ctx_t *ctx, uint8_t counter[AES_LIB_BLOCK_SIZE],
+                           uint8_t *out, const uint8_t *in, size_t len);
+aes_status_t aes_ctr_crypt_iov(const aes_ctx_t *ctx, uint8_t counter[AES_LIB_BLOCK_SIZE],
+                               const struct iovec *out, size_t out_cnt,
+                               const struct iovec *in, size_t in_cnt);
+
+/* CTR with the CRC32C (aes_crc32c.h) of one side computed in the same pass */
+#define AES_CRC32C_INPUT        0
+#define AES_CRC32C_OUTPUT       1
+
+aes_status_t aes_ctr_crypt_crc32c(const aes_ctx_t *ctx, uint8_t counter[AES_LIB_BLOCK_SIZE],
+                                  uint8_t *out, const uint8_t *in, size_t len,
+                                  uint32_t flags, uint32_t *crc);
+
+/* CMAC (RFC 4493), the multi-message call interleaves independent messages */
+#define AES_CMAC_SIZE       16
+
+aes_status_t aes_cmac(const aes_ctx_t *ctx, uint8_t mac[AES_CMAC_SIZE],
+                      const uint8_t *msg, size_t len);
+aes_status_t aes_cmac_multi(const aes_ctx_t *ctx, uint8_t (*macs)[AES_CMAC_SIZE],
+                            const uint8_t *const *msgs, const size_t *lens, size_t count);
+
+/* CTR_DRBG (SP 800-90A) with AES-256, no derivation function */
+#define AES_DRBG_SEED_SIZE      48          /* entropy input and maximum additional input */
+#define AES_DRBG_MAX_REQUEST    65536       /* bytes per generate call (2^19 bits) */
+
+aes_status_t aes_drbg_new(aes_drbg_t **drbg, const uint8_t entropy[AES_DRBG_SEED_SIZE],
+                          const uint8_t *pers, size_t pers_len);
+aes_status_t aes_drbg_reseed(aes_drbg_t *drbg, const uint8_t entropy[AES_DRBG_SEED_SIZE],
+                             const uint8_t *add, size_t add_len);
+aes_status_t aes_drbg_generate(aes_drbg_t *drbg, uint8_t *out, size_t len,
+                               const uint8_t *add, size_t add_len);
+void aes_drbg_free(aes_drbg_t *drbg);
+
+/* per-thread CTR_DRBG seeded from getrandom(), output served from a buffer */
+aes_status_t aes_rand_bytes(uint8_t *out, size_t len);
+
+/* AES-GCM-SIV (RFC 8452), nonce-misuse resistant AEAD, 16 or 32-byte key */
+#define AES_GCMSIV_NONCE_SIZE   12
+#define AES_GCMSIV_TAG_SIZE     16
+#define AES_GCMSIV_MAX_LENGTH   ((uint64_t)1 << 36)     /* plaintext and AAD bytes */
+
+aes_status_t aes_gcmsiv_encrypt(const aes_ctx_t *ctx, const uint8_t nonce[AES_GCMSIV_NONCE_SIZE],
+                                uint8_t *out, uint8_t tag[AES_GCMSIV_TAG_SIZE],
+                                const uint8_t *in, size_t len, const uint8_t *aad, size_t aad_len);
+aes_status_t aes_gcmsiv_decrypt(const aes_ctx_t *ctx, const uint8_t nonce[AES_GCMSIV_NONCE_SIZE],
+                                uint8_t *out, const uint8_t *in, size_t len,
+                                const uint8_t tag[AES_GCMSIV_TAG_SIZE],
+                                const uint8_t *aad, size_t aad_len);
+
+/* AES-GCM (SP 800-38D), 16-byte tags; the iovec calls take scattered data */
+#define AES_GCM_IV_SIZE         12
+#define AES_GCM_TAG_SIZE        16
+#define AES_GCM_MAX_LENGTH      (((uint64_t)1 << 36) - 32)     /* plaintext bytes */
+
+aes_status_t aes_gcm_encrypt(const aes_ctx_t *ctx, const uint8_t *iv, size_t iv_len,
+                             uint8_t *out, uint8_t tag[AES_GCM_TAG_SIZE],
+                             const uint8_t *in, size_t len, const uint8_t *aad, size_t aad_len);
+aes_status_t aes_gcm_decrypt(const aes_ctx_t *ctx, const uint8_t *iv, size_t iv_len,
+                             uint8_t *out, const uint8_t *in, size_t len,
+                             const uint8_t tag[AES_GCM_TAG_SIZE],
+                             const uint8_t *aad, size_t aad_len);
+aes_status_t aes_gcm_encrypt_iov(const aes_ctx_t *ctx, const uint8_t *iv, size_t iv_len,
+                                 const struct iovec *out, size_t out_cnt,
+                                 uint8_t tag[AES_GCM_TAG_SIZE],
+                                 const struct iovec *in, size_t in_cnt,
+                                 const uint8_t *aad, size_t aad_len);
+aes_status_t aes_gcm_decrypt_iov(const aes_ctx_t *ctx, const uint8_t *iv, size_t iv_len,
+                                 const struct iovec *out, size_t out_cnt,
+                                 const struct iovec *in, size_t in_cnt,
+                                 const uint8_t tag[AES_GCM_TAG_SIZE],
+                                 const uint8_t *aad, size_t aad_len);
+
+/* CCM (NIST SP 800-38C, RFC 3610): nonce of 7 to 13 bytes, even tag of 4 to 16 bytes */
+#define AES_CCM_NONCE_MIN       7
+#define AES_CCM_NONCE_MAX       13
+#define AES_CCM_TAG_MIN         4
+#define AES_CCM_TAG_MAX         16
+
+aes_status_t aes_ccm_encrypt(const aes_ctx_t *ctx, const uint8_t *nonce, size_t nonce_len,
+                             uint8_t *out, uint8_t *tag, size_t tag_len,
+                             const uint8_t *in, size_t len, const uint8_t *aad, size_t aad_len);
+aes_status_t aes_ccm_decrypt(const aes_ctx_t *ctx, const uint8_t *nonce, size_t nonce_len,
+                             uint8_t *out, const uint8_t *in, size_t len,
+                             const uint8_t *tag, size_t tag_len,
+                             const uint8_t *aad, size_t aad_len);
+
+/* OCB3 (RFC 7253): nonce of 1 to 15 bytes (12 recommended), tag of 1 to 16 bytes */
+#define AES_OCB_NONCE_MAX       15
+#define AES_OCB_TAG_MAX         16
+#define AES_OCB_MAX_LENGTH      (((uint64_t)1 << 36) - 16)     /* plaintext or AAD bytes */
+
+aes_status_t aes_ocb_encrypt(const aes_ctx_t *ctx, const uint8_t *nonce, size_t nonce_len,
+                             uint8_t *out, uint8_t *tag, size_t tag_len,
+                             const uint8_t *in, size_t len, const uint8_t *aad, size_t aad_len);
+aes_status_t aes_ocb_decrypt(const aes_ctx_t *ctx, const uint8_t *nonce, size_t nonce_len,
+                             uint8_t *out, const uint8_t *in, size_t len,
+                             const uint8_t *tag, size_t tag_len,
+                             const uint8_t *aad, size_t aad_len);
+
+/* key wrap: RFC 3394 (KW) and RFC 5649 (KWP, with padding) */
+#define AES_KW_SEMIBLOCK        8
+#define AES_KW_RFC3394          0   /* key a multiple of 8 bytes, at least 16 */
+#define AES_KW_RFC5649          1   /* key of any length from 1 byte */
+/* bytes written by aes_kw_wrap for a len-byte key */
+#define AES_KW_WRAPPED_SIZE(len) \
+    ((((len) + AES_KW_SEMIBLOCK - 1)/AES_KW_SEMIBLOCK + 1)*AES_KW_SEMIBLOCK)
+
+aes_status_t aes_kw_wrap(const aes_ctx_t *kek, uint32_t variant, uint8_t *out, size_t *out_len,
+                         const uint8_t *in, size_t len);
+aes_status_t aes_kw_unwrap(const aes_ctx_t *kek, uint32_t variant, uint8_t *out, size_t *out_len,
+                           const uint8_t *in, size_t len);
+aes_status_t aes_kw_unwrap_ctx(const aes_ctx_t *kek, uint32_t variant, aes_ctx_t **ctxs,
+                               aes_status_t *status, const uint8_t *const *wrapped,
+                               const size_t *lens, size_t count);
+
+/*
+ * FF1 format-preserving encryption (NIST SP 800-38G): a string of numerals
+ * in [0, radix) maps to a string of the same length and radix. A key
+ * context, radix and tweak are bound once; the batch calls run many
+ * strings of one length side by side.
+ */
+#define AES_FF1_RADIX_MAX       65536
+#define AES_FF1_LEN_MAX         64      /* numerals per string */
+#define AES_FF1_TWEAK_MAX       256     /* tweak bytes */
+
+aes_status_t aes_ff1_new(aes_ff1_t **ff1, const aes_ctx_t *ctx, uint32_t radix,
+                         const uint8_t *tweak, size_t tweak_len);
+void aes_ff1_free(aes_ff1_t *ff1);
+uint32_t aes_ff1_min_len(const aes_ff1_t *ff1);
+aes_status_t aes_ff1_encrypt(const aes_ff1_t *ff1, uint16_t *out, const uint16_t *in, size_t len);
+aes_status_t aes_ff1_decrypt(const aes_ff1_t *ff1, uint16_t *out, const uint16_t *in, size_t len);
+aes_status_t aes_ff1_encrypt_batch(const aes_ff1_t *ff1, uint16_t *out, const uint16_t *in,
+                                   size_t len, size_t count);
+aes_status_t aes_ff1_decrypt_batch(const aes_ff1_t *ff1, uint16_t *out, const uint16_t *in,
+                                   size_t len, size_t count);
+
+/* streaming interface: chunks of any size, at most one partial block buffered */
+#define AES_STREAM_ECB          0
+#define AES_STREAM_CBC          1
+#define AES_STREAM_CTR          2
+#define AES_STREAM_CMAC         3
+#define AES_STREAM_ENCRYPT      0
+#define AES_STREAM_DECRYPT      1
+
+aes_status_t aes_stream_new(aes_stream_t **st, const aes_ctx_t *ctx, uint32_t mode, uint32_t dir);
+void aes_stream_free(aes_stream_t *st);
+aes_status_t aes_stream_init(aes_stream_t *st, const uint8_t iv[AES_LIB_BLOCK_SIZE]);
+aes_status_t aes_stream_update(aes_stream_t *st, uint8_t *out, size_t *out_len,
+                               const uint8_t *in, size_t len);
+aes_status_t aes_stream_final(aes_stream_t *st, uint8_t *out, size_t *out_len);
+
+/*
+ * PRIVATE API
+ */
+#ifdef AES_LIB_PRIVATE
+#include "aes_engine.h"
+#include "aes_polyval.h"
+
+/* blocks processed per engine call when a mode needs a staging buffer */
+#define AES_LIB_BATCH   32
+/* minimum number of contexts mapped at a time by the context arena */
+#define AES_LIB_CTX_CHUNK   64
+
+/* messages whose CMAC chains advance together in aes_cmac_multi */
+#define AES_CMAC_LANES      8
+/* wrapped keys whose unwrap chains advance together */
+#define AES_KW_LANES        8
+/* OCB L_i table entries, L_{ntz(i)} for every block index below 2^32 */
+#define AES_OCB_L_COUNT     32
+/* OCB blocks per offset group: offsets inside a group are its base XOR a constant */
+#define AES_OCB_GROUP       8
+
+struct aes_ctx_s {
+    aes_sched_t sched;
+    const aes_engine_t *engine;
+    /* CMAC subkeys, derived once at context creation */
+    uint8_t cmac_k1[AES_LIB_BLOCK_SIZE];
+    uint8_t cmac_k2[AES_LIB_BLOCK_SIZE];
+    /* GHASH key H = E(K, 0^128), derived once at context creation */
+    aes_polyval_t gcm_h;
+    /* OCB L_*, L_$ and L_i, and ocb_pre[k] = L_{ntz(1)} ^ ... ^ L_{ntz(k)} */
+    uint8_t ocb_lstar[AES_LIB_BLOCK_SIZE];
+    uint8_t ocb_ldollar[AES_LIB_BLOCK_SIZE];
+    uint8_t ocb_l[AES_OCB_L_COUNT][AES_LIB_BLOCK_SIZE];
+    uint8_t ocb_pre[AES_OCB_GROUP][AES_LIB_BLOCK_SIZE];
+};
+
+/* FF1 Feistel rounds */
+#define AES_FF1_ROUNDS          10
+/* Q blocks processed per round, and blocks of S: round number and NUM(B) take at most 65 bytes */
+#define AES_FF1_BLOCKS          5
+/* strings advanced together through one round, one wide engine call per Q block */
+#define AES_FF1_BATCH           32
+
+/* per string length: the part of the round function that does not depend on the round */
+typedef struct aes_ff1_len_s {
+    uint8_t mac[AES_LIB_BLOCK_SIZE];    /* CBC-MAC of P and of the leading constant blocks of Q */
+    uint8_t prefix[AES_LIB_BLOCK_SIZE]; /* tweak tail and zero pad opening the first varying block */
+    uint8_t prefix_len;
+    uint8_t blocks;                     /* varying Q blocks, with the round number and NUM(B) */
+    uint8_t b;                          /* bytes of NUM(B) */
+    uint8_t d;                          /* bytes of S used, a multiple of 4 */
+} aes_ff1_len_t;
+
+struct aes_ff1_s {
+    const aes_ctx_t *ctx;
+    uint32_t radix;
+    uint32_t inv;                       /* floor(2^32 / radix), for divisions by the radix */
+    uint32_t min_len;                   /* smallest length with radix^len >= 1000000 */
+    uint32_t group;                     /* numerals per 32-bit word, radix^group < 2^32 */
+    uint32_t pow[32];                   /* radix^0 .. radix^group */
+    uint32_t recip[32];                 /* reciprocal of pow[k] << shift[k], for short division */
+    uint8_t shift[32];                  /* normalization shift of pow[k] */
+    aes_ff1_len_t len[AES_FF1_LEN_MAX + 1];
+};
+
+struct aes_stream_s {
+    const aes_ctx_t *ctx;
+    uint32_t mode;
+    uint32_t dir;
+    uint8_t iv[AES_LIB_BLOCK_SIZE];     /* CBC chain, CTR counter or CMAC chain */
+    uint8_t buf[AES_LIB_BLOCK_SIZE];    /* pending input, or CTR keystream */
+    uint32_t buf_len;                   /* bytes pending, or CTR keystream bytes used */
+};
+
+/* bytes pre-generated by one refill of the per-thread buffer */
+#define AES_DRBG_BUFFER         4096
+/* refills of the per-thread buffer between two reseeds from getrandom() */
+#define AES_DRBG_RESEED_REFILLS 1024
+/* SP 800-90A reseed_interval for AES-256 CTR_DRBG */
+#define AES_DRBG_RESEED_LIMIT   ((uint64_t)1 << 48)
+
+/* bytes deciphered then hashed together by aes_gcmsiv_decrypt, fits in L1 */
+#define AES_GCMSIV_CHUNK        8192
+
+struct aes_drbg_s {
+    aes_sched_t sched;          /* Key */
+    const aes_engine_t *engine;
+    uint8_t v[AES_LIB_BLOCK_SIZE];
+    uint64_t reseed_counter;
+    /* per-thread generator: buffered output and the fork it was seeded in */
+    uint64_t fork_gen;
+    size_t pos;
+    size_t avail;
+    uint8_t buf[AES_DRBG_BUFFER];
+};
+
+void aes_ctr_blocks(uint8_t *blocks, uint8_t counter[AES_LIB_BLOCK_SIZE], size_t nblocks);
+void aes_xor_blocks(uint8_t *out, const uint8_t *a, const uint8_t *b, size_t len);
+void aes_cmac_subkeys(aes_ctx_t *ctx);
+void aes_cmac_last(const aes_ctx_t *ctx, uint8_t *x, const uint8_t *msg, size_t left);
+void aes_gcm_subkey(aes_ctx_t *ctx);
+void aes_ocb_subkeys(aes_ctx_t *ctx);
+
+/* position in an iovec array, walked by aes_iov_span */
+typedef struct aes_iov_cursor_s {
+    const struct iovec *iov;
+    size_t cnt;
+    size_t idx;     /* current fragment */
+    size_t off;     /* bytes of the current fragment consumed */
+} aes_iov_cursor_t;
+
+aes_status_t aes_iov_check(const struct iovec *out, size_t out_cnt,
+                           const struct iovec *in, size_t in_cnt, size_t *len);
+void aes_iov_cursor_init(aes_iov_cursor_t *c, const struct iovec *iov, size_t cnt);
+size_t aes_iov_span(aes_iov_cursor_t *in, aes_iov_cursor_t *out, const uint8_t **src, uint8_t **dst);
+#endif
+
+#endif /* AES_LIB_H */
@@ -0,0 +1,98 @@
+/**
+ * @file aes_perf.h
+ * @brief header file for hardware performance-counter profiling
+ *
+ * Cycles, instructions, L1D read misses and branch misses are counted in
+ * user space for the calling thread with perf_event_open, as one group so
+ * the ratios (IPC) come from the same interval. The reference engine is
+ * profiled per stage (AddRoundKey, SubBytes, ShiftRows, MixColumns) and the
+ * block engines per engine call. Events the kernel or the CPU does not
+ * provide (virtual machines, perf_event_paranoid > 2) are reported as
+ * unavailable and only the timing is kept.
+*/
+
+#ifndef AES_PERF_H
+#define AES_PERF_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aes_engine.h"
+
+/*
+ * PUBLIC API
+ */
+
+/* counted events */
+#define AES_PERF_CYCLES             0
+#define AES_PERF_INSTRUCTIONS       1
+#define AES_PERF_L1D_MISSES         2   /* L1D read misses */
+#define AES_PERF_BRANCH_MISSES      3
+#define AES_PERF_EVENTS             4
+
+/* stages of the reference cipher */
+#define AES_PERF_STAGE_ADDROUNDKEY  0
+#define AES_PERF_STAGE_SUBBYTES     1
+#define AES_PERF_STAGE_SHIFTROWS    2
+#define AES_PERF_STAGE_MIXCOLUMNS   3
+#define AES_PERF_STAGES             4
+
+/* blocks run through one stage between two counter reads */
+#define AES_PERF_SLICE              256
+
+typedef struct aes_perf_s {
+    int fd[AES_PERF_EVENTS];        /* -1 when the event is unavailable */
+    uint64_t id[AES_PERF_EVENTS];
+    int leader;                     /* group leader, -1 when nothing is counted */
+    uint32_t valid;                 /* bit e set when event e is counted */
+} aes_perf_t;
+
+/* raw counter values at the start of a measured interval */
+typedef struct aes_perf_mark_s {
+    uint64_t value[AES_PERF_EVENTS];
+    uint64_t enabled;
+    uint64_t running;
+    uint64_t nsec;
+} aes_perf_mark_t;
+
+/* accumulated deltas of the measured intervals */
+typedef struct aes_perf_sample_s {
+    uint64_t count[AES_PERF_EVENTS];
+    uint32_t valid;
+    uint64_t time_nsec;
+    uint64_t blocks;
+    uint64_t calls;
+} aes_perf_sample_t;
+
+uint32_t aes_perf_open(aes_perf_t *perf);
+void aes_perf_close(aes_perf_t *perf);
+const char *aes_perf_event_name(uint32_t event);
+const char *aes_perf_stage_name(uint32_t stage);
+void aes_perf_begin(const aes_perf_t *perf, aes_perf_mark_t *mark);
+void aes_perf_end(const aes_perf_t *perf, const aes_perf_mark_t *mark,
+                  aes_perf_sample_t *sample, uint64_t blocks);
+int32_t aes_perf_ref_stages(const aes_perf_t *perf, uint32_t key_length, size_t nblocks,
+                            aes_perf_sample_t stages[AES_PERF_STAGES]);
+int32_t aes_perf_engine(const aes_perf_t *perf, const aes_engine_t *engine, uint32_t key_length,
+                        size_t batch, size_t nblocks, aes_perf_sample_t *sample);
+void aes_perf_report_header(FILE *fp);
+void aes_perf_report(FILE *fp, const char *label, const aes_perf_sample_t *sample);
+
+/*
+ * PRIVATE API
+ */
+#ifdef AES_PERF_C
+/* read_format PERF_FORMAT_GROUP | TOTAL_TIME_ENABLED | TOTAL_TIME_RUNNING | ID */
+typedef struct aes_perf_group_s {
+    uint64_t nr;
+    uint64_t enabled;
+    uint64_t running;
+    struct {
+        uint64_t value;
+        uint64_t id;
+    } event[AES_PERF_EVENTS];
+} aes_perf_group_t;
+#endif
+
+#endif /* AES_PERF_H */
@@ -0,0 +1,43 @@
+/**
+ * @file aes_polyval.h
+ * @brief header file for POLYVAL and GHASH, the hashes of GCM-SIV and GCM
+ *
+ * POLYVAL (RFC 8452) is evaluated either with carry-less multiply
+ * (PCLMULQDQ) or, on any CPU, through the 4-bit GHASH table of the
+ * bit-reflected field as described in RFC 8452 appendix A. GHASH shares
+ * the key layout; a key is only valid with the update function matching
+ * its init function.
+*/
+
+#ifndef AES_POLYVAL_H
+#define AES_POLYVAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * PUBLIC API
+ */
+
+#define AES_POLYVAL_SIZE    16
+/* blocks folded per reduction by the carry-less multiply path */
+#define AES_POLYVAL_AGG     4
+
+typedef struct aes_polyval_s {
+    /* table path: multiples of mulX_GHASH(ByteReverse(H)) */
+    uint64_t hl[16];
+    uint64_t hh[16];
+    /* carry-less path: H, H^2 .. H^AES_POLYVAL_AGG in the POLYVAL field */
+    uint8_t hpow[AES_POLYVAL_AGG][AES_POLYVAL_SIZE];
+    uint32_t clmul;
+} aes_polyval_t;
+
+int32_t aes_polyval_clmul_supported(void);
+void aes_polyval_init(aes_polyval_t *pv, const uint8_t h[AES_POLYVAL_SIZE], uint32_t clmul);
+void aes_polyval_update(const aes_polyval_t *pv, uint8_t s[AES_POLYVAL_SIZE],
+                        const uint8_t *data, size_t nblocks);
+void aes_ghash_init(aes_polyval_t *pv, const uint8_t h[AES_POLYVAL_SIZE], uint32_t clmul);
+void aes_ghash_update(const aes_polyval_t *pv, uint8_t s[AES_POLYVAL_SIZE],
+                      const uint8_t *data, size_t nblocks);
+
+#endif /* AES_POLYVAL_H */
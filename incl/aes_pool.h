@@ -0,0 +1,79 @@
+/**
+ * @file aes_pool.h
+ * @brief header file for the topology-aware worker pool of the parallel modes
+ *
+ * The CPU and NUMA layout is read from sysfs. Workers are pinned one per
+ * CPU, spread over the nodes first and over physical cores before their
+ * SMT siblings. Each worker allocates its scratch buffer and its copy of
+ * the job's key context itself after pinning, so first touch places them
+ * on its local node. Jobs are cut into tasks sized to half of the L2.
+*/
+
+#ifndef AES_POOL_H
+#define AES_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aes_lib.h"
+
+/*
+ * PUBLIC API
+ */
+
+#define AES_POOL_MAX_CPUS       1024
+#define AES_POOL_MAX_NODES      64
+/* L2 size assumed when sysfs does not report one */
+#define AES_POOL_L2_DEFAULT     (256*1024)
+
+typedef struct aes_pool_s aes_pool_t;
+
+typedef struct aes_topology_s {
+    uint32_t ncpus;                         /* online CPUs */
+    uint32_t nnodes;                        /* NUMA nodes with online CPUs */
+    size_t l2_size;                         /* bytes of L2 seen by one core */
+    /* online CPUs in placement order, and their node */
+    uint16_t cpu[AES_POOL_MAX_CPUS];
+    uint16_t node[AES_POOL_MAX_CPUS];
+} aes_topology_t;
+
+aes_status_t aes_pool_topology(aes_topology_t *topo);
+aes_status_t aes_pool_new(aes_pool_t **pool, uint32_t threads);
+void aes_pool_free(aes_pool_t *pool);
+uint32_t aes_pool_threads(const aes_pool_t *pool);
+size_t aes_pool_chunk_size(const aes_pool_t *pool);
+
+aes_status_t aes_ctr_crypt_pool(aes_pool_t *pool, const aes_ctx_t *ctx,
+                                uint8_t counter[AES_LIB_BLOCK_SIZE],
+                                uint8_t *out, const uint8_t *in, size_t len);
+
+/*
+ * PRIVATE API
+ */
+#ifdef AES_LIB_PRIVATE
+#include "aes_arena.h"
+
+/* state owned by one worker, allocated on its node */
+typedef struct aes_pool_worker_s {
+    aes_pool_t *pool;
+    uint32_t id;
+    int32_t cpu;                /* -1 when not pinned */
+    uint32_t node;
+    aes_arena_t arena;          /* secure, holds ctx */
+    aes_arena_t scratch_arena;
+    aes_ctx_t *ctx;             /* replica of the job's key context */
+    uint8_t *scratch;           /* aes_pool_chunk_size bytes, NULL if unavailable */
+    size_t scratch_size;
+} aes_pool_worker_t;
+
+/* one task of a job, task in [0, ntasks) */
+typedef void (*aes_pool_fn_t)(void *arg, uint64_t task, aes_pool_worker_t *w);
+
+aes_status_t aes_pool_run(aes_pool_t *pool, aes_pool_fn_t fn, void *arg, const aes_ctx_t *ctx,
+                          uint64_t ntasks, uint32_t max_workers);
+aes_pool_t *aes_pool_default(void);
+int32_t aes_pool_pin(uint32_t cpu);
+void aes_pool_fail_workers(uint32_t fail);
+#endif
+
+#endif /* AES_POOL_H */
@@ -0,0 +1,77 @@
+/**
+ * @file aes_replay.h
+ * @brief header file for the workload-replay benchmark
+ *
+ * A workload is a list of (size, key id, mode, op) records, read from a
+ * trace file or drawn from a synthetic distribution: Pareto message sizes
+ * and Zipf key popularity, the heavy tails seen in production traffic.
+ * The replay runs every record through the library API on the calling
+ * thread, creating key contexts through a fixed-size key cache, and
+ * reports throughput and latency percentiles per mode.
+ *
+ * Trace files are text, one record per line, '#' starts a comment:
+ *     <size> <key id> <ecb|cbc|ctr|gcm|cmac> <enc|dec>
+*/
+
+#ifndef AES_REPLAY_H
+#define AES_REPLAY_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aes_lib.h"
+
+/*
+ * PUBLIC API
+ */
+
+/* record modes */
+#define AES_REPLAY_ECB          0
+#define AES_REPLAY_CBC          1
+#define AES_REPLAY_CTR          2
+#define AES_REPLAY_GCM          3
+#define AES_REPLAY_CMAC         4
+#define AES_REPLAY_MODES        5
+
+/* record operations, CMAC ignores it */
+#define AES_REPLAY_ENCRYPT      0
+#define AES_REPLAY_DECRYPT      1
+
+/* largest message of a record */
+#define AES_REPLAY_MAX_SIZE     (16 << 20)
+/* default number of key contexts kept by the replay */
+#define AES_REPLAY_KEY_CACHE    64
+
+typedef struct aes_replay_rec_s {
+    uint32_t size;              /* bytes, rounded up to whole blocks for ECB and CBC */
+    uint32_t key_id;
+    uint8_t mode;               /* AES_REPLAY_xxx mode */
+    uint8_t op;                 /* AES_REPLAY_ENCRYPT or AES_REPLAY_DECRYPT */
+} aes_replay_rec_t;
+
+typedef struct aes_replay_synth_s {
+    size_t records;
+    uint32_t keys;              /* distinct key ids */
+    double key_skew;            /* Zipf exponent of key popularity, 0 for uniform */
+    uint32_t min_size;          /* Pareto scale, smallest message */
+    uint32_t max_size;          /* messages are clipped to this size */
+    double size_alpha;          /* Pareto shape, smaller is heavier-tailed */
+    uint32_t modes;             /* mask of (1 << AES_REPLAY_xxx) drawn uniformly */
+    uint32_t decrypt_pct;       /* share of decrypt records, 0..100 */
+    uint64_t seed;
+} aes_replay_synth_t;
+
+typedef struct aes_replay_cfg_s {
+    uint32_t key_cache;         /* key context slots, direct-mapped by key id */
+    uint32_t key_length;        /* 16, 24 or 32 bytes */
+} aes_replay_cfg_t;
+
+void aes_replay_synth_default(aes_replay_synth_t *synth);
+aes_status_t aes_replay_synth(const aes_replay_synth_t *synth, aes_replay_rec_t **recs, size_t *n);
+aes_status_t aes_replay_load(const char *path, aes_replay_rec_t **recs, size_t *n);
+aes_status_t aes_replay_save(const char *path, const aes_replay_rec_t *recs, size_t n);
+aes_status_t aes_replay_run(const aes_replay_cfg_t *cfg, const aes_replay_rec_t *recs, size_t n,
+                            FILE *report);
+
+#endif /* AES_REPLAY_H */
@@ -0,0 +1,102 @@
+/**
+ * @file aes_stats.h
+ * @brief header file for AES performance counters
+ *
+ * Counters are kept per thread and only summed when a snapshot is taken, so
+ * the cipher hot path never writes to a cache line shared with another thread.
+*/
+
+#ifndef AES_STATS_H
+#define AES_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * PUBLIC API
+ */
+
+/* backend (engine) running the blocks */
+#define AES_STATS_BACKEND_REF       0   /* step-by-step reference (aes.c) */
+#define AES_STATS_BACKEND_TTABLE    1   /* portable 32-bit T-table engine */
+#define AES_STATS_BACKEND_AESNI     2   /* x86 AES-NI engine */
+#define AES_STATS_BACKEND_MAX       3
+
+/* mode of operation, or API path used by the caller */
+#define AES_STATS_MODE_BLOCK        0   /* single-block aes_cipher/aes_decipher */
+#define AES_STATS_MODE_ECB          1
+#define AES_STATS_MODE_CBC          2
+#define AES_STATS_MODE_CTR          3
+#define AES_STATS_MODE_CMAC         4
+#define AES_STATS_MODE_DRBG         5
+#define AES_STATS_MODE_GCMSIV       6
+#define AES_STATS_MODE_KW           7   /* key wrap, RFC 3394/5649 */
+#define AES_STATS_MODE_GCM          8
+#define AES_STATS_MODE_CCM          9
+#define AES_STATS_MODE_OCB          10
+#define AES_STATS_MODE_FF1          11  /* format-preserving, SP 800-38G */
+#define AES_STATS_MODE_MAX          12
+
+/* key size index */
+#define AES_STATS_KEY_128           0
+#define AES_STATS_KEY_192           1
+#define AES_STATS_KEY_256           2
+#define AES_STATS_KEY_MAX           3
+
+/* direction */
+#define AES_STATS_DIR_ENC           0
+#define AES_STATS_DIR_DEC           1
+#define AES_STATS_DIR_MAX           2
+
+/* batch size histogram: bucket i counts calls of [2^i, 2^(i+1)) blocks */
+#define AES_STATS_BATCH_BUCKETS     16
+
+/* export formats */
+#define AES_STATS_FMT_JSON          0
+#define AES_STATS_FMT_PROMETHEUS    1
+
+typedef struct aes_stats_s {
+    uint64_t blocks[AES_STATS_BACKEND_MAX][AES_STATS_MODE_MAX][AES_STATS_KEY_MAX][AES_STATS_DIR_MAX];
+    uint64_t calls[AES_STATS_BACKEND_MAX][AES_STATS_MODE_MAX][AES_STATS_KEY_MAX][AES_STATS_DIR_MAX];
+    uint64_t time_nsec[AES_STATS_BACKEND_MAX][AES_STATS_MODE_MAX];
+    uint64_t batch_hist[AES_STATS_BATCH_BUCKETS];
+    uint64_t key_expansions[AES_STATS_KEY_MAX];
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+} aes_stats_t;
+
+void aes_stats_add_blocks(uint32_t backend, uint32_t mode, uint32_t key_length,
+                          uint32_t dir, uint64_t nblocks);
+void aes_stats_add_time(uint32_t backend, uint32_t mode, uint64_t nsec);
+void aes_stats_add_keyexpansion(uint32_t key_length);
+void aes_stats_add_cache(uint32_t hit);
+void aes_stats_snapshot(aes_stats_t *snapshot);
+void aes_stats_reset(void);
+int32_t aes_stats_export(FILE *fp, uint32_t format);
+uint64_t aes_stats_timestamp(void);
+
+/*
+ * optional timing: build with AES_STATS_TIMING defined to accumulate the time
+ * spent per backend and mode. Without it the macros compile to nothing.
+ */
+#ifdef AES_STATS_TIMING
+#define AES_STATS_TIME_BEGIN(t)                 uint64_t t = aes_stats_timestamp()
+#define AES_STATS_TIME_END(t, backend, mode)    \
+    aes_stats_add_time((backend), (mode), aes_stats_timestamp() - (t))
+#else
+#define AES_STATS_TIME_BEGIN(t)                 do { } while (0)
+#define AES_STATS_TIME_END(t, backend, mode)    do { } while (0)
+#endif /* AES_STATS_TIMING */
+
+/*
+ * PRIVATE API
+ */
+#ifdef AES_STATS_C
+/* one record per thread, padded so two threads never share a cache line */
+typedef struct aes_stats_thread_s {
+    aes_stats_t counters;
+    struct aes_stats_thread_s *next;
+} __attribute__((aligned(64))) aes_stats_thread_t;
+#endif
+
+#endif /* AES_STATS_H */
@@ -15,20 +15,45 @@
 #include <string.h>
 #include <time.h>
 #include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "aes.h"
 #include "aes_log.h"
+#include "aes_stats.h"
+#include "aes_kat.h"
+#include "aes_arena.h"
+#include "aes_daemon.h"
+#include "aes_container.h"
+#include "aes_perf.h"
+#include "aes_replay.h"
+
+/* bytes opened per window by "open" */
+#define OPEN_WINDOW (16 << 20)
 
 /* Global variables */
+static volatile sig_atomic_t daemon_stop = 0;
 
 
 /* prototypes */
 void int_handler(int32_t sig);
+void stop_handler(int32_t sig);
 uint64_t get_timestamp_nsec(void);
 void part1(void);
 void part2(void);
 void part3(void);
 void part4(void);
 void measure_exectime(void);
+int32_t selftest(void);
+int32_t difftest(void);
+int32_t read_key_file(const char *path, uint8_t *key, size_t *key_len);
+int32_t daemon_main(int argc, char **argv);
+int32_t loadgen_main(int argc, char **argv);
+int32_t seal_main(int argc, char **argv);
+int32_t open_main(int argc, char **argv);
+int32_t perf_main(int argc, char **argv);
+int32_t replay_main(int argc, char **argv);
 
 /* functions */
 /**
@@ -42,6 +67,16 @@ void int_handler(int32_t sig)
     exit(EXIT_SUCCESS);
 }
 
+/**
+ * @brief Ask the daemon loop to return on CTRL-C or SIGTERM
+ * @param[in] sig interrupt signal
+ */
+void stop_handler(int32_t sig)
+{
+    (void)sig;
+    daemon_stop = 1;
+}
+
 /**
  * @brief Provide a timestamp in ns
  * @return timestamp value in ns
@@ -189,10 +224,11 @@ void part3(void)
     memcpy(&state.byte, ciphered_text, sizeof(ciphered_text));
     aes_block2mat(&state);
     /* decipher_key expansion */
+    aes_key_t round_key_buf[11];
     aes_key_t *round_keys[11];
     aes_key_t *(*expanded_keys)[] = &round_keys;
     for (uint32_t i=0;i<11;i++) {
-        round_keys[i] = calloc(1, sizeof(aes_key_t));
+        round_keys[i] = &round_key_buf[i];
     }
     memcpy(round_keys[0], &decipher_key, sizeof(aes_key_t));
     aes_keyexpansion(expanded_keys, &decipher_key);
@@ -265,14 +301,11 @@ void part3(void)
 */
 void part4(void)
 {
-    /*uint8_t clear_text[16] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
-                              0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
-    uint8_t key[16] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
-                       0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};*/
-    uint8_t clear_text[16] = {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+    /* FIPS-197 C.1: expected clear text is 00112233445566778899aabbccddeeff */
+    uint8_t ciphered_text[16] = {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
                               0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a};
-    uint8_t key[16] = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
-                       0xab, 0xf7, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x3c};
+    uint8_t key[16] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                       0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
     
     aes_block_t clear_block, ciphered_block;
     
@@ -287,8 +320,8 @@ void part4(void)
     memset(&ciphered_block, 0, sizeof(aes_block_t));
     
     /* prepare AES state */
-    memcpy(&clear_block.byte, clear_text, sizeof(clear_text));
-    aes_block2mat(&clear_block);
+    memcpy(&ciphered_block.byte, ciphered_text, sizeof(ciphered_text));
+    aes_block2mat(&ciphered_block);
     /* prepare AES key */
     memcpy(&decipher_key.byte, key, sizeof(key));
     decipher_key.length = AES128_KEY_SIZE/8;
@@ -298,7 +331,7 @@ void part4(void)
 
     /* deactivate DBG_LOG to measure time */
 #ifndef DBG_LOG
-    uint64_t timestamp_nsec;
+    double time_spent = 0;
     //pour stocker le temps d'exécution du code
    
     clock_t begin = clock();
@@ -306,9 +339,9 @@ void part4(void)
     clock_t end = clock();
     
     // calcule le temps écoulé en trouvant la différence (end - begin) et divisant la différence par CLOCKS_PER_SEC pour convertir en secondes
-    timestamp_nsec += (double)(end - begin) / CLOCKS_PER_SEC;
+    time_spent += (double)(end - begin) / CLOCKS_PER_SEC;
     
-    printf("The elapsed time is %f seconds\n\n", timestamp_nsec);
+    printf("The elapsed time is %f seconds\n\n", time_spent);
     
 #endif /* DGB_LOG */
 }
@@ -405,16 +438,471 @@ void measure_exectime(void)
     
 }
 
+/**
+* @brief run the known-answer tests on the step functions and all engines
+* @return number of failed tests
+*/
+int32_t selftest(void)
+{
+    int32_t fail = aes_kat_run(AES_KAT_FULL, stdout);
+    int32_t id = aes_engine_init(AES_ENGINE_INIT_BENCH);
+    printf("%d test(s) failed\n", fail);
+    if (id < 0) {
+        printf("no engine passed the power-on self-test\n");
+        return fail + 1;
+    }
+    printf("selected engine: %s\n", aes_engine_by_id((uint32_t)id)->name);
+    return fail;
+}
+
+/**
+* @brief differential check of the engines on an input read from stdin
+* @return 0 when all engines agree, abort otherwise (AFL-style harness)
+*/
+int32_t difftest(void)
+{
+    uint8_t data[1 + AES256_KEY_SIZE/8 + AES_KAT_DIFF_MAX_BLOCKS*AES_BLOCK_SIZE];
+    size_t size = fread(data, 1, sizeof(data), stdin);
+
+    if (aes_kat_differential(data, size) != 0) {
+        fprintf(stderr, "[ERROR] difftest: engines disagree with the reference\n");
+        abort();
+    }
+    return 0;
+}
+
+/**
+* @brief read a raw 16, 24 or 32-byte key
+* @param[in] path key file
+* @param[out] key receives the key, AES256_KEY_SIZE/8 bytes
+* @param[out] key_len receives the key length in bytes
+* @return 0 on success
+*/
+int32_t read_key_file(const char *path, uint8_t *key, size_t *key_len)
+{
+    FILE *fp = fopen(path, "rb");
+
+    if (fp == NULL) {
+        fprintf(stderr, "[ERROR] cannot open key file %s\n", path);
+        return 1;
+    }
+    *key_len = fread(key, 1, AES256_KEY_SIZE/8, fp);
+    fclose(fp);
+    return 0;
+}
+
+/**
+* @brief serve encryption requests on a Unix socket until CTRL-C
+* @param[in] argc number of arguments
+* @param[in] argv "daemon" <socket> [latency_usec] [batch_blocks] [key_file],
+* without key file an ephemeral AES-128 key is drawn
+* @return 0 on a clean stop
+*/
+int32_t daemon_main(int argc, char **argv)
+{
+    aes_daemon_cfg_t cfg;
+    uint8_t key[AES256_KEY_SIZE/8];
+    size_t key_len = AES128_KEY_SIZE/8;
+    aes_status_t status;
+
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s daemon <socket> [latency_usec] [batch_blocks] [key_file]\n", argv[0]);
+        return 1;
+    }
+    if (argc > 5) {
+        if (read_key_file(argv[5], key, &key_len) != 0) {
+            return 1;
+        }
+    } else if (aes_rand_bytes(key, key_len) != AES_OK) {
+        fprintf(stderr, "[ERROR] daemon: no entropy for the key\n");
+        return 1;
+    }
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.path = argv[2];
+    cfg.key = key;
+    cfg.key_len = key_len;
+    cfg.latency_usec = (argc > 3) ? (uint32_t)strtoul(argv[3], NULL, 0) : AES_DAEMON_LATENCY_USEC;
+    cfg.batch_blocks = (argc > 4) ? (uint32_t)strtoul(argv[4], NULL, 0) : AES_DAEMON_BATCH_BLOCKS;
+    cfg.stop = &daemon_stop;
+    signal(SIGINT, stop_handler);
+    signal(SIGTERM, stop_handler);
+    printf("daemon on %s, latency budget %u us, batch %u blocks\n", cfg.path,
+           cfg.latency_usec, cfg.batch_blocks);
+    status = aes_daemon_run(&cfg);
+    aes_memzero(key, sizeof(key));
+    /* EINTR and EAGAIN of the event loop are expected, not for log_deinit */
+    errno = 0;
+    if (status != AES_OK) {
+        fprintf(stderr, "[ERROR] daemon: %s\n", aes_strerror(status));
+        return 1;
+    }
+    return 0;
+}
+
+/**
+* @brief measure a running daemon over loopback
+* @param[in] argc number of arguments
+* @param[in] argv "loadgen" <socket> [clients] [depth] [payload] [seconds]
+* @return number of failed requests
+*/
+int32_t loadgen_main(int argc, char **argv)
+{
+    aes_loadgen_cfg_t cfg;
+    int32_t ret;
+
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s loadgen <socket> [clients] [depth] [payload] [seconds]\n", argv[0]);
+        return 1;
+    }
+    cfg.path = argv[2];
+    cfg.clients = (argc > 3) ? (uint32_t)strtoul(argv[3], NULL, 0) : 8;
+    cfg.depth = (argc > 4) ? (uint32_t)strtoul(argv[4], NULL, 0) : 1;
+    cfg.payload = (argc > 5) ? (size_t)strtoul(argv[5], NULL, 0) : 64;
+    cfg.seconds = (argc > 6) ? (uint32_t)strtoul(argv[6], NULL, 0) : 2;
+    ret = aes_loadgen_run(&cfg, stdout);
+    errno = 0;
+    return ret;
+}
+
+/**
+* @brief encrypt a file into a seekable container
+* @param[in] argc number of arguments
+* @param[in] argv "seal" <key_file> <in> <out> [chunk_size] [threads]
+* @return 0 on success
+*/
+int32_t seal_main(int argc, char **argv)
+{
+    uint8_t key[AES256_KEY_SIZE/8];
+    size_t key_len;
+    aes_ctx_t *ctx = NULL;
+    uint32_t chunk_size, threads;
+    struct stat st;
+    int in_fd = -1, out_fd = -1;
+    aes_status_t status = AES_ERR_IO;
+
+    if (argc < 5) {
+        fprintf(stderr, "usage: %s seal <key_file> <in> <out> [chunk_size] [threads]\n", argv[0]);
+        return 1;
+    }
+    if (read_key_file(argv[2], key, &key_len) != 0) {
+        return 1;
+    }
+    chunk_size = (argc > 5) ? (uint32_t)strtoul(argv[5], NULL, 0) : AES_CONTAINER_CHUNK_SIZE;
+    threads = (argc > 6) ? (uint32_t)strtoul(argv[6], NULL, 0) : (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+    in_fd = open(argv[3], O_RDONLY);
+    /* the chunks are read in parallel at their offsets: no pipe or device */
+    if ((in_fd >= 0) && ((fstat(in_fd, &st) != 0) || !S_ISREG(st.st_mode))) {
+        aes_memzero(key, sizeof(key));
+        close(in_fd);
+        errno = 0;
+        fprintf(stderr, "[ERROR] seal: %s is not a regular file\n", argv[3]);
+        return 1;
+    }
+    out_fd = open(argv[4], O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if ((in_fd >= 0) && (out_fd >= 0)) {
+        status = aes_ctx_new(&ctx, key, key_len);
+    }
+    if (status == AES_OK) {
+        status = aes_container_seal(ctx, out_fd, in_fd, chunk_size, threads);
+    }
+    aes_memzero(key, sizeof(key));
+    aes_ctx_free(ctx);
+    if (in_fd >= 0) {
+        close(in_fd);
+    }
+    if ((out_fd >= 0) && (close(out_fd) != 0) && (status == AES_OK)) {
+        status = AES_ERR_IO;
+    }
+    errno = 0;
+    if (status != AES_OK) {
+        fprintf(stderr, "[ERROR] seal: %s\n", aes_strerror(status));
+        return 1;
+    }
+    return 0;
+}
+
+/**
+* @brief decrypt a byte range of a container to stdout
+* @param[in] argc number of arguments
+* @param[in] argv "open" <key_file> <in> [--offset N] [--length N] [--threads N]
+* @return 0 on success
+* @note the range is opened in windows of whole chunks, so memory use does
+* not grow with the range
+*/
+int32_t open_main(int argc, char **argv)
+{
+    uint8_t key[AES256_KEY_SIZE/8];
+    size_t key_len;
+    aes_ctx_t *ctx = NULL;
+    aes_container_info_t info;
+    uint64_t offset = 0, length = UINT64_MAX, end, window = 0;
+    uint32_t threads = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+    uint8_t *buf = NULL;
+    int fd;
+    aes_status_t status;
+
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s open <key_file> <in> [--offset N] [--length N] [--threads N]\n",
+                argv[0]);
+        return 1;
+    }
+    for (int i=4;i<argc;i+=2) {
+        if (i + 1 == argc) {
+            fprintf(stderr, "[ERROR] open: option %s needs a value\n", argv[i]);
+            fprintf(stderr, "usage: %s open <key_file> <in> [--offset N] [--length N] [--threads N]\n",
+                    argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[i], "--offset") == 0) {
+            offset = strtoull(argv[i+1], NULL, 0);
+        } else if (strcmp(argv[i], "--length") == 0) {
+            length = strtoull(argv[i+1], NULL, 0);
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            threads = (uint32_t)strtoul(argv[i+1], NULL, 0);
+        } else {
+            fprintf(stderr, "[ERROR] open: unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (read_key_file(argv[2], key, &key_len) != 0) {
+        return 1;
+    }
+    fd = open(argv[3], O_RDONLY);
+    status = (fd >= 0) ? aes_container_info(fd, &info) : AES_ERR_IO;
+    if (status == AES_OK) {
+        status = aes_ctx_new(&ctx, key, key_len);
+    }
+    aes_memzero(key, sizeof(key));
+    if (status == AES_OK) {
+        /* default length: up to the end */
+        if (offset <= info.length) {
+            length = (length < info.length - offset) ? length : info.length - offset;
+        }
+        /* whole chunks per window, a few per thread */
+        window = (uint64_t)info.chunk_size*((threads != 0) ? threads : 1)*4;
+        window = (window < OPEN_WINDOW) ? OPEN_WINDOW - OPEN_WINDOW % info.chunk_size : window;
+        buf = malloc(window);
+        status = (buf != NULL) ? AES_OK : AES_ERR_NOMEM;
+    }
+    for (;(status == AES_OK) && (length != 0);offset = end) {
+        end = (offset/window + 1)*window;
+        end = (end - offset < length) ? end : offset + length;
+        status = aes_container_read(ctx, fd, buf, offset, (size_t)(end - offset), threads);
+        if ((status == AES_OK) && (fwrite(buf, 1, (size_t)(end - offset), stdout) != end - offset)) {
+            status = AES_ERR_IO;
+        }
+        length -= end - offset;
+    }
+    if (buf != NULL) {
+        aes_memzero(buf, window);
+        free(buf);
+    }
+    aes_ctx_free(ctx);
+    if (fd >= 0) {
+        close(fd);
+    }
+    errno = 0;
+    if (status != AES_OK) {
+        fprintf(stderr, "[ERROR] open: %s\n", aes_strerror(status));
+        return 1;
+    }
+    return 0;
+}
+
+/**
+* @brief profile the reference stages and the engine batches with the
+* hardware counters
+* @param[in] argc number of arguments
+* @param[in] argv "perf" [blocks] [key_bits]
+* @return 0 on success
+*/
+int32_t perf_main(int argc, char **argv)
+{
+    static const size_t batches[] = {1, 8, 64, 512, 4096};
+    size_t nblocks = (argc > 2) ? (size_t)strtoul(argv[2], NULL, 0) : 65536;
+    uint32_t key_length = (argc > 3) ? (uint32_t)strtoul(argv[3], NULL, 0)/8 : AES128_KEY_SIZE/8;
+    aes_perf_sample_t stages[AES_PERF_STAGES];
+    aes_perf_sample_t total;
+    aes_perf_t perf;
+    uint32_t valid;
+    int32_t ret = 0;
+
+    valid = aes_perf_open(&perf);
+    printf("AES-%u, %lu blocks, events:", key_length*8, (unsigned long)nblocks);
+    for (uint32_t e=0;e<AES_PERF_EVENTS;e++) {
+        printf(" %s%s", aes_perf_event_name(e), (valid & (1u << e)) ? "" : " (n/a)");
+    }
+    printf("\n\nref, per stage\n");
+    aes_perf_report_header(stdout);
+    if (aes_perf_ref_stages(&perf, key_length, nblocks, stages) != 0) {
+        fprintf(stderr, "[ERROR] perf: reference stages failed\n");
+        ret = 1;
+    }
+    memset(&total, 0, sizeof(total));
+    total.valid = stages[0].valid;
+    total.blocks = stages[0].blocks;
+    for (uint32_t s=0;s<AES_PERF_STAGES;s++) {
+        aes_perf_report(stdout, aes_perf_stage_name(s), &stages[s]);
+        for (uint32_t e=0;e<AES_PERF_EVENTS;e++) {
+            total.count[e] += stages[s].count[e];
+        }
+        total.valid &= stages[s].valid;
+        total.time_nsec += stages[s].time_nsec;
+        total.calls += stages[s].calls;
+    }
+    aes_perf_report(stdout, "total", &total);
+    for (uint32_t id=0;id<AES_ENGINE_MAX;id++) {
+        const aes_engine_t *engine = aes_engine_by_id(id);
+
+        if ((engine == NULL) || !engine->supported()) {
+            continue;
+        }
+        printf("\n%s, per batch\n", engine->name);
+        aes_perf_report_header(stdout);
+        for (size_t i=0;i<sizeof(batches)/sizeof(batches[0]);i++) {
+            aes_perf_sample_t sample;
+            char label[32];
+
+            if (aes_perf_engine(&perf, engine, key_length, batches[i], nblocks, &sample) != 0) {
+                fprintf(stderr, "[ERROR] perf: %s failed\n", engine->name);
+                ret = 1;
+                break;
+            }
+            snprintf(label, sizeof(label), "batch %lu", (unsigned long)batches[i]);
+            aes_perf_report(stdout, label, &sample);
+        }
+    }
+    aes_perf_close(&perf);
+    /* perf_event_open failures are reported as n/a, not for log_deinit */
+    errno = 0;
+    return ret;
+}
+
+/**
+* @brief replay a recorded or synthetic workload through the library
+* @param[in] argc number of arguments
+* @param[in] argv "replay" [--trace file] [--records N] [--keys N] [--skew S]
+* [--alpha A] [--max-size N] [--cache N] [--key-bits N] [--seed N] [--save file],
+* without a trace the workload is drawn from aes_replay_synth_default
+* adjusted by the options
+* @return 0 on success
+*/
+int32_t replay_main(int argc, char **argv)
+{
+    aes_replay_synth_t synth;
+    aes_replay_cfg_t cfg;
+    aes_replay_rec_t *recs = NULL;
+    const char *trace = NULL;
+    const char *save = NULL;
+    size_t n = 0;
+    aes_status_t status;
+
+    aes_replay_synth_default(&synth);
+    cfg.key_cache = AES_REPLAY_KEY_CACHE;
+    cfg.key_length = AES128_KEY_SIZE/8;
+    for (int i=2;i<argc;i+=2) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "[ERROR] replay: %s needs a value\n", argv[i]);
+            return 1;
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            trace = argv[i+1];
+        } else if (strcmp(argv[i], "--save") == 0) {
+            save = argv[i+1];
+        } else if (strcmp(argv[i], "--records") == 0) {
+            synth.records = (size_t)strtoul(argv[i+1], NULL, 0);
+        } else if (strcmp(argv[i], "--keys") == 0) {
+            synth.keys = (uint32_t)strtoul(argv[i+1], NULL, 0);
+        } else if (strcmp(argv[i], "--skew") == 0) {
+            synth.key_skew = strtod(argv[i+1], NULL);
+        } else if (strcmp(argv[i], "--alpha") == 0) {
+            synth.size_alpha = strtod(argv[i+1], NULL);
+        } else if (strcmp(argv[i], "--max-size") == 0) {
+            synth.max_size = (uint32_t)strtoul(argv[i+1], NULL, 0);
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            cfg.key_cache = (uint32_t)strtoul(argv[i+1], NULL, 0);
+        } else if (strcmp(argv[i], "--key-bits") == 0) {
+            cfg.key_length = (uint32_t)strtoul(argv[i+1], NULL, 0)/8;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            synth.seed = strtoull(argv[i+1], NULL, 0);
+        } else {
+            fprintf(stderr, "[ERROR] replay: unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    status = (trace != NULL) ? aes_replay_load(trace, &recs, &n) : aes_replay_synth(&synth, &recs, &n);
+    if ((status == AES_OK) && (save != NULL)) {
+        status = aes_replay_save(save, recs, n);
+    }
+    if (status == AES_OK) {
+        if (trace != NULL) {
+            printf("trace %s, AES-%u\n", trace, cfg.key_length*8);
+        } else {
+            printf("synthetic: %u keys Zipf(%.2f), sizes Pareto(%.2f) %u..%u bytes, AES-%u\n",
+                   synth.keys, synth.key_skew, synth.size_alpha, synth.min_size, synth.max_size,
+                   cfg.key_length*8);
+        }
+        status = aes_replay_run(&cfg, recs, n, stdout);
+    }
+    free(recs);
+    errno = 0;
+    if (status != AES_OK) {
+        fprintf(stderr, "[ERROR] replay: %s\n", aes_strerror(status));
+        return 1;
+    }
+    return 0;
+}
+
 /**
  * @brief Main process
+ * @param[in] argc number of arguments
+ * @param[in] argv "selftest" runs the known-answer tests, "difftest" runs the
+ * differential check on stdin, "daemon" and "loadgen" run the encryption
+ * daemon and its load generator, "seal" and "open" write and read a
+ * container, "perf" profiles with the hardware counters, "replay" runs a
+ * workload trace, no argument runs the TP parts
  * @return 0 when process is terminated
  */
-int main(void)
+int main(int argc, char **argv)
 {
     /* install int handler to catch Ctrl-C */
     signal(SIGINT, int_handler);
     /* init logger */
     log_init("./log.txt");
+    if ((argc > 1) && (strcmp(argv[1], "selftest") == 0)) {
+        int32_t fail = selftest();
+        log_deinit();
+        return (fail == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if ((argc > 1) && (strcmp(argv[1], "difftest") == 0)) {
+        difftest();
+        log_deinit();
+        return EXIT_SUCCESS;
+    }
+    if ((argc > 1) && (strcmp(argv[1], "daemon") == 0)) {
+        int32_t ret = daemon_main(argc, argv);
+        log_deinit();
+        return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if ((argc > 1) && (strcmp(argv[1], "loadgen") == 0)) {
+        int32_t ret = loadgen_main(argc, argv);
+        log_deinit();
+        return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if ((argc > 1) && ((strcmp(argv[1], "seal") == 0) || (strcmp(argv[1], "open") == 0))) {
+        int32_t ret = (argv[1][0] == 's') ? seal_main(argc, argv) : open_main(argc, argv);
+        log_deinit();
+        return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if ((argc > 1) && (strcmp(argv[1], "perf") == 0)) {
+        int32_t ret = perf_main(argc, argv);
+        log_deinit();
+        return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if ((argc > 1) && (strcmp(argv[1], "replay") == 0)) {
+        int32_t ret = replay_main(argc, argv);
+        log_deinit();
+        return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
     /* TP is divided in 4 parts */
     printf("=========================================\n");
     printf(" Part 1\n");
@@ -432,6 +920,10 @@ int main(void)
     printf(" Part 4\n");
     printf("-----------------------------------------\n");
     part4();
+    printf("=========================================\n");
+    printf(" Counters\n");
+    printf("-----------------------------------------\n");
+    aes_stats_export(stdout, AES_STATS_FMT_JSON);
     /* stop logger */
     log_deinit();
     return(0);